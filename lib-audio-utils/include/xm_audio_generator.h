@@ -67,6 +67,28 @@ void xm_audio_generator_stop(XmAudioGenerator *self);
  */
 int xm_audio_generator_get_progress(XmAudioGenerator *self);
 
+/**
+ * @brief set the number of threads decoding tracks in parallel,
+ *        takes effect on the next xm_audio_generator_start
+ *
+ * @param self XmAudioGenerator
+ * @param nb_threads 0(default) decodes all tracks on the mixing thread
+ */
+void xm_audio_generator_set_decode_threads(XmAudioGenerator *self,
+    int nb_threads);
+
+/**
+ * @brief render the timeline as segments mixed and encoded in parallel,
+ *        only with the ffmpeg encoder, takes effect on the next
+ *        xm_audio_generator_start
+ *
+ * @param self XmAudioGenerator
+ * @param nb_segments 0 or 1(default) renders sequentially
+ * @param overlap_ms warm up time of every segment, 0 uses 3000ms
+ */
+void xm_audio_generator_set_render_segments(XmAudioGenerator *self,
+    int nb_segments, int overlap_ms);
+
 /**
  * @brief startup add voice effects and mix voice\bgm\music
  *
@@ -4,6 +4,7 @@
 #define XM_AUDIO_UTILS_H_
 
 #include <stdbool.h>
+#include <stddef.h>
 
 enum ActionType {
     AC_NONE = -1,
@@ -70,6 +71,57 @@ int xm_audio_utils_mixer_get_frame(XmAudioUtils *self,
 int xm_audio_utils_mixer_seekTo(XmAudioUtils *self,
     int seek_time_ms);
 
+/**
+ * @brief set the number of threads decoding mixer tracks in parallel,
+ *        call it from the thread that gets mixed frames
+ *
+ * @param self XmAudioUtils
+ * @param nb_threads 0(default) decodes all tracks on the calling thread
+ */
+void xm_audio_utils_mixer_set_decode_threads(XmAudioUtils *self,
+    int nb_threads);
+
+/**
+ * @brief set how long before its start a mixer clip is opened in the
+ *        background, call it from the thread that gets mixed frames
+ *
+ * @param self XmAudioUtils
+ * @param preload_time_ms 1000(default), 0 opens each clip at its start
+ */
+void xm_audio_utils_mixer_set_preload_time(XmAudioUtils *self,
+    int preload_time_ms);
+
+/**
+ * @brief run the voice effects of each mixer clip on their own threads,
+ *        one per effect, call it from the thread that gets mixed frames
+ *
+ * @param self XmAudioUtils
+ * @param enable false(default) runs them on the thread decoding the track
+ */
+void xm_audio_utils_mixer_set_effect_pipeline(XmAudioUtils *self,
+    bool enable);
+
+/**
+ * @brief set the process wide cache of decoded audio files, so a looping
+ *        bgm and the clips sharing a file are decoded only once
+ *
+ * @param budget_bytes 0(default) disables the cache
+ * @param spill_dir directory of the memory mapped cache files,
+ *        NULL keeps the decoded audio in memory
+ * @return Less than 0 means failure
+ */
+int xm_audio_utils_set_decode_cache(size_t budget_bytes,
+    const char *spill_dir);
+
+/**
+ * @brief set the directory where the packet index built on the first seek
+ *        into an audio file is kept, so later opens seek without a scan
+ *
+ * @param index_dir NULL(default) keeps the index in memory only
+ * @return Less than 0 means failure
+ */
+int xm_audio_utils_set_seek_index_dir(const char *index_dir);
+
 /**
  * @brief init mixer
  *
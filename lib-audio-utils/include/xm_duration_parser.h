@@ -15,4 +15,29 @@
 int get_file_duration_ms(const char *file_addr, bool is_pcm,
     int bits_per_sample, int src_sample_rate_in_Hz, int src_nb_channels);
 
+typedef struct XmAudioFileInfo {
+    int duration_ms;
+    int sample_rate;
+    int nb_channels;
+    char codec_name[32];
+} XmAudioFileInfo;
+
+/**
+ * @brief Get the duration, sample_rate, nb_channels and codec of an audio file
+ *
+ * @param file_addr Input audio file path.
+ * @param info Output file info.
+ * @return 0 on success, less than 0 on failure.
+ */
+int get_file_audio_info(const char *file_addr, XmAudioFileInfo *info);
+
+/**
+ * @brief Keep the probe results of audio files in a cache file, so they are
+ *        probed again only when their size or mtime changes
+ *
+ * @param cache_file Path of the cache file, NULL(default) keeps them in memory.
+ * @return less than 0 on failure.
+ */
+int set_file_probe_cache(const char *cache_file);
+
 #endif //XM_DURATION_PARSER_H
@@ -1,20 +1,35 @@
 #include "audio_decoder_factory.h"
 #include "ffmpeg_decoder.h"
 #include "pcm_decoder.h"
+#include "wav_decoder.h"
 
 IAudioDecoder *audio_decoder_create(const char *file_addr,
     int src_sample_rate, int src_nb_channels, int dst_sample_rate,
     int dst_nb_channels, float volume_flp, enum DecoderType decoder_type)
+{
+    return audio_decoder_create_fmt(file_addr, src_sample_rate,
+        src_nb_channels, dst_sample_rate, dst_nb_channels, volume_flp,
+        decoder_type, DECODER_SAMPLE_FMT_S16);
+}
+
+IAudioDecoder *audio_decoder_create_fmt(const char *file_addr,
+    int src_sample_rate, int src_nb_channels, int dst_sample_rate,
+    int dst_nb_channels, float volume_flp, enum DecoderType decoder_type,
+    enum DecoderSampleFormat sample_fmt)
 {
     IAudioDecoder *decoder = NULL;
     switch(decoder_type) {
         case DECODER_FFMPEG:
+            // plain wav files skip the probing and decoding of libavformat
+            decoder = WavDecoder_create(file_addr, dst_sample_rate,
+                            dst_nb_channels, volume_flp, sample_fmt);
+            if (decoder) break;
             decoder = FFmpegDecoder_create(file_addr, dst_sample_rate,
-                            dst_nb_channels, volume_flp);
+                            dst_nb_channels, volume_flp, sample_fmt);
         break;
         default:
             decoder = PcmDecoder_create(file_addr, src_sample_rate,
-                src_nb_channels, src_sample_rate, dst_nb_channels, volume_flp);
+                src_nb_channels, dst_sample_rate, dst_nb_channels, volume_flp);
         break;
     }
 
@@ -11,4 +11,14 @@ enum DecoderType {
 IAudioDecoder *audio_decoder_create(const char *file_addr,
     int src_sample_rate, int src_nb_channels, int dst_sample_rate,
     int dst_nb_channels, float volume_flp, enum DecoderType decoder_type);
+
+/**
+ * @brief audio_decoder_create with the output format negotiated, a decoder
+ *        that can not produce sample_fmt natively is read through
+ *        the conversion of IAudioDecoder
+ */
+IAudioDecoder *audio_decoder_create_fmt(const char *file_addr,
+    int src_sample_rate, int src_nb_channels, int dst_sample_rate,
+    int dst_nb_channels, float volume_flp, enum DecoderType decoder_type,
+    enum DecoderSampleFormat sample_fmt);
 #endif //AUDIO_DECODER_FACTORY_H
\ No newline at end of file
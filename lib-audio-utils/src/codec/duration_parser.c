@@ -4,34 +4,109 @@
 #include "error_def.h"
 #include "tools/util.h"
 #include "ffmpeg_utils.h"
+#include "wave/wav_dec.h"
 #include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
 
 #define fftime_to_milliseconds(ts) (av_rescale(ts, 1000, AV_TIME_BASE))
+// bytes read to probe the container, enough for the headers only
+#define HEADER_PROBE_SIZE "32768"
+// length of the stream analyzed when the headers leave something unknown
+#define FALLBACK_ANALYZE_DURATION (AV_TIME_BASE / 2)
 
 extern void RegisterFFmpeg();
 
-int get_audio_file_duration_ms(const char *file_addr) {
-    int ret = -1;
-    if (!file_addr) return -1;
-    LogInfo("%s file_addr %s.\n", __func__, file_addr);
+static const char *wav_codec_name(const WavHeader *header) {
+    if (header->audio_format == WAV_FORMAT_IEEE_FLOAT)
+        return header->bits_per_sample == 64 ? "pcm_f64le" : "pcm_f32le";
+    switch (header->bits_per_sample) {
+    case 8: return "pcm_u8";
+    case 24: return "pcm_s24le";
+    case 32: return "pcm_s32le";
+    default: return "pcm_s16le";
+    }
+}
+
+// plain wav files are answered from the header without libavformat
+static int probe_wav(const char *file_addr, AudioProbeInfo *info) {
+    WavContext wav_ctx;
+    memset(&wav_ctx, 0, sizeof(wav_ctx));
+    if (wav_read_header(file_addr, &wav_ctx) < 0 || !wav_ctx.is_wav)
+        return -1;
 
+    WavHeader *header = &wav_ctx.header;
+    if (header->sample_rate == 0 || header->block_align == 0)
+        return -1;
+    int64_t data_size = header->data_size;
+    if (data_size > (int64_t)wav_ctx.file_size - wav_ctx.pcm_data_offset)
+        data_size = (int64_t)wav_ctx.file_size - wav_ctx.pcm_data_offset;
+    if (data_size < 0) data_size = 0;
+
+    info->duration_ms = data_size / header->block_align * 1000
+        / header->sample_rate;
+    info->sample_rate = header->sample_rate;
+    info->nb_channels = header->nb_channels;
+    snprintf(info->codec_name, sizeof(info->codec_name), "%s",
+        wav_codec_name(header));
+    return 0;
+}
+
+static bool stream_info_known(AVFormatContext *fmt_ctx, int stream_index) {
+    if (stream_index < 0)
+        return false;
+    AVStream *st = fmt_ctx->streams[stream_index];
+    return (st->duration != AV_NOPTS_VALUE
+        || fmt_ctx->duration != AV_NOPTS_VALUE)
+        && st->codecpar->sample_rate > 0 && st->codecpar->channels > 0;
+}
+
+static int probe_ffmpeg(const char *file_addr, AudioProbeInfo *info) {
+    int ret = -1;
     RegisterFFmpeg();
 
+    // read the container headers only, most formats carry the duration
+    // and the stream parameters there
     AVFormatContext *fmt_ctx = NULL;
-    ret = OpenInputMediaFile(&fmt_ctx, file_addr);
-    if (ret < 0) goto end;
+    AVDictionary *opts = NULL;
+    av_dict_set(&opts, "probesize", HEADER_PROBE_SIZE, 0);
+    ret = avformat_open_input(&fmt_ctx, file_addr, NULL, &opts);
+    av_dict_free(&opts);
+    if (ret < 0) {
+        // the format may hide behind a large tag, probe it the usual way
+        LogInfo("%s header probe of %s failed, fall back.\n", __func__,
+            file_addr);
+        ret = OpenInputMediaFile(&fmt_ctx, file_addr);
+        if (ret < 0) goto end;
+    }
 
-    int audio_stream_index = FindBestStream(fmt_ctx, AVMEDIA_TYPE_AUDIO);
+    int audio_stream_index = av_find_best_stream(fmt_ctx,
+        AVMEDIA_TYPE_AUDIO, -1, -1, NULL, 0);
+    if (!stream_info_known(fmt_ctx, audio_stream_index)) {
+        fmt_ctx->max_analyze_duration = FALLBACK_ANALYZE_DURATION;
+        ret = avformat_find_stream_info(fmt_ctx, NULL);
+        if (ret < 0) {
+            LogError("%s find stream info of %s failed.\n", __func__,
+                file_addr);
+            goto end;
+        }
+        audio_stream_index = FindBestStream(fmt_ctx, AVMEDIA_TYPE_AUDIO);
+    }
     ret = audio_stream_index;
     if (ret < 0) goto end;
 
     AVStream *audio_stream = fmt_ctx->streams[audio_stream_index];
     if (audio_stream->duration != AV_NOPTS_VALUE) {
-        ret = av_rescale_q(audio_stream->duration,
+        info->duration_ms = av_rescale_q(audio_stream->duration,
             audio_stream->time_base, AV_TIME_BASE_Q) / 1000;
     } else {
-        ret = fftime_to_milliseconds(fmt_ctx->duration);
+        info->duration_ms = fftime_to_milliseconds(fmt_ctx->duration);
     }
+    info->sample_rate = audio_stream->codecpar->sample_rate;
+    info->nb_channels = audio_stream->codecpar->channels;
+    snprintf(info->codec_name, sizeof(info->codec_name), "%s",
+        avcodec_get_name(audio_stream->codecpar->codec_id));
+    ret = 0;
 
 end:
     if (fmt_ctx != NULL) {
@@ -41,6 +116,33 @@ end:
     return ret;
 }
 
+int probe_audio_file(const char *file_addr, AudioProbeInfo *info) {
+    int ret = -1;
+    if (!file_addr || !info) return -1;
+    LogInfo("%s file_addr %s.\n", __func__, file_addr);
+
+    struct stat st;
+    bool cacheable = stat(file_addr, &st) == 0 && S_ISREG(st.st_mode);
+    if (cacheable && probe_cache_lookup(file_addr, st.st_size,
+            st.st_mtime, info) == 0)
+        return 0;
+
+    memset(info, 0, sizeof(*info));
+    if ((ret = probe_wav(file_addr, info)) < 0
+            && (ret = probe_ffmpeg(file_addr, info)) < 0)
+        return ret;
+
+    if (cacheable)
+        probe_cache_store(file_addr, st.st_size, st.st_mtime, info);
+    return 0;
+}
+
+int get_audio_file_duration_ms(const char *file_addr) {
+    AudioProbeInfo info;
+    int ret = probe_audio_file(file_addr, &info);
+    return ret < 0 ? ret : info.duration_ms;
+}
+
 int get_pcm_file_duration_ms(const char *file_addr,
     int bits_per_sample, int src_sample_rate_in_Hz, int src_nb_channels) {
     int ret = -1;
@@ -1,5 +1,12 @@
 #ifndef DURATION_PARSER_H
 #define DURATION_PARSER_H
+#include "probe_cache.h"
+
+/**
+ * @brief duration, sample rate, channels and codec of an audio file, read
+ *        from the headers where possible and kept in the probe cache
+ */
+int probe_audio_file(const char *file_addr, AudioProbeInfo *info);
 
 int get_audio_file_duration_ms(const char *file_addr);
 
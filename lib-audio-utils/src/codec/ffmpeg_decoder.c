@@ -3,15 +3,23 @@
 #include "log.h"
 #include "error_def.h"
 #include "ffmpeg_utils.h"
+#include "pcm_cache.h"
+#include "seek_index.h"
 
 #define milliseconds_to_fftime(ms) (av_rescale(ms, AV_TIME_BASE, 1000))
 #define fftime_to_milliseconds(ts) (av_rescale(ts, 1000, AV_TIME_BASE))
-#define OUT_SAMPLE_FMT AV_SAMPLE_FMT_S16
+// packets decoded ahead of a seek target to settle the decoder
+#define SEEK_PREROLL_NB_PACKETS 4
 
 typedef struct IAudioDecoder_Opaque {
     // seek parameters
     int seek_pos_ms;
     bool seek_req;
+    bool seek_index_loaded;
+    // samples before seek_target_pts are decoded and dropped
+    int64_t seek_target_pts;
+    bool resume_pending;
+    int64_t skip_samples;
     int duration_ms;
     bool decode_completed;
 
@@ -25,10 +33,15 @@ typedef struct IAudioDecoder_Opaque {
     int dst_sample_rate_in_Hz;
     int dst_nb_channels;
     int dst_bits_per_sample;
+    // AV_SAMPLE_FMT_S16 or AV_SAMPLE_FMT_FLT
+    enum AVSampleFormat dst_sample_fmt;
+    int dst_frame_bytes;
 
+    // only holds the samples that did not fit in the caller's buffer
     AVAudioFifo* audio_fifo;
-    uint8_t** copy_buffer;
-    int max_nb_copy_samples;
+    // caller's buffer decoded frames are written to while get_pcm_frame runs
+    uint8_t *direct_buffer;
+    int direct_nb_samples;
 
     // Codec parameters
     AVFormatContext* fmt_ctx;
@@ -44,6 +57,14 @@ typedef struct IAudioDecoder_Opaque {
     uint8_t** dst_data;
 
     char* file_addr;
+
+    // decoded pcm shared with other decoders of the file, the codec is
+    // closed once it is set
+    PcmCacheEntry *cache;
+    int64_t cache_pos;
+    // entry taking what is decoded, dropped unless the whole file is
+    // played from the start, committed and read as cache at its end
+    PcmCacheEntry *fill;
 } IAudioDecoder_Opaque;
 
 static void FFmpegDecoder_free(IAudioDecoder_Opaque *decoder);
@@ -64,42 +85,72 @@ static inline void free_input_media_context(AVFormatContext **fmt_ctx,
     }
 }
 
-static int get_frame_from_fifo(IAudioDecoder_Opaque *decoder,
-        short *buffer, const int buffer_size_in_short) {
-    int ret = -1;
-    if (NULL == decoder)
-        return ret;
+// read up to nb_samples samples of the fifo straight into buffer
+static int read_fifo(IAudioDecoder_Opaque *decoder,
+        void *buffer, int nb_samples) {
+    int size = av_audio_fifo_size(decoder->audio_fifo);
+    if (nb_samples > size) nb_samples = size;
+    if (nb_samples <= 0)
+        return 0;
+    return AudioFifoGet(decoder->audio_fifo, nb_samples, (void **)&buffer);
+}
 
-    int nb_samples = buffer_size_in_short / decoder->dst_nb_channels;
-    if (nb_samples > decoder->max_nb_copy_samples) {
-        decoder->max_nb_copy_samples = nb_samples;
-        ret = AllocateSampleBuffer(&(decoder->copy_buffer), decoder->dst_nb_channels,
-                                   decoder->max_nb_copy_samples, OUT_SAMPLE_FMT);
-        if (ret < 0) goto end;
+static inline int64_t ms_to_nb_shorts(IAudioDecoder_Opaque *decoder, int ms) {
+    return (int64_t)ms * decoder->dst_sample_rate_in_Hz / 1000
+        * decoder->dst_nb_channels;
+}
+
+static int get_frame_from_cache(IAudioDecoder_Opaque *decoder,
+        short *buffer, const int buffer_size_in_short, bool loop) {
+    int64_t nb_shorts = 0;
+    const short *data = pcm_cache_data(decoder->cache, &nb_shorts);
+    int64_t start = ms_to_nb_shorts(decoder, decoder->crop_start_time_in_ms);
+    int64_t end = start + ms_to_nb_shorts(decoder, decoder->duration_ms);
+    if (end > nb_shorts) end = nb_shorts;
+    if (start > end) start = end;
+
+    if (decoder->seek_req) {
+        decoder->cache_pos = start
+            + ms_to_nb_shorts(decoder, decoder->seek_pos_ms);
+        decoder->seek_pos_ms = 0;
+        decoder->seek_req = false;
     }
+    if (decoder->cache_pos < start) decoder->cache_pos = start;
 
+    int ret = 0;
     memset(buffer, 0, sizeof(short) * buffer_size_in_short);
-    ret = AudioFifoGet(decoder->audio_fifo, nb_samples, (void**)decoder->copy_buffer);
-    if (ret < 0) goto end;
+    while (ret < buffer_size_in_short) {
+        if (decoder->cache_pos >= end) {
+            if (!loop || end == start) break;
+            decoder->cache_pos = start;
+        }
+        int64_t len = end - decoder->cache_pos;
+        if (len > buffer_size_in_short - ret) len = buffer_size_in_short - ret;
+        memcpy(buffer + ret, data + decoder->cache_pos, sizeof(short) * len);
+        decoder->cache_pos += len;
+        ret += len;
+    }
 
-    ret = ret * decoder->dst_nb_channels;
-    memcpy(buffer, decoder->copy_buffer[0], sizeof(short) * ret);
+    if (ret == 0) {
+        decoder->decode_completed = true;
+        return PCM_FILE_EOF;
+    }
     set_gain(buffer, ret, decoder->volume_fix);
-
-end:
     return ret;
 }
 
-static int resample_audio(IAudioDecoder_Opaque *decoder) {
+static int resample_audio(IAudioDecoder_Opaque *decoder,
+        const uint8_t **data, int nb_samples) {
     int ret = -1;
     if (NULL == decoder)
         return ret;
 
-    decoder->dst_nb_samples = swr_get_out_samples(decoder->swr_ctx, decoder->audio_frame->nb_samples);
+    decoder->dst_nb_samples = swr_get_out_samples(decoder->swr_ctx, nb_samples);
     if (decoder->dst_nb_samples > decoder->max_dst_nb_samples) {
         decoder->max_dst_nb_samples = decoder->dst_nb_samples;
         ret = AllocateSampleBuffer(&(decoder->dst_data), decoder->dst_nb_channels,
-                               decoder->max_dst_nb_samples, OUT_SAMPLE_FMT);
+                               decoder->max_dst_nb_samples,
+                               decoder->dst_sample_fmt);
         if (ret < 0) {
             LogError("%s av_samples_alloc error, error code = %d.\n", __func__, ret);
             goto end;
@@ -108,8 +159,7 @@ static int resample_audio(IAudioDecoder_Opaque *decoder) {
     // Convert to destination format
     ret = decoder->dst_nb_samples =
         swr_convert(decoder->swr_ctx, decoder->dst_data, decoder->dst_nb_samples,
-                    (const uint8_t **)decoder->audio_frame->data,
-                    decoder->audio_frame->nb_samples);
+                    data, nb_samples);
     if (ret < 0) {
         LogError("%s swr_convert error, error code = %d.\n", __func__, ret);
         goto end;
@@ -119,24 +169,119 @@ end:
     return ret < 0 ? ret : 0;
 }
 
-static int seekTo_l(IAudioDecoder_Opaque *decoder) {
-    int ret = 0;
+// queue the decoded frame, dropping the samples before the seek target
+static int queue_audio_frame(IAudioDecoder_Opaque *decoder) {
+    AVFrame *frame = decoder->audio_frame;
+    int offset = 0;
+    if (decoder->skip_samples > 0) {
+        if (decoder->skip_samples >= frame->nb_samples) {
+            decoder->skip_samples -= frame->nb_samples;
+            return 0;
+        }
+        offset = decoder->skip_samples;
+        decoder->skip_samples = 0;
+    }
+
+    const uint8_t *data[AV_NUM_DATA_POINTERS] = { NULL };
+    int channels = decoder->dec_ctx->channels;
+    bool planar = av_sample_fmt_is_planar(frame->format);
+    int nb_planes = planar ? channels : 1;
+    if (nb_planes > AV_NUM_DATA_POINTERS)
+        return AVERROR(EINVAL);
+    int step = av_get_bytes_per_sample(frame->format) * (planar ? 1 : channels);
+    for (int i = 0; i < nb_planes; i++) {
+        data[i] = frame->extended_data[i] + offset * step;
+    }
+    int nb_samples = frame->nb_samples - offset;
+
+    int ret;
+    if (decoder->direct_nb_samples > 0
+            && av_audio_fifo_size(decoder->audio_fifo) == 0) {
+        // write into the caller's buffer, only the rest goes to the fifo
+        uint8_t *out = decoder->direct_buffer;
+        if (decoder->swr_ctx) {
+            ret = swr_convert(decoder->swr_ctx, &out,
+                decoder->direct_nb_samples, data, nb_samples);
+            if (ret < 0) {
+                LogError("%s swr_convert error, error code = %d.\n",
+                    __func__, ret);
+                return ret;
+            }
+            nb_samples = 0;
+        } else {
+            ret = FFMIN(nb_samples, decoder->direct_nb_samples);
+            memcpy(out, data[0], ret * decoder->dst_frame_bytes);
+            data[0] += ret * step;
+            nb_samples -= ret;
+        }
+        decoder->direct_buffer += ret * decoder->dst_frame_bytes;
+        decoder->direct_nb_samples -= ret;
+        if (decoder->direct_nb_samples > 0)
+            return 0;
+    }
+
+    if (decoder->swr_ctx) {
+        // with no input left this drains what swr buffered
+        ret = resample_audio(decoder, data, nb_samples);
+        if (ret < 0) return ret;
+        ret = AudioFifoPut(decoder->audio_fifo, decoder->dst_nb_samples,
+                           (void **)decoder->dst_data);
+    } else if (nb_samples > 0) {
+        ret = AudioFifoPut(decoder->audio_fifo, nb_samples, (void **)data);
+    } else {
+        ret = 0;
+    }
+    return ret;
+}
+
+/**
+ * Seek to pos_ms of the file. The demuxer lands a few packets before the
+ * target, using the packet index of seek_index, and the decoded samples up
+ * to the target are dropped, so crops and seeks are sample accurate.
+ */
+static int seek_stream(IAudioDecoder_Opaque *decoder, int pos_ms) {
+    AVStream *st = decoder->fmt_ctx->streams[decoder->audio_stream_index];
     int64_t start_time = decoder->fmt_ctx->start_time;
     int64_t start_pos = (start_time != AV_NOPTS_VALUE ? start_time : 0);
-    int64_t seek_pos = start_pos + milliseconds_to_fftime(
-        decoder->seek_pos_ms + decoder->crop_start_time_in_ms);
+    int64_t seek_pos = start_pos + milliseconds_to_fftime(pos_ms);
+    int64_t target = av_rescale_q(seek_pos, AV_TIME_BASE_Q, st->time_base);
+
+    if (pos_ms > 0 && !decoder->seek_index_loaded) {
+        decoder->seek_index_loaded = true;
+        seek_index_load(decoder->fmt_ctx, decoder->audio_stream_index,
+            decoder->file_addr);
+    }
 
-    ret = avformat_seek_file(decoder->fmt_ctx, -1, INT64_MIN, seek_pos,
-        INT64_MAX, AVSEEK_FLAG_BACKWARD);
+    int64_t seek_pts = target;
+    int index = av_index_search_timestamp(st, target, AVSEEK_FLAG_BACKWARD);
+    if (index >= 0) {
+        index = FFMAX(index - SEEK_PREROLL_NB_PACKETS, 0);
+        seek_pts = st->index_entries[index].timestamp;
+    }
+    int ret = av_seek_frame(decoder->fmt_ctx, decoder->audio_stream_index,
+        seek_pts, AVSEEK_FLAG_BACKWARD);
+    if (ret < 0) {
+        ret = avformat_seek_file(decoder->fmt_ctx, -1, INT64_MIN, seek_pos,
+            INT64_MAX, AVSEEK_FLAG_BACKWARD);
+    }
     if (ret < 0) {
         LogError("%s: error while seeking.\n", __func__);
-        goto end;
-    } else {
-        LogInfo("%s: avformat_seek_file success.\n", __func__);
-        AudioFifoReset(decoder->audio_fifo);
+        return ret;
     }
 
-end:
+    avcodec_flush_buffers(decoder->dec_ctx);
+    if (decoder->swr_ctx) swr_init(decoder->swr_ctx);
+    decoder->flush = false;
+    decoder->seek_target_pts = target;
+    decoder->resume_pending = true;
+    decoder->skip_samples = 0;
+    return 0;
+}
+
+static int seekTo_l(IAudioDecoder_Opaque *decoder) {
+    int ret = seek_stream(decoder,
+        decoder->seek_pos_ms + decoder->crop_start_time_in_ms);
+    AudioFifoReset(decoder->audio_fifo);
     decoder->seek_pos_ms = 0;
     decoder->seek_req = false;
     return ret;
@@ -163,6 +308,18 @@ static int read_audio_packet(IAudioDecoder_Opaque *decoder,
         av_packet_unref(pkt);
     }
 
+    if (ret >= 0 && decoder->resume_pending) {
+        AVStream *st = decoder->fmt_ctx->streams[decoder->audio_stream_index];
+        int64_t pts = pkt->pts != AV_NOPTS_VALUE ? pkt->pts : pkt->dts;
+        decoder->resume_pending = false;
+        decoder->skip_samples = 0;
+        if (pts != AV_NOPTS_VALUE && decoder->seek_target_pts > pts) {
+            decoder->skip_samples = av_rescale_q(
+                decoder->seek_target_pts - pts, st->time_base,
+                (AVRational){ 1, decoder->dec_ctx->sample_rate });
+        }
+    }
+
     return ret;
 }
 
@@ -218,18 +375,8 @@ static int decode_audio_frame(IAudioDecoder_Opaque *decoder) {
                 goto end;
             }
 
-            if (decoder->swr_ctx) {
-                ret = resample_audio(decoder);
-                if (ret < 0) goto end;
-                ret = AudioFifoPut(decoder->audio_fifo, decoder->dst_nb_samples,
-                                   (void **)decoder->dst_data);
-                if (ret < 0) goto end;
-            } else {
-                ret =
-                    AudioFifoPut(decoder->audio_fifo, decoder->audio_frame->nb_samples,
-                                 (void **)decoder->audio_frame->data);
-                if (ret < 0) goto end;
-            }
+            ret = queue_audio_frame(decoder);
+            if (ret < 0) goto end;
         }
     }
 
@@ -260,7 +407,7 @@ static int open_audio_file(IAudioDecoder_Opaque *decoder,
 
     ret = InitResampler(decoder->dec_ctx->channels, decoder->dst_nb_channels,
                         decoder->dec_ctx->sample_rate, decoder->dst_sample_rate_in_Hz,
-                        decoder->dec_ctx->sample_fmt, OUT_SAMPLE_FMT,
+                        decoder->dec_ctx->sample_fmt, decoder->dst_sample_fmt,
                         &(decoder->swr_ctx));
     if (ret < 0) goto end;
 
@@ -294,17 +441,8 @@ static void decoder_flush(IAudioDecoder_Opaque *decoder)
             break;
         }
 
-        if (decoder->swr_ctx) {
-            ret = resample_audio(decoder);
-            if (ret < 0) break;
-            ret = AudioFifoPut(decoder->audio_fifo, decoder->dst_nb_samples,
-                        (void **)decoder->dst_data);
-            if (ret < 0) break;
-        } else {
-            ret = AudioFifoPut(decoder->audio_fifo, decoder->audio_frame->nb_samples,
-                        (void **)decoder->audio_frame->data);
-            if (ret < 0) break;
-        }
+        ret = queue_audio_frame(decoder);
+        if (ret < 0) break;
     }
 }
 
@@ -320,8 +458,15 @@ static int get_duration_l(IAudioDecoder_Opaque *decoder) {
     return duration_ms;
 }
 
+static int get_source_duration_ms(IAudioDecoder_Opaque *decoder) {
+    if (decoder->cache)
+        return pcm_cache_duration_ms(decoder->cache);
+    return get_duration_l(decoder);
+}
+
 static void init_decoder_params(IAudioDecoder_Opaque *decoder,
-    int sample_rate, int channels, float volume_flp) {
+    int sample_rate, int channels, enum AVSampleFormat sample_fmt,
+    float volume_flp) {
     if (NULL == decoder)
         return;
 
@@ -330,25 +475,30 @@ static void init_decoder_params(IAudioDecoder_Opaque *decoder,
     decoder->crop_end_time_in_ms = 0;
     decoder->dst_sample_rate_in_Hz = sample_rate;
     decoder->dst_nb_channels = channels;
-    decoder->dst_bits_per_sample = BITS_PER_SAMPLE_16;
-    decoder->max_nb_copy_samples = MAX_NB_SAMPLES;
+    decoder->dst_sample_fmt = sample_fmt;
+    decoder->dst_bits_per_sample = av_get_bytes_per_sample(sample_fmt) << 3;
+    decoder->dst_frame_bytes = av_get_bytes_per_sample(sample_fmt) * channels;
     decoder->max_dst_nb_samples = MAX_NB_SAMPLES;
     decoder->dst_nb_samples = MAX_NB_SAMPLES;
     decoder->audio_stream_index = -1;
     decoder->seek_pos_ms = 0;
     decoder->seek_req = false;
+    decoder->seek_index_loaded = false;
+    decoder->resume_pending = false;
+    decoder->skip_samples = 0;
     decoder->flush = false;
     decoder->duration_ms = 0;
     decoder->volume_flp = volume_flp;
     decoder->volume_fix = (short)(32767 * volume_flp);
     decoder->decode_completed = false;
+    decoder->cache_pos = 0;
 }
 
 static void init_timings_params(IAudioDecoder_Opaque *decoder,
     int crop_start_time_ms, int crop_end_time_ms) {
     if (!decoder) return;
 
-    decoder->duration_ms = get_duration_l(decoder);
+    decoder->duration_ms = get_source_duration_ms(decoder);
     decoder->crop_start_time_in_ms = crop_start_time_ms < 0 ? 0 :
         (crop_start_time_ms > decoder->duration_ms ? decoder->duration_ms : crop_start_time_ms);
     decoder->crop_end_time_in_ms = crop_end_time_ms < 0 ? 0 :
@@ -360,7 +510,8 @@ static void init_timings_params(IAudioDecoder_Opaque *decoder,
 }
 
 static int init_decoder(IAudioDecoder_Opaque *decoder,
-        const char *file_addr, int sample_rate, int channels, float volume_flp) {
+        const char *file_addr, int sample_rate, int channels,
+        enum AVSampleFormat sample_fmt, float volume_flp) {
     LogInfo("%s\n", __func__);
     int ret = -1;
     char *tmp_file_addr = NULL;
@@ -375,16 +526,12 @@ static int init_decoder(IAudioDecoder_Opaque *decoder,
     ret = CheckSampleRateAndChannels(sample_rate, channels);
     if (ret < 0) goto end;
 
-    init_decoder_params(decoder, sample_rate, channels, volume_flp);
+    init_decoder_params(decoder, sample_rate, channels, sample_fmt,
+        volume_flp);
 
     // Allocate sample buffer for resampler
     ret = AllocateSampleBuffer(&(decoder->dst_data), channels,
-                               decoder->max_dst_nb_samples, OUT_SAMPLE_FMT);
-    if (ret < 0) goto end;
-
-    // Allocate sample buffer for copy_buffer
-    ret = AllocateSampleBuffer(&(decoder->copy_buffer), channels,
-                               decoder->max_nb_copy_samples, OUT_SAMPLE_FMT);
+                               decoder->max_dst_nb_samples, sample_fmt);
     if (ret < 0) goto end;
 
     // Allocate buffer for audio frame
@@ -396,7 +543,7 @@ static int init_decoder(IAudioDecoder_Opaque *decoder,
     }
 
     // Allocate buffer for audio fifo
-    decoder->audio_fifo = av_audio_fifo_alloc(OUT_SAMPLE_FMT, channels, 1);
+    decoder->audio_fifo = av_audio_fifo_alloc(sample_fmt, channels, 1);
     if (NULL == decoder->audio_fifo) {
         LogError("%s Could not allocate audio FIFO\n", __func__);
         ret = AVERROR(ENOMEM);
@@ -421,19 +568,7 @@ end:
     return ret;
 }
 
-static void FFmpegDecoder_free(IAudioDecoder_Opaque *decoder) {
-    LogInfo("%s\n", __func__);
-    if (NULL == decoder)
-        return;
-
-    if (decoder->audio_fifo) {
-        av_audio_fifo_free(decoder->audio_fifo);
-        decoder->audio_fifo = NULL;
-    }
-    if (decoder->copy_buffer) {
-        av_freep(&(decoder->copy_buffer[0]));
-        av_freep(&(decoder->copy_buffer));
-    }
+static void close_codec(IAudioDecoder_Opaque *decoder) {
     free_input_media_context(&(decoder->fmt_ctx), &(decoder->dec_ctx));
     if (decoder->audio_frame) {
         av_frame_free(&(decoder->audio_frame));
@@ -443,6 +578,70 @@ static void FFmpegDecoder_free(IAudioDecoder_Opaque *decoder) {
         swr_free(&(decoder->swr_ctx));
         decoder->swr_ctx = NULL;
     }
+}
+
+static void drop_fill(IAudioDecoder_Opaque *decoder) {
+    if (!decoder->fill)
+        return;
+    LogInfo("%s %s is not cached.\n", __func__, decoder->file_addr);
+    pcm_cache_release(&decoder->fill);
+}
+
+// append the decoded pcm, at the end of the file the entry is committed and
+// the decoder goes on reading it instead of the codec
+static void fill_cache(IAudioDecoder_Opaque *decoder,
+        const short *data, int nb_shorts, bool eof) {
+    if (nb_shorts > 0
+            && pcm_cache_append(decoder->fill, data, nb_shorts) < 0) {
+        drop_fill(decoder);
+        return;
+    }
+    if (!eof)
+        return;
+
+    int duration_ms = get_duration_l(decoder);
+    if (decoder->crop_start_time_in_ms > 0
+            || decoder->duration_ms < duration_ms
+            || pcm_cache_commit(decoder->fill, duration_ms) < 0) {
+        drop_fill(decoder);
+        return;
+    }
+    decoder->cache = decoder->fill;
+    decoder->fill = NULL;
+    close_codec(decoder);
+    AudioFifoReset(decoder->audio_fifo);
+    pcm_cache_data(decoder->cache, &decoder->cache_pos);
+}
+
+static void open_cache(IAudioDecoder_Opaque *decoder) {
+    size_t size_hint = ms_to_nb_shorts(decoder, decoder->duration_ms)
+        * sizeof(short);
+    PcmCacheEntry *entry = NULL;
+    enum PcmCacheResult res = pcm_cache_acquire(decoder->file_addr,
+        decoder->dst_sample_rate_in_Hz, decoder->dst_nb_channels,
+        size_hint, &entry);
+    if (res == PCM_CACHE_FILL) {
+        decoder->fill = entry;
+    } else if (res == PCM_CACHE_HIT) {
+        decoder->cache = entry;
+        close_codec(decoder);
+        decoder->duration_ms = pcm_cache_duration_ms(decoder->cache);
+        AudioFifoReset(decoder->audio_fifo);
+    }
+}
+
+static void FFmpegDecoder_free(IAudioDecoder_Opaque *decoder) {
+    LogInfo("%s\n", __func__);
+    if (NULL == decoder)
+        return;
+
+    pcm_cache_release(&decoder->cache);
+    pcm_cache_release(&decoder->fill);
+    if (decoder->audio_fifo) {
+        av_audio_fifo_free(decoder->audio_fifo);
+        decoder->audio_fifo = NULL;
+    }
+    close_codec(decoder);
     if (decoder->dst_data) {
         av_freep(&(decoder->dst_data[0]));
         av_freep(&(decoder->dst_data));
@@ -453,36 +652,31 @@ static void FFmpegDecoder_free(IAudioDecoder_Opaque *decoder) {
     }
 }
 
-static int FFmpegDecoder_get_pcm_frame(
-        IAudioDecoder_Opaque *decoder, short *buffer,
-        const int buffer_size_in_short, bool loop) {
+// decode up to buffer_size samples of the output format into buffer
+static int decode_frames(IAudioDecoder_Opaque *decoder, uint8_t *buffer,
+        const int buffer_size, bool loop) {
     int ret = -1;
-    if (!decoder || !buffer || buffer_size_in_short < 0)
-        return ret;
-    if (decoder->decode_completed) return PCM_FILE_EOF;
+    int nb_samples = buffer_size / decoder->dst_nb_channels;
+    ret = read_fifo(decoder, buffer, nb_samples);
+    if (ret < 0) goto end;
+    decoder->direct_buffer = buffer + ret * decoder->dst_frame_bytes;
+    decoder->direct_nb_samples = nb_samples - ret;
 
-    while (av_audio_fifo_size(decoder->audio_fifo) * decoder->dst_nb_channels <
-           buffer_size_in_short) {
+    while (decoder->direct_nb_samples > 0) {
         ret = decode_audio_frame(decoder);
         if (ret < 0) {
             if (ret == AVERROR_EOF && !decoder->flush) {
                 decoder_flush(decoder);
             }
             if (ret == AVERROR_EOF && loop) {
-                int crop_start_time_in_ms = decoder->crop_start_time_in_ms;
-                int crop_end_time_in_ms = decoder->crop_end_time_in_ms;
-                if ((ret = init_decoder(decoder, decoder->file_addr,
-                        decoder->dst_sample_rate_in_Hz, decoder->dst_nb_channels,
-                        decoder->volume_flp)) < 0) {
-                    LogError("%s init_decoder failed\n", __func__);
-                    goto end;
-                }
-                if (FFmpegDecoder_set_crop_pos(decoder,
-                    crop_start_time_in_ms, crop_end_time_in_ms) < 0) {
-                    LogError("%s FFmpegDecoder_set_crop_pos failed.\n", __func__);
+                // the flushed tail is delivered ahead of the next pass
+                if ((ret = seek_stream(decoder,
+                        decoder->crop_start_time_in_ms)) < 0) {
+                    LogError("%s seek_stream failed\n", __func__);
                     goto end;
                 }
-            } else if (ret == AVERROR_EOF && 0 != av_audio_fifo_size(decoder->audio_fifo)) {
+            } else if (ret == AVERROR_EOF
+                    && decoder->direct_nb_samples < nb_samples) {
                 break;
             } else {
                 decoder->decode_completed = true;
@@ -490,19 +684,88 @@ static int FFmpegDecoder_get_pcm_frame(
             }
         }
     }
-    return get_frame_from_fifo(decoder, buffer, buffer_size_in_short);
+
+    ret = (nb_samples - decoder->direct_nb_samples) * decoder->dst_nb_channels;
+    decoder->direct_buffer = NULL;
+    decoder->direct_nb_samples = 0;
+    return ret;
 
 end:
+    decoder->direct_buffer = NULL;
+    decoder->direct_nb_samples = 0;
     if (ret == AVERROR_EOF) ret = PCM_FILE_EOF;
     return ret;
 }
 
+static int FFmpegDecoder_get_pcm_frame(
+        IAudioDecoder_Opaque *decoder, short *buffer,
+        const int buffer_size_in_short, bool loop) {
+    int ret = -1;
+    if (!decoder || !buffer || buffer_size_in_short < 0)
+        return ret;
+    if (decoder->decode_completed) return PCM_FILE_EOF;
+    if (decoder->cache)
+        return get_frame_from_cache(decoder, buffer,
+            buffer_size_in_short, loop);
+
+    // while filling, the end of the file is met here before looping
+    bool filling = decoder->fill != NULL;
+    ret = decode_frames(decoder, (uint8_t *)buffer,
+        buffer_size_in_short, loop && !filling);
+    if (filling) {
+        bool eof = ret == PCM_FILE_EOF
+            || (ret >= 0 && ret < buffer_size_in_short);
+        if (ret < 0 && !eof)
+            drop_fill(decoder);
+        else
+            fill_cache(decoder, buffer, ret > 0 ? ret : 0, eof);
+
+        if (eof && loop) {
+            int nb_shorts = ret > 0 ? ret : 0;
+            decoder->decode_completed = false;
+            set_gain(buffer, nb_shorts, decoder->volume_fix);
+            if (decoder->cache)
+                ret = get_frame_from_cache(decoder, buffer + nb_shorts,
+                    buffer_size_in_short - nb_shorts, loop);
+            else
+                ret = FFmpegDecoder_get_pcm_frame(decoder,
+                    buffer + nb_shorts, buffer_size_in_short - nb_shorts,
+                    loop);
+            if (ret < 0) return nb_shorts > 0 ? nb_shorts : ret;
+            return nb_shorts + ret;
+        }
+    }
+    if (ret < 0) return ret;
+    memset(buffer + ret, 0, sizeof(short) * (buffer_size_in_short - ret));
+    set_gain(buffer, ret, decoder->volume_fix);
+    return ret;
+}
+
+static int FFmpegDecoder_get_pcm_frame_flt(
+        IAudioDecoder_Opaque *decoder, float *buffer,
+        const int buffer_size, bool loop) {
+    int ret = -1;
+    if (!decoder || !buffer || buffer_size < 0)
+        return ret;
+    if (decoder->decode_completed) return PCM_FILE_EOF;
+
+    ret = decode_frames(decoder, (uint8_t *)buffer, buffer_size, loop);
+    if (ret < 0) return ret;
+    memset(buffer + ret, 0, sizeof(float) * (buffer_size - ret));
+    if (fabsf(decoder->volume_flp - 1.0f) > FLOAT_EPS) {
+        for (int i = 0; i < ret; i++)
+            buffer[i] *= decoder->volume_flp;
+    }
+    return ret;
+}
+
 static int FFmpegDecoder_seekTo(IAudioDecoder_Opaque *decoder,
         int seek_pos_ms) {
     LogInfo("%s seek_pos_ms %d\n", __func__, seek_pos_ms);
     if (NULL == decoder)
         return -1;
 
+    drop_fill(decoder);
     decoder->decode_completed = false;
     decoder->seek_req = true;
     decoder->seek_pos_ms = seek_pos_ms < 0 ? 0 : seek_pos_ms;
@@ -523,22 +786,29 @@ static int FFmpegDecoder_set_crop_pos(
     int crop_end_time_ms) {
     LogInfo("%s\n", __func__);
     int ret = -1;
-    if (!decoder || !decoder->fmt_ctx)
+    if (!decoder || (!decoder->fmt_ctx && !decoder->cache))
         return ret;
 
+    int64_t nb_filled = 0;
+    pcm_cache_data(decoder->fill, &nb_filled);
+    if (crop_start_time_ms > 0 || nb_filled > 0)
+        drop_fill(decoder);
     init_timings_params(decoder, crop_start_time_ms, crop_end_time_ms);
+    if (decoder->cache) {
+        decoder->cache_pos =
+            ms_to_nb_shorts(decoder, decoder->crop_start_time_in_ms);
+        return decoder->duration_ms;
+    }
 
-    int64_t start_time = decoder->fmt_ctx->start_time;
-    start_time = (start_time != AV_NOPTS_VALUE ? start_time : 0);
-    int64_t start_pos = start_time + milliseconds_to_fftime(decoder->crop_start_time_in_ms);
-    ret = avformat_seek_file(decoder->fmt_ctx, -1, INT64_MIN, start_pos,
-        INT64_MAX, AVSEEK_FLAG_BACKWARD);
+    ret = seek_stream(decoder, decoder->crop_start_time_in_ms);
+    AudioFifoReset(decoder->audio_fifo);
 
     return ret < 0 ? ret : decoder->duration_ms;
 }
 
 IAudioDecoder *FFmpegDecoder_create(const char *file_addr,
-    int dst_sample_rate, int dst_channels, float volume_flp) {
+    int dst_sample_rate, int dst_channels, float volume_flp,
+    enum DecoderSampleFormat sample_fmt) {
     LogInfo("%s.\n", __func__);
     int ret = -1;
     if (NULL == file_addr) {
@@ -554,15 +824,29 @@ IAudioDecoder *FFmpegDecoder_create(const char *file_addr,
 
     decoder->func_set_crop_pos = FFmpegDecoder_set_crop_pos;
     decoder->func_seekTo = FFmpegDecoder_seekTo;
-    decoder->func_get_pcm_frame = FFmpegDecoder_get_pcm_frame;
     decoder->func_free = FFmpegDecoder_free;
+    // swr converts straight to the requested format, the other one is
+    // converted by IAudioDecoder
+    enum AVSampleFormat dst_sample_fmt = AV_SAMPLE_FMT_S16;
+    if (sample_fmt == DECODER_SAMPLE_FMT_FLT) {
+        dst_sample_fmt = AV_SAMPLE_FMT_FLT;
+        decoder->func_get_pcm_frame_flt = FFmpegDecoder_get_pcm_frame_flt;
+    } else {
+        decoder->func_get_pcm_frame = FFmpegDecoder_get_pcm_frame;
+    }
+    decoder->out_sample_fmt = sample_fmt;
 
     IAudioDecoder_Opaque *opaque = decoder->opaque;
     if ((ret = init_decoder(opaque, file_addr, dst_sample_rate,
-            dst_channels, volume_flp)) < 0) {
+            dst_channels, dst_sample_fmt, volume_flp)) < 0) {
         LogError("%s init_decoder failed.\n", __func__);
         goto end;
     }
+    // the shared cache holds s16 pcm
+    if (dst_sample_fmt == AV_SAMPLE_FMT_S16)
+        open_cache(opaque);
+    if (!opaque->cache && !opaque->fmt_ctx)
+        goto end;
     decoder->out_sample_rate = opaque->dst_sample_rate_in_Hz;
     decoder->out_nb_channels = opaque->dst_nb_channels;
     decoder->out_bits_per_sample = opaque->dst_bits_per_sample;
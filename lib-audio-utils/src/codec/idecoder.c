@@ -1,5 +1,17 @@
 #include "idecoder.h"
 
+static void *get_convert_buffer(IAudioDecoder *decoder, int size)
+{
+    if (size > decoder->convert_buffer_size) {
+        void *buffer = realloc(decoder->convert_buffer, size);
+        if (!buffer)
+            return NULL;
+        decoder->convert_buffer = buffer;
+        decoder->convert_buffer_size = size;
+    }
+    return decoder->convert_buffer;
+}
+
 void IAudioDecoder_free(IAudioDecoder *decoder)
 {
     if(!decoder)
@@ -9,6 +21,8 @@ void IAudioDecoder_free(IAudioDecoder *decoder)
         decoder->func_free(decoder->opaque);
 
     free(decoder->opaque);
+    if (decoder->convert_buffer)
+        free(decoder->convert_buffer);
 }
 
 void IAudioDecoder_freep(IAudioDecoder **decoder)
@@ -31,6 +45,47 @@ int IAudioDecoder_get_pcm_frame(IAudioDecoder *decoder,
         return decoder->func_get_pcm_frame(decoder->opaque,
             buffer, buffer_size_in_short, loop);
 
+    if (decoder->func_get_pcm_frame_flt) {
+        float *tmp = (float *)get_convert_buffer(decoder,
+            buffer_size_in_short * sizeof(float));
+        if (!tmp)
+            return -1;
+        int ret = decoder->func_get_pcm_frame_flt(decoder->opaque,
+            tmp, buffer_size_in_short, loop);
+        for (int i = 0; i < ret; i++) {
+            float v = tmp[i] * 32768.0f;
+            buffer[i] = v >= 32767.0f ? 32767 :
+                (v <= -32768.0f ? -32768 : (short)lrintf(v));
+        }
+        return ret;
+    }
+
+    return -1;
+}
+
+int IAudioDecoder_get_pcm_frame_flt(IAudioDecoder *decoder,
+    float *buffer, int buffer_size, bool loop)
+{
+    if (!decoder || !buffer)
+        return -1;
+
+    if (decoder->func_get_pcm_frame_flt)
+        return decoder->func_get_pcm_frame_flt(decoder->opaque,
+            buffer, buffer_size, loop);
+
+    if (decoder->func_get_pcm_frame) {
+        short *tmp = (short *)get_convert_buffer(decoder,
+            buffer_size * sizeof(short));
+        if (!tmp)
+            return -1;
+        int ret = decoder->func_get_pcm_frame(decoder->opaque,
+            tmp, buffer_size, loop);
+        for (int i = 0; i < ret; i++) {
+            buffer[i] = tmp[i] * (1.0f / 32768.0f);
+        }
+        return ret;
+    }
+
     return -1;
 }
 
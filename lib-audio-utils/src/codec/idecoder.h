@@ -31,6 +31,12 @@ static inline int calculation_duration_ms(int64_t size,
     return 1000 * (size / bytes_per_sample / nb_channles / sample_rate);
 }
 
+enum DecoderSampleFormat {
+    DECODER_SAMPLE_FMT_S16 = 0,
+    // interleaved float, full scale is [-1.0, 1.0]
+    DECODER_SAMPLE_FMT_FLT
+};
+
 typedef struct IAudioDecoder_Opaque IAudioDecoder_Opaque;
 typedef struct IAudioDecoder
 {
@@ -38,11 +44,20 @@ typedef struct IAudioDecoder
     int out_sample_rate;
     int out_nb_channels;
     int out_bits_per_sample;
+    // the format the decoder produces natively
+    enum DecoderSampleFormat out_sample_fmt;
     int duration_ms;
 
+    // scratch of the format read when it is not the native one
+    void *convert_buffer;
+    int convert_buffer_size;
+
     void (*func_free)(IAudioDecoder_Opaque *opaque);
+    // a decoder sets at least the callback of its native format
     int (*func_get_pcm_frame)(IAudioDecoder_Opaque *opaque,
         short *buffer, int buffer_size_in_short, bool loop);
+    int (*func_get_pcm_frame_flt)(IAudioDecoder_Opaque *opaque,
+        float *buffer, int buffer_size, bool loop);
     int (*func_set_crop_pos)(IAudioDecoder_Opaque *opaque,
         int crop_start_time_in_ms, int crop_end_time_in_ms);
     int (*func_seekTo)(IAudioDecoder_Opaque *opaque, int seek_pos_ms);
@@ -52,6 +67,12 @@ void IAudioDecoder_free(IAudioDecoder *decoder);
 void IAudioDecoder_freep(IAudioDecoder **decoder);
 int IAudioDecoder_get_pcm_frame(IAudioDecoder *decoder,
     short *buffer, int buffer_size_in_short, bool loop);
+/**
+ * @brief float variant of IAudioDecoder_get_pcm_frame, the samples are
+ *        converted only if the decoder does not produce float natively
+ */
+int IAudioDecoder_get_pcm_frame_flt(IAudioDecoder *decoder,
+    float *buffer, int buffer_size, bool loop);
 int IAudioDecoder_seekTo(IAudioDecoder *decoder, int seek_pos_ms);
 int IAudioDecoder_set_crop_pos(IAudioDecoder *decoder,
     int crop_start_time_in_ms, int crop_end_time_in_ms);
@@ -0,0 +1,316 @@
+#include "pcm_cache.h"
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "error_def.h"
+#include "log.h"
+
+enum EntryState {
+    ENTRY_FILLING = 0,
+    ENTRY_READY
+};
+
+struct PcmCacheEntry {
+    char *file_addr;
+    int64_t mtime;
+    int64_t file_size;
+    int sample_rate;
+    int nb_channels;
+
+    enum EntryState state;
+    int ref_count;
+    short *data;
+    int64_t nb_shorts;
+    // bytes reserved from the budget
+    size_t reserved;
+    bool mapped;
+    int duration_ms;
+
+    // most recently used first
+    PcmCacheEntry *prev;
+    PcmCacheEntry *next;
+};
+
+static struct {
+    pthread_mutex_t mutex;
+    size_t budget;
+    size_t used;
+    char *spill_dir;
+    PcmCacheEntry *head;
+    PcmCacheEntry *tail;
+} cache = {
+    PTHREAD_MUTEX_INITIALIZER, 0, 0, NULL, NULL, NULL
+};
+
+static void unlink_l(PcmCacheEntry *entry) {
+    if (entry->prev) entry->prev->next = entry->next;
+    else cache.head = entry->next;
+    if (entry->next) entry->next->prev = entry->prev;
+    else cache.tail = entry->prev;
+    entry->prev = entry->next = NULL;
+}
+
+static void push_front_l(PcmCacheEntry *entry) {
+    entry->prev = NULL;
+    entry->next = cache.head;
+    if (cache.head) cache.head->prev = entry;
+    cache.head = entry;
+    if (!cache.tail) cache.tail = entry;
+}
+
+static void entry_free(PcmCacheEntry *entry) {
+    if (!entry)
+        return;
+    if (entry->data) {
+        if (entry->mapped)
+            munmap(entry->data, entry->nb_shorts * sizeof(short));
+        else
+            free(entry->data);
+    }
+    if (entry->file_addr) free(entry->file_addr);
+    free(entry);
+}
+
+static void remove_l(PcmCacheEntry *entry) {
+    unlink_l(entry);
+    cache.used -= entry->reserved;
+    entry_free(entry);
+}
+
+static void evict_l(size_t limit) {
+    PcmCacheEntry *entry = cache.tail;
+    while (entry && cache.used > limit) {
+        PcmCacheEntry *prev = entry->prev;
+        if (entry->state == ENTRY_READY && entry->ref_count == 0) {
+            LogInfo("%s %s.\n", __func__, entry->file_addr);
+            remove_l(entry);
+        }
+        entry = prev;
+    }
+}
+
+static int reserve_l(PcmCacheEntry *entry, size_t bytes) {
+    if (bytes > cache.budget)
+        return -1;
+    evict_l(cache.budget - bytes);
+    if (cache.used + bytes > cache.budget)
+        return -1;
+    cache.used += bytes;
+    entry->reserved += bytes;
+    return 0;
+}
+
+static PcmCacheEntry *find_l(const char *file_addr, const struct stat *st,
+        int sample_rate, int nb_channels) {
+    for (PcmCacheEntry *entry = cache.head; entry; entry = entry->next) {
+        if (entry->sample_rate == sample_rate
+                && entry->nb_channels == nb_channels
+                && entry->mtime == (int64_t)st->st_mtime
+                && entry->file_size == (int64_t)st->st_size
+                && !strcmp(entry->file_addr, file_addr))
+            return entry;
+    }
+    return NULL;
+}
+
+// move the pcm of a finished entry to an unlinked file and map it
+static void spill(PcmCacheEntry *entry, const char *dir) {
+    size_t size = entry->nb_shorts * sizeof(short);
+    if (size == 0)
+        return;
+
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/pcm_cache_XXXXXX", dir);
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        LogWarning("%s mkstemp %s failed.\n", __func__, path);
+        return;
+    }
+    unlink(path);
+
+    void *map = MAP_FAILED;
+    const char *p = (const char *)entry->data;
+    size_t left = size;
+    while (left > 0) {
+        ssize_t n = write(fd, p, left);
+        if (n <= 0) goto end;
+        p += n;
+        left -= n;
+    }
+    map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (map != MAP_FAILED) {
+        free(entry->data);
+        entry->data = (short *)map;
+        entry->mapped = true;
+    }
+end:
+    if (map == MAP_FAILED)
+        LogWarning("%s spill to %s failed.\n", __func__, dir);
+    close(fd);
+}
+
+int pcm_cache_set_budget(size_t budget_bytes, const char *spill_dir) {
+    LogInfo("%s budget_bytes %zu, spill_dir %s.\n", __func__,
+        budget_bytes, spill_dir ? spill_dir : "none");
+    char *dir = NULL;
+    if (spill_dir && !(dir = strdup(spill_dir)))
+        return AEERROR_NOMEM;
+
+    pthread_mutex_lock(&cache.mutex);
+    if (cache.spill_dir) free(cache.spill_dir);
+    cache.spill_dir = dir;
+    cache.budget = budget_bytes;
+    evict_l(budget_bytes);
+    pthread_mutex_unlock(&cache.mutex);
+    return 0;
+}
+
+enum PcmCacheResult pcm_cache_acquire(const char *file_addr,
+        int sample_rate, int nb_channels, size_t size_hint,
+        PcmCacheEntry **entry) {
+    if (!file_addr || !entry || sample_rate <= 0 || nb_channels <= 0)
+        return PCM_CACHE_NONE;
+    *entry = NULL;
+
+    struct stat st;
+    if (stat(file_addr, &st) != 0 || !S_ISREG(st.st_mode))
+        return PCM_CACHE_NONE;
+
+    enum PcmCacheResult ret = PCM_CACHE_NONE;
+    pthread_mutex_lock(&cache.mutex);
+    if (size_hint > cache.budget)
+        goto end;
+    PcmCacheEntry *found = find_l(file_addr, &st, sample_rate, nb_channels);
+    if (found) {
+        // an entry still filling is only complete at the end of the file
+        if (found->state == ENTRY_READY) {
+            found->ref_count++;
+            unlink_l(found);
+            push_front_l(found);
+            *entry = found;
+            ret = PCM_CACHE_HIT;
+        }
+        goto end;
+    }
+
+    PcmCacheEntry *self = (PcmCacheEntry *)calloc(1, sizeof(PcmCacheEntry));
+    if (!self || !(self->file_addr = strdup(file_addr))) {
+        entry_free(self);
+        goto end;
+    }
+    self->mtime = st.st_mtime;
+    self->file_size = st.st_size;
+    self->sample_rate = sample_rate;
+    self->nb_channels = nb_channels;
+    self->state = ENTRY_FILLING;
+    self->ref_count = 1;
+    size_hint = (size_hint / sizeof(short)) * sizeof(short);
+    if (reserve_l(self, size_hint) < 0) {
+        entry_free(self);
+        goto end;
+    }
+    if (size_hint > 0 && !(self->data = (short *)malloc(size_hint))) {
+        cache.used -= self->reserved;
+        entry_free(self);
+        goto end;
+    }
+    push_front_l(self);
+    *entry = self;
+    ret = PCM_CACHE_FILL;
+end:
+    pthread_mutex_unlock(&cache.mutex);
+    return ret;
+}
+
+int pcm_cache_append(PcmCacheEntry *entry, const short *data, int nb_shorts) {
+    if (!entry || !data || nb_shorts < 0 || entry->state != ENTRY_FILLING)
+        return -1;
+
+    size_t need = (entry->nb_shorts + nb_shorts) * sizeof(short);
+    if (need > entry->reserved) {
+        size_t size = entry->reserved << 1;
+        if (size < need) size = need;
+
+        pthread_mutex_lock(&cache.mutex);
+        int ret = reserve_l(entry, size - entry->reserved);
+        if (ret < 0 && need > entry->reserved)
+            ret = reserve_l(entry, (size = need) - entry->reserved);
+        pthread_mutex_unlock(&cache.mutex);
+        if (ret < 0)
+            return -1;
+
+        short *buf = (short *)realloc(entry->data, size);
+        if (!buf)
+            return AEERROR_NOMEM;
+        entry->data = buf;
+    }
+
+    memcpy(entry->data + entry->nb_shorts, data, nb_shorts * sizeof(short));
+    entry->nb_shorts += nb_shorts;
+    return 0;
+}
+
+int pcm_cache_commit(PcmCacheEntry *entry, int duration_ms) {
+    if (!entry || entry->state != ENTRY_FILLING)
+        return -1;
+
+    size_t size = entry->nb_shorts * sizeof(short);
+    if (size > 0 && size < entry->reserved) {
+        short *buf = (short *)realloc(entry->data, size);
+        if (buf) entry->data = buf;
+    }
+
+    char dir[512] = { 0 };
+    pthread_mutex_lock(&cache.mutex);
+    if (cache.spill_dir)
+        snprintf(dir, sizeof(dir), "%s", cache.spill_dir);
+    pthread_mutex_unlock(&cache.mutex);
+    if (dir[0])
+        spill(entry, dir);
+
+    pthread_mutex_lock(&cache.mutex);
+    cache.used -= entry->reserved - size;
+    entry->reserved = size;
+    entry->duration_ms = duration_ms;
+    entry->state = ENTRY_READY;
+    pthread_mutex_unlock(&cache.mutex);
+    LogInfo("%s %s %" PRId64 " bytes.\n", __func__, entry->file_addr,
+        (int64_t)size);
+    return 0;
+}
+
+void pcm_cache_release(PcmCacheEntry **entry) {
+    if (!entry || !*entry)
+        return;
+    PcmCacheEntry *self = *entry;
+
+    pthread_mutex_lock(&cache.mutex);
+    self->ref_count--;
+    if (self->state == ENTRY_FILLING) {
+        remove_l(self);
+    } else if (self->ref_count == 0) {
+        evict_l(cache.budget);
+    }
+    pthread_mutex_unlock(&cache.mutex);
+    *entry = NULL;
+}
+
+const short *pcm_cache_data(PcmCacheEntry *entry, int64_t *nb_shorts) {
+    if (!entry) {
+        if (nb_shorts) *nb_shorts = 0;
+        return NULL;
+    }
+    if (nb_shorts) *nb_shorts = entry->nb_shorts;
+    return entry->data;
+}
+
+int pcm_cache_duration_ms(PcmCacheEntry *entry) {
+    return entry ? entry->duration_ms : 0;
+}
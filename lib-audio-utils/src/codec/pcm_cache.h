@@ -0,0 +1,70 @@
+#ifndef _PCM_CACHE_H_
+#define _PCM_CACHE_H_
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Process wide cache of decoded and resampled s16 pcm, keyed by
+ * (path, mtime, size, sample_rate, nb_channels). An entry holds the whole
+ * file at unity gain. The decoder that missed it fills it while playing
+ * the file and commits it at the end, it is shared read only afterwards.
+ * Entries not in use are evicted least recently used first when the budget
+ * is exceeded. With a spill directory, finished entries are moved to
+ * unlinked files there and memory mapped.
+ *
+ * Only decoders with s16 output use the cache. Float decoders, like the
+ * ones of mixer clips with effects, always decode the file themselves.
+ */
+
+typedef struct PcmCacheEntry PcmCacheEntry;
+
+enum PcmCacheResult {
+    PCM_CACHE_NONE = -1,
+    // the entry is complete and can be read
+    PCM_CACHE_HIT,
+    // the caller owns the new entry and has to fill it
+    PCM_CACHE_FILL
+};
+
+/**
+ * @brief set the size of the cache in bytes, 0(default) disables it
+ *
+ * @param spill_dir directory of the spill files, NULL keeps entries in memory
+ */
+int pcm_cache_set_budget(size_t budget_bytes, const char *spill_dir);
+
+/**
+ * @brief look up a file
+ *
+ * @param size_hint expected size of the pcm in bytes
+ * @return PCM_CACHE_HIT or PCM_CACHE_FILL with *entry referenced,
+ *         PCM_CACHE_NONE if the file can not be cached or another thread
+ *         is still filling it
+ */
+enum PcmCacheResult pcm_cache_acquire(const char *file_addr,
+    int sample_rate, int nb_channels, size_t size_hint,
+    PcmCacheEntry **entry);
+
+/**
+ * @brief append pcm to an entry being filled
+ *
+ * @return 0 on success, less than 0 if the entry outgrew the budget
+ */
+int pcm_cache_append(PcmCacheEntry *entry, const short *data, int nb_shorts);
+
+/**
+ * @brief mark a filled entry complete and wake up the waiting readers
+ *
+ * @param duration_ms duration of the stream reported by the container
+ */
+int pcm_cache_commit(PcmCacheEntry *entry, int duration_ms);
+
+/**
+ * @brief drop a reference, an entry released before its commit is discarded
+ */
+void pcm_cache_release(PcmCacheEntry **entry);
+
+const short *pcm_cache_data(PcmCacheEntry *entry, int64_t *nb_shorts);
+int pcm_cache_duration_ms(PcmCacheEntry *entry);
+
+#endif
@@ -4,10 +4,17 @@
 #include "tools/util.h"
 #include "tools/fifo.h"
 #include "ffmpeg_utils.h"
+#include "pcm_resampler.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// bytes of the mapped file asked to be read ahead of the read position
+#define READAHEAD_BYTES (1 << 20)
 
 typedef struct IAudioDecoder_Opaque {
     // seek parameters
@@ -45,6 +52,19 @@ typedef struct IAudioDecoder_Opaque {
     int64_t file_size;
     int64_t cur_pos;
     FILE *reader;
+
+    // the file is read through map when it could be mapped
+    const uint8_t *map;
+    size_t map_size;
+    int64_t map_pos;
+    int64_t readahead_pos;
+
+    // set when the source rate differs from the output rate
+    PcmResampler *resampler;
+    short *rs_buffer;
+    int rs_len;
+    int rs_pos;
+    bool rs_flushed;
 } IAudioDecoder_Opaque;
 
 static void PcmDecoder_free(IAudioDecoder_Opaque *decoder);
@@ -62,6 +82,193 @@ static int64_t calculate_location_bytes(int time_in_ms,
         (src_nb_channels * bits_per_sample / 8));
 }
 
+// apply the gain and convert the channels in a single pass
+static void copy_frames(short *dst, const short *src, int nb_samples,
+        int src_nb_channels, int dst_nb_channels, short volume_fix) {
+    int v = volume_fix;
+    if (src_nb_channels == dst_nb_channels) {
+        int n = nb_samples * src_nb_channels;
+        if (volume_fix == 32767) {
+            memcpy(dst, src, n * sizeof(short));
+        } else {
+            for (int i = 0; i < n; i++)
+                dst[i] = src[i] * v >> 15;
+        }
+    } else if (src_nb_channels == 1) {
+        for (int i = 0; i < nb_samples; i++) {
+            short x = volume_fix == 32767 ? src[i] : src[i] * v >> 15;
+            dst[2 * i] = x;
+            dst[2 * i + 1] = x;
+        }
+    } else {
+        for (int i = 0; i < nb_samples; i++) {
+            short l = src[2 * i], r = src[2 * i + 1];
+            if (volume_fix != 32767) {
+                l = l * v >> 15;
+                r = r * v >> 15;
+            }
+            dst[i] = (l + r) >> 1;
+        }
+    }
+}
+
+static void map_readahead(IAudioDecoder_Opaque *decoder, int64_t pos) {
+    if (pos + (READAHEAD_BYTES >> 1) < decoder->readahead_pos)
+        return;
+
+    int64_t page_size = sysconf(_SC_PAGESIZE);
+    int64_t from = pos > decoder->readahead_pos ? pos : decoder->readahead_pos;
+    from -= from % page_size;
+    if (from >= (int64_t)decoder->map_size)
+        return;
+    int64_t len = READAHEAD_BYTES;
+    if (from + len > (int64_t)decoder->map_size)
+        len = decoder->map_size - from;
+    madvise((void *)(decoder->map + from), len, MADV_WILLNEED);
+    decoder->readahead_pos = from + len;
+}
+
+static void map_seek(IAudioDecoder_Opaque *decoder, int64_t pos) {
+    decoder->map_pos = pos;
+    decoder->readahead_pos = 0;
+    map_readahead(decoder, pos);
+}
+
+static void map_file(IAudioDecoder_Opaque *decoder) {
+    int64_t size = decoder->pcm_start_pos + decoder->file_size;
+    if (size <= 0 || (uint64_t)size > SIZE_MAX)
+        return;
+
+    void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE,
+        fileno(decoder->reader), 0);
+    if (map == MAP_FAILED) {
+        LogWarning("%s mmap %s failed, fall back to fread.\n", __func__,
+            decoder->file_addr);
+        return;
+    }
+    madvise(map, size, MADV_SEQUENTIAL);
+    decoder->map = (const uint8_t *)map;
+    decoder->map_size = size;
+    map_seek(decoder, decoder->pcm_start_pos);
+}
+
+// read up to nb_frames frames from the mapping, return the frames read
+static int read_map(IAudioDecoder_Opaque *decoder, short *buffer,
+        int nb_frames, bool loop, int dst_nb_channels, short volume_fix) {
+    int64_t start = decoder->pcm_start_pos + decoder->crop_start_pos;
+    int64_t end = start + decoder->duration_bytes;
+    if (end > (int64_t)decoder->map_size) end = decoder->map_size;
+    int frame_bytes = decoder->src_nb_channels * sizeof(short);
+
+    int ret = 0;
+    while (nb_frames > 0) {
+        if (decoder->map_pos + frame_bytes > end) {
+            if (!loop || end - start < frame_bytes) break;
+            map_seek(decoder, start);
+        }
+        int64_t n = (end - decoder->map_pos) / frame_bytes;
+        if (n > nb_frames) n = nb_frames;
+        map_readahead(decoder, decoder->map_pos + n * frame_bytes);
+
+        copy_frames(buffer + ret * dst_nb_channels,
+            (const short *)(decoder->map + decoder->map_pos), n,
+            decoder->src_nb_channels, dst_nb_channels, volume_fix);
+        decoder->map_pos += n * frame_bytes;
+        ret += n;
+        nb_frames -= n;
+    }
+    return ret;
+}
+
+// read up to nb_frames source frames as they are, return the frames read
+static int read_source(IAudioDecoder_Opaque *decoder, short *buffer,
+        int nb_frames) {
+    if (decoder->map)
+        return read_map(decoder, buffer, nb_frames, false,
+            decoder->src_nb_channels, 32767);
+
+    int frame_bytes = decoder->src_nb_channels * sizeof(short);
+    int64_t left = (decoder->duration_bytes - decoder->cur_pos
+        - decoder->seek_pos_bytes) / frame_bytes;
+    if (left < nb_frames) nb_frames = left;
+    if (nb_frames <= 0)
+        return 0;
+
+    int read_len = fread(buffer, frame_bytes, nb_frames, decoder->reader);
+    if (read_len <= 0)
+        return 0;
+    decoder->cur_pos += read_len * frame_bytes;
+    return read_len;
+}
+
+static void rewind_source(IAudioDecoder_Opaque *decoder) {
+    int64_t start = decoder->pcm_start_pos + decoder->crop_start_pos;
+    if (decoder->map) {
+        map_seek(decoder, start);
+    } else {
+        decoder->cur_pos = 0;
+        decoder->seek_pos_bytes = 0;
+        fseek(decoder->reader, start, SEEK_SET);
+    }
+}
+
+static void reset_resampler(IAudioDecoder_Opaque *decoder) {
+    pcm_resampler_reset(decoder->resampler);
+    decoder->rs_len = 0;
+    decoder->rs_pos = 0;
+    decoder->rs_flushed = false;
+}
+
+static int read_resampled(IAudioDecoder_Opaque *decoder, short *buffer,
+        int buffer_size_in_short, bool loop) {
+    int src_nb_channels = decoder->src_nb_channels;
+    int dst_nb_channels = decoder->dst_nb_channels;
+    int nb_frames = buffer_size_in_short / dst_nb_channels;
+    int max_src_frames = decoder->max_src_buffer_size / src_nb_channels;
+
+    int ret = 0;
+    while (ret < nb_frames) {
+        if (decoder->rs_pos < decoder->rs_len) {
+            int n = decoder->rs_len - decoder->rs_pos;
+            if (n > nb_frames - ret) n = nb_frames - ret;
+            copy_frames(buffer + ret * dst_nb_channels,
+                decoder->rs_buffer + decoder->rs_pos * src_nb_channels, n,
+                src_nb_channels, dst_nb_channels, decoder->volume_fix);
+            decoder->rs_pos += n;
+            ret += n;
+            continue;
+        }
+        if (decoder->rs_flushed)
+            break;
+
+        int n = read_source(decoder, decoder->src_buffer, max_src_frames);
+        if (n == 0 && loop) {
+            rewind_source(decoder);
+            n = read_source(decoder, decoder->src_buffer, max_src_frames);
+        }
+        decoder->rs_pos = 0;
+        if (n > 0) {
+            decoder->rs_len = pcm_resampler_process(decoder->resampler,
+                decoder->src_buffer, n, decoder->rs_buffer);
+        } else {
+            decoder->rs_len = pcm_resampler_flush(decoder->resampler,
+                decoder->rs_buffer);
+            decoder->rs_flushed = true;
+        }
+        if (decoder->rs_len < 0) {
+            int err = decoder->rs_len;
+            decoder->rs_len = 0;
+            return err;
+        }
+    }
+
+    if (ret == 0) {
+        decoder->decode_completed = true;
+        return PCM_FILE_EOF;
+    }
+    return ret * dst_nb_channels;
+}
+
 static int write_fifo(IAudioDecoder_Opaque *decoder) {
     int ret = -1;
     if (!decoder || !decoder->reader)
@@ -239,6 +446,27 @@ static int init_decoder(IAudioDecoder_Opaque *decoder,
     }
 
     get_duration_l(decoder);
+    map_file(decoder);
+
+    if (src_sample_rate != dst_sample_rate) {
+        decoder->resampler = pcm_resampler_create(src_sample_rate,
+            dst_sample_rate, src_nb_channels);
+        if (!decoder->resampler) {
+            LogError("%s pcm_resampler_create failed.\n", __func__);
+            ret = -1;
+            goto end;
+        }
+        int max_out_frames = pcm_resampler_max_out_frames(decoder->resampler,
+            decoder->max_src_buffer_size / src_nb_channels);
+        decoder->rs_buffer = (short *)calloc(
+            max_out_frames * src_nb_channels, sizeof(short));
+        if (!decoder->rs_buffer) {
+            LogError("%s calloc rs_buffer failed.\n", __func__);
+            ret = AEERROR_NOMEM;
+            goto end;
+        }
+        reset_resampler(decoder);
+    }
 
     if (tmp_file_addr) {
         av_freep(&tmp_file_addr);
@@ -273,6 +501,16 @@ static void PcmDecoder_free(IAudioDecoder_Opaque *decoder) {
         fclose(decoder->reader);
         decoder->reader = NULL;
     }
+    if (decoder->map) {
+        munmap((void *)decoder->map, decoder->map_size);
+        decoder->map = NULL;
+        decoder->map_size = 0;
+    }
+    pcm_resampler_freep(&decoder->resampler);
+    if (decoder->rs_buffer) {
+        free(decoder->rs_buffer);
+        decoder->rs_buffer = NULL;
+    }
 }
 
 static int PcmDecoder_get_pcm_frame(
@@ -282,6 +520,18 @@ static int PcmDecoder_get_pcm_frame(
     if (!decoder || !buffer || buffer_size_in_short < 0)
         return ret;
     if (decoder->decode_completed) return PCM_FILE_EOF;
+    if (decoder->resampler)
+        return read_resampled(decoder, buffer, buffer_size_in_short, loop);
+    if (decoder->map) {
+        ret = read_map(decoder, buffer,
+            buffer_size_in_short / decoder->dst_nb_channels, loop,
+            decoder->dst_nb_channels, decoder->volume_fix);
+        if (ret == 0) {
+            decoder->decode_completed = true;
+            return PCM_FILE_EOF;
+        }
+        return ret * decoder->dst_nb_channels;
+    }
 
     while (fifo_occupancy(decoder->pcm_fifo) < (size_t) buffer_size_in_short) {
 	ret = write_fifo(decoder);
@@ -332,6 +582,7 @@ static int PcmDecoder_seekTo(IAudioDecoder_Opaque *decoder,
 
     if (decoder->pcm_fifo) fifo_clear(decoder->pcm_fifo);
     decoder->cur_pos = 0;
+    if (decoder->resampler) reset_resampler(decoder);
 
     //The offset needs to be a multiple of 2, because the pcm data is 16-bit.
     //The size of seek is in pcm data.
@@ -340,6 +591,11 @@ static int PcmDecoder_seekTo(IAudioDecoder_Opaque *decoder,
         decoder->src_nb_channels);
     LogInfo("%s fseek offset %"PRId64".\n", __func__,
         decoder->seek_pos_bytes + decoder->pcm_start_pos + decoder->crop_start_pos);
+    if (decoder->map) {
+        map_seek(decoder, decoder->seek_pos_bytes + decoder->pcm_start_pos
+            + decoder->crop_start_pos);
+        return 0;
+    }
     return fseek(decoder->reader,
         decoder->seek_pos_bytes + decoder->pcm_start_pos + decoder->crop_start_pos, SEEK_SET);
 }
@@ -353,6 +609,11 @@ static int PcmDecoder_set_crop_pos(
         return ret;
 
     init_timings_params(decoder, crop_start_time_ms, crop_end_time_ms);
+    if (decoder->resampler) reset_resampler(decoder);
+    if (decoder->map) {
+        map_seek(decoder, decoder->pcm_start_pos + decoder->crop_start_pos);
+        return decoder->duration_ms;
+    }
 
     ret = fseek(decoder->reader,
         decoder->pcm_start_pos + decoder->crop_start_pos, SEEK_SET);
@@ -370,11 +631,6 @@ IAudioDecoder *PcmDecoder_create(const char *file_addr,
         return NULL;
     }
 
-    if (src_sample_rate != dst_sample_rate) {
-        LogError("%s not support pcm resampling.\n", __func__);
-        return NULL;
-    }
-
     IAudioDecoder *decoder = IAudioDecoder_create(sizeof(IAudioDecoder_Opaque));
     if (!decoder) {
         LogError("%s Could not allocate IAudioDecoder.\n", __func__);
@@ -0,0 +1,288 @@
+#include "pcm_resampler.h"
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "error_def.h"
+#include "log.h"
+
+#if defined(__SSE__) || defined(__SSE2__)
+#include <xmmintrin.h>
+#define PCM_RESAMPLER_SSE
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define PCM_RESAMPLER_NEON
+#endif
+
+// half length of the kernel in input frames when upsampling
+#define KERNEL_HALF_TAPS 16
+#define MAX_NB_PHASES 4096
+#define MAX_NB_CHANNELS 2
+#define KAISER_BETA 8.0
+// cutoff relative to the lower nyquist frequency of the two rates
+#define CUTOFF 0.92
+// frames of input appended per process loop
+#define MAX_NB_IN_FRAMES 1024
+
+struct PcmResampler {
+    int nb_channels;
+    // output frame k is at input time k * M / L
+    int L;
+    int M;
+    int nb_taps;
+    float *table;
+
+    // planar input history, buf[c][pos] is the first tap of the next output
+    float *buf[MAX_NB_CHANNELS];
+    int buf_len;
+    int capacity;
+    int pos;
+    int phase;
+};
+
+static int gcd(int a, int b) {
+    while (b) {
+        int t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+static double bessel_i0(double x) {
+    double sum = 1.0, term = 1.0;
+    for (int k = 1; k < 50; k++) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+        if (term < sum * 1e-12)
+            break;
+    }
+    return sum;
+}
+
+static void build_table(PcmResampler *r) {
+    double fc = CUTOFF * (r->L < r->M ? (double)r->L / r->M : 1.0);
+    int half = r->nb_taps >> 1;
+    double i0_beta = bessel_i0(KAISER_BETA);
+
+    for (int p = 0; p < r->L; p++) {
+        float *h = r->table + p * r->nb_taps;
+        double sum = 0.0;
+        for (int j = 0; j < r->nb_taps; j++) {
+            // distance in input frames from the output time to tap j
+            double x = (half - 1 - j) + (double)p / r->L;
+            double w = x / half;
+            double v = fc;
+            if (fabs(x) > 1e-9)
+                v = sin(M_PI * fc * x) / (M_PI * x);
+            v *= fabs(w) < 1.0 ?
+                bessel_i0(KAISER_BETA * sqrt(1.0 - w * w)) / i0_beta : 0.0;
+            h[j] = v;
+            sum += v;
+        }
+        for (int j = 0; j < r->nb_taps; j++) {
+            h[j] /= sum;
+        }
+    }
+}
+
+static inline float dot(const float *x, const float *h, int n) {
+    int i = 0;
+    float sum = 0.0f;
+#if defined(PCM_RESAMPLER_SSE)
+    __m128 acc0 = _mm_setzero_ps(), acc1 = _mm_setzero_ps();
+    for (; i + 8 <= n; i += 8) {
+        acc0 = _mm_add_ps(acc0,
+            _mm_mul_ps(_mm_loadu_ps(x + i), _mm_loadu_ps(h + i)));
+        acc1 = _mm_add_ps(acc1,
+            _mm_mul_ps(_mm_loadu_ps(x + i + 4), _mm_loadu_ps(h + i + 4)));
+    }
+    float lanes[4];
+    _mm_storeu_ps(lanes, _mm_add_ps(acc0, acc1));
+    sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#elif defined(PCM_RESAMPLER_NEON)
+    float32x4_t acc0 = vdupq_n_f32(0.0f), acc1 = vdupq_n_f32(0.0f);
+    for (; i + 8 <= n; i += 8) {
+        acc0 = vmlaq_f32(acc0, vld1q_f32(x + i), vld1q_f32(h + i));
+        acc1 = vmlaq_f32(acc1, vld1q_f32(x + i + 4), vld1q_f32(h + i + 4));
+    }
+    float32x4_t acc = vaddq_f32(acc0, acc1);
+    sum = vgetq_lane_f32(acc, 0) + vgetq_lane_f32(acc, 1)
+        + vgetq_lane_f32(acc, 2) + vgetq_lane_f32(acc, 3);
+#endif
+    for (; i < n; i++) {
+        sum += x[i] * h[i];
+    }
+    return sum;
+}
+
+static inline short float_to_s16(float v) {
+    if (v >= 32767.0f) return 32767;
+    if (v <= -32768.0f) return -32768;
+    return (short)lrintf(v);
+}
+
+static int reserve(PcmResampler *r, int nb_frames) {
+    if (r->buf_len + nb_frames <= r->capacity)
+        return 0;
+
+    int capacity = r->buf_len + nb_frames;
+    for (int c = 0; c < r->nb_channels; c++) {
+        float *buf = (float *)realloc(r->buf[c], capacity * sizeof(float));
+        if (!buf)
+            return AEERROR_NOMEM;
+        r->buf[c] = buf;
+    }
+    r->capacity = capacity;
+    return 0;
+}
+
+static int produce(PcmResampler *r, short *out) {
+    int nb_out = 0;
+    const int ch = r->nb_channels;
+    while (r->pos + r->nb_taps <= r->buf_len) {
+        const float *h = r->table + r->phase * r->nb_taps;
+        for (int c = 0; c < ch; c++) {
+            out[nb_out * ch + c] =
+                float_to_s16(dot(r->buf[c] + r->pos, h, r->nb_taps));
+        }
+        nb_out++;
+        r->phase += r->M;
+        r->pos += r->phase / r->L;
+        r->phase %= r->L;
+    }
+
+    // keep only the history the next outputs need
+    int shift = r->pos < r->buf_len ? r->pos : r->buf_len;
+    if (shift > 0) {
+        for (int c = 0; c < ch; c++) {
+            memmove(r->buf[c], r->buf[c] + shift,
+                (r->buf_len - shift) * sizeof(float));
+        }
+        r->buf_len -= shift;
+        r->pos -= shift;
+    }
+    return nb_out;
+}
+
+int pcm_resampler_max_out_frames(PcmResampler *r, int nb_in_frames) {
+    if (!r || nb_in_frames < 0)
+        return 0;
+    // the history never holds more than nb_taps frames between two calls
+    int64_t n = (int64_t)r->nb_taps + (r->nb_taps >> 1) + nb_in_frames;
+    return n * r->L / r->M + 1;
+}
+
+int pcm_resampler_process(PcmResampler *r, const short *in,
+        int nb_in_frames, short *out) {
+    if (!r || !in || !out || nb_in_frames < 0)
+        return -1;
+
+    int nb_out = 0;
+    const int ch = r->nb_channels;
+    while (nb_in_frames > 0) {
+        int n = nb_in_frames < MAX_NB_IN_FRAMES ?
+            nb_in_frames : MAX_NB_IN_FRAMES;
+        int ret = reserve(r, n);
+        if (ret < 0)
+            return ret;
+        for (int c = 0; c < ch; c++) {
+            float *dst = r->buf[c] + r->buf_len;
+            for (int i = 0; i < n; i++) {
+                dst[i] = in[i * ch + c];
+            }
+        }
+        r->buf_len += n;
+        in += n * ch;
+        nb_in_frames -= n;
+        nb_out += produce(r, out + nb_out * ch);
+    }
+    return nb_out;
+}
+
+int pcm_resampler_flush(PcmResampler *r, short *out) {
+    if (!r || !out)
+        return -1;
+
+    int n = r->nb_taps >> 1;
+    int ret = reserve(r, n);
+    if (ret < 0)
+        return ret;
+    for (int c = 0; c < r->nb_channels; c++) {
+        memset(r->buf[c] + r->buf_len, 0, n * sizeof(float));
+    }
+    r->buf_len += n;
+    ret = produce(r, out);
+    pcm_resampler_reset(r);
+    return ret;
+}
+
+void pcm_resampler_reset(PcmResampler *r) {
+    if (!r)
+        return;
+
+    // prime the history so the first output is centered on input frame 0
+    int pad = (r->nb_taps >> 1) - 1;
+    for (int c = 0; c < r->nb_channels; c++) {
+        memset(r->buf[c], 0, pad * sizeof(float));
+    }
+    r->buf_len = pad;
+    r->pos = 0;
+    r->phase = 0;
+}
+
+void pcm_resampler_freep(PcmResampler **r) {
+    if (!r || !*r)
+        return;
+    PcmResampler *self = *r;
+
+    for (int c = 0; c < MAX_NB_CHANNELS; c++) {
+        if (self->buf[c]) free(self->buf[c]);
+    }
+    if (self->table) free(self->table);
+    free(self);
+    *r = NULL;
+}
+
+PcmResampler *pcm_resampler_create(int src_sample_rate,
+        int dst_sample_rate, int nb_channels) {
+    LogInfo("%s src_sample_rate %d, dst_sample_rate %d, nb_channels %d.\n",
+        __func__, src_sample_rate, dst_sample_rate, nb_channels);
+    if (src_sample_rate <= 0 || dst_sample_rate <= 0
+            || nb_channels <= 0 || nb_channels > MAX_NB_CHANNELS)
+        return NULL;
+
+    int g = gcd(src_sample_rate, dst_sample_rate);
+    if (dst_sample_rate / g > MAX_NB_PHASES) {
+        LogError("%s unsupported ratio %d/%d.\n", __func__,
+            dst_sample_rate, src_sample_rate);
+        return NULL;
+    }
+
+    PcmResampler *self = (PcmResampler *)calloc(1, sizeof(PcmResampler));
+    if (!self) {
+        LogError("%s calloc PcmResampler failed.\n", __func__);
+        return NULL;
+    }
+
+    self->nb_channels = nb_channels;
+    self->L = dst_sample_rate / g;
+    self->M = src_sample_rate / g;
+    // widen the kernel with the lower cutoff when downsampling,
+    // keeping the length a multiple of 8 for the vector loop
+    int half = KERNEL_HALF_TAPS;
+    if (self->L < self->M)
+        half = (int)ceil((double)KERNEL_HALF_TAPS * self->M / self->L);
+    self->nb_taps = (2 * half + 7) & ~7;
+
+    self->table = (float *)malloc(
+        (size_t)self->L * self->nb_taps * sizeof(float));
+    if (!self->table || reserve(self, self->nb_taps + MAX_NB_IN_FRAMES) < 0) {
+        LogError("%s alloc buffers failed.\n", __func__);
+        pcm_resampler_freep(&self);
+        return NULL;
+    }
+    build_table(self);
+    pcm_resampler_reset(self);
+    return self;
+}
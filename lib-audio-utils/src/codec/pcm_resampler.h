@@ -0,0 +1,44 @@
+#ifndef _PCM_RESAMPLER_H_
+#define _PCM_RESAMPLER_H_
+
+/**
+ * Streaming polyphase resampler of interleaved s16 pcm. The rate ratio is
+ * reduced to L/M and a Kaiser windowed sinc is tabulated for each of the L
+ * phases at create time. Output frame k is taken at input time k * M / L,
+ * so the output is aligned with the input without delay.
+ */
+
+typedef struct PcmResampler PcmResampler;
+
+/**
+ * @brief upper bound of the frames a call of pcm_resampler_process with
+ *        nb_in_frames input frames, or of pcm_resampler_flush, writes
+ */
+int pcm_resampler_max_out_frames(PcmResampler *r, int nb_in_frames);
+
+/**
+ * @brief resample nb_in_frames frames, all input is consumed
+ *
+ * @param out room for pcm_resampler_max_out_frames(r, nb_in_frames) frames
+ * @return number of frames written to out, less than 0 on failure
+ */
+int pcm_resampler_process(PcmResampler *r, const short *in,
+    int nb_in_frames, short *out);
+
+/**
+ * @brief write the frames still held back at the end of the input
+ *
+ * @param out room for pcm_resampler_max_out_frames(r, 0) frames
+ */
+int pcm_resampler_flush(PcmResampler *r, short *out);
+
+/**
+ * @brief drop the buffered input, call it after a seek
+ */
+void pcm_resampler_reset(PcmResampler *r);
+
+void pcm_resampler_freep(PcmResampler **r);
+PcmResampler *pcm_resampler_create(int src_sample_rate,
+    int dst_sample_rate, int nb_channels);
+
+#endif
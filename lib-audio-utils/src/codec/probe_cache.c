@@ -0,0 +1,283 @@
+#include "probe_cache.h"
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "error_def.h"
+#include "log.h"
+
+#define PROBE_CACHE_MAGIC 0x31435058 // "XPC1"
+#define MIN_NB_BUCKETS 256
+// paths longer than this are not written to the cache file
+#define MAX_PATH_LEN 4096
+
+// one record of the cache file, followed by path_len bytes of path
+typedef struct ProbeRecord {
+    uint32_t path_len;
+    int32_t duration_ms;
+    int32_t sample_rate;
+    int32_t nb_channels;
+    int64_t file_size;
+    int64_t mtime;
+    char codec_name[32];
+} ProbeRecord;
+
+typedef struct ProbeEntry {
+    char *file_addr;
+    uint64_t hash;
+    int64_t file_size;
+    int64_t mtime;
+    AudioProbeInfo info;
+    struct ProbeEntry *next;
+} ProbeEntry;
+
+static struct {
+    pthread_mutex_t mutex;
+    ProbeEntry **buckets;
+    size_t nb_buckets;
+    size_t nb_entries;
+    // records in the cache file, superseded ones included
+    size_t nb_records;
+    char *cache_file;
+    int fd;
+} cache = {
+    PTHREAD_MUTEX_INITIALIZER, NULL, 0, 0, 0, NULL, -1
+};
+
+static uint64_t hash_path(const char *path) {
+    // FNV-1a
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (const char *p = path; *p; p++) {
+        hash ^= (unsigned char)*p;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+static ProbeEntry *find_l(const char *file_addr, uint64_t hash) {
+    if (!cache.buckets)
+        return NULL;
+    ProbeEntry *entry = cache.buckets[hash & (cache.nb_buckets - 1)];
+    for (; entry; entry = entry->next) {
+        if (entry->hash == hash && !strcmp(entry->file_addr, file_addr))
+            return entry;
+    }
+    return NULL;
+}
+
+static int grow_l(void) {
+    size_t nb_buckets = cache.nb_buckets ? cache.nb_buckets << 1 : MIN_NB_BUCKETS;
+    ProbeEntry **buckets = (ProbeEntry **)calloc(nb_buckets, sizeof(ProbeEntry *));
+    if (!buckets)
+        return AEERROR_NOMEM;
+
+    for (size_t i = 0; i < cache.nb_buckets; i++) {
+        ProbeEntry *entry = cache.buckets[i];
+        while (entry) {
+            ProbeEntry *next = entry->next;
+            size_t b = entry->hash & (nb_buckets - 1);
+            entry->next = buckets[b];
+            buckets[b] = entry;
+            entry = next;
+        }
+    }
+    free(cache.buckets);
+    cache.buckets = buckets;
+    cache.nb_buckets = nb_buckets;
+    return 0;
+}
+
+// insert or update, return 1 if the entry changed
+static int put_l(const char *file_addr, int64_t file_size, int64_t mtime,
+        const AudioProbeInfo *info) {
+    uint64_t hash = hash_path(file_addr);
+    ProbeEntry *entry = find_l(file_addr, hash);
+    if (!entry) {
+        if (cache.nb_entries >= cache.nb_buckets && grow_l() < 0)
+            return AEERROR_NOMEM;
+        entry = (ProbeEntry *)calloc(1, sizeof(ProbeEntry));
+        if (!entry || !(entry->file_addr = strdup(file_addr))) {
+            free(entry);
+            return AEERROR_NOMEM;
+        }
+        entry->hash = hash;
+        size_t b = hash & (cache.nb_buckets - 1);
+        entry->next = cache.buckets[b];
+        cache.buckets[b] = entry;
+        cache.nb_entries++;
+    } else if (entry->file_size == file_size && entry->mtime == mtime
+            && !memcmp(&entry->info, info, sizeof(*info))) {
+        return 0;
+    }
+    entry->file_size = file_size;
+    entry->mtime = mtime;
+    entry->info = *info;
+    return 1;
+}
+
+static void fill_record(ProbeRecord *record, const char *file_addr,
+        int64_t file_size, int64_t mtime, const AudioProbeInfo *info) {
+    memset(record, 0, sizeof(*record));
+    record->path_len = strlen(file_addr);
+    record->duration_ms = info->duration_ms;
+    record->sample_rate = info->sample_rate;
+    record->nb_channels = info->nb_channels;
+    record->file_size = file_size;
+    record->mtime = mtime;
+    memcpy(record->codec_name, info->codec_name, sizeof(record->codec_name));
+    record->codec_name[sizeof(record->codec_name) - 1] = '\0';
+}
+
+// a record and its path go out in one write, so concurrent appends of
+// several processes do not interleave
+static int write_record(int fd, const char *file_addr, int64_t file_size,
+        int64_t mtime, const AudioProbeInfo *info) {
+    size_t path_len = strlen(file_addr);
+    if (path_len > MAX_PATH_LEN)
+        return 0;
+
+    char buf[sizeof(ProbeRecord) + MAX_PATH_LEN];
+    fill_record((ProbeRecord *)buf, file_addr, file_size, mtime, info);
+    memcpy(buf + sizeof(ProbeRecord), file_addr, path_len);
+    size_t len = sizeof(ProbeRecord) + path_len;
+    return write(fd, buf, len) == (ssize_t)len ? 0 : -1;
+}
+
+static void load_l(FILE *fp) {
+    char path[MAX_PATH_LEN + 1];
+    ProbeRecord record;
+    while (fread(&record, sizeof(record), 1, fp) == 1) {
+        // a torn record at the end is dropped
+        if (record.path_len == 0 || record.path_len > MAX_PATH_LEN
+                || fread(path, 1, record.path_len, fp) != record.path_len)
+            break;
+        path[record.path_len] = '\0';
+
+        AudioProbeInfo info;
+        memset(&info, 0, sizeof(info));
+        info.duration_ms = record.duration_ms;
+        info.sample_rate = record.sample_rate;
+        info.nb_channels = record.nb_channels;
+        memcpy(info.codec_name, record.codec_name, sizeof(info.codec_name));
+        info.codec_name[sizeof(info.codec_name) - 1] = '\0';
+        if (put_l(path, record.file_size, record.mtime, &info) < 0)
+            break;
+        cache.nb_records++;
+    }
+}
+
+// write the live entries to a new file and replace the old one with it
+static int compact_l(const char *cache_file) {
+    char tmp_file[MAX_PATH_LEN + 32];
+    snprintf(tmp_file, sizeof(tmp_file), "%s.%ld.tmp", cache_file,
+        (long)getpid());
+    int fd = open(tmp_file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return -1;
+
+    uint32_t magic = PROBE_CACHE_MAGIC;
+    bool ok = write(fd, &magic, sizeof(magic)) == sizeof(magic);
+    size_t nb_records = 0;
+    for (size_t i = 0; ok && i < cache.nb_buckets; i++) {
+        for (ProbeEntry *e = cache.buckets[i]; ok && e; e = e->next) {
+            ok = write_record(fd, e->file_addr, e->file_size,
+                e->mtime, &e->info) == 0;
+            nb_records++;
+        }
+    }
+    ok = (close(fd) == 0) && ok;
+    if (!ok || rename(tmp_file, cache_file) != 0) {
+        LogWarning("%s write %s failed.\n", __func__, cache_file);
+        remove(tmp_file);
+        return -1;
+    }
+    cache.nb_records = nb_records;
+    return 0;
+}
+
+static int open_file_l(const char *cache_file) {
+    FILE *fp = fopen(cache_file, "rb");
+    if (fp) {
+        uint32_t magic = 0;
+        if (fread(&magic, sizeof(magic), 1, fp) == 1
+                && magic == PROBE_CACHE_MAGIC) {
+            load_l(fp);
+        } else {
+            LogWarning("%s %s is not a probe cache, rewrite it.\n",
+                __func__, cache_file);
+            cache.nb_records = SIZE_MAX;
+        }
+        fclose(fp);
+    } else {
+        cache.nb_records = SIZE_MAX;
+    }
+
+    // superseded records and torn tails are dropped by rewriting the file
+    if (cache.nb_records != cache.nb_entries)
+        compact_l(cache_file);
+
+    cache.fd = open(cache_file, O_WRONLY | O_APPEND);
+    if (cache.fd < 0) {
+        LogWarning("%s open %s failed.\n", __func__, cache_file);
+        return -1;
+    }
+    return 0;
+}
+
+int probe_cache_set_file(const char *cache_file) {
+    LogInfo("%s cache_file %s.\n", __func__, cache_file ? cache_file : "none");
+    if (cache_file && strlen(cache_file) > MAX_PATH_LEN)
+        return -1;
+    char *tmp = NULL;
+    if (cache_file && !(tmp = strdup(cache_file)))
+        return AEERROR_NOMEM;
+
+    int ret = 0;
+    pthread_mutex_lock(&cache.mutex);
+    if (cache.fd >= 0) {
+        close(cache.fd);
+        cache.fd = -1;
+    }
+    if (cache.cache_file) free(cache.cache_file);
+    cache.cache_file = tmp;
+    cache.nb_records = 0;
+    if (tmp)
+        ret = open_file_l(tmp);
+    pthread_mutex_unlock(&cache.mutex);
+    return ret;
+}
+
+int probe_cache_lookup(const char *file_addr, int64_t file_size,
+        int64_t mtime, AudioProbeInfo *info) {
+    if (!file_addr || !info)
+        return -1;
+
+    int ret = -1;
+    pthread_mutex_lock(&cache.mutex);
+    ProbeEntry *entry = find_l(file_addr, hash_path(file_addr));
+    if (entry && entry->file_size == file_size && entry->mtime == mtime) {
+        *info = entry->info;
+        ret = 0;
+    }
+    pthread_mutex_unlock(&cache.mutex);
+    return ret;
+}
+
+void probe_cache_store(const char *file_addr, int64_t file_size,
+        int64_t mtime, const AudioProbeInfo *info) {
+    if (!file_addr || !info)
+        return;
+
+    pthread_mutex_lock(&cache.mutex);
+    if (put_l(file_addr, file_size, mtime, info) > 0 && cache.fd >= 0) {
+        if (write_record(cache.fd, file_addr, file_size, mtime, info) == 0) {
+            cache.nb_records++;
+        } else {
+            LogWarning("%s append to %s failed.\n", __func__, cache.cache_file);
+        }
+    }
+    pthread_mutex_unlock(&cache.mutex);
+}
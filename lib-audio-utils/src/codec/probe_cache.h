@@ -0,0 +1,35 @@
+#ifndef _PROBE_CACHE_H_
+#define _PROBE_CACHE_H_
+#include <stdint.h>
+
+/**
+ * Process wide cache of the probe results of audio files, keyed by
+ * (path, size, mtime), so listing a library only opens files that are new
+ * or changed. With a cache file set the results are also appended to it
+ * and loaded back by the next process.
+ */
+
+typedef struct AudioProbeInfo {
+    int duration_ms;
+    int sample_rate;
+    int nb_channels;
+    char codec_name[32];
+} AudioProbeInfo;
+
+/**
+ * @brief set the file the results are kept in, loading the results it
+ *        holds, NULL(default) keeps them in memory only
+ */
+int probe_cache_set_file(const char *cache_file);
+
+/**
+ * @return 0 and fills info if the file was probed with this size and mtime,
+ *         less than 0 otherwise
+ */
+int probe_cache_lookup(const char *file_addr, int64_t file_size,
+    int64_t mtime, AudioProbeInfo *info);
+
+void probe_cache_store(const char *file_addr, int64_t file_size,
+    int64_t mtime, const AudioProbeInfo *info);
+
+#endif
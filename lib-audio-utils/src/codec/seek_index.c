@@ -0,0 +1,365 @@
+#if defined(__ANDROID__) || defined (__linux__)
+#include "seek_index.h"
+#include <inttypes.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "log.h"
+#include "error_def.h"
+
+#define SEEK_INDEX_MAGIC 0x31495358 // "XSI1"
+// indexes kept in memory, the least recently used idle ones are dropped
+#define MAX_NB_CACHED_INDEXES 64
+
+typedef struct SeekPoint {
+    int64_t pos;
+    int64_t pts;
+} SeekPoint;
+
+typedef struct SeekIndexHeader {
+    uint32_t magic;
+    uint32_t path_len;
+    int64_t file_size;
+    int64_t mtime;
+    int64_t nb_points;
+} SeekIndexHeader;
+
+typedef struct SeekIndex {
+    char *file_addr;
+    int64_t file_size;
+    int64_t mtime;
+    int stream_index;
+    SeekPoint *points;
+    int64_t nb_points;
+    int ref_count;
+    // most recently used first
+    struct SeekIndex *prev;
+    struct SeekIndex *next;
+} SeekIndex;
+
+static pthread_mutex_t dir_mutex = PTHREAD_MUTEX_INITIALIZER;
+static char *index_dir = NULL;
+
+static struct {
+    pthread_mutex_t mutex;
+    int nb_indexes;
+    SeekIndex *head;
+    SeekIndex *tail;
+} cache = {PTHREAD_MUTEX_INITIALIZER, 0, NULL, NULL};
+
+static void index_free(SeekIndex *index) {
+    if (!index) return;
+    if (index->points) free(index->points);
+    if (index->file_addr) free(index->file_addr);
+    free(index);
+}
+
+static void unlink_l(SeekIndex *index) {
+    if (index->prev) index->prev->next = index->next;
+    else cache.head = index->next;
+    if (index->next) index->next->prev = index->prev;
+    else cache.tail = index->prev;
+    index->prev = index->next = NULL;
+}
+
+static void push_front_l(SeekIndex *index) {
+    index->prev = NULL;
+    index->next = cache.head;
+    if (cache.head) cache.head->prev = index;
+    cache.head = index;
+    if (!cache.tail) cache.tail = index;
+}
+
+static void evict_l(void) {
+    SeekIndex *index = cache.tail;
+    while (index && cache.nb_indexes > MAX_NB_CACHED_INDEXES) {
+        SeekIndex *prev = index->prev;
+        if (index->ref_count == 0) {
+            unlink_l(index);
+            cache.nb_indexes--;
+            index_free(index);
+        }
+        index = prev;
+    }
+}
+
+static SeekIndex *find_l(const char *file_addr, const struct stat *st_file,
+        int stream_index) {
+    for (SeekIndex *index = cache.head; index; index = index->next) {
+        if (index->stream_index == stream_index
+                && index->mtime == (int64_t)st_file->st_mtime
+                && index->file_size == (int64_t)st_file->st_size
+                && !strcmp(index->file_addr, file_addr))
+            return index;
+    }
+    return NULL;
+}
+
+static SeekIndex *index_acquire(const char *file_addr,
+        const struct stat *st_file, int stream_index) {
+    pthread_mutex_lock(&cache.mutex);
+    SeekIndex *index = find_l(file_addr, st_file, stream_index);
+    if (index) {
+        index->ref_count++;
+        unlink_l(index);
+        push_front_l(index);
+    }
+    pthread_mutex_unlock(&cache.mutex);
+    return index;
+}
+
+// takes points on success, returns the cached index of the file referenced
+static SeekIndex *index_insert(const char *file_addr,
+        const struct stat *st_file, int stream_index,
+        SeekPoint *points, int64_t nb_points) {
+    SeekIndex *self = (SeekIndex *)calloc(1, sizeof(SeekIndex));
+    if (!self || !(self->file_addr = strdup(file_addr))) {
+        index_free(self);
+        return NULL;
+    }
+    self->file_size = st_file->st_size;
+    self->mtime = st_file->st_mtime;
+    self->stream_index = stream_index;
+    self->points = points;
+    self->nb_points = nb_points;
+    self->ref_count = 1;
+
+    pthread_mutex_lock(&cache.mutex);
+    // another decoder indexed the file meanwhile
+    SeekIndex *index = find_l(file_addr, st_file, stream_index);
+    if (index) {
+        index->ref_count++;
+    } else {
+        push_front_l(self);
+        cache.nb_indexes++;
+        evict_l();
+    }
+    pthread_mutex_unlock(&cache.mutex);
+
+    if (index) {
+        index_free(self);
+        return index;
+    }
+    return self;
+}
+
+static void index_release(SeekIndex **index) {
+    if (!index || !*index)
+        return;
+    pthread_mutex_lock(&cache.mutex);
+    (*index)->ref_count--;
+    evict_l();
+    pthread_mutex_unlock(&cache.mutex);
+    *index = NULL;
+}
+
+static int sidecar_path(const char *file_addr, char *path, size_t size) {
+    int ret = -1;
+    pthread_mutex_lock(&dir_mutex);
+    if (index_dir) {
+        // FNV-1a of the path names the sidecar file
+        uint64_t hash = 0xcbf29ce484222325ULL;
+        for (const char *p = file_addr; *p; p++) {
+            hash ^= (unsigned char)*p;
+            hash *= 0x100000001b3ULL;
+        }
+        snprintf(path, size, "%s/%016llx.idx", index_dir,
+            (unsigned long long)hash);
+        ret = 0;
+    }
+    pthread_mutex_unlock(&dir_mutex);
+    return ret;
+}
+
+static void add_points(AVStream *st, const SeekPoint *points, int64_t nb) {
+    for (int64_t i = 0; i < nb; i++) {
+        av_add_index_entry(st, points[i].pos, points[i].pts,
+            0, 0, AVINDEX_KEYFRAME);
+    }
+}
+
+static int read_sidecar(const char *path, const char *file_addr,
+        const struct stat *st_file, SeekPoint **out, int64_t *nb_points) {
+    int ret = -1;
+    SeekPoint *points = NULL;
+    char *name = NULL;
+    FILE *fp = fopen(path, "rb");
+    if (!fp)
+        return -1;
+
+    SeekIndexHeader header;
+    if (fread(&header, sizeof(header), 1, fp) != 1
+            || header.magic != SEEK_INDEX_MAGIC
+            || header.file_size != (int64_t)st_file->st_size
+            || header.mtime != (int64_t)st_file->st_mtime
+            || header.path_len != strlen(file_addr)
+            || header.nb_points <= 0 || header.nb_points > INT_MAX)
+        goto end;
+
+    name = (char *)calloc(header.path_len + 1, 1);
+    points = (SeekPoint *)malloc(header.nb_points * sizeof(SeekPoint));
+    if (!name || !points)
+        goto end;
+    if (fread(name, 1, header.path_len, fp) != header.path_len
+            || strcmp(name, file_addr)
+            || fread(points, sizeof(SeekPoint), header.nb_points, fp)
+            != (size_t)header.nb_points)
+        goto end;
+
+    *out = points;
+    *nb_points = header.nb_points;
+    points = NULL;
+    ret = 0;
+end:
+    if (name) free(name);
+    if (points) free(points);
+    fclose(fp);
+    return ret;
+}
+
+static void write_sidecar(const char *path, const char *file_addr,
+        const struct stat *st_file, const SeekPoint *points, int64_t nb) {
+    char tmp_path[1100];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.%ld.tmp", path, (long)getpid());
+    FILE *fp = fopen(tmp_path, "wb");
+    if (!fp) {
+        LogWarning("%s open %s failed.\n", __func__, tmp_path);
+        return;
+    }
+
+    SeekIndexHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = SEEK_INDEX_MAGIC;
+    header.path_len = strlen(file_addr);
+    header.file_size = st_file->st_size;
+    header.mtime = st_file->st_mtime;
+    header.nb_points = nb;
+    bool ok = fwrite(&header, sizeof(header), 1, fp) == 1
+        && fwrite(file_addr, 1, header.path_len, fp) == header.path_len
+        && fwrite(points, sizeof(SeekPoint), nb, fp) == (size_t)nb;
+    ok = (fclose(fp) == 0) && ok;
+    // rename keeps readers from seeing a partial file
+    if (!ok || rename(tmp_path, path) != 0) {
+        LogWarning("%s write %s failed.\n", __func__, path);
+        remove(tmp_path);
+    }
+}
+
+static int scan_packets(AVFormatContext *fmt_ctx, int stream_index,
+        SeekPoint **points, int64_t *nb_points) {
+    int ret = 0;
+    int64_t capacity = 0;
+    int64_t start_time = fmt_ctx->start_time != AV_NOPTS_VALUE ?
+        fmt_ctx->start_time : 0;
+    *points = NULL;
+    *nb_points = 0;
+
+    ret = avformat_seek_file(fmt_ctx, -1, INT64_MIN, start_time,
+        INT64_MAX, AVSEEK_FLAG_BACKWARD);
+    if (ret < 0)
+        return ret;
+
+    AVPacket pkt;
+    InitPacket(&pkt);
+    while (av_read_frame(fmt_ctx, &pkt) >= 0) {
+        int64_t pts = pkt.pts != AV_NOPTS_VALUE ? pkt.pts : pkt.dts;
+        if (pkt.stream_index == stream_index && pkt.pos >= 0
+                && pts != AV_NOPTS_VALUE) {
+            if (*nb_points == capacity) {
+                capacity = capacity > 0 ? capacity << 1 : 1024;
+                SeekPoint *tmp = (SeekPoint *)realloc(*points,
+                    capacity * sizeof(SeekPoint));
+                if (!tmp) {
+                    av_packet_unref(&pkt);
+                    ret = AEERROR_NOMEM;
+                    goto fail;
+                }
+                *points = tmp;
+            }
+            (*points)[*nb_points].pos = pkt.pos;
+            (*points)[*nb_points].pts = pts;
+            (*nb_points)++;
+        }
+        av_packet_unref(&pkt);
+    }
+    return 0;
+fail:
+    free(*points);
+    *points = NULL;
+    *nb_points = 0;
+    return ret;
+}
+
+int seek_index_set_dir(const char *dir) {
+    LogInfo("%s dir %s.\n", __func__, dir ? dir : "none");
+    char *tmp = NULL;
+    if (dir && !(tmp = strdup(dir)))
+        return AEERROR_NOMEM;
+
+    pthread_mutex_lock(&dir_mutex);
+    if (index_dir) free(index_dir);
+    index_dir = tmp;
+    pthread_mutex_unlock(&dir_mutex);
+    return 0;
+}
+
+int seek_index_load(AVFormatContext *fmt_ctx, int stream_index,
+        const char *file_addr) {
+    if (!fmt_ctx || !file_addr || stream_index < 0
+            || stream_index >= (int)fmt_ctx->nb_streams)
+        return -1;
+    AVStream *st = fmt_ctx->streams[stream_index];
+
+    // demuxers like mov already index every packet
+    if (st->nb_frames > 0 && st->nb_index_entries >= st->nb_frames)
+        return st->nb_index_entries;
+
+    struct stat st_file;
+    bool cacheable = stat(file_addr, &st_file) == 0
+        && S_ISREG(st_file.st_mode);
+    SeekIndex *index = cacheable ?
+        index_acquire(file_addr, &st_file, stream_index) : NULL;
+    if (index) {
+        add_points(st, index->points, index->nb_points);
+        index_release(&index);
+        return st->nb_index_entries;
+    }
+
+    char path[1024];
+    bool has_sidecar = cacheable
+        && sidecar_path(file_addr, path, sizeof(path)) == 0;
+    SeekPoint *points = NULL;
+    int64_t nb_points = 0;
+    if (!has_sidecar
+            || read_sidecar(path, file_addr, &st_file,
+                &points, &nb_points) < 0) {
+        int ret = scan_packets(fmt_ctx, stream_index, &points, &nb_points);
+        if (ret < 0 || nb_points == 0) {
+            LogWarning("%s scan %s failed.\n", __func__, file_addr);
+            if (points) free(points);
+            return ret < 0 ? ret : -1;
+        }
+        if (has_sidecar)
+            write_sidecar(path, file_addr, &st_file, points, nb_points);
+        LogInfo("%s %s %" PRId64 " packets.\n", __func__,
+            file_addr, nb_points);
+    }
+
+    if (cacheable)
+        index = index_insert(file_addr, &st_file, stream_index,
+            points, nb_points);
+    if (index) {
+        add_points(st, index->points, index->nb_points);
+        index_release(&index);
+    } else {
+        add_points(st, points, nb_points);
+        free(points);
+    }
+    return st->nb_index_entries;
+}
+
+#endif // defined(__ANDROID__) || defined (__linux__)
@@ -0,0 +1,33 @@
+#if defined(__ANDROID__) || defined (__linux__)
+#ifndef SEEK_INDEX_H
+#define SEEK_INDEX_H
+#include "ffmpeg_utils.h"
+
+/**
+ * Packet level index of an audio stream, byte position and pts of every
+ * packet. It is loaded into the demuxer so a seek lands on the exact packet,
+ * also for formats like VBR MP3 whose own index is coarse. The index of a
+ * file is built once per process and shared by all its decoders, keyed by
+ * path, size and mtime. With an index directory set, it is also kept in a
+ * sidecar file there and survives the process.
+ */
+
+/**
+ * @brief set the directory of the sidecar files, NULL(default) keeps the
+ *        index in memory only
+ */
+int seek_index_set_dir(const char *dir);
+
+/**
+ * @brief make sure the demuxer of the stream indexes every packet, from the
+ *        cached index, the sidecar file or a scan of the packets of the file
+ *
+ * The read position of fmt_ctx is undefined afterwards, seek before reading.
+ *
+ * @return number of index entries, less than 0 on failure
+ */
+int seek_index_load(AVFormatContext *fmt_ctx, int stream_index,
+    const char *file_addr);
+
+#endif // SEEK_INDEX_H
+#endif // defined(__ANDROID__) || defined (__linux__)
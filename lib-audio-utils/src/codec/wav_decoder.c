@@ -0,0 +1,614 @@
+#include "wav_decoder.h"
+#include "log.h"
+#include "error_def.h"
+#include "tools/util.h"
+#include "ffmpeg_utils.h"
+#include "pcm_resampler.h"
+#include "wave/wav_dec.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// bytes of the mapped file asked to be read ahead of the read position
+#define READAHEAD_BYTES (1 << 20)
+
+enum WavSampleFormat {
+    WAV_SAMPLE_S16,
+    WAV_SAMPLE_S24,
+    WAV_SAMPLE_S32,
+    WAV_SAMPLE_F32
+};
+
+typedef struct IAudioDecoder_Opaque {
+    bool decode_completed;
+
+    // play-out volume.
+    short volume_fix;
+    float volume_flp;
+    // float output, the samples skip the s16 quantization
+    bool out_flt;
+
+    // Input parameters
+    int src_sample_rate_in_Hz;
+    int src_nb_channels;
+    enum WavSampleFormat sample_fmt;
+    int frame_bytes;
+    int64_t data_offset;
+    int64_t nb_frames;
+
+    // Output parameters, positions are frames from the start of the data
+    int crop_start_time_in_ms;
+    int crop_end_time_in_ms;
+    int64_t crop_start_frame;
+    int64_t crop_end_frame;
+    int duration_ms;
+    int dst_sample_rate_in_Hz;
+    int dst_nb_channels;
+
+    char *file_addr;
+    const uint8_t *map;
+    size_t map_size;
+    int64_t map_pos;
+    int64_t readahead_pos;
+
+    // set when the source rate differs from the output rate
+    PcmResampler *resampler;
+    int max_src_frames;
+    short *src_buffer;
+    short *rs_buffer;
+    int rs_len;
+    int rs_pos;
+    bool rs_flushed;
+} IAudioDecoder_Opaque;
+
+static inline int load_sample(const uint8_t *p, enum WavSampleFormat fmt) {
+    switch (fmt) {
+    case WAV_SAMPLE_S16: {
+        int16_t v;
+        memcpy(&v, p, sizeof(v));
+        return v;
+    }
+    case WAV_SAMPLE_S24:
+        return (int16_t)(p[1] | (p[2] << 8));
+    case WAV_SAMPLE_S32: {
+        int32_t v;
+        memcpy(&v, p, sizeof(v));
+        return v >> 16;
+    }
+    default: {
+        float v;
+        memcpy(&v, p, sizeof(v));
+        v *= 32768.0f;
+        if (v >= 32767.0f) return 32767;
+        if (v <= -32768.0f) return -32768;
+        return (int)v;
+    }
+    }
+}
+
+// convert the frames to s16 with the gain applied, a mono output averages
+// all channels, a stereo output takes the first two
+static inline __attribute__((always_inline)) void convert_frames(
+        short *dst, const uint8_t *src, int nb_frames,
+        enum WavSampleFormat fmt, int src_nb_channels, int dst_nb_channels,
+        short volume_fix) {
+    const int bytes = fmt == WAV_SAMPLE_S16 ? 2 : (fmt == WAV_SAMPLE_S24 ? 3 : 4);
+    const int frame_bytes = bytes * src_nb_channels;
+    const int v = volume_fix;
+
+    if (fmt == WAV_SAMPLE_S16 && volume_fix == 32767
+            && src_nb_channels == dst_nb_channels) {
+        memcpy(dst, src, (size_t)nb_frames * frame_bytes);
+        return;
+    }
+
+    for (int i = 0; i < nb_frames; i++, src += frame_bytes) {
+        if (dst_nb_channels == 1) {
+            int x = load_sample(src, fmt);
+            if (src_nb_channels > 1) {
+                for (int c = 1; c < src_nb_channels; c++)
+                    x += load_sample(src + c * bytes, fmt);
+                x /= src_nb_channels;
+            }
+            *dst++ = volume_fix == 32767 ? x : x * v >> 15;
+        } else {
+            int l = load_sample(src, fmt);
+            int r = src_nb_channels > 1 ? load_sample(src + bytes, fmt) : l;
+            if (volume_fix != 32767) {
+                l = l * v >> 15;
+                r = r * v >> 15;
+            }
+            *dst++ = l;
+            *dst++ = r;
+        }
+    }
+}
+
+static void convert(IAudioDecoder_Opaque *decoder, short *dst,
+        const uint8_t *src, int nb_frames, short volume_fix) {
+    int src_ch = decoder->src_nb_channels;
+    int dst_ch = decoder->dst_nb_channels;
+    // constant formats let each call inline its own loop
+    switch (decoder->sample_fmt) {
+    case WAV_SAMPLE_S16:
+        convert_frames(dst, src, nb_frames, WAV_SAMPLE_S16,
+            src_ch, dst_ch, volume_fix);
+        break;
+    case WAV_SAMPLE_S24:
+        convert_frames(dst, src, nb_frames, WAV_SAMPLE_S24,
+            src_ch, dst_ch, volume_fix);
+        break;
+    case WAV_SAMPLE_S32:
+        convert_frames(dst, src, nb_frames, WAV_SAMPLE_S32,
+            src_ch, dst_ch, volume_fix);
+        break;
+    default:
+        convert_frames(dst, src, nb_frames, WAV_SAMPLE_F32,
+            src_ch, dst_ch, volume_fix);
+        break;
+    }
+}
+
+static inline float load_sample_flt(const uint8_t *p,
+        enum WavSampleFormat fmt) {
+    switch (fmt) {
+    case WAV_SAMPLE_S16: {
+        int16_t v;
+        memcpy(&v, p, sizeof(v));
+        return v * (1.0f / 32768.0f);
+    }
+    case WAV_SAMPLE_S24:
+        return (int32_t)((uint32_t)p[0] << 8 | (uint32_t)p[1] << 16
+            | (uint32_t)p[2] << 24) * (1.0f / 2147483648.0f);
+    case WAV_SAMPLE_S32: {
+        int32_t v;
+        memcpy(&v, p, sizeof(v));
+        return v * (1.0f / 2147483648.0f);
+    }
+    default: {
+        float v;
+        memcpy(&v, p, sizeof(v));
+        return v;
+    }
+    }
+}
+
+static inline __attribute__((always_inline)) void convert_frames_flt(
+        float *dst, const uint8_t *src, int nb_frames,
+        enum WavSampleFormat fmt, int src_nb_channels, int dst_nb_channels,
+        float volume) {
+    const int bytes = fmt == WAV_SAMPLE_S16 ? 2 : (fmt == WAV_SAMPLE_S24 ? 3 : 4);
+    const int frame_bytes = bytes * src_nb_channels;
+
+    for (int i = 0; i < nb_frames; i++, src += frame_bytes) {
+        if (dst_nb_channels == 1) {
+            float x = load_sample_flt(src, fmt);
+            if (src_nb_channels > 1) {
+                for (int c = 1; c < src_nb_channels; c++)
+                    x += load_sample_flt(src + c * bytes, fmt);
+                x *= 1.0f / src_nb_channels;
+            }
+            *dst++ = x * volume;
+        } else {
+            float l = load_sample_flt(src, fmt);
+            float r = src_nb_channels > 1 ?
+                load_sample_flt(src + bytes, fmt) : l;
+            *dst++ = l * volume;
+            *dst++ = r * volume;
+        }
+    }
+}
+
+static void convert_flt(IAudioDecoder_Opaque *decoder, float *dst,
+        const uint8_t *src, int nb_frames) {
+    int src_ch = decoder->src_nb_channels;
+    int dst_ch = decoder->dst_nb_channels;
+    float volume = decoder->volume_flp;
+    switch (decoder->sample_fmt) {
+    case WAV_SAMPLE_S16:
+        convert_frames_flt(dst, src, nb_frames, WAV_SAMPLE_S16,
+            src_ch, dst_ch, volume);
+        break;
+    case WAV_SAMPLE_S24:
+        convert_frames_flt(dst, src, nb_frames, WAV_SAMPLE_S24,
+            src_ch, dst_ch, volume);
+        break;
+    case WAV_SAMPLE_S32:
+        convert_frames_flt(dst, src, nb_frames, WAV_SAMPLE_S32,
+            src_ch, dst_ch, volume);
+        break;
+    default:
+        convert_frames_flt(dst, src, nb_frames, WAV_SAMPLE_F32,
+            src_ch, dst_ch, volume);
+        break;
+    }
+}
+
+static void map_readahead(IAudioDecoder_Opaque *decoder, int64_t pos) {
+    if (pos + (READAHEAD_BYTES >> 1) < decoder->readahead_pos)
+        return;
+
+    int64_t page_size = sysconf(_SC_PAGESIZE);
+    int64_t from = pos > decoder->readahead_pos ? pos : decoder->readahead_pos;
+    from -= from % page_size;
+    if (from >= (int64_t)decoder->map_size)
+        return;
+    int64_t len = READAHEAD_BYTES;
+    if (from + len > (int64_t)decoder->map_size)
+        len = decoder->map_size - from;
+    madvise((void *)(decoder->map + from), len, MADV_WILLNEED);
+    decoder->readahead_pos = from + len;
+}
+
+static inline int64_t frame_offset(IAudioDecoder_Opaque *decoder,
+        int64_t frame) {
+    return decoder->data_offset + frame * decoder->frame_bytes;
+}
+
+static void map_seek(IAudioDecoder_Opaque *decoder, int64_t frame) {
+    decoder->map_pos = frame;
+    decoder->readahead_pos = 0;
+    map_readahead(decoder, frame_offset(decoder, frame));
+}
+
+// read up to nb_frames frames at the output channels and format,
+// return the frames read
+static int read_map(IAudioDecoder_Opaque *decoder, void *buffer,
+        int nb_frames, bool loop, short volume_fix) {
+    int64_t start = decoder->crop_start_frame;
+    int64_t end = decoder->crop_end_frame;
+    int dst_nb_channels = decoder->dst_nb_channels;
+
+    int ret = 0;
+    while (nb_frames > 0) {
+        if (decoder->map_pos >= end) {
+            if (!loop || end <= start) break;
+            map_seek(decoder, start);
+        }
+        int64_t n = end - decoder->map_pos;
+        if (n > nb_frames) n = nb_frames;
+        map_readahead(decoder, frame_offset(decoder, decoder->map_pos + n));
+
+        const uint8_t *src =
+            decoder->map + frame_offset(decoder, decoder->map_pos);
+        if (decoder->out_flt) {
+            convert_flt(decoder, (float *)buffer + ret * dst_nb_channels,
+                src, n);
+        } else {
+            convert(decoder, (short *)buffer + ret * dst_nb_channels,
+                src, n, volume_fix);
+        }
+        decoder->map_pos += n;
+        ret += n;
+        nb_frames -= n;
+    }
+    return ret;
+}
+
+static void reset_resampler(IAudioDecoder_Opaque *decoder) {
+    pcm_resampler_reset(decoder->resampler);
+    decoder->rs_len = 0;
+    decoder->rs_pos = 0;
+    decoder->rs_flushed = false;
+}
+
+static int read_resampled(IAudioDecoder_Opaque *decoder, short *buffer,
+        int nb_frames, bool loop) {
+    int dst_nb_channels = decoder->dst_nb_channels;
+
+    int ret = 0;
+    while (ret < nb_frames) {
+        if (decoder->rs_pos < decoder->rs_len) {
+            int n = decoder->rs_len - decoder->rs_pos;
+            if (n > nb_frames - ret) n = nb_frames - ret;
+            memcpy(buffer + ret * dst_nb_channels,
+                decoder->rs_buffer + decoder->rs_pos * dst_nb_channels,
+                n * dst_nb_channels * sizeof(short));
+            decoder->rs_pos += n;
+            ret += n;
+            continue;
+        }
+        if (decoder->rs_flushed)
+            break;
+
+        // the gain is applied before resampling, the resampler only
+        // sees the output channels
+        int n = read_map(decoder, decoder->src_buffer,
+            decoder->max_src_frames, loop, decoder->volume_fix);
+        decoder->rs_pos = 0;
+        if (n > 0) {
+            decoder->rs_len = pcm_resampler_process(decoder->resampler,
+                decoder->src_buffer, n, decoder->rs_buffer);
+        } else {
+            decoder->rs_len = pcm_resampler_flush(decoder->resampler,
+                decoder->rs_buffer);
+            decoder->rs_flushed = true;
+        }
+        if (decoder->rs_len < 0) {
+            int err = decoder->rs_len;
+            decoder->rs_len = 0;
+            return err;
+        }
+    }
+    return ret;
+}
+
+static int parse_header(IAudioDecoder_Opaque *decoder, const char *file_addr) {
+    WavContext wav_ctx;
+    memset(&wav_ctx, 0, sizeof(wav_ctx));
+    if (wav_read_header(file_addr, &wav_ctx) < 0 || !wav_ctx.is_wav)
+        return -1;
+
+    WavHeader *header = &wav_ctx.header;
+    int bits = header->bits_per_sample;
+    if (header->audio_format == WAV_FORMAT_IEEE_FLOAT && bits == 32) {
+        decoder->sample_fmt = WAV_SAMPLE_F32;
+    } else if (header->audio_format == WAV_FORMAT_PCM && bits == 16) {
+        decoder->sample_fmt = WAV_SAMPLE_S16;
+    } else if (header->audio_format == WAV_FORMAT_PCM && bits == 24) {
+        decoder->sample_fmt = WAV_SAMPLE_S24;
+    } else if (header->audio_format == WAV_FORMAT_PCM && bits == 32) {
+        decoder->sample_fmt = WAV_SAMPLE_S32;
+    } else {
+        LogInfo("%s unsupported format 0x%x, %d bits.\n", __func__,
+            header->audio_format, bits);
+        return -1;
+    }
+    if (header->nb_channels <= 0 || header->sample_rate <= 0
+            || header->block_align != header->nb_channels * bits / 8) {
+        LogInfo("%s unsupported layout, nb_channels %d block_align %d.\n",
+            __func__, header->nb_channels, header->block_align);
+        return -1;
+    }
+
+    decoder->src_sample_rate_in_Hz = header->sample_rate;
+    decoder->src_nb_channels = header->nb_channels;
+    decoder->frame_bytes = header->block_align;
+    decoder->data_offset = wav_ctx.pcm_data_offset;
+    // a streamed file may leave the data size unset or too large
+    int64_t data_size = header->data_size;
+    if (data_size > (int64_t)wav_ctx.file_size - decoder->data_offset)
+        data_size = (int64_t)wav_ctx.file_size - decoder->data_offset;
+    decoder->nb_frames = data_size > 0 ? data_size / decoder->frame_bytes : 0;
+    return 0;
+}
+
+static int map_file(IAudioDecoder_Opaque *decoder) {
+    FILE *reader = NULL;
+    int ret = ae_open_file(&reader, decoder->file_addr, false);
+    if (ret < 0)
+        return ret;
+
+    size_t size = frame_offset(decoder, decoder->nb_frames);
+    void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fileno(reader), 0);
+    fclose(reader);
+    if (map == MAP_FAILED) {
+        LogWarning("%s mmap %s failed.\n", __func__, decoder->file_addr);
+        return -1;
+    }
+    madvise(map, size, MADV_SEQUENTIAL);
+    decoder->map = (const uint8_t *)map;
+    decoder->map_size = size;
+    return 0;
+}
+
+static int64_t ms_to_frames(IAudioDecoder_Opaque *decoder, int time_ms) {
+    return (int64_t)time_ms * decoder->src_sample_rate_in_Hz / 1000;
+}
+
+static void WavDecoder_free(IAudioDecoder_Opaque *decoder) {
+    LogInfo("%s\n", __func__);
+    if (NULL == decoder)
+        return;
+
+    if (decoder->file_addr) {
+        av_freep(&decoder->file_addr);
+    }
+    if (decoder->map) {
+        munmap((void *)decoder->map, decoder->map_size);
+        decoder->map = NULL;
+        decoder->map_size = 0;
+    }
+    pcm_resampler_freep(&decoder->resampler);
+    if (decoder->src_buffer) {
+        free(decoder->src_buffer);
+        decoder->src_buffer = NULL;
+    }
+    if (decoder->rs_buffer) {
+        free(decoder->rs_buffer);
+        decoder->rs_buffer = NULL;
+    }
+}
+
+static int WavDecoder_get_pcm_frame(
+        IAudioDecoder_Opaque *decoder, short *buffer,
+        int buffer_size_in_short, bool loop) {
+    int ret = -1;
+    if (!decoder || !buffer || buffer_size_in_short < 0)
+        return ret;
+    if (decoder->decode_completed) return PCM_FILE_EOF;
+
+    int nb_frames = buffer_size_in_short / decoder->dst_nb_channels;
+    if (decoder->resampler)
+        ret = read_resampled(decoder, buffer, nb_frames, loop);
+    else
+        ret = read_map(decoder, buffer, nb_frames, loop, decoder->volume_fix);
+    if (ret < 0)
+        return ret;
+    if (ret == 0) {
+        decoder->decode_completed = true;
+        return PCM_FILE_EOF;
+    }
+    return ret * decoder->dst_nb_channels;
+}
+
+static int WavDecoder_get_pcm_frame_flt(
+        IAudioDecoder_Opaque *decoder, float *buffer,
+        int buffer_size, bool loop) {
+    int ret = -1;
+    if (!decoder || !buffer || buffer_size < 0)
+        return ret;
+    if (decoder->decode_completed) return PCM_FILE_EOF;
+
+    ret = read_map(decoder, buffer, buffer_size / decoder->dst_nb_channels,
+        loop, decoder->volume_fix);
+    if (ret == 0) {
+        decoder->decode_completed = true;
+        return PCM_FILE_EOF;
+    }
+    return ret * decoder->dst_nb_channels;
+}
+
+static int WavDecoder_seekTo(IAudioDecoder_Opaque *decoder,
+        int seek_pos_ms) {
+    LogInfo("%s seek_pos_ms %d\n", __func__, seek_pos_ms);
+    if (NULL == decoder)
+        return -1;
+
+    decoder->decode_completed = false;
+    seek_pos_ms = seek_pos_ms < 0 ? 0 : seek_pos_ms;
+    int file_duration = decoder->duration_ms;
+    if (file_duration > 0 && seek_pos_ms != file_duration) {
+        seek_pos_ms = seek_pos_ms % file_duration;
+    }
+
+    int64_t frame = decoder->crop_start_frame
+        + ms_to_frames(decoder, seek_pos_ms);
+    if (frame > decoder->crop_end_frame) frame = decoder->crop_end_frame;
+    if (decoder->resampler) reset_resampler(decoder);
+    map_seek(decoder, frame);
+    return 0;
+}
+
+static int WavDecoder_set_crop_pos(
+    IAudioDecoder_Opaque *decoder, int crop_start_time_ms,
+    int crop_end_time_ms) {
+    LogInfo("%s\n", __func__);
+    if (!decoder)
+        return -1;
+
+    int file_duration = decoder->nb_frames * 1000
+        / decoder->src_sample_rate_in_Hz;
+    decoder->crop_start_time_in_ms = crop_start_time_ms < 0 ? 0 :
+        (crop_start_time_ms > file_duration ? file_duration : crop_start_time_ms);
+    decoder->crop_end_time_in_ms = crop_end_time_ms < 0 ? 0 :
+        (crop_end_time_ms > file_duration ? file_duration : crop_end_time_ms);
+    decoder->duration_ms =
+        decoder->crop_end_time_in_ms - decoder->crop_start_time_in_ms;
+
+    decoder->crop_start_frame =
+        ms_to_frames(decoder, decoder->crop_start_time_in_ms);
+    decoder->crop_end_frame =
+        ms_to_frames(decoder, decoder->crop_end_time_in_ms);
+    if (decoder->crop_end_frame > decoder->nb_frames)
+        decoder->crop_end_frame = decoder->nb_frames;
+    LogInfo("%s crop_start_time %d crop_end_time %d duration %d.\n", __func__,
+        decoder->crop_start_time_in_ms, decoder->crop_end_time_in_ms,
+        decoder->duration_ms);
+
+    decoder->decode_completed = false;
+    if (decoder->resampler) reset_resampler(decoder);
+    map_seek(decoder, decoder->crop_start_frame);
+    return decoder->duration_ms;
+}
+
+static int init_decoder(IAudioDecoder_Opaque *decoder, const char *file_addr,
+        int dst_sample_rate, int dst_nb_channels, float volume_flp,
+        bool out_flt) {
+    int ret = -1;
+    if (dst_sample_rate <= 0 || dst_nb_channels < 1 || dst_nb_channels > 2)
+        return ret;
+
+    if ((ret = parse_header(decoder, file_addr)) < 0)
+        return ret;
+    // pcm_resampler works on s16, swr resamples float output
+    if (out_flt && decoder->src_sample_rate_in_Hz != dst_sample_rate)
+        return -1;
+    if ((ret = CopyString(file_addr, &decoder->file_addr)) < 0) {
+        LogError("%s CopyString failed\n", __func__);
+        return ret;
+    }
+    if (decoder->nb_frames <= 0 || (ret = map_file(decoder)) < 0)
+        return -1;
+
+    decoder->volume_fix = (short)(32767 * volume_flp);
+    decoder->volume_flp = volume_flp;
+    decoder->out_flt = out_flt;
+    decoder->dst_sample_rate_in_Hz = dst_sample_rate;
+    decoder->dst_nb_channels = dst_nb_channels;
+    decoder->crop_start_frame = 0;
+    decoder->crop_end_frame = decoder->nb_frames;
+    decoder->duration_ms = decoder->nb_frames * 1000
+        / decoder->src_sample_rate_in_Hz;
+    map_seek(decoder, 0);
+
+    if (decoder->src_sample_rate_in_Hz != dst_sample_rate) {
+        decoder->resampler = pcm_resampler_create(
+            decoder->src_sample_rate_in_Hz, dst_sample_rate, dst_nb_channels);
+        if (!decoder->resampler) {
+            LogError("%s pcm_resampler_create failed.\n", __func__);
+            return -1;
+        }
+        decoder->max_src_frames = MAX_NB_SAMPLES / dst_nb_channels;
+        int max_out_frames = pcm_resampler_max_out_frames(decoder->resampler,
+            decoder->max_src_frames);
+        decoder->src_buffer = (short *)calloc(MAX_NB_SAMPLES, sizeof(short));
+        decoder->rs_buffer = (short *)calloc(
+            max_out_frames * dst_nb_channels, sizeof(short));
+        if (!decoder->src_buffer || !decoder->rs_buffer) {
+            LogError("%s calloc resample buffers failed.\n", __func__);
+            return AEERROR_NOMEM;
+        }
+        reset_resampler(decoder);
+    }
+    return 0;
+}
+
+IAudioDecoder *WavDecoder_create(const char *file_addr,
+        int dst_sample_rate, int dst_nb_channels, float volume_flp,
+        enum DecoderSampleFormat sample_fmt) {
+    LogInfo("%s.\n", __func__);
+    if (!file_addr) {
+        LogError("%s file_addr is NULL.\n", __func__);
+        return NULL;
+    }
+
+    IAudioDecoder *decoder = IAudioDecoder_create(sizeof(IAudioDecoder_Opaque));
+    if (!decoder) {
+        LogError("%s Could not allocate IAudioDecoder.\n", __func__);
+        return NULL;
+    }
+
+    decoder->func_set_crop_pos = WavDecoder_set_crop_pos;
+    decoder->func_seekTo = WavDecoder_seekTo;
+    decoder->func_free = WavDecoder_free;
+    bool out_flt = sample_fmt == DECODER_SAMPLE_FMT_FLT;
+    if (out_flt) {
+        decoder->func_get_pcm_frame_flt = WavDecoder_get_pcm_frame_flt;
+    } else {
+        decoder->func_get_pcm_frame = WavDecoder_get_pcm_frame;
+    }
+    decoder->out_sample_fmt = sample_fmt;
+
+    IAudioDecoder_Opaque *opaque = decoder->opaque;
+    if (init_decoder(opaque, file_addr, dst_sample_rate,
+            dst_nb_channels, volume_flp, out_flt) < 0) {
+        LogInfo("%s %s is not served natively.\n", __func__, file_addr);
+        goto end;
+    }
+    decoder->out_sample_rate = opaque->dst_sample_rate_in_Hz;
+    decoder->out_nb_channels = opaque->dst_nb_channels;
+    decoder->out_bits_per_sample = out_flt ? 32 : BITS_PER_SAMPLE_16;
+    decoder->duration_ms = opaque->duration_ms;
+
+    return decoder;
+end:
+    if (decoder) {
+        IAudioDecoder_freep(&decoder);
+    }
+    return NULL;
+}
@@ -0,0 +1,17 @@
+#ifndef WAV_DECODER_H
+#define WAV_DECODER_H
+#include "idecoder.h"
+
+/**
+ * @brief open a plain wav file, pcm s16/s24/s32 or float32 with any
+ *        number of channels, read straight from a mapping of the file
+ *
+ * @param sample_fmt output format, float output needs the source rate
+ * @return NULL if the file is not such a wav file or could not be mapped,
+ *         the caller falls back to FFmpegDecoder then
+ */
+IAudioDecoder *WavDecoder_create(const char *file_addr,
+    int dst_sample_rate, int dst_nb_channels, float volume_flp,
+    enum DecoderSampleFormat sample_fmt);
+
+#endif // WAV_DECODER_H
@@ -11,24 +11,51 @@
 #include "log.h"
 #include "tools/conversion.h"
 #include "tools/fifo.h"
-#include "tools/sdl_mutex.h"
+#include "tools/param_snapshot.h"
 #include "tools/util.h"
 
-#define SAMPLE_RATE 44100
+enum BeautifyMode {
+    BEAUTIFY_NONE = 0,
+    CLEAN_VOICE,
+    BASS,
+    LOW_VOICE,
+    PENETRATING,
+    MAGNETIC,
+    SOFT_PITCH,
+    NB_BEAUTIFY_MODES
+};
+
+typedef struct {
+    enum BeautifyMode mode;
+} params_t;
+
+// the effects of one mode, set() builds them the first time it is chosen
+typedef struct {
+    enum EqualizerMode eq_mode;
+    Compressor *compressor;
+    MulCompressor *mul_compressor;
+    Flanger *flanger;
+} preset_t;
+
 typedef struct {
     fifo *fifo_in;
     fifo *fifo_out;
-    SdlMutex *sdl_mutex;
-    bool is_beautify_on;
+    ParamSnapshot *snapshot;
     float flp_buffer[MAX_NB_SAMPLES];
     short fix_buffer[MAX_NB_SAMPLES];
     Equalizer *equalizer;
-    Compressor *compressor;
-    MulCompressor *mul_compressor;
-    Flanger *flanger;
+    preset_t presets[NB_BEAUTIFY_MODES];
+    // the preset of the mode the audio thread runs, NULL if none
+    preset_t *preset;
     Limiter *limiter;
 } priv_t;
 
+static void preset_free(preset_t *preset) {
+    if (preset->compressor) CompressorFree(&preset->compressor);
+    if (preset->mul_compressor) MulCompressorFree(&preset->mul_compressor);
+    if (preset->flanger) FlangerFree(&preset->flanger);
+}
+
 static int beautify_close(EffectContext *ctx) {
     LogInfo("%s.\n", __func__);
     assert(NULL != ctx);
@@ -37,11 +64,11 @@ static int beautify_close(EffectContext *ctx) {
         priv_t *priv = (priv_t *)ctx->priv;
         if (priv->fifo_in) fifo_delete(&priv->fifo_in);
         if (priv->fifo_out) fifo_delete(&priv->fifo_out);
-        if (priv->sdl_mutex) sdl_mutex_free(&priv->sdl_mutex);
+        if (priv->snapshot) param_snapshot_freep(&priv->snapshot);
         if (priv->equalizer) EqualizerFree(&priv->equalizer);
-        if (priv->compressor) CompressorFree(&priv->compressor);
-        if (priv->mul_compressor) MulCompressorFree(&priv->mul_compressor);
-        if (priv->flanger) FlangerFree(&priv->flanger);
+        for (int mode = 0; mode < NB_BEAUTIFY_MODES; ++mode)
+            preset_free(&priv->presets[mode]);
+        priv->preset = NULL;
         if (priv->limiter) LimiterFree(&priv->limiter);
     }
     return 0;
@@ -57,31 +84,15 @@ static int beautify_init(EffectContext *ctx, int argc, const char **argv) {
     if (NULL == priv) return AEERROR_NULL_POINT;
 
     int ret = 0;
-    priv->equalizer = EqualizerCreate(SAMPLE_RATE);
+    const int sample_rate = ctx->in_signal.sample_rate;
+    const int channels = ctx->in_signal.channels;
+    priv->equalizer = EqualizerCreate(sample_rate, channels);
     if (NULL == priv->equalizer) {
         ret = AEERROR_NOMEM;
         goto end;
     }
 
-    priv->compressor = CompressorCreate(SAMPLE_RATE);
-    if (NULL == priv->compressor) {
-        ret = AEERROR_NOMEM;
-        goto end;
-    }
-
-    priv->mul_compressor = MulCompressorCreate(SAMPLE_RATE);
-    if (NULL == priv->compressor) {
-        ret = AEERROR_NOMEM;
-        goto end;
-    }
-
-    priv->flanger = FlangerCreate(SAMPLE_RATE);
-    if (NULL == priv->flanger) {
-        ret = AEERROR_NOMEM;
-        goto end;
-    }
-
-    priv->limiter = LimiterCreate(SAMPLE_RATE);
+    priv->limiter = LimiterCreate(sample_rate, channels);
     if (NULL == priv->limiter) {
         ret = AEERROR_NOMEM;
         goto end;
@@ -99,12 +110,12 @@ static int beautify_init(EffectContext *ctx, int argc, const char **argv) {
         ret = AEERROR_NOMEM;
         goto end;
     }
-    priv->sdl_mutex = sdl_mutex_create();
-    if (NULL == priv->sdl_mutex) {
+    params_t params = {.mode = BEAUTIFY_NONE};
+    priv->snapshot = param_snapshot_create(sizeof(params_t), &params);
+    if (NULL == priv->snapshot) {
         ret = AEERROR_NOMEM;
         goto end;
     }
-    priv->is_beautify_on = false;
 
 end:
     if (ret < 0) beautify_close(ctx);
@@ -112,82 +123,143 @@ end:
 }
 
 // 清晰人声
-static void create_clean_voice(priv_t *priv) {
-    EqualizerSetMode(priv->equalizer, EqCleanVoice);
-    CompressorSet(priv->compressor, -19.8f, 3.01f, 2.0f, 50.0f, 5.5f);
-    MulCompressorSetMode(priv->mul_compressor, MulComCleanVoice);
-    FlangerSet(priv->flanger, 0.0f, 0.0f, 0.0f, 0.0f, 0.1f, WAVE_SINE, 0.0f);
+static void create_clean_voice(preset_t *preset) {
+    preset->eq_mode = EqCleanVoice;
+    CompressorSet(preset->compressor, -19.8f, 3.01f, 2.0f, 50.0f, 5.5f);
+    MulCompressorSetMode(preset->mul_compressor, MulComCleanVoice);
+    FlangerSet(preset->flanger, 0.0f, 0.0f, 0.0f, 0.0f, 0.1f, WAVE_SINE, 0.0f);
 }
 
 // 低音
-static void create_bass_effect(priv_t *priv) {
+static void create_bass_effect(preset_t *preset) {
     // 低音 -> 沉稳
-    EqualizerSetMode(priv->equalizer, EqBass);
-    CompressorSet(priv->compressor, -24.2f, 5.0f, 3.76f, 50.0f, 5.7f);
-    MulCompressorSetMode(priv->mul_compressor, MulComBass);
-    FlangerSet(priv->flanger, 0.0f, 0.0f, 0.0f, 0.0f, 0.1f, WAVE_SINE, 0.0f);
+    preset->eq_mode = EqBass;
+    CompressorSet(preset->compressor, -24.2f, 5.0f, 3.76f, 50.0f, 5.7f);
+    MulCompressorSetMode(preset->mul_compressor, MulComBass);
+    FlangerSet(preset->flanger, 0.0f, 0.0f, 0.0f, 0.0f, 0.1f, WAVE_SINE, 0.0f);
 }
 // 低沉
-static void create_low_voice(priv_t *priv) {
+static void create_low_voice(preset_t *preset) {
     // 低沉 -> 低音
-    EqualizerSetMode(priv->equalizer, EqLowVoice);
-    CompressorSet(priv->compressor, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f);
-    MulCompressorSetMode(priv->mul_compressor, MulComLowVoice);
-    FlangerSet(priv->flanger, 0.0f, 0.0f, 0.0f, 0.0f, 0.1f, WAVE_SINE, 0.0f);
+    preset->eq_mode = EqLowVoice;
+    CompressorSet(preset->compressor, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f);
+    MulCompressorSetMode(preset->mul_compressor, MulComLowVoice);
+    FlangerSet(preset->flanger, 0.0f, 0.0f, 0.0f, 0.0f, 0.1f, WAVE_SINE, 0.0f);
 }
 
 // 穿透
-static void create_penetrating_effect(priv_t *priv) {
+static void create_penetrating_effect(preset_t *preset) {
     // 穿透
-    EqualizerSetMode(priv->equalizer, EqPenetrating);
-    CompressorSet(priv->compressor, -21.0f, 3.22f, 1.0f, 40.0f, 9.0f);
-    MulCompressorSetMode(priv->mul_compressor, MulComPenetrating);
-    FlangerSet(priv->flanger, 0.0f, 0.0f, 0.0f, 0.0f, 0.1f, WAVE_SINE, 0.0f);
+    preset->eq_mode = EqPenetrating;
+    CompressorSet(preset->compressor, -21.0f, 3.22f, 1.0f, 40.0f, 9.0f);
+    MulCompressorSetMode(preset->mul_compressor, MulComPenetrating);
+    FlangerSet(preset->flanger, 0.0f, 0.0f, 0.0f, 0.0f, 0.1f, WAVE_SINE, 0.0f);
 }
 
 // 磁性
-static void create_magnetic_effect(priv_t *priv) {
+static void create_magnetic_effect(preset_t *preset) {
     // 磁性
-    EqualizerSetMode(priv->equalizer, EqMagnetic);
-    CompressorSet(priv->compressor, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f);
-    MulCompressorSetMode(priv->mul_compressor, MulComMagnetic);
-    FlangerSet(priv->flanger, 0.0f, 2.0f, 10.0f, 20.0f, 1.5f, WAVE_SINE, 25.0f);
+    preset->eq_mode = EqMagnetic;
+    CompressorSet(preset->compressor, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f);
+    MulCompressorSetMode(preset->mul_compressor, MulComMagnetic);
+    FlangerSet(preset->flanger, 0.0f, 2.0f, 10.0f, 20.0f, 1.5f, WAVE_SINE, 25.0f);
 }
 
 // 柔和高音
-static void create_soft_pitch(priv_t *priv) {
+static void create_soft_pitch(preset_t *preset) {
     // 柔和高音
-    EqualizerSetMode(priv->equalizer, EqSoftPitch);
-    CompressorSet(priv->compressor, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f);
-    MulCompressorSetMode(priv->mul_compressor, MulComSoftPitch);
-    FlangerSet(priv->flanger, 0.0f, 0.0f, 0.0f, 0.0f, 0.1f, WAVE_SINE, 0.0f);
+    preset->eq_mode = EqSoftPitch;
+    CompressorSet(preset->compressor, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f);
+    MulCompressorSetMode(preset->mul_compressor, MulComSoftPitch);
+    FlangerSet(preset->flanger, 0.0f, 0.0f, 0.0f, 0.0f, 0.1f, WAVE_SINE, 0.0f);
 }
 
-static void beautify_set_mode(priv_t *priv, const char *mode) {
-    LogInfo("%s mode = %s.\n", __func__, mode);
-    sdl_mutex_lock(priv->sdl_mutex);
+// control thread, the audio thread only picks the preset up once published
+static int preset_create(preset_t *preset, enum BeautifyMode mode,
+                         int sample_rate, int channels) {
+    if (preset->compressor) return 0;
 
-    priv->is_beautify_on = true;
+    preset->compressor = CompressorCreate(sample_rate, channels);
+    preset->mul_compressor = MulCompressorCreate(sample_rate, channels);
+    preset->flanger = FlangerCreate(sample_rate, channels);
+    if (NULL == preset->compressor || NULL == preset->mul_compressor ||
+        NULL == preset->flanger) {
+        preset_free(preset);
+        return AEERROR_NOMEM;
+    }
 
-    if (0 == strcasecmp(mode, "None")) {
-        priv->is_beautify_on = false;
-    } else if (0 == strcasecmp(mode, "CleanVoice")) {
-        create_clean_voice(priv);
+    switch (mode) {
+        case CLEAN_VOICE:
+            create_clean_voice(preset);
+            break;
+        case BASS:
+            create_bass_effect(preset);
+            break;
+        case LOW_VOICE:
+            create_low_voice(preset);
+            break;
+        case PENETRATING:
+            create_penetrating_effect(preset);
+            break;
+        case MAGNETIC:
+            create_magnetic_effect(preset);
+            break;
+        case SOFT_PITCH:
+            create_soft_pitch(preset);
+            break;
+        default:
+            break;
+    }
+    return 0;
+}
+
+static int beautify_set_mode(EffectContext *ctx, const char *mode) {
+    priv_t *priv = (priv_t *)ctx->priv;
+    LogInfo("%s mode = %s.\n", __func__, mode);
+    params_t params = {.mode = BEAUTIFY_NONE};
+
+    if (0 == strcasecmp(mode, "CleanVoice")) {
+        params.mode = CLEAN_VOICE;
     } else if (0 == strcasecmp(mode, "Bass")) {
-        create_bass_effect(priv);
+        params.mode = BASS;
     } else if (0 == strcasecmp(mode, "LowVoice")) {
-        create_low_voice(priv);
+        params.mode = LOW_VOICE;
     } else if (0 == strcasecmp(mode, "Penetrating")) {
-        create_penetrating_effect(priv);
+        params.mode = PENETRATING;
     } else if (0 == strcasecmp(mode, "Magnetic")) {
-        create_magnetic_effect(priv);
+        params.mode = MAGNETIC;
     } else if (0 == strcasecmp(mode, "SoftPitch")) {
-        create_soft_pitch(priv);
-    } else {
-        priv->is_beautify_on = false;
+        params.mode = SOFT_PITCH;
+    }
+
+    if (params.mode != BEAUTIFY_NONE &&
+        preset_create(&priv->presets[params.mode], params.mode,
+                      ctx->in_signal.sample_rate,
+                      ctx->in_signal.channels) < 0) {
+        LogError("%s preset_create failed.\n", __func__);
+        return AEERROR_NOMEM;
     }
+    return param_snapshot_publish(priv->snapshot, &params);
+}
 
-    sdl_mutex_unlock(priv->sdl_mutex);
+// audio thread, once per block
+static bool is_beautify_on(priv_t *priv) {
+    bool changed = false;
+    const params_t *params = param_snapshot_acquire(priv->snapshot, &changed);
+    if (changed) {
+        preset_t *preset = NULL;
+        if (params->mode != BEAUTIFY_NONE)
+            preset = &priv->presets[params->mode];
+        // a new mode starts from silence, an unchanged one goes on
+        if (preset != priv->preset && preset) {
+            EqualizerSetMode(priv->equalizer, preset->eq_mode);
+            CompressorReset(preset->compressor);
+            MulCompressorReset(preset->mul_compressor);
+            FlangerReset(preset->flanger);
+        }
+        priv->preset = preset;
+    }
+    return priv->preset != NULL;
 }
 
 static int beautify_set(EffectContext *ctx, const char *key, int flags) {
@@ -195,12 +267,30 @@ static int beautify_set(EffectContext *ctx, const char *key, int flags) {
     AEDictionaryEntry *entry = ae_dict_get(ctx->options, key, NULL, flags);
     if (entry) {
         if (0 == strcasecmp(entry->key, "mode")) {
-            beautify_set_mode(ctx->priv, entry->value);
+            if (beautify_set_mode(ctx, entry->value) < 0)
+                return AEERROR_NOMEM;
         }
     }
     return 0;
 }
 
+static int beautify_reset(EffectContext *ctx) {
+    assert(NULL != ctx);
+    priv_t *priv = (priv_t *)ctx->priv;
+    if (NULL == priv) return AEERROR_NULL_POINT;
+
+    fifo_clear(priv->fifo_in);
+    fifo_clear(priv->fifo_out);
+    EqualizerReset(priv->equalizer);
+    if (priv->preset) {
+        CompressorReset(priv->preset->compressor);
+        MulCompressorReset(priv->preset->mul_compressor);
+        FlangerReset(priv->preset->flanger);
+    }
+    LimiterReset(priv->limiter);
+    return 0;
+}
+
 static int beautify_send(EffectContext *ctx, const void *samples,
                          const size_t nb_samples) {
     assert(NULL != ctx);
@@ -218,29 +308,30 @@ static int beautify_receive(EffectContext *ctx, void *samples,
     assert(NULL != priv);
     assert(NULL != priv->fifo_in);
 
-    sdl_mutex_lock(priv->sdl_mutex);
-    if (priv->is_beautify_on) {
-        int nb_samples =
-            fifo_read(priv->fifo_in, priv->fix_buffer, MAX_NB_SAMPLES);
+    // whole frames only
+    const int block = MAX_NB_SAMPLES / ctx->in_signal.channels *
+                      ctx->in_signal.channels;
+    if (is_beautify_on(priv)) {
+        int nb_samples = fifo_read(priv->fifo_in, priv->fix_buffer, block);
         while (nb_samples > 0) {
             S16ToFloat(priv->fix_buffer, priv->flp_buffer, nb_samples);
             // 均衡器处理
             EqualizerProcess(priv->equalizer, priv->flp_buffer, nb_samples);
             // 单频段压缩器处理
-            nb_samples = CompressorProcess(priv->compressor, priv->flp_buffer,
-                                           nb_samples);
+            nb_samples = CompressorProcess(priv->preset->compressor,
+                                           priv->flp_buffer, nb_samples);
             // 多频段压缩器处理
-            nb_samples = MulCompressorProcess(priv->mul_compressor,
+            nb_samples = MulCompressorProcess(priv->preset->mul_compressor,
                                               priv->flp_buffer, nb_samples);
             // 镶边处理
-            FlangerProcess(priv->flanger, priv->flp_buffer, nb_samples);
+            FlangerProcess(priv->preset->flanger, priv->flp_buffer,
+                           nb_samples);
             // 限制器处理
             nb_samples =
                 LimiterProcess(priv->limiter, priv->flp_buffer, nb_samples);
             FloatToS16(priv->flp_buffer, priv->fix_buffer, nb_samples);
             fifo_write(priv->fifo_out, priv->fix_buffer, nb_samples);
-            nb_samples =
-                fifo_read(priv->fifo_in, priv->fix_buffer, MAX_NB_SAMPLES);
+            nb_samples = fifo_read(priv->fifo_in, priv->fix_buffer, block);
         }
     } else {
         while (fifo_occupancy(priv->fifo_in) > 0) {
@@ -249,14 +340,29 @@ static int beautify_receive(EffectContext *ctx, void *samples,
         }
     }
 
-    sdl_mutex_unlock(priv->sdl_mutex);
-
     if (atomic_load(&ctx->return_max_nb_samples) &&
         fifo_occupancy(priv->fifo_out) < max_nb_samples)
         return 0;
     return fifo_read(priv->fifo_out, samples, max_nb_samples);
 }
 
+static int beautify_process(EffectContext *ctx, float *samples,
+                            const size_t nb_samples) {
+    assert(NULL != ctx);
+    priv_t *priv = (priv_t *)ctx->priv;
+    assert(NULL != priv);
+
+    if (!is_beautify_on(priv)) return nb_samples;
+
+    int ret = nb_samples;
+    const preset_t *preset = priv->preset;
+    EqualizerProcess(priv->equalizer, samples, ret);
+    ret = CompressorProcess(preset->compressor, samples, ret);
+    ret = MulCompressorProcess(preset->mul_compressor, samples, ret);
+    FlangerProcess(preset->flanger, samples, ret);
+    return LimiterProcess(priv->limiter, samples, ret);
+}
+
 const EffectHandler *effect_beautify_fn(void) {
     static EffectHandler handler = {.name = "beautify",
                                     .usage = "",
@@ -265,6 +371,9 @@ const EffectHandler *effect_beautify_fn(void) {
                                     .set = beautify_set,
                                     .send = beautify_send,
                                     .receive = beautify_receive,
-                                    .close = beautify_close};
+                                    .close = beautify_close,
+                                    .process = beautify_process,
+                                    .multichannel = true,
+                                    .reset = beautify_reset};
     return &handler;
 }
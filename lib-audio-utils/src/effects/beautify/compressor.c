@@ -2,9 +2,9 @@
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #define FFMIN(a, b) ((a) > (b) ? (b) : (a))
-#define FFMIN3(a, b, c) FFMIN(FFMIN(a, b), c)
 
 struct CompressorT {
     float output_gain;
@@ -15,6 +15,9 @@ struct CompressorT {
     float compressor_threshold_in_dB;
     float expander_slopes;
     float expander_threshold_in_dB;
+    // the thresholds as mean squares, compared with xrms
+    float compressor_threshold;
+    float expander_threshold;
     float xrms;
     float gain;
     float delay_in_sec;  /* Delay to apply before companding */
@@ -23,13 +26,33 @@ struct CompressorT {
     int delay_buf_index; /* Index into delay_buf */
     int delay_buf_cnt;   /* No. of active entries in delay_buf */
     int sample_rate;
+    int channels;
 };
 
-Compressor* CompressorCreate(const int sample_rate) {
+static void UpdateThresholds(Compressor* inst) {
+    inst->compressor_threshold =
+        powf(10.0f, inst->compressor_threshold_in_dB / 10.0f);
+    inst->expander_threshold =
+        powf(10.0f, inst->expander_threshold_in_dB / 10.0f);
+}
+
+/**
+ * 10^(slopes * (threshold_in_dB - X) / 20) with X = 10 * log10(xrms),
+ * written as a power of xrms / threshold so no log is needed, and only
+ * computed on the side of the threshold where it is below 1
+ */
+static inline float GainOf(const float xrms, const float threshold,
+                           const float slopes) {
+    if ((xrms > threshold) != (slopes > 0.0f)) return 1.0f;
+    return powf(xrms / threshold, -0.5f * slopes);
+}
+
+Compressor* CompressorCreate(const int sample_rate, const int channels) {
     Compressor* self = (Compressor*)calloc(1, sizeof(Compressor));
     if (NULL == self) return NULL;
 
     self->sample_rate = sample_rate;
+    self->channels = channels > 0 ? channels : 1;
     self->output_gain = 1.0f;
     self->xrms = 0.0f;
     self->gain = 1.0f;
@@ -38,8 +61,10 @@ Compressor* CompressorCreate(const int sample_rate) {
     self->compressor_slopes = 1.0f;
     self->expander_threshold_in_dB = -90.0f;
     self->expander_slopes = -1.0f;
+    UpdateThresholds(self);
     self->delay_in_sec = 0.001f;
-    self->delay_buf_size = self->delay_in_sec * self->sample_rate;
+    self->delay_buf_size =
+        (int)(self->delay_in_sec * self->sample_rate) * self->channels;
     self->delay_buf = (float*)calloc(self->delay_buf_size, sizeof(float));
     if (NULL == self->delay_buf) CompressorFree(&self);
 
@@ -58,6 +83,16 @@ void CompressorFree(Compressor** inst) {
     *inst = NULL;
 }
 
+void CompressorReset(Compressor* inst) {
+    if (NULL == inst) return;
+    inst->xrms = 0.0f;
+    inst->gain = 1.0f;
+    inst->delay_buf_index = 0;
+    inst->delay_buf_cnt = 0;
+    if (inst->delay_buf)
+        memset(inst->delay_buf, 0, inst->delay_buf_size * sizeof(float));
+}
+
 void CompressorSet(Compressor* inst, const float compressor_threshold_in_dB,
                    const float ratio, const float attack_time_in_ms,
                    const float decay_time_in_ms,
@@ -65,6 +100,7 @@ void CompressorSet(Compressor* inst, const float compressor_threshold_in_dB,
     // TODO: 验证为什么rms计算的幅度与原始幅度相差3dB
     inst->compressor_threshold_in_dB = compressor_threshold_in_dB;
     inst->compressor_slopes = 1.0f - 1.0f / ratio;
+    UpdateThresholds(inst);
     inst->attack_time =
         1.0f - expf(-2.2f * 1000.0f / inst->sample_rate / attack_time_in_ms);
     inst->decay_time =
@@ -79,32 +115,38 @@ int CompressorProcess(Compressor* inst, float* buffer, const int buffer_size) {
         return buffer_size;
     int nb_samples = 0;
 
-    for (int i = 0; i < buffer_size; ++i) {
+    for (int i = 0; i < buffer_size; i += inst->channels) {
+        // the loudest channel drives the gain of all of them, so the
+        // stereo image does not shift
+        float x2 = buffer[i] * buffer[i];
+        for (int c = 1; c < inst->channels; ++c)
+            x2 = fmaxf(x2, buffer[i + c] * buffer[i + c]);
         inst->xrms = (1.0f - inst->average_time) * inst->xrms +
-                     inst->average_time * buffer[i] * buffer[i];
-        float X = 10.0f * log10f(inst->xrms);
-        // float G = FFMIN(0, inst->compressor_slopes *
-        //                        (inst->compressor_threshold_in_dB - X));
-        // printf("xrms = %f X = %f\n", inst->xrms, X);
-        float G = FFMIN3(
-            0, inst->compressor_slopes * (inst->compressor_threshold_in_dB - X),
-            inst->expander_slopes * (inst->expander_threshold_in_dB - X));
-        float f = powf(10.0f, G / 20.0f);
+                     inst->average_time * x2;
+        // min(0, compressor G, expander G) in dB
+        float f = FFMIN(GainOf(inst->xrms, inst->compressor_threshold,
+                               inst->compressor_slopes),
+                        GainOf(inst->xrms, inst->expander_threshold,
+                               inst->expander_slopes));
         float coeff = f < inst->gain ? inst->attack_time : inst->decay_time;
         inst->gain = (1.0f - coeff) * inst->gain + coeff * f;
 
-        if (inst->delay_buf_size <= 0) {
-            buffer[nb_samples++] *= inst->gain * inst->output_gain;
-        } else {
-            float tmp = buffer[i];
-            if (inst->delay_buf_cnt < inst->delay_buf_size) {
-                inst->delay_buf_cnt++;
+        for (int c = 0; c < inst->channels; ++c) {
+            if (inst->delay_buf_size <= 0) {
+                buffer[nb_samples++] *= inst->gain * inst->output_gain;
             } else {
-                buffer[nb_samples++] = inst->delay_buf[inst->delay_buf_index] *
-                                       inst->gain * inst->output_gain;
+                float tmp = buffer[i + c];
+                if (inst->delay_buf_cnt < inst->delay_buf_size) {
+                    inst->delay_buf_cnt++;
+                } else {
+                    buffer[nb_samples++] =
+                        inst->delay_buf[inst->delay_buf_index] * inst->gain *
+                        inst->output_gain;
+                }
+                inst->delay_buf[inst->delay_buf_index++] = tmp;
+                if (inst->delay_buf_index == inst->delay_buf_size)
+                    inst->delay_buf_index = 0;
             }
-            inst->delay_buf[inst->delay_buf_index++] = tmp;
-            inst->delay_buf_index %= inst->delay_buf_size;
         }
     }
     return nb_samples;
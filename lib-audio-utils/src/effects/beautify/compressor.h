@@ -11,9 +11,10 @@ extern "C" {
  * @brief 创建压缩器
  *
  * @param sample_rate 输入数据的采样率
+ * @param channels 声道数，各声道共用一个增益（联动检测）
  * @return Compressor*
  */
-Compressor* CompressorCreate(const int sample_rate);
+Compressor* CompressorCreate(const int sample_rate, const int channels);
 
 /**
  * @brief 释放压缩器
@@ -21,6 +22,12 @@ Compressor* CompressorCreate(const int sample_rate);
  * @param inst
  */
 void CompressorFree(Compressor** inst);
+/**
+ * @brief 清空处理过的信号留下的状态，参数保持不变
+ *
+ * @param inst
+ */
+void CompressorReset(Compressor* inst);
 
 /**
  * @brief 设置参数
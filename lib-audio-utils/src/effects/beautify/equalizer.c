@@ -3,167 +3,161 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include "dsp_tools/iir_design/iir_design.h"
+#include <string.h>
+#include "dsp_tools/iir_design/biquad_cascade.h"
 
 #define FFMAX(a, b) ((a) > (b) ? (a) : (b))
 #define FFMIN(a, b) ((a) > (b) ? (b) : (a))
 
 #define PI 3.14159265358979323f
 
+// the presets are indexed by mode
+#define NB_EQUALIZER_MODES (EqSoftPitch + 1)
+
 struct EqualizerT {
-    Band* equalizer_bands;
-    short nb_equalizer_bands;
+    // one cascade per mode, designed on create, NULL for EqNone
+    BiquadCascade* presets[NB_EQUALIZER_MODES];
+    // the preset of the current mode
+    BiquadCascade* cascade;
     int sample_rate;
+    int channels;
 };
 
-static void CreateCleanVoice(Equalizer* inst) {
-    inst->nb_equalizer_bands = 4;
-    inst->equalizer_bands =
-        (Band*)calloc(inst->nb_equalizer_bands, sizeof(Band));
-    if (NULL == inst->equalizer_bands) return;
-
-    iir_2nd_coeffs_butterworth_highpass(inst->equalizer_bands,
-                                        inst->sample_rate, 50.0f);
-    iir_2nd_coeffs_peak(inst->equalizer_bands + 1, inst->sample_rate, 200.f,
-                        2.0f, 1.66f);
-    iir_2nd_coeffs_peak(inst->equalizer_bands + 2, inst->sample_rate, 80.f,
-                        2.0f, 1.43f);
-    iir_2nd_coeffs_high_shelf(inst->equalizer_bands + 3, inst->sample_rate,
-                              4300.0f, 0.7f, 1.74f);
-}
-
-static void CreateBassEffect(Equalizer* inst) {
-    inst->nb_equalizer_bands = 3;
-    inst->equalizer_bands =
-        (Band*)calloc(inst->nb_equalizer_bands, sizeof(Band));
-    if (NULL == inst->equalizer_bands) return;
-
-    iir_2nd_coeffs_butterworth_highpass(inst->equalizer_bands,
-                                        inst->sample_rate, 50.0f);
-    iir_2nd_coeffs_peak(inst->equalizer_bands + 1, inst->sample_rate, 150.f,
-                        2.0f, 1.95f);
-    iir_2nd_coeffs_peak(inst->equalizer_bands + 2, inst->sample_rate, 500.0f,
-                        2.0f, 1.74f);
-}
-
-static void CreateLowVoice(Equalizer* inst) {
-    inst->nb_equalizer_bands = 4;
-    inst->equalizer_bands =
-        (Band*)calloc(inst->nb_equalizer_bands, sizeof(Band));
-    if (NULL == inst->equalizer_bands) return;
-
-    iir_2nd_coeffs_butterworth_highpass(inst->equalizer_bands,
-                                        inst->sample_rate, 50.0f);
-    iir_2nd_coeffs_peak(inst->equalizer_bands + 1, inst->sample_rate, 200.f,
-                        2.0f, 1.53f);
-    iir_2nd_coeffs_peak(inst->equalizer_bands + 2, inst->sample_rate, 1250.0f,
-                        2.0f, 0.813f);
-    iir_2nd_coeffs_high_shelf(inst->equalizer_bands + 3, inst->sample_rate,
-                              7500.0f, 0.7f, 0.708f);
+static int CreateCleanVoice(Band* bands, const int sample_rate) {
+    iir_2nd_coeffs_butterworth_highpass(bands, sample_rate, 50.0f);
+    iir_2nd_coeffs_peak(bands + 1, sample_rate, 200.f, 2.0f, 1.66f);
+    iir_2nd_coeffs_peak(bands + 2, sample_rate, 80.f, 2.0f, 1.43f);
+    iir_2nd_coeffs_high_shelf(bands + 3, sample_rate, 4300.0f, 0.7f, 1.74f);
+    return 4;
 }
 
-static void CreatePenetratingEffect(Equalizer* inst) {
-    inst->nb_equalizer_bands = 2;
-    inst->equalizer_bands =
-        (Band*)calloc(inst->nb_equalizer_bands, sizeof(Band));
-    if (NULL == inst->equalizer_bands) return;
-
-    iir_2nd_coeffs_peak(inst->equalizer_bands, inst->sample_rate, 2000.f, 2.0f,
-                        1.51f);
-    iir_2nd_coeffs_high_shelf(inst->equalizer_bands + 1, inst->sample_rate,
-                              4300.0f, 0.7f, 1.74f);
+static int CreateBassEffect(Band* bands, const int sample_rate) {
+    iir_2nd_coeffs_butterworth_highpass(bands, sample_rate, 50.0f);
+    iir_2nd_coeffs_peak(bands + 1, sample_rate, 150.f, 2.0f, 1.95f);
+    iir_2nd_coeffs_peak(bands + 2, sample_rate, 500.0f, 2.0f, 1.74f);
+    return 3;
 }
 
-static void CreateMagneticEffect(Equalizer* inst) {
-    inst->nb_equalizer_bands = 3;
-    inst->equalizer_bands =
-        (Band*)calloc(inst->nb_equalizer_bands, sizeof(Band));
-    if (NULL == inst->equalizer_bands) return;
-
-    iir_2nd_coeffs_butterworth_highpass(inst->equalizer_bands,
-                                        inst->sample_rate, 50.0f);
-    iir_2nd_coeffs_peak(inst->equalizer_bands + 1, inst->sample_rate, 500.f,
-                        2.0f, 1.74f);
-    iir_2nd_coeffs_peak(inst->equalizer_bands + 2, inst->sample_rate, 1200.0f,
-                        2.0f, 1.55f);
+static int CreateLowVoice(Band* bands, const int sample_rate) {
+    iir_2nd_coeffs_butterworth_highpass(bands, sample_rate, 50.0f);
+    iir_2nd_coeffs_peak(bands + 1, sample_rate, 200.f, 2.0f, 1.53f);
+    iir_2nd_coeffs_peak(bands + 2, sample_rate, 1250.0f, 2.0f, 0.813f);
+    iir_2nd_coeffs_high_shelf(bands + 3, sample_rate, 7500.0f, 0.7f, 0.708f);
+    return 4;
 }
 
-static void CreateSoftPitch(Equalizer* inst) {
-    inst->nb_equalizer_bands = 5;
-    inst->equalizer_bands =
-        (Band*)calloc(inst->nb_equalizer_bands, sizeof(Band));
-    if (NULL == inst->equalizer_bands) return;
-
-    iir_2nd_coeffs_peak(inst->equalizer_bands, inst->sample_rate, 300.f, 2.0f,
-                        1.2f);
-    iir_2nd_coeffs_peak(inst->equalizer_bands + 1, inst->sample_rate, 1200.f,
-                        2.0f, 1.82f);
-    iir_2nd_coeffs_peak(inst->equalizer_bands + 2, inst->sample_rate, 5000.f,
-                        4.0f, 0.501f);  // -6dB
-    iir_2nd_coeffs_peak(inst->equalizer_bands + 3, inst->sample_rate, 8000.f,
-                        4.0f, 0.501f);  // -6dB
-    iir_2nd_coeffs_high_shelf(inst->equalizer_bands + 4, inst->sample_rate,
-                              10000.0f, 0.7f, 0.562f);  //-5db
+static int CreatePenetratingEffect(Band* bands, const int sample_rate) {
+    iir_2nd_coeffs_peak(bands, sample_rate, 2000.f, 2.0f, 1.51f);
+    iir_2nd_coeffs_high_shelf(bands + 1, sample_rate, 4300.0f, 0.7f, 1.74f);
+    return 2;
 }
 
-Equalizer* EqualizerCreate(const int sample_rate) {
-    Equalizer* self = (Equalizer*)calloc(1, sizeof(Equalizer));
-    if (self) self->sample_rate = sample_rate;
-    return self;
+static int CreateMagneticEffect(Band* bands, const int sample_rate) {
+    iir_2nd_coeffs_butterworth_highpass(bands, sample_rate, 50.0f);
+    iir_2nd_coeffs_peak(bands + 1, sample_rate, 500.f, 2.0f, 1.74f);
+    iir_2nd_coeffs_peak(bands + 2, sample_rate, 1200.0f, 2.0f, 1.55f);
+    return 3;
 }
 
-void EqualizerFree(Equalizer** inst) {
-    if (NULL == inst || NULL == *inst) return;
-    Equalizer* self = *inst;
-    if (self->equalizer_bands) {
-        free(self->equalizer_bands);
-        self->equalizer_bands = NULL;
-    }
-    free(*inst);
-    *inst = NULL;
+static int CreateSoftPitch(Band* bands, const int sample_rate) {
+    iir_2nd_coeffs_peak(bands, sample_rate, 300.f, 2.0f, 1.2f);
+    iir_2nd_coeffs_peak(bands + 1, sample_rate, 1200.f, 2.0f, 1.82f);
+    iir_2nd_coeffs_peak(bands + 2, sample_rate, 5000.f, 4.0f,
+                        0.501f);  // -6dB
+    iir_2nd_coeffs_peak(bands + 3, sample_rate, 8000.f, 4.0f,
+                        0.501f);  // -6dB
+    iir_2nd_coeffs_high_shelf(bands + 4, sample_rate, 10000.0f, 0.7f,
+                              0.562f);  //-5db
+    return 5;
 }
 
-void EqualizerSetMode(Equalizer* inst, const enum EqualizerMode mode) {
-    if (inst->equalizer_bands) {
-        free(inst->equalizer_bands);
-        inst->equalizer_bands = NULL;
-        inst->nb_equalizer_bands = 0;
-    }
+// designs the bands of mode, every channel gets the same
+static BiquadCascade* CreatePreset(Equalizer* inst,
+                                   const enum EqualizerMode mode) {
+    Band bands[BIQUAD_MAX_SECTIONS];
+    memset(bands, 0, sizeof(bands));
 
+    int nb_bands = 0;
     switch (mode) {
         case EqCleanVoice:
             // 清晰人声
-            CreateCleanVoice(inst);
+            nb_bands = CreateCleanVoice(bands, inst->sample_rate);
             break;
         case EqBass:
             // 低音 -> 沉稳
-            CreateBassEffect(inst);
+            nb_bands = CreateBassEffect(bands, inst->sample_rate);
             break;
         case EqLowVoice:
             // 低沉 -> 低音
-            CreateLowVoice(inst);
+            nb_bands = CreateLowVoice(bands, inst->sample_rate);
             break;
         case EqPenetrating:
             // 穿透
-            CreatePenetratingEffect(inst);
+            nb_bands = CreatePenetratingEffect(bands, inst->sample_rate);
             break;
         case EqMagnetic:
             // 磁性
-            CreateMagneticEffect(inst);
+            nb_bands = CreateMagneticEffect(bands, inst->sample_rate);
             break;
         case EqSoftPitch:
             // 柔和高音
-            CreateSoftPitch(inst);
+            nb_bands = CreateSoftPitch(bands, inst->sample_rate);
             break;
         default:
             break;
     }
+    if (nb_bands <= 0) return NULL;
+
+    BiquadCascade* cascade = biquad_cascade_create(inst->channels, nb_bands);
+    if (NULL == cascade) return NULL;
+    for (int i = 0; i < nb_bands; ++i) {
+        for (int c = 0; c < inst->channels; ++c)
+            biquad_cascade_set(cascade, c, i, bands + i);
+    }
+    return cascade;
 }
 
-void EqualizerProcess(Equalizer* inst, float* buffer, const int buffer_size) {
+Equalizer* EqualizerCreate(const int sample_rate, const int channels) {
+    Equalizer* self = (Equalizer*)calloc(1, sizeof(Equalizer));
+    if (NULL == self) return NULL;
+
+    self->sample_rate = sample_rate;
+    self->channels = channels > 0 ? channels : 1;
+    for (int mode = EqNone + 1; mode < NB_EQUALIZER_MODES; ++mode) {
+        self->presets[mode] = CreatePreset(self, mode);
+        if (NULL == self->presets[mode]) {
+            EqualizerFree(&self);
+            return NULL;
+        }
+    }
+    return self;
+}
+
+void EqualizerFree(Equalizer** inst) {
+    if (NULL == inst || NULL == *inst) return;
+    Equalizer* self = *inst;
+    for (int mode = 0; mode < NB_EQUALIZER_MODES; ++mode)
+        biquad_cascade_free(&self->presets[mode]);
+    free(*inst);
+    *inst = NULL;
+}
+
+void EqualizerReset(Equalizer* inst) {
     if (NULL == inst) return;
+    biquad_cascade_reset(inst->cascade);
+}
 
-    for (int i = 0; i < inst->nb_equalizer_bands; ++i) {
-        band_process(inst->equalizer_bands + i, buffer, buffer_size);
-    }
-}
\ No newline at end of file
+void EqualizerSetMode(Equalizer* inst, const enum EqualizerMode mode) {
+    if (NULL == inst) return;
+
+    inst->cascade = NULL;
+    if (mode > EqNone && mode < NB_EQUALIZER_MODES)
+        inst->cascade = inst->presets[mode];
+    // a new mode starts from silence
+    biquad_cascade_reset(inst->cascade);
+}
+
+void EqualizerProcess(Equalizer* inst, float* buffer, const int buffer_size) {
+    if (NULL == inst || NULL == inst->cascade) return;
+    biquad_cascade_process(inst->cascade, buffer, buffer_size);
+}
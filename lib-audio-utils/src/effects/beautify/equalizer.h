@@ -27,9 +27,11 @@ typedef struct EqualizerT Equalizer;
 /**
  * @brief 创建均衡器
  *
+ * @param sample_rate 输入数据的采样率
+ * @param channels 声道数，多声道数据交错存放
  * @return Equalizer*
  */
-Equalizer* EqualizerCreate(const int sample_rate);
+Equalizer* EqualizerCreate(const int sample_rate, const int channels);
 
 /**
  * @brief 释放均衡器
@@ -38,6 +40,13 @@ Equalizer* EqualizerCreate(const int sample_rate);
  */
 void EqualizerFree(Equalizer** inst);
 
+/**
+ * @brief 清空处理过的信号留下的状态，参数保持不变
+ *
+ * @param inst
+ */
+void EqualizerReset(Equalizer* inst);
+
 /**
  * @brief 设置音效模式
  *
@@ -3,6 +3,7 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
@@ -24,11 +25,11 @@ struct FlangerT {
     float channel_phase;
     interp_t interpolation;
 
-    /* Delay buffers */
+    /* Delay buffers, one line of delay_buf_length for each channel */
     float* delay_bufs;
     size_t delay_buf_length;
     size_t delay_buf_pos;
-    float delay_last;
+    float* delay_last;
 
     /* Low Frequency Oscillator */
     float* lfo;
@@ -39,6 +40,7 @@ struct FlangerT {
     float in_gain;
 
     int sample_rate;
+    int channels;
 };
 
 // "[delay depth regen width speed shape phase interp]",
@@ -73,11 +75,17 @@ struct FlangerT {
 // "each channel",
 // "interp   --    lin   delay-line interpolation: linear|quadratic"
 
-Flanger* FlangerCreate(const int sample_rate) {
+Flanger* FlangerCreate(const int sample_rate, const int channels) {
     Flanger* self = (Flanger*)calloc(1, sizeof(Flanger));
     if (NULL == self) return NULL;
 
     self->sample_rate = sample_rate;
+    self->channels = channels > 0 ? channels : 1;
+    self->delay_last = (float*)calloc(self->channels, sizeof(float));
+    if (NULL == self->delay_last) {
+        FlangerFree(&self);
+        return NULL;
+    }
     FlangerSet(self, 0.0f, 0.0f, 0.0f, 0.0f, 0.1f, WAVE_SINE, 0.0f);
     return self;
 }
@@ -94,10 +102,25 @@ void FlangerFree(Flanger** inst) {
         free(self->lfo);
         self->lfo = NULL;
     }
+    if (self->delay_last) {
+        free(self->delay_last);
+        self->delay_last = NULL;
+    }
     free(*inst);
     *inst = NULL;
 }
 
+void FlangerReset(Flanger* inst) {
+    if (NULL == inst) return;
+    if (inst->delay_bufs) {
+        memset(inst->delay_bufs, 0,
+               inst->delay_buf_length * inst->channels * sizeof(float));
+    }
+    memset(inst->delay_last, 0, inst->channels * sizeof(float));
+    inst->delay_buf_pos = 0;
+    inst->lfo_pos = 0;
+}
+
 static void lsx_generate_wave_table(wave_t wave_type, sox_data_t data_type,
                                     void* table, size_t table_size, float min,
                                     float max, float phase) {
@@ -203,7 +226,8 @@ void FlangerSet(Flanger* inst, const float delay, const float depth,
         free(inst->delay_bufs);
         inst->delay_bufs = NULL;
     }
-    inst->delay_bufs = (float*)calloc(inst->delay_buf_length, sizeof(float));
+    inst->delay_bufs = (float*)calloc(inst->delay_buf_length * inst->channels,
+                                      sizeof(float));
 
     /* Create the LFO lookup table: */
     inst->lfo_length = inst->sample_rate / inst->speed;
@@ -222,40 +246,47 @@ void FlangerSet(Flanger* inst, const float delay, const float depth,
 void FlangerProcess(Flanger* inst, float* buffer, const int buffer_size) {
     if (NULL == inst || NULL == buffer || buffer_size <= 0) return;
 
-    for (int i = 0; i < buffer_size; ++i) {
-        size_t channel_phase = inst->lfo_length * inst->channel_phase + .5;
-        double delay =
-            inst->lfo[(inst->lfo_pos + channel_phase) % inst->lfo_length];
-        float frac_delay = modf(delay, &delay);
-        size_t int_delay = (size_t)delay;
-
+    for (int i = 0; i < buffer_size; i += inst->channels) {
         inst->delay_buf_pos =
             (inst->delay_buf_pos + inst->delay_buf_length - 1) %
             inst->delay_buf_length;
-        inst->delay_bufs[inst->delay_buf_pos] =
-            buffer[i] + inst->delay_last * inst->feedback_gain;
 
-        float delayed_0 = inst->delay_bufs[(inst->delay_buf_pos + int_delay++) %
-                                           inst->delay_buf_length];
-        float delayed_1 = inst->delay_bufs[(inst->delay_buf_pos + int_delay++) %
-                                           inst->delay_buf_length];
-        float delayed;
+        for (int c = 0; c < inst->channels; ++c) {
+            // every channel sweeps one more channel_phase behind
+            size_t channel_phase =
+                inst->lfo_length * inst->channel_phase * (c + 1) + .5;
+            double delay =
+                inst->lfo[(inst->lfo_pos + channel_phase) % inst->lfo_length];
+            float frac_delay = modf(delay, &delay);
+            size_t int_delay = (size_t)delay;
+            float* delay_buf = inst->delay_bufs + c * inst->delay_buf_length;
+            float* sample = buffer + i + c;
+
+            delay_buf[inst->delay_buf_pos] =
+                *sample + inst->delay_last[c] * inst->feedback_gain;
+
+            float delayed_0 = delay_buf[(inst->delay_buf_pos + int_delay++) %
+                                        inst->delay_buf_length];
+            float delayed_1 = delay_buf[(inst->delay_buf_pos + int_delay++) %
+                                        inst->delay_buf_length];
+            float delayed;
 
-        if (INTERP_LINEAR == inst->interpolation) {
-            delayed = delayed_0 + (delayed_1 - delayed_0) * frac_delay;
-        } else {
-            float a, b;
-            float delayed_2 =
-                inst->delay_bufs[(inst->delay_buf_pos + int_delay++) %
-                                 inst->delay_buf_length];
-            delayed_2 -= delayed_0;
-            delayed_1 -= delayed_0;
-            a = delayed_2 * .5 - delayed_1;
-            b = delayed_1 * 2 - delayed_2 * .5;
-            delayed = delayed_0 + (a * frac_delay + b) * frac_delay;
+            if (INTERP_LINEAR == inst->interpolation) {
+                delayed = delayed_0 + (delayed_1 - delayed_0) * frac_delay;
+            } else {
+                float a, b;
+                float delayed_2 =
+                    delay_buf[(inst->delay_buf_pos + int_delay++) %
+                              inst->delay_buf_length];
+                delayed_2 -= delayed_0;
+                delayed_1 -= delayed_0;
+                a = delayed_2 * .5 - delayed_1;
+                b = delayed_1 * 2 - delayed_2 * .5;
+                delayed = delayed_0 + (a * frac_delay + b) * frac_delay;
+            }
+            inst->delay_last[c] = delayed;
+            *sample = *sample * inst->in_gain + delayed * inst->delay_gain;
         }
-        inst->delay_last = delayed;
-        buffer[i] = buffer[i] * inst->in_gain + delayed * inst->delay_gain;
         inst->lfo_pos = (inst->lfo_pos + 1) % inst->lfo_length;
     }
-}
\ No newline at end of file
+}
@@ -14,9 +14,10 @@ extern "C" {
  * @brief 创建镶边效果器
  *
  * @param sample_rate 输入数据的采样率
+ * @param channels 声道数，每个声道有自己的延迟线
  * @return Flanger*
  */
-Flanger* FlangerCreate(const int sample_rate);
+Flanger* FlangerCreate(const int sample_rate, const int channels);
 
 /**
  * @brief 释放镶边效果器
@@ -25,6 +26,13 @@ Flanger* FlangerCreate(const int sample_rate);
  */
 void FlangerFree(Flanger** inst);
 
+/**
+ * @brief 清空处理过的信号留下的状态，参数保持不变
+ *
+ * @param inst
+ */
+void FlangerReset(Flanger* inst);
+
 /**
  * @brief 设置参数
  *
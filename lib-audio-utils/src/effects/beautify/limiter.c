@@ -2,6 +2,7 @@
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #define FFMIN(a, b) ((a) > (b) ? (b) : (a))
 #define FFMIN3(a, b, c) FFMIN(FFMIN(a, b), c)
@@ -19,19 +20,22 @@ struct LimiterT {
     int delay_buf_index; /* Index into delay_buf */
     int delay_buf_cnt;   /* No. of active entries in delay_buf */
     int sample_rate;
+    int channels;
     short limiter_switch;
 };
 
-Limiter* LimiterCreate(const int sample_rate) {
+Limiter* LimiterCreate(const int sample_rate, const int channels) {
     Limiter* self = (Limiter*)calloc(1, sizeof(Limiter));
     if (NULL == self) return NULL;
 
     self->sample_rate = sample_rate;
+    self->channels = channels > 0 ? channels : 1;
     self->xpeak = 0.0f;
     self->gain = 1.0f;
     self->limiter_switch = 0;
     self->delay_in_sec = 0.0f;
-    self->delay_buf_size = self->delay_in_sec * self->sample_rate;
+    self->delay_buf_size =
+        (int)(self->delay_in_sec * self->sample_rate) * self->channels;
     self->delay_buf = (float*)calloc(self->delay_buf_size, sizeof(float));
     if (NULL == self->delay_buf) LimiterFree(&self);
 
@@ -50,6 +54,16 @@ void LimiterFree(Limiter** inst) {
     *inst = NULL;
 }
 
+void LimiterReset(Limiter* inst) {
+    if (NULL == inst) return;
+    inst->xpeak = 0.0f;
+    inst->gain = 1.0f;
+    inst->delay_buf_index = 0;
+    inst->delay_buf_cnt = 0;
+    if (inst->delay_buf)
+        memset(inst->delay_buf, 0, inst->delay_buf_size * sizeof(float));
+}
+
 void LimiterSetSwitch(Limiter* inst, const int limiter_switch) {
     inst->limiter_switch = limiter_switch;
 }
@@ -69,25 +83,31 @@ int LimiterProcess(Limiter* inst, float* buffer, const int buffer_size) {
     if (NULL == inst || 0 == inst->limiter_switch) return buffer_size;
     int nb_samples = 0;
 
-    for (int i = 0; i < buffer_size; ++i) {
+    for (int i = 0; i < buffer_size; i += inst->channels) {
+        // linked peak detection, one gain for all channels
         float a = fabs(buffer[i]);
+        for (int c = 1; c < inst->channels; ++c)
+            a = fmaxf(a, fabs(buffer[i + c]));
         float coeff = a > inst->xpeak ? inst->attack_time : inst->decay_time;
         inst->xpeak = (1.0f - coeff) * inst->xpeak + coeff * a;
         float f = FFMIN(1.0f, inst->limiter_threshold / inst->xpeak);
         coeff = f < inst->gain ? inst->attack_time : inst->decay_time;
         inst->gain = (1 - coeff) * inst->gain + coeff * f;
-        if (inst->delay_buf_size <= 0) {
-            buffer[nb_samples++] *= inst->gain * inst->output_gain;
-        } else {
-            float tmp = buffer[i];
-            if (inst->delay_buf_cnt < inst->delay_buf_size) {
-                inst->delay_buf_cnt++;
+        for (int c = 0; c < inst->channels; ++c) {
+            if (inst->delay_buf_size <= 0) {
+                buffer[nb_samples++] *= inst->gain * inst->output_gain;
             } else {
-                buffer[nb_samples++] = inst->delay_buf[inst->delay_buf_index] *
-                                       inst->gain * inst->output_gain;
+                float tmp = buffer[i + c];
+                if (inst->delay_buf_cnt < inst->delay_buf_size) {
+                    inst->delay_buf_cnt++;
+                } else {
+                    buffer[nb_samples++] =
+                        inst->delay_buf[inst->delay_buf_index] * inst->gain *
+                        inst->output_gain;
+                }
+                inst->delay_buf[inst->delay_buf_index++] = tmp;
+                inst->delay_buf_index %= inst->delay_buf_size;
             }
-            inst->delay_buf[inst->delay_buf_index++] = tmp;
-            inst->delay_buf_index %= inst->delay_buf_size;
         }
     }
     return nb_samples;
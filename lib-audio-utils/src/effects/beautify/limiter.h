@@ -10,9 +10,11 @@ extern "C" {
 /**
  * @brief 创建限制器
  *
+ * @param sample_rate 输入数据的采样率
+ * @param channels 声道数，各声道共用一个增益（联动检测）
  * @return Limiter*
  */
-Limiter* LimiterCreate(const int sample_rate);
+Limiter* LimiterCreate(const int sample_rate, const int channels);
 
 /**
  * @brief 释放限制器
@@ -20,6 +22,12 @@ Limiter* LimiterCreate(const int sample_rate);
  * @param inst
  */
 void LimiterFree(Limiter** inst);
+/**
+ * @brief 清空处理过的信号留下的状态，参数保持不变
+ *
+ * @param inst
+ */
+void LimiterReset(Limiter* inst);
 
 void LimiterSetSwitch(Limiter* inst, const int limiter_switch);
 
@@ -4,41 +4,53 @@
 #include <stdlib.h>
 #include <string.h>
 #include "compressor.h"
-#include "dsp_tools/iir_design/iir_design.h"
+#include "dsp_tools/iir_design/biquad_cascade.h"
+
+#define NB_COMPRESSOR_BANDS 4
+#define NB_CROSSOVERS (NB_COMPRESSOR_BANDS - 1)
+/**
+ * a Linkwitz-Riley crossover is two butterworth biquads in a row, its
+ * lowpass and highpass sum to an allpass. The bands are split at the
+ * middle crossover, then at the crossover of their half, and an allpass
+ * of the other half's crossover puts both halves in the same phase, so
+ * the four bands sum to an allpass of the input.
+ */
+#define NB_CROSSOVER_SECTIONS 5
 
 typedef struct CompressorBandT {
     float* buffer;
-    Band* iir_band;
     Compressor* compressor;
 } CompressorBand;
 
 struct MulCompressorT {
     int sample_rate;
+    int channels;
     int max_nb_samples;
     short nb_compressor_bands;
     CompressorBand* compressor_bands;
+    // the crossover, lane b * channels + c filters channel c into band b
+    BiquadCascade* filter_bank;
 };
 
-MulCompressor* MulCompressorCreate(const int sample_rate) {
+MulCompressor* MulCompressorCreate(const int sample_rate, const int channels) {
     MulCompressor* self = (MulCompressor*)calloc(1, sizeof(MulCompressor));
     if (NULL == self) return NULL;
 
     self->sample_rate = sample_rate;
+    self->channels = channels > 0 ? channels : 1;
     return self;
 }
 
 static void CompressorBandFree(MulCompressor* inst) {
-    if (NULL == inst || NULL == inst->compressor_bands) return;
+    if (NULL == inst) return;
+    biquad_cascade_free(&inst->filter_bank);
+    if (NULL == inst->compressor_bands) return;
     for (int i = 0; i < inst->nb_compressor_bands; ++i) {
         if (inst->compressor_bands + i) {
             if ((inst->compressor_bands + i)->buffer) {
                 free((inst->compressor_bands + i)->buffer);
                 (inst->compressor_bands + i)->buffer = NULL;
             }
-            if ((inst->compressor_bands + i)->iir_band) {
-                free((inst->compressor_bands + i)->iir_band);
-                (inst->compressor_bands + i)->iir_band = NULL;
-            }
             if ((inst->compressor_bands + i)->compressor)
                 CompressorFree(&(inst->compressor_bands + i)->compressor);
         }
@@ -62,312 +74,173 @@ void MulCompressorFree(MulCompressor** inst) {
     *inst = NULL;
 }
 
+void MulCompressorReset(MulCompressor* inst) {
+    if (NULL == inst || NULL == inst->compressor_bands) return;
+    biquad_cascade_reset(inst->filter_bank);
+    for (int i = 0; i < inst->nb_compressor_bands; ++i)
+        CompressorReset((inst->compressor_bands + i)->compressor);
+}
+
+static int CreateCrossover(MulCompressor* inst,
+                           const float crossovers[NB_CROSSOVERS]) {
+    Band lp[NB_CROSSOVERS], hp[NB_CROSSOVERS], ap[NB_CROSSOVERS];
+    for (int i = 0; i < NB_CROSSOVERS; ++i) {
+        // a crossover above the band of the signal moves below nyquist
+        const float freq = fminf(crossovers[i], 0.45f * inst->sample_rate);
+        if (iir_2nd_coeffs_butterworth_lowpass(lp + i, inst->sample_rate,
+                                               freq) < 0 ||
+            iir_2nd_coeffs_butterworth_highpass(hp + i, inst->sample_rate,
+                                                freq) < 0 ||
+            iir_2nd_coeffs_allpass(ap + i, inst->sample_rate, freq,
+                                   sqrtf(0.5f)) < 0)
+            return -1;
+    }
+
+    const Band* sections[NB_COMPRESSOR_BANDS][NB_CROSSOVER_SECTIONS] = {
+        {lp + 1, lp + 1, lp, lp, ap + 2},
+        {lp + 1, lp + 1, hp, hp, ap + 2},
+        {hp + 1, hp + 1, ap, lp + 2, lp + 2},
+        {hp + 1, hp + 1, ap, hp + 2, hp + 2}};
+    inst->filter_bank = biquad_cascade_create(
+        NB_COMPRESSOR_BANDS * inst->channels, NB_CROSSOVER_SECTIONS);
+    if (NULL == inst->filter_bank) return -1;
+    for (int b = 0; b < NB_COMPRESSOR_BANDS; ++b) {
+        for (int c = 0; c < inst->channels; ++c) {
+            for (int j = 0; j < NB_CROSSOVER_SECTIONS; ++j) {
+                biquad_cascade_set(inst->filter_bank, b * inst->channels + c,
+                                   j, sections[b][j]);
+            }
+        }
+    }
+    return 0;
+}
+
+// the crossover and a compressor per band, the caller sets the compressors
+static int CreateBands(MulCompressor* inst,
+                       const float crossovers[NB_CROSSOVERS]) {
+    inst->compressor_bands =
+        (CompressorBand*)calloc(NB_COMPRESSOR_BANDS, sizeof(CompressorBand));
+    if (NULL == inst->compressor_bands) goto end;
+    inst->nb_compressor_bands = NB_COMPRESSOR_BANDS;
+
+    for (int i = 0; i < inst->nb_compressor_bands; ++i) {
+        (inst->compressor_bands + i)->compressor =
+            CompressorCreate(inst->sample_rate, inst->channels);
+        if (NULL == (inst->compressor_bands + i)->compressor) goto end;
+    }
+    if (CreateCrossover(inst, crossovers) < 0) goto end;
+    return 0;
+end:
+    CompressorBandFree(inst);
+    return -1;
+}
+
 static void CreateCleanVoice(MulCompressor* inst) {
-    inst->nb_compressor_bands = 4;
-    inst->compressor_bands = (CompressorBand*)calloc(inst->nb_compressor_bands,
-                                                     sizeof(CompressorBand));
-    if (NULL == inst->compressor_bands) return;
+    const float crossovers[NB_CROSSOVERS] = {150.0f, 3360.0f, 9150.0f};
+    if (CreateBands(inst, crossovers) < 0) return;
 
     // 设置第一个压缩器
-    inst->compressor_bands->iir_band = (Band*)calloc(1, sizeof(Band));
-    if (NULL == inst->compressor_bands->iir_band) goto end;
-    iir_2nd_coeffs_butterworth_lowpass(inst->compressor_bands->iir_band,
-                                       inst->sample_rate, 150);
-    inst->compressor_bands->compressor = CompressorCreate(inst->sample_rate);
     CompressorSet(inst->compressor_bands->compressor, -15.0f, 2.0f, 1.0f, 50.0f,
                   -3.0f);
-
     // 设置第二个压缩器
-    (inst->compressor_bands + 1)->iir_band = (Band*)calloc(1, sizeof(Band));
-    if (NULL == (inst->compressor_bands + 1)->iir_band) goto end;
-    iir_2nd_coeffs_butterworth_bandpass(
-        (inst->compressor_bands + 1)->iir_band, inst->sample_rate,
-        sqrt(150.0f * 3360.0f), sqrt(150.0f * 3360.0f) / (3360.0f - 150.0f));
-    (inst->compressor_bands + 1)->compressor =
-        CompressorCreate(inst->sample_rate);
-    CompressorSet((inst->compressor_bands + 1)->compressor, -18, 2.0f, 1.0f,
+    CompressorSet((inst->compressor_bands + 1)->compressor, -18.0f, 2.0f, 1.0f,
                   50.0f, -2.7f);
-
     // 设置第三个压缩器
-    (inst->compressor_bands + 2)->iir_band = (Band*)calloc(1, sizeof(Band));
-    if (NULL == (inst->compressor_bands + 2)->iir_band) goto end;
-    iir_2nd_coeffs_butterworth_bandpass(
-        (inst->compressor_bands + 2)->iir_band, inst->sample_rate,
-        sqrt(3360.0f * 9150.0f), sqrt(3360.0f * 9150.0f) / (9150.0f - 3360.0f));
-    (inst->compressor_bands + 2)->compressor =
-        CompressorCreate(inst->sample_rate);
-    CompressorSet((inst->compressor_bands + 2)->compressor, -15, 2.0f, 1.0f,
+    CompressorSet((inst->compressor_bands + 2)->compressor, -15.0f, 2.0f, 1.0f,
                   50.0f, 4.0f);
-
     // 设置第四个压缩器
-    (inst->compressor_bands + 3)->iir_band = (Band*)calloc(1, sizeof(Band));
-    if (NULL == (inst->compressor_bands + 3)->iir_band) goto end;
-    iir_2nd_coeffs_butterworth_highpass(inst->compressor_bands->iir_band,
-                                        inst->sample_rate, 9150.0f);
-    (inst->compressor_bands + 3)->compressor =
-        CompressorCreate(inst->sample_rate);
     CompressorSet((inst->compressor_bands + 3)->compressor, -15.0f, 2.0f, 1.0f,
                   50.0f, 1.0f);
-
-    return;
-end:
-    CompressorBandFree(inst);
 }
 
 static void CreateBassEffect(MulCompressor* inst) {
-    inst->nb_compressor_bands = 4;
-    inst->compressor_bands = (CompressorBand*)calloc(inst->nb_compressor_bands,
-                                                     sizeof(CompressorBand));
-    if (NULL == inst->compressor_bands) return;
+    const float crossovers[NB_CROSSOVERS] = {195.2f, 527.7f, 11250.0f};
+    if (CreateBands(inst, crossovers) < 0) return;
 
     // 设置第一个压缩器
-    inst->compressor_bands->iir_band = (Band*)calloc(1, sizeof(Band));
-    if (NULL == inst->compressor_bands->iir_band) goto end;
-    iir_2nd_coeffs_butterworth_lowpass(inst->compressor_bands->iir_band,
-                                       inst->sample_rate, 195.2f);
-    inst->compressor_bands->compressor = CompressorCreate(inst->sample_rate);
     CompressorSet(inst->compressor_bands->compressor, -15.0f, 2.0f, 1.0f, 50.0f,
                   -0.5f);
-
     // 设置第二个压缩器
-    (inst->compressor_bands + 1)->iir_band = (Band*)calloc(1, sizeof(Band));
-    if (NULL == (inst->compressor_bands + 1)->iir_band) goto end;
-    iir_2nd_coeffs_butterworth_bandpass(
-        (inst->compressor_bands + 1)->iir_band, inst->sample_rate,
-        sqrt(195.2f * 527.7f), sqrt(195.2 * 527.7f) / (527.7f - 195.2f));
-    (inst->compressor_bands + 1)->compressor =
-        CompressorCreate(inst->sample_rate);
     CompressorSet((inst->compressor_bands + 1)->compressor, -15.0f, 2.0f, 1.0f,
                   50.0f, 4.0f);
-
     // 设置第三个压缩器
-    (inst->compressor_bands + 2)->iir_band = (Band*)calloc(1, sizeof(Band));
-    if (NULL == (inst->compressor_bands + 2)->iir_band) goto end;
-    iir_2nd_coeffs_butterworth_bandpass(
-        (inst->compressor_bands + 2)->iir_band, inst->sample_rate,
-        sqrt(527.7f * 11250.0f),
-        sqrt(527.37f * 11250.0f) / (11250.0f - 527.7f));
-    (inst->compressor_bands + 2)->compressor =
-        CompressorCreate(inst->sample_rate);
     CompressorSet((inst->compressor_bands + 2)->compressor, -15.0f, 4.5f, 1.0f,
                   50.0f, -2.0f);
-
     // 设置第四个压缩器
-    (inst->compressor_bands + 3)->iir_band = (Band*)calloc(1, sizeof(Band));
-    if (NULL == (inst->compressor_bands + 3)->iir_band) goto end;
-    iir_2nd_coeffs_butterworth_highpass(inst->compressor_bands->iir_band,
-                                        inst->sample_rate, 11250.0f);
-    (inst->compressor_bands + 3)->compressor =
-        CompressorCreate(inst->sample_rate);
     CompressorSet((inst->compressor_bands + 3)->compressor, -15.0f, 2.0f, 1.0f,
                   50.0f, -3.0f);
-    return;
-end:
-    CompressorBandFree(inst);
 }
 
 static void CreateLowVoice(MulCompressor* inst) {
-    inst->nb_compressor_bands = 4;
-    inst->compressor_bands = (CompressorBand*)calloc(inst->nb_compressor_bands,
-                                                     sizeof(CompressorBand));
-    if (NULL == inst->compressor_bands) return;
+    const float crossovers[NB_CROSSOVERS] = {400.0f, 3360.0f, 9150.0f};
+    if (CreateBands(inst, crossovers) < 0) return;
 
     // 设置第一个压缩器
-    inst->compressor_bands->iir_band = (Band*)calloc(1, sizeof(Band));
-    if (NULL == inst->compressor_bands->iir_band) goto end;
-    iir_2nd_coeffs_butterworth_lowpass(inst->compressor_bands->iir_band,
-                                       inst->sample_rate, 400.0f);
-    inst->compressor_bands->compressor = CompressorCreate(inst->sample_rate);
     CompressorSet(inst->compressor_bands->compressor, -15.0f, 2.0f, 1.0f, 50.0f,
                   2.0f);
-
     // 设置第二个压缩器
-    (inst->compressor_bands + 1)->iir_band = (Band*)calloc(1, sizeof(Band));
-    if (NULL == (inst->compressor_bands + 1)->iir_band) goto end;
-    iir_2nd_coeffs_butterworth_bandpass(
-        (inst->compressor_bands + 1)->iir_band, inst->sample_rate,
-        sqrt(150.0f * 3360.0f), sqrt(150.0f * 3360.0) / (3360.f - 150.0f));
-    (inst->compressor_bands + 1)->compressor =
-        CompressorCreate(inst->sample_rate);
     CompressorSet((inst->compressor_bands + 1)->compressor, -15.3f, 2.0f, 1.0f,
                   50.0f, 3.0f);
-
     // 设置第三个压缩器
-    (inst->compressor_bands + 2)->iir_band = (Band*)calloc(1, sizeof(Band));
-    if (NULL == (inst->compressor_bands + 2)->iir_band) goto end;
-    iir_2nd_coeffs_butterworth_bandpass(
-        (inst->compressor_bands + 2)->iir_band, inst->sample_rate,
-        sqrt(3360.0f * 9150.0f), sqrt(3360.0f * 9150.0f) / (9150.0f - 3360.0f));
-    (inst->compressor_bands + 2)->compressor =
-        CompressorCreate(inst->sample_rate);
     CompressorSet((inst->compressor_bands + 2)->compressor, -20.0f, 2.0f, 1.0f,
                   50.0f, 2.0f);
-
     // 设置第四个压缩器
-    (inst->compressor_bands + 3)->iir_band = (Band*)calloc(1, sizeof(Band));
-    if (NULL == (inst->compressor_bands + 3)->iir_band) goto end;
-    iir_2nd_coeffs_butterworth_highpass(inst->compressor_bands->iir_band,
-                                        inst->sample_rate, 9150.0f);
-    (inst->compressor_bands + 3)->compressor =
-        CompressorCreate(inst->sample_rate);
     CompressorSet((inst->compressor_bands + 3)->compressor, -20.0f, 2.0f, 1.0f,
                   50.0f, 2.0f);
-    return;
-end:
-    CompressorBandFree(inst);
 }
 
 static void CreatePenetratingEffect(MulCompressor* inst) {
-    inst->nb_compressor_bands = 4;
-    inst->compressor_bands = (CompressorBand*)calloc(inst->nb_compressor_bands,
-                                                     sizeof(CompressorBand));
-    if (NULL == inst->compressor_bands) return;
+    const float crossovers[NB_CROSSOVERS] = {150.0f, 1020.0f, 5040.0f};
+    if (CreateBands(inst, crossovers) < 0) return;
 
     // 设置第一个压缩器
-    inst->compressor_bands->iir_band = (Band*)calloc(1, sizeof(Band));
-    if (NULL == inst->compressor_bands->iir_band) goto end;
-    iir_2nd_coeffs_butterworth_lowpass(inst->compressor_bands->iir_band,
-                                       inst->sample_rate, 150.0f);
-    inst->compressor_bands->compressor = CompressorCreate(inst->sample_rate);
     CompressorSet(inst->compressor_bands->compressor, -15.0f, 2.0f, 1.0f, 50.0f,
                   -5.0f);
-
     // 设置第二个压缩器
-    (inst->compressor_bands + 1)->iir_band = (Band*)calloc(1, sizeof(Band));
-    if (NULL == (inst->compressor_bands + 1)->iir_band) goto end;
-    iir_2nd_coeffs_butterworth_bandpass(
-        (inst->compressor_bands + 1)->iir_band, inst->sample_rate,
-        sqrt(150.0f * 1020.0f), sqrt(150.0f * 1020.0) / (1020.f - 150.0f));
-    (inst->compressor_bands + 1)->compressor =
-        CompressorCreate(inst->sample_rate);
     CompressorSet((inst->compressor_bands + 1)->compressor, -15.0f, 2.0f, 1.0f,
                   50.0f, 0.0f);
-
     // 设置第三个压缩器
-    (inst->compressor_bands + 2)->iir_band = (Band*)calloc(1, sizeof(Band));
-    if (NULL == (inst->compressor_bands + 2)->iir_band) goto end;
-    iir_2nd_coeffs_butterworth_bandpass(
-        (inst->compressor_bands + 2)->iir_band, inst->sample_rate,
-        sqrt(1020.0f * 5040.0f), sqrt(1020.0f * 5040.0f) / (5040.0f - 1020.0f));
-    (inst->compressor_bands + 2)->compressor =
-        CompressorCreate(inst->sample_rate);
     CompressorSet((inst->compressor_bands + 2)->compressor, -15.0f, 2.0f, 1.0f,
                   50.0f, 2.0f);
-
     // 设置第四个压缩器
-    (inst->compressor_bands + 3)->iir_band = (Band*)calloc(1, sizeof(Band));
-    if (NULL == (inst->compressor_bands + 3)->iir_band) goto end;
-    iir_2nd_coeffs_butterworth_highpass(inst->compressor_bands->iir_band,
-                                        inst->sample_rate, 5040.0f);
-    (inst->compressor_bands + 3)->compressor =
-        CompressorCreate(inst->sample_rate);
     CompressorSet((inst->compressor_bands + 3)->compressor, -15.0f, 2.0f, 1.0f,
                   50.0f, 0.0f);
-    return;
-end:
-    CompressorBandFree(inst);
 }
 
 static void CreateMagneticEffect(MulCompressor* inst) {
-    inst->nb_compressor_bands = 4;
-    inst->compressor_bands = (CompressorBand*)calloc(inst->nb_compressor_bands,
-                                                     sizeof(CompressorBand));
-    if (NULL == inst->compressor_bands) return;
+    const float crossovers[NB_CROSSOVERS] = {200.0f, 1050.0f, 9150.0f};
+    if (CreateBands(inst, crossovers) < 0) return;
 
     // 设置第一个压缩器
-    inst->compressor_bands->iir_band = (Band*)calloc(1, sizeof(Band));
-    if (NULL == inst->compressor_bands->iir_band) goto end;
-    iir_2nd_coeffs_butterworth_lowpass(inst->compressor_bands->iir_band,
-                                       inst->sample_rate, 200.0f);
-    inst->compressor_bands->compressor = CompressorCreate(inst->sample_rate);
     CompressorSet(inst->compressor_bands->compressor, -15.0f, 2.0f, 1.0f, 50.0f,
                   0.0f);
-
     // 设置第二个压缩器
-    (inst->compressor_bands + 1)->iir_band = (Band*)calloc(1, sizeof(Band));
-    if (NULL == (inst->compressor_bands + 1)->iir_band) goto end;
-    iir_2nd_coeffs_butterworth_bandpass(
-        (inst->compressor_bands + 1)->iir_band, inst->sample_rate,
-        sqrt(200.0f * 1050.0f), sqrt(200.0f * 1050.0) / (1020.f - 200.0f));
-    (inst->compressor_bands + 1)->compressor =
-        CompressorCreate(inst->sample_rate);
     CompressorSet((inst->compressor_bands + 1)->compressor, -15.3f, 2.0f, 1.0f,
                   50.0f, 2.0f);
-
     // 设置第三个压缩器
-    (inst->compressor_bands + 2)->iir_band = (Band*)calloc(1, sizeof(Band));
-    if (NULL == (inst->compressor_bands + 2)->iir_band) goto end;
-    iir_2nd_coeffs_butterworth_bandpass(
-        (inst->compressor_bands + 2)->iir_band, inst->sample_rate,
-        sqrt(1050.0f * 9150.0f), sqrt(1050.0f * 9150.0f) / (9150.0f - 1050.0f));
-    (inst->compressor_bands + 2)->compressor =
-        CompressorCreate(inst->sample_rate);
     CompressorSet((inst->compressor_bands + 2)->compressor, -20.0f, 2.0f, 1.0f,
                   50.0f, 3.0f);
-
     // 设置第四个压缩器
-    (inst->compressor_bands + 3)->iir_band = (Band*)calloc(1, sizeof(Band));
-    if (NULL == (inst->compressor_bands + 3)->iir_band) goto end;
-    iir_2nd_coeffs_butterworth_highpass(inst->compressor_bands->iir_band,
-                                        inst->sample_rate, 9150.0f);
-    (inst->compressor_bands + 3)->compressor =
-        CompressorCreate(inst->sample_rate);
     CompressorSet((inst->compressor_bands + 3)->compressor, -20.0f, 2.0f, 1.0f,
                   50.0f, 0.0f);
-    return;
-end:
-    CompressorBandFree(inst);
 }
 
 static void CreateSoftPitch(MulCompressor* inst) {
-    inst->nb_compressor_bands = 4;
-    inst->compressor_bands = (CompressorBand*)calloc(inst->nb_compressor_bands,
-                                                     sizeof(CompressorBand));
-    if (NULL == inst->compressor_bands) return;
+    const float crossovers[NB_CROSSOVERS] = {150.0f, 2820.0f, 9970.0f};
+    if (CreateBands(inst, crossovers) < 0) return;
 
     // 设置第一个压缩器
-    inst->compressor_bands->iir_band = (Band*)calloc(1, sizeof(Band));
-    if (NULL == inst->compressor_bands->iir_band) goto end;
-    iir_2nd_coeffs_butterworth_lowpass(inst->compressor_bands->iir_band,
-                                       inst->sample_rate, 150.0f);
-    inst->compressor_bands->compressor = CompressorCreate(inst->sample_rate);
     CompressorSet(inst->compressor_bands->compressor, -15.0f, 2.0f, 1.0f, 50.0f,
                   -5.0f);
-
     // 设置第二个压缩器
-    (inst->compressor_bands + 1)->iir_band = (Band*)calloc(1, sizeof(Band));
-    if (NULL == (inst->compressor_bands + 1)->iir_band) goto end;
-    iir_2nd_coeffs_butterworth_bandpass(
-        (inst->compressor_bands + 1)->iir_band, inst->sample_rate,
-        sqrt(150.0f * 2820.0f), sqrt(150.0f * 2820.0) / (2820.f - 150.0f));
-    (inst->compressor_bands + 1)->compressor =
-        CompressorCreate(inst->sample_rate);
     CompressorSet((inst->compressor_bands + 1)->compressor, -15.0f, 2.0f, 1.0f,
                   50.0f, -3.0f);
-
     // 设置第三个压缩器
-    (inst->compressor_bands + 2)->iir_band = (Band*)calloc(1, sizeof(Band));
-    if (NULL == (inst->compressor_bands + 2)->iir_band) goto end;
-    iir_2nd_coeffs_butterworth_bandpass(
-        (inst->compressor_bands + 2)->iir_band, inst->sample_rate,
-        sqrt(2820.0f * 9970.0f), sqrt(2820.0f * 9970.0f) / (9970.0f - 2820.0f));
-    (inst->compressor_bands + 2)->compressor =
-        CompressorCreate(inst->sample_rate);
     CompressorSet((inst->compressor_bands + 2)->compressor, -15.0f, 2.0f, 1.0f,
                   50.0f, 5.0f);
-
     // 设置第四个压缩器
-    (inst->compressor_bands + 3)->iir_band = (Band*)calloc(1, sizeof(Band));
-    if (NULL == (inst->compressor_bands + 3)->iir_band) goto end;
-    iir_2nd_coeffs_butterworth_highpass(inst->compressor_bands->iir_band,
-                                        inst->sample_rate, 9970.0f);
-    (inst->compressor_bands + 3)->compressor =
-        CompressorCreate(inst->sample_rate);
     CompressorSet((inst->compressor_bands + 3)->compressor, -15.0f, 2.0f, 1.0f,
                   50.0f, -1.0f);
-    return;
-end:
-    CompressorBandFree(inst);
 }
 
 void MulCompressorSetMode(MulCompressor* inst,
@@ -403,18 +276,6 @@ void MulCompressorSetMode(MulCompressor* inst,
     }
 }
 
-static int CompressorBandProcess(CompressorBand* compressor_band, float* buffer,
-                                 const int buffer_size) {
-    // 拷贝数据
-    memcpy(compressor_band->buffer, buffer, buffer_size * sizeof(float));
-    // 分频
-    band_process(compressor_band->iir_band, compressor_band->buffer,
-                 buffer_size);
-    // 压缩处理
-    return CompressorProcess(compressor_band->compressor,
-                             compressor_band->buffer, buffer_size);
-}
-
 static int RellocateBuffer(MulCompressor* inst, const int buffer_size) {
     for (int i = 0; i < inst->nb_compressor_bands; ++i) {
         if ((inst->compressor_bands + i)->buffer) {
@@ -442,18 +303,25 @@ int MulCompressorProcess(MulCompressor* inst, float* buffer,
         if (RellocateBuffer(inst, buffer_size) < 0) return buffer_size;
     }
 
-    // 分频处理
+    // 分频
+    float* band_buffers[inst->nb_compressor_bands];
+    for (int i = 0; i < inst->nb_compressor_bands; ++i)
+        band_buffers[i] = (inst->compressor_bands + i)->buffer;
+    biquad_cascade_process_bands(inst->filter_bank, inst->channels, buffer,
+                                 band_buffers, buffer_size);
+
+    // 压缩处理
     for (int i = 0; i < inst->nb_compressor_bands; ++i) {
-        ret = CompressorBandProcess(inst->compressor_bands + i, buffer,
-                                    buffer_size);
+        ret = CompressorProcess((inst->compressor_bands + i)->compressor,
+                                (inst->compressor_bands + i)->buffer,
+                                buffer_size);
     }
 
-    // TODO: 合并
-    memset(buffer, 0, sizeof(float) * buffer_size);
-    for (int i = 0; i < ret; ++i) {
-        for (int j = 0; j < inst->nb_compressor_bands; ++j) {
-            buffer[i] += (inst->compressor_bands + j)->buffer[i];
-        }
+    // 合并
+    memcpy(buffer, inst->compressor_bands->buffer, sizeof(float) * ret);
+    for (int j = 1; j < inst->nb_compressor_bands; ++j) {
+        const float* band = (inst->compressor_bands + j)->buffer;
+        for (int i = 0; i < ret; ++i) buffer[i] += band[i];
     }
 
     return ret;
@@ -28,9 +28,10 @@ extern "C" {
  * @brief 创建多频段压缩器
  *
  * @param sample_rate
+ * @param channels 声道数，多声道数据交错存放
  * @return MulCompressor*
  */
-MulCompressor* MulCompressorCreate(const int sample_rate);
+MulCompressor* MulCompressorCreate(const int sample_rate, const int channels);
 
 /**
  * @brief 释放多频段压缩器
@@ -39,6 +40,13 @@ MulCompressor* MulCompressorCreate(const int sample_rate);
  */
 void MulCompressorFree(MulCompressor** inst);
 
+/**
+ * @brief 清空处理过的信号留下的状态，参数保持不变
+ *
+ * @param inst
+ */
+void MulCompressorReset(MulCompressor* inst);
+
 /**
  * @brief 设置音效模式
  *
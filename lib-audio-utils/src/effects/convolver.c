@@ -0,0 +1,405 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "effect_struct.h"
+#include "error_def.h"
+#include "log.h"
+#include "convolver/partitioned_convolver.h"
+#include "tools/fifo.h"
+#include "tools/param_snapshot.h"
+#include "tools/conversion.h"
+#include "tools/util.h"
+
+#define MAX_SAMPLE_SIZE 2048
+#define MAX_IR_PATH 1024
+#define DEFAULT_BLOCK_SIZE 1024
+
+typedef struct {
+    bool effect_on;
+    // impulse response file, empty for none
+    char ir_path[MAX_IR_PATH];
+    // frames per partition, also the latency
+    int block_size;
+    float wet_gain_dB;
+    float dry_gain_dB;
+    // built by set() for ir_path and block_size, each copy holds a
+    // reference, NULL for none
+    PartitionedConvolver *conv;
+} params_t;
+
+typedef struct {
+    fifo *fifo_in;
+    fifo *fifo_out;
+    // the copy set() edits, published to the audio thread through snapshot
+    params_t params;
+    ParamSnapshot *snapshot;
+
+    // derived from the params by the audio thread
+    bool running;
+    int block_size;
+    float wet_gain;
+    float dry_gain;
+    // the conv of the params acquired last, they keep it alive
+    PartitionedConvolver *conv;
+
+    // frames of the block being collected
+    float *in_block;
+    int nb_in;
+    // frames drain() still gives back, -1 until the input has ended
+    int nb_drain;
+    float *out_block;
+    // processed frames not handed back yet
+    fifo *out_frames;
+
+    short fix_buffer[MAX_SAMPLE_SIZE];
+    float flp_buffer[MAX_SAMPLE_SIZE];
+} priv_t;
+
+static void init_parameter(params_t *params) {
+    assert(NULL != params);
+    params->effect_on = false;
+    params->ir_path[0] = '\0';
+    params->block_size = DEFAULT_BLOCK_SIZE;
+    params->wet_gain_dB = 0.0f;
+    params->dry_gain_dB = 0.0f;
+    params->conv = NULL;
+}
+
+static void params_retain(void *params) {
+    partitioned_convolver_ref(((params_t *)params)->conv);
+}
+
+static void params_release(void *params) {
+    partitioned_convolver_freep(&((params_t *)params)->conv);
+}
+
+static bool valid_block_size(int block_size) {
+    return block_size >= IR_MIN_BLOCK_SIZE &&
+           block_size <= IR_MAX_BLOCK_SIZE &&
+           (block_size & (block_size - 1)) == 0;
+}
+
+// the frames collected so far go out unprocessed
+static void flush_in_block(EffectContext *ctx) {
+    priv_t *priv = (priv_t *)ctx->priv;
+    if (priv->nb_in > 0)
+        fifo_write(priv->out_frames, priv->in_block, priv->nb_in);
+    priv->nb_in = 0;
+}
+
+static void convolver_start(EffectContext *ctx, const params_t *params) {
+    LogInfo("%s.\n", __func__);
+    priv_t *priv = (priv_t *)ctx->priv;
+
+    priv->wet_gain = dB_to_linear(params->wet_gain_dB);
+    priv->dry_gain = dB_to_linear(params->dry_gain_dB);
+
+    // the blocks of the old and the new size do not line up
+    if (priv->block_size != params->block_size) flush_in_block(ctx);
+    priv->block_size = params->block_size;
+    priv->conv = params->conv;
+
+    if (params->effect_on && !priv->running)
+        partitioned_convolver_reset(priv->conv);
+    priv->running = params->effect_on;
+}
+
+// audio thread, once per block
+static const params_t *acquire_params(EffectContext *ctx) {
+    priv_t *priv = (priv_t *)ctx->priv;
+    bool changed = false;
+    const params_t *params = param_snapshot_acquire(priv->snapshot, &changed);
+    if (changed) convolver_start(ctx, params);
+    return params;
+}
+
+static void convolve_block(EffectContext *ctx) {
+    priv_t *priv = (priv_t *)ctx->priv;
+    const size_t nb_samples = priv->block_size * ctx->in_signal.channels;
+
+    if (priv->running && priv->conv) {
+        partitioned_convolver_process(priv->conv, priv->in_block,
+                                      priv->out_block);
+        const float wet_gain = priv->wet_gain, dry_gain = priv->dry_gain;
+        for (size_t i = 0; i < nb_samples; ++i) {
+            priv->out_block[i] = priv->out_block[i] * wet_gain +
+                                 priv->in_block[i] * dry_gain;
+        }
+        fifo_write(priv->out_frames, priv->out_block, priv->block_size);
+    } else {
+        fifo_write(priv->out_frames, priv->in_block, priv->block_size);
+    }
+    priv->nb_in = 0;
+}
+
+/**
+ * Collects the input into blocks, a block comes out once it is complete,
+ * so the output lags block_size frames behind and fewer samples than
+ * given come back until the first block is done. Blocks are collected
+ * even when the effect is off, switching it does not shift the signal.
+ */
+static int convolver_filter(EffectContext *ctx, float *samples,
+                            const size_t nb_samples) {
+    priv_t *priv = (priv_t *)ctx->priv;
+    const int channels = ctx->in_signal.channels;
+    const size_t nb_frames = nb_samples / channels;
+    acquire_params(ctx);
+
+    // the output never gets ahead of the input, samples is reused in place
+    size_t nb_read = 0, nb_written = 0;
+    while (nb_read < nb_frames) {
+        size_t n = priv->block_size - priv->nb_in;
+        if (n > nb_frames - nb_read) n = nb_frames - nb_read;
+        memcpy(priv->in_block + (size_t)priv->nb_in * channels,
+               samples + nb_read * channels, n * channels * sizeof(float));
+        priv->nb_in += n;
+        nb_read += n;
+
+        if (priv->nb_in == priv->block_size) convolve_block(ctx);
+        nb_written += fifo_read(priv->out_frames,
+                                samples + nb_written * channels,
+                                nb_read - nb_written);
+    }
+    return nb_written * channels;
+}
+
+// zeros after the input push out the pending block and the tail
+static int convolver_drain(EffectContext *ctx, float *samples,
+                           const size_t nb_samples) {
+    assert(NULL != ctx);
+    priv_t *priv = (priv_t *)ctx->priv;
+    assert(NULL != priv);
+    const int channels = ctx->in_signal.channels;
+    acquire_params(ctx);
+
+    if (priv->nb_drain < 0) {
+        priv->nb_drain = priv->nb_in + fifo_occupancy(priv->out_frames);
+        if (priv->running)
+            priv->nb_drain += partitioned_convolver_tail_frames(priv->conv);
+    }
+
+    size_t nb_frames = nb_samples / channels;
+    if (nb_frames > (size_t)priv->nb_drain) nb_frames = priv->nb_drain;
+    size_t nb_out = 0;
+    while (nb_out < nb_frames) {
+        float *out = samples + nb_out * channels;
+        const size_t n = nb_frames - nb_out;
+        memset(out, 0, n * channels * sizeof(float));
+        nb_out += convolver_filter(ctx, out, n * channels) / channels;
+    }
+    priv->nb_drain -= nb_frames;
+    return nb_frames * channels;
+}
+
+static int convolver_close(EffectContext *ctx) {
+    LogInfo("%s.\n", __func__);
+    assert(NULL != ctx);
+
+    if (ctx->priv) {
+        priv_t *priv = (priv_t *)ctx->priv;
+        if (priv->fifo_in) fifo_delete(&priv->fifo_in);
+        if (priv->fifo_out) fifo_delete(&priv->fifo_out);
+        if (priv->out_frames) fifo_delete(&priv->out_frames);
+        if (priv->snapshot) param_snapshot_freep(&priv->snapshot);
+        priv->conv = NULL;
+        if (priv->in_block) {
+            free(priv->in_block);
+            priv->in_block = NULL;
+        }
+        if (priv->out_block) {
+            free(priv->out_block);
+            priv->out_block = NULL;
+        }
+    }
+    return 0;
+}
+
+static int convolver_init(EffectContext *ctx, int argc, const char **argv) {
+    LogInfo("%s.\n", __func__);
+    for (int i = 0; i < argc; ++i) {
+        LogInfo("argv[%d] = %s\n", i, argv[i]);
+    }
+    assert(NULL != ctx);
+    priv_t *priv = (priv_t *)ctx->priv;
+    if (NULL == priv) return AEERROR_NULL_POINT;
+
+    int ret = 0;
+    const int channels = ctx->in_signal.channels;
+    priv->fifo_in = fifo_create(sizeof(short));
+    if (NULL == priv->fifo_in) {
+        ret = AEERROR_NOMEM;
+        goto end;
+    }
+    priv->fifo_out = fifo_create(sizeof(short));
+    if (NULL == priv->fifo_out) {
+        ret = AEERROR_NOMEM;
+        goto end;
+    }
+    priv->out_frames = fifo_create(channels * sizeof(float));
+    if (NULL == priv->out_frames) {
+        ret = AEERROR_NOMEM;
+        goto end;
+    }
+    priv->in_block = (float *)calloc(IR_MAX_BLOCK_SIZE * channels,
+                                     sizeof(float));
+    priv->out_block = (float *)calloc(IR_MAX_BLOCK_SIZE * channels,
+                                      sizeof(float));
+    if (NULL == priv->in_block || NULL == priv->out_block) {
+        LogError("%s calloc blocks failed.\n", __func__);
+        ret = AEERROR_NOMEM;
+        goto end;
+    }
+
+    init_parameter(&priv->params);
+    priv->block_size = priv->params.block_size;
+    priv->nb_drain = -1;
+    priv->snapshot = param_snapshot_create_ref(sizeof(params_t), &priv->params,
+                                               params_retain, params_release);
+    if (NULL == priv->snapshot) {
+        ret = AEERROR_NOMEM;
+        goto end;
+    }
+
+end:
+    if (ret < 0) convolver_close(ctx);
+    return ret;
+}
+
+static int convolver_set(EffectContext *ctx, const char *key, int flags) {
+    assert(NULL != ctx);
+
+    priv_t *priv = (priv_t *)ctx->priv;
+    AEDictionaryEntry *entry = ae_dict_get(ctx->options, key, NULL, flags);
+    if (entry) {
+        LogInfo("%s key = %s val = %s\n", __func__, entry->key, entry->value);
+
+        // a bad value leaves the published params unchanged
+        params_t params = priv->params;
+        if (0 == strcasecmp(entry->key, "Switch")) {
+            if (0 == strcasecmp(entry->value, "Off")) {
+                params.effect_on = false;
+            } else if (0 == strcasecmp(entry->value, "On")) {
+                params.effect_on = true;
+            }
+        } else if (0 == strcasecmp(entry->key, "ir")) {
+            if (strlen(entry->value) >= MAX_IR_PATH) {
+                LogError("%s path too long.\n", __func__);
+                return AEERROR_INVALID_PARAMETER;
+            }
+            strcpy(params.ir_path, entry->value);
+        } else if (0 == strcasecmp(entry->key, "block_size")) {
+            params.block_size = atoi(entry->value);
+            if (!valid_block_size(params.block_size)) {
+                LogError("%s block_size must be a power of 2 in [%d, %d].\n",
+                         __func__, IR_MIN_BLOCK_SIZE, IR_MAX_BLOCK_SIZE);
+                return AEERROR_INVALID_PARAMETER;
+            }
+        } else if (0 == strcasecmp(entry->key, "wet_gain_dB")) {
+            params.wet_gain_dB = strtod(entry->value, NULL);
+        } else if (0 == strcasecmp(entry->key, "dry_gain_dB")) {
+            params.dry_gain_dB = strtod(entry->value, NULL);
+        }
+
+        // decode, transform and allocate here rather than on the audio
+        // thread, which only picks up the convolver with the params
+        PartitionedConvolver *conv = NULL;
+        if ('\0' == params.ir_path[0]) {
+            params.conv = NULL;
+        } else if (0 != strcmp(params.ir_path, priv->params.ir_path) ||
+                   params.block_size != priv->params.block_size ||
+                   NULL == priv->params.conv) {
+            IrSpectrum *ir = ir_spectrum_load(params.ir_path,
+                ctx->in_signal.sample_rate, ctx->in_signal.channels,
+                params.block_size);
+            if (NULL == ir) return AEERROR_INVALID_PARAMETER;
+            conv = partitioned_convolver_create(ir);
+            ir_spectrum_release(&ir);
+            if (NULL == conv) return AEERROR_NOMEM;
+            params.conv = conv;
+        }
+
+        // the published copy takes its own reference of conv
+        int ret = param_snapshot_publish(priv->snapshot, &params);
+        partitioned_convolver_freep(&conv);
+        if (ret < 0) return AEERROR_NOMEM;
+        priv->params = params;
+    }
+    return 0;
+}
+
+static int convolver_reset(EffectContext *ctx) {
+    assert(NULL != ctx);
+    priv_t *priv = (priv_t *)ctx->priv;
+    if (NULL == priv) return AEERROR_NULL_POINT;
+
+    fifo_clear(priv->fifo_in);
+    fifo_clear(priv->fifo_out);
+    fifo_clear(priv->out_frames);
+    priv->nb_in = 0;
+    priv->nb_drain = -1;
+    partitioned_convolver_reset(priv->conv);
+    return 0;
+}
+
+static int convolver_send(EffectContext *ctx, const void *samples,
+                          const size_t nb_samples) {
+    assert(NULL != ctx);
+    priv_t *priv = (priv_t *)ctx->priv;
+    assert(NULL != priv);
+    assert(NULL != priv->fifo_in);
+
+    return fifo_write(priv->fifo_in, samples, nb_samples);
+}
+
+static int convolver_receive(EffectContext *ctx, void *samples,
+                             const size_t max_nb_samples) {
+    assert(NULL != ctx);
+    priv_t *priv = (priv_t *)ctx->priv;
+    assert(NULL != priv);
+    assert(NULL != priv->fifo_in);
+
+    // whole frames only
+    const size_t block = MAX_SAMPLE_SIZE / ctx->in_signal.channels *
+                         ctx->in_signal.channels;
+    int nb_samples = fifo_read(priv->fifo_in, priv->fix_buffer, block);
+    while (nb_samples > 0) {
+        S16ToFloat(priv->fix_buffer, priv->flp_buffer, nb_samples);
+        nb_samples = convolver_filter(ctx, priv->flp_buffer, nb_samples);
+        FloatToS16(priv->flp_buffer, priv->fix_buffer, nb_samples);
+        fifo_write(priv->fifo_out, priv->fix_buffer, nb_samples);
+        nb_samples = fifo_read(priv->fifo_in, priv->fix_buffer, block);
+    }
+
+    if (atomic_load(&ctx->return_max_nb_samples) &&
+        fifo_occupancy(priv->fifo_out) < max_nb_samples)
+        return 0;
+
+    return fifo_read(priv->fifo_out, samples, max_nb_samples);
+}
+
+static int convolver_process(EffectContext *ctx, float *samples,
+                             const size_t nb_samples) {
+    assert(NULL != ctx);
+    assert(NULL != ctx->priv);
+
+    return convolver_filter(ctx, samples, nb_samples);
+}
+
+const EffectHandler *effect_convolver_fn(void) {
+    static EffectHandler handler = {
+        .name = "convolver",
+        .usage = "keys: Switch On/Off, ir <impulse response file>, "
+                 "block_size <64..8192, power of 2>, "
+                 "wet_gain_dB, dry_gain_dB",
+        .priv_size = sizeof(priv_t),
+        .init = convolver_init,
+        .set = convolver_set,
+        .send = convolver_send,
+        .receive = convolver_receive,
+        .close = convolver_close,
+        .process = convolver_process,
+        .multichannel = true,
+        .drain = convolver_drain,
+        .reset = convolver_reset};
+    return &handler;
+}
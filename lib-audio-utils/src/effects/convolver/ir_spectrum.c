@@ -0,0 +1,220 @@
+#include "ir_spectrum.h"
+#include <math.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "codec/audio_decoder_factory.h"
+#include "dsp_tools/fft/fft8g.h"
+#include "error_def.h"
+#include "log.h"
+
+static struct {
+    pthread_mutex_t mutex;
+    // the responses loaded from files
+    IrSpectrum *head;
+} cache = {PTHREAD_MUTEX_INITIALIZER, NULL};
+
+static bool is_power_of_2(int n) { return n > 0 && (n & (n - 1)) == 0; }
+
+void ir_spectrum_transform(int block_size, float *frame, int *ip, float *w,
+                           float *spectrum) {
+    ae_rdft_f(block_size << 1, 1, frame, ip, w);
+
+    float *re = spectrum;
+    float *im = spectrum + block_size;
+    re[0] = frame[0];
+    im[0] = frame[1];
+    for (int k = 1; k < block_size; ++k) {
+        re[k] = frame[k << 1];
+        im[k] = frame[(k << 1) + 1];
+    }
+}
+
+static void ir_spectrum_free(IrSpectrum *ir) {
+    if (!ir) return;
+    if (ir->spectra) free(ir->spectra);
+    if (ir->file_addr) free(ir->file_addr);
+    free(ir);
+}
+
+IrSpectrum *ir_spectrum_create(const float *ir, int nb_frames, int channels,
+                               int block_size) {
+    if (!ir || nb_frames <= 0 || channels <= 0 ||
+        !is_power_of_2(block_size) || block_size < IR_MIN_BLOCK_SIZE ||
+        block_size > IR_MAX_BLOCK_SIZE) {
+        LogError("%s invalid param, %d frames %d channels block %d.\n",
+                 __func__, nb_frames, channels, block_size);
+        return NULL;
+    }
+
+    const int n = block_size << 1;
+    float *frame = NULL;
+    int *ip = NULL;
+    float *w = NULL;
+    IrSpectrum *self = (IrSpectrum *)calloc(1, sizeof(IrSpectrum));
+    if (!self) goto fail;
+
+    self->block_size = block_size;
+    self->nb_partitions = (nb_frames + block_size - 1) / block_size;
+    self->channels = channels;
+    self->ref_count = 1;
+    self->spectra = (float *)malloc(
+        (size_t)channels * self->nb_partitions * n * sizeof(float));
+    frame = (float *)malloc(n * sizeof(float));
+    ip = (int *)calloc(2 + (int)sqrt(n / 2) + 1, sizeof(int));
+    w = (float *)malloc(n / 2 * sizeof(float));
+    if (!self->spectra || !frame || !ip || !w) goto fail;
+
+    const float scale = 1.0f / block_size;
+    float *spectrum = self->spectra;
+    for (int c = 0; c < channels; ++c) {
+        for (int p = 0; p < self->nb_partitions; ++p) {
+            const int offset = p * block_size;
+            int len = nb_frames - offset;
+            if (len > block_size) len = block_size;
+
+            memset(frame, 0, n * sizeof(float));
+            for (int i = 0; i < len; ++i)
+                frame[i] = ir[(size_t)(offset + i) * channels + c] * scale;
+            ir_spectrum_transform(block_size, frame, ip, w, spectrum);
+            spectrum += n;
+        }
+    }
+
+    free(frame);
+    free(ip);
+    free(w);
+    return self;
+fail:
+    LogError("%s out of memory.\n", __func__);
+    if (frame) free(frame);
+    if (ip) free(ip);
+    if (w) free(w);
+    ir_spectrum_free(self);
+    return NULL;
+}
+
+// the whole file as interleaved float, NULL on failure
+static float *decode_file(const char *file_addr, int sample_rate,
+                          int channels, int *nb_frames) {
+    IAudioDecoder *decoder = audio_decoder_create_fmt(file_addr, 0, 0,
+        sample_rate, channels, 1.0f, DECODER_FFMPEG, DECODER_SAMPLE_FMT_FLT);
+    if (!decoder) {
+        LogError("%s open %s failed.\n", __func__, file_addr);
+        return NULL;
+    }
+
+    const int max_nb_samples = IR_MAX_SECONDS * sample_rate * channels;
+    const int read_size = 1024 / channels * channels;
+    int nb_samples = 0;
+    int capacity = 0;
+    float *samples = NULL;
+    while (nb_samples < max_nb_samples) {
+        if (nb_samples + read_size > capacity) {
+            int new_capacity = capacity ? capacity << 1 : 16 * read_size;
+            float *tmp = (float *)realloc(samples,
+                                          new_capacity * sizeof(float));
+            if (!tmp) {
+                LogError("%s out of memory.\n", __func__);
+                nb_samples = 0;
+                break;
+            }
+            samples = tmp;
+            capacity = new_capacity;
+        }
+        int ret = IAudioDecoder_get_pcm_frame_flt(decoder,
+            samples + nb_samples, read_size, false);
+        if (ret <= 0) break;
+        nb_samples += ret;
+    }
+    IAudioDecoder_freep(&decoder);
+
+    if (nb_samples > max_nb_samples) nb_samples = max_nb_samples;
+    *nb_frames = nb_samples / channels;
+    if (*nb_frames <= 0) {
+        LogError("%s no samples in %s.\n", __func__, file_addr);
+        if (samples) free(samples);
+        return NULL;
+    }
+    return samples;
+}
+
+IrSpectrum *ir_spectrum_load(const char *file_addr, int sample_rate,
+                             int channels, int block_size) {
+    if (!file_addr || sample_rate <= 0 || channels <= 0) return NULL;
+
+    struct stat st;
+    if (stat(file_addr, &st) < 0) {
+        LogError("%s stat %s failed.\n", __func__, file_addr);
+        return NULL;
+    }
+
+    IrSpectrum *ir = NULL;
+    // held while decoding, so a response is never transformed twice
+    pthread_mutex_lock(&cache.mutex);
+    for (ir = cache.head; ir; ir = ir->next) {
+        if (ir->sample_rate == sample_rate && ir->channels == channels &&
+            ir->block_size == block_size &&
+            ir->mtime == (int64_t)st.st_mtime &&
+            ir->file_size == (int64_t)st.st_size &&
+            !strcmp(ir->file_addr, file_addr)) {
+            ir->ref_count++;
+            goto end;
+        }
+    }
+
+    int nb_frames = 0;
+    float *samples = decode_file(file_addr, sample_rate, channels,
+                                 &nb_frames);
+    if (!samples) goto end;
+    ir = ir_spectrum_create(samples, nb_frames, channels, block_size);
+    free(samples);
+    if (!ir) goto end;
+
+    ir->file_addr = strdup(file_addr);
+    if (!ir->file_addr) {
+        ir_spectrum_free(ir);
+        ir = NULL;
+        goto end;
+    }
+    ir->mtime = st.st_mtime;
+    ir->file_size = st.st_size;
+    ir->sample_rate = sample_rate;
+    ir->next = cache.head;
+    cache.head = ir;
+    LogInfo("%s %s, %d frames in %d partitions.\n", __func__, file_addr,
+            nb_frames, ir->nb_partitions);
+end:
+    pthread_mutex_unlock(&cache.mutex);
+    return ir;
+}
+
+IrSpectrum *ir_spectrum_ref(IrSpectrum *ir) {
+    if (!ir) return NULL;
+    pthread_mutex_lock(&cache.mutex);
+    ir->ref_count++;
+    pthread_mutex_unlock(&cache.mutex);
+    return ir;
+}
+
+void ir_spectrum_release(IrSpectrum **ir) {
+    if (!ir || !*ir) return;
+
+    IrSpectrum *self = *ir;
+    *ir = NULL;
+    pthread_mutex_lock(&cache.mutex);
+    if (--self->ref_count > 0) {
+        pthread_mutex_unlock(&cache.mutex);
+        return;
+    }
+    for (IrSpectrum **p = &cache.head; *p; p = &(*p)->next) {
+        if (*p == self) {
+            *p = self->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&cache.mutex);
+    ir_spectrum_free(self);
+}
@@ -0,0 +1,81 @@
+#ifndef IR_SPECTRUM_H_
+#define IR_SPECTRUM_H_
+#include <stdint.h>
+
+/**
+ * An impulse response cut into partitions of block_size frames, each
+ * zero padded to 2 * block_size and transformed once, ready for uniformly
+ * partitioned overlap-save convolution. Read only once created, so any
+ * number of convolvers share one. Responses loaded from files are kept in
+ * a process wide cache keyed by (path, mtime, size, sample_rate, channels,
+ * block_size) for as long as someone holds a reference.
+ */
+
+#define IR_MIN_BLOCK_SIZE 64
+#define IR_MAX_BLOCK_SIZE 8192
+// longer responses are cut
+#define IR_MAX_SECONDS 10
+
+typedef struct IrSpectrum IrSpectrum;
+struct IrSpectrum {
+    int block_size;
+    int nb_partitions;
+    int channels;
+    /**
+     * nb_partitions spectra of each channel, channel after channel. A
+     * spectrum is block_size real parts followed by block_size imaginary
+     * parts, bin 0 holds dc and nyquist as its real and imaginary part.
+     * Scaled by the 1 / block_size of the inverse transform.
+     */
+    float *spectra;
+
+    // private to ir_spectrum.c
+    int ref_count;
+    char *file_addr;
+    int64_t mtime;
+    int64_t file_size;
+    int sample_rate;
+    IrSpectrum *next;
+};
+
+/**
+ * @brief transform a frame of 2 * block_size samples in place into the
+ *        layout of IrSpectrum.spectra
+ *
+ * @param ip, w tables of ae_rdft_f, ip[0] = 0 makes them on first use
+ * @param spectrum 2 * block_size floats
+ */
+void ir_spectrum_transform(int block_size, float *frame, int *ip, float *w,
+                           float *spectrum);
+
+/**
+ * @brief partition an impulse response held in memory
+ *
+ * @param ir nb_frames interleaved frames of channels samples
+ * @param block_size power of two between IR_MIN_BLOCK_SIZE and
+ *        IR_MAX_BLOCK_SIZE
+ * @return NULL if a param is invalid or out of memory
+ */
+IrSpectrum *ir_spectrum_create(const float *ir, int nb_frames, int channels,
+                               int block_size);
+
+/**
+ * @brief decode an impulse response file resampled to sample_rate and
+ *        mixed to channels, or take it from the cache
+ *
+ * @return NULL if the file could not be decoded
+ */
+IrSpectrum *ir_spectrum_load(const char *file_addr, int sample_rate,
+                             int channels, int block_size);
+
+/**
+ * @brief take another reference of ir
+ */
+IrSpectrum *ir_spectrum_ref(IrSpectrum *ir);
+
+/**
+ * @brief drop a reference, the last one frees ir
+ */
+void ir_spectrum_release(IrSpectrum **ir);
+
+#endif  // IR_SPECTRUM_H_
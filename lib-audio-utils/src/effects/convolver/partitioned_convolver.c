@@ -0,0 +1,172 @@
+#include "partitioned_convolver.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dsp_tools/fft/fft8g.h"
+#include "log.h"
+
+typedef struct {
+    // input of the previous block, the first half of the next fft frame
+    float *history;
+    // spectra of the last nb_partitions input blocks
+    float *fdl;
+} channel_t;
+
+struct PartitionedConvolver {
+    int ref_count;
+    IrSpectrum *ir;
+    int block_size;
+    int nb_partitions;
+    int channels;
+    // slot of the newest spectrum in the fdl of every channel
+    int head;
+    channel_t *chans;
+
+    float *frame;
+    float *acc;
+    // tables of ae_rdft_f, which also writes ip, so not shared with ir
+    int *ip;
+    float *w;
+};
+
+// acc += x * h over the bins of a spectrum
+static void spectrum_mul_add(const int block_size, const float *x,
+                             const float *h, float *acc) {
+    const float *restrict xr = x, *restrict xi = x + block_size;
+    const float *restrict hr = h, *restrict hi = h + block_size;
+    float *restrict ar = acc, *restrict ai = acc + block_size;
+
+    // dc and nyquist are real
+    const float dc = ar[0] + xr[0] * hr[0];
+    const float nyquist = ai[0] + xi[0] * hi[0];
+    for (int k = 0; k < block_size; ++k) {
+        ar[k] += xr[k] * hr[k] - xi[k] * hi[k];
+        ai[k] += xr[k] * hi[k] + xi[k] * hr[k];
+    }
+    ar[0] = dc;
+    ai[0] = nyquist;
+}
+
+void partitioned_convolver_process(PartitionedConvolver *conv,
+                                   const float *in, float *out) {
+    const int block_size = conv->block_size;
+    const int channels = conv->channels;
+    const int n = block_size << 1;
+    const int stride = channels;
+    float *frame = conv->frame;
+    float *acc = conv->acc;
+
+    conv->head = conv->head > 0 ? conv->head - 1 : conv->nb_partitions - 1;
+    for (int c = 0; c < channels; ++c) {
+        channel_t *chan = conv->chans + c;
+
+        // overlap-save, the previous block then this one
+        memcpy(frame, chan->history, block_size * sizeof(float));
+        for (int i = 0; i < block_size; ++i)
+            chan->history[i] = frame[block_size + i] = in[i * stride + c];
+        ir_spectrum_transform(block_size, frame, conv->ip, conv->w,
+                              chan->fdl + (size_t)conv->head * n);
+
+        // partition p meets the input of p blocks before
+        const float *h = conv->ir->spectra +
+                         (size_t)c * conv->nb_partitions * n;
+        memset(acc, 0, n * sizeof(float));
+        for (int p = 0, slot = conv->head; p < conv->nb_partitions; ++p) {
+            spectrum_mul_add(block_size, chan->fdl + (size_t)slot * n,
+                             h + (size_t)p * n, acc);
+            if (++slot == conv->nb_partitions) slot = 0;
+        }
+
+        frame[0] = acc[0];
+        frame[1] = acc[block_size];
+        for (int k = 1; k < block_size; ++k) {
+            frame[k << 1] = acc[k];
+            frame[(k << 1) + 1] = acc[block_size + k];
+        }
+        ae_rdft_f(n, -1, frame, conv->ip, conv->w);
+
+        // the first half wrapped around, the second is the linear part
+        for (int i = 0; i < block_size; ++i)
+            out[i * stride + c] = frame[block_size + i];
+    }
+}
+
+int partitioned_convolver_tail_frames(const PartitionedConvolver *conv) {
+    return conv ? conv->nb_partitions * conv->block_size : 0;
+}
+
+void partitioned_convolver_reset(PartitionedConvolver *conv) {
+    if (!conv) return;
+
+    const size_t n = conv->block_size << 1;
+    for (int c = 0; c < conv->channels; ++c) {
+        memset(conv->chans[c].history, 0, conv->block_size * sizeof(float));
+        memset(conv->chans[c].fdl, 0,
+               conv->nb_partitions * n * sizeof(float));
+    }
+    conv->head = 0;
+}
+
+PartitionedConvolver *partitioned_convolver_ref(PartitionedConvolver *conv) {
+    if (!conv) return NULL;
+    __atomic_add_fetch(&conv->ref_count, 1, __ATOMIC_RELAXED);
+    return conv;
+}
+
+void partitioned_convolver_freep(PartitionedConvolver **conv) {
+    if (!conv || !*conv) return;
+
+    PartitionedConvolver *self = *conv;
+    *conv = NULL;
+    if (__atomic_sub_fetch(&self->ref_count, 1, __ATOMIC_ACQ_REL) > 0)
+        return;
+    if (self->chans) {
+        for (int c = 0; c < self->channels; ++c) {
+            if (self->chans[c].history) free(self->chans[c].history);
+            if (self->chans[c].fdl) free(self->chans[c].fdl);
+        }
+        free(self->chans);
+    }
+    if (self->frame) free(self->frame);
+    if (self->acc) free(self->acc);
+    if (self->ip) free(self->ip);
+    if (self->w) free(self->w);
+    ir_spectrum_release(&self->ir);
+    free(self);
+}
+
+PartitionedConvolver *partitioned_convolver_create(IrSpectrum *ir) {
+    if (!ir) return NULL;
+
+    PartitionedConvolver *self =
+        (PartitionedConvolver *)calloc(1, sizeof(PartitionedConvolver));
+    if (!self) goto fail;
+
+    self->ref_count = 1;
+    self->ir = ir_spectrum_ref(ir);
+    self->block_size = ir->block_size;
+    self->nb_partitions = ir->nb_partitions;
+    self->channels = ir->channels;
+
+    const size_t n = self->block_size << 1;
+    self->frame = (float *)malloc(n * sizeof(float));
+    self->acc = (float *)malloc(n * sizeof(float));
+    self->ip = (int *)calloc(2 + (int)sqrt(n / 2) + 1, sizeof(int));
+    self->w = (float *)malloc(n / 2 * sizeof(float));
+    self->chans = (channel_t *)calloc(self->channels, sizeof(channel_t));
+    if (!self->frame || !self->acc || !self->ip || !self->w || !self->chans)
+        goto fail;
+
+    for (int c = 0; c < self->channels; ++c) {
+        self->chans[c].history =
+            (float *)calloc(self->block_size, sizeof(float));
+        self->chans[c].fdl =
+            (float *)calloc(self->nb_partitions * n, sizeof(float));
+        if (!self->chans[c].history || !self->chans[c].fdl) goto fail;
+    }
+    return self;
+fail:
+    LogError("%s out of memory.\n", __func__);
+    partitioned_convolver_freep(&self);
+    return NULL;
+}
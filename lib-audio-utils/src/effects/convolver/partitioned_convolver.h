@@ -0,0 +1,54 @@
+#ifndef PARTITIONED_CONVOLVER_H_
+#define PARTITIONED_CONVOLVER_H_
+#include "ir_spectrum.h"
+
+/**
+ * Uniformly partitioned overlap-save convolution. Each block of input is
+ * transformed once and kept in a delay line of spectra, the output block
+ * is the inverse transform of the sum of those spectra times the matching
+ * partitions of the impulse response. Costs two transforms of
+ * 2 * block_size points per block and channel plus one complex multiply
+ * add per bin and partition, whatever the length of the response. Channel
+ * c of the input is convolved with channel c of the response.
+ */
+
+typedef struct PartitionedConvolver PartitionedConvolver;
+
+/**
+ * @brief create a convolver, it takes its own reference of ir
+ *
+ * @return NULL if out of memory, else a convolver with one reference
+ */
+PartitionedConvolver *partitioned_convolver_create(IrSpectrum *ir);
+
+/**
+ * @brief take another reference of conv
+ */
+PartitionedConvolver *partitioned_convolver_ref(PartitionedConvolver *conv);
+
+/**
+ * @brief drop a reference, the last one frees conv
+ */
+void partitioned_convolver_freep(PartitionedConvolver **conv);
+
+/**
+ * @brief frames the output goes on for after the last input frame, the
+ *        response rounded up to whole blocks
+ */
+int partitioned_convolver_tail_frames(const PartitionedConvolver *conv);
+
+/**
+ * @brief clear the delay line, as if only silence had come in so far
+ */
+void partitioned_convolver_reset(PartitionedConvolver *conv);
+
+/**
+ * @brief convolve the next block
+ *
+ * @param in block_size interleaved frames of ir->channels samples
+ * @param out the response to everything up to the end of in, may be in
+ */
+void partitioned_convolver_process(PartitionedConvolver *conv,
+                                   const float *in, float *out);
+
+#endif  // PARTITIONED_CONVOLVER_H_
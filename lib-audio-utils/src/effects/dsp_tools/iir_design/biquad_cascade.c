@@ -0,0 +1,249 @@
+#include "biquad_cascade.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define BIQUAD_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define BIQUAD_NEON
+#endif
+
+#define NB_GROUP_LANES 4
+// floats of a section in a group, b0 b1 b2 a1 a2 of each lane
+#define SECTION_COEFFS (5 * NB_GROUP_LANES)
+// floats of a section in a group, s1 s2 of each lane
+#define SECTION_STATES (2 * NB_GROUP_LANES)
+
+/**
+ * The lanes are stored in groups of four, lane l is element l % 4 of
+ * group l / 4. The unused lanes of the last group pass silence.
+ */
+struct BiquadCascadeT {
+    int nb_lanes;
+    int nb_groups;
+    int nb_sections;
+    float *coeffs;
+    float *states;
+};
+
+#if defined(BIQUAD_SSE2) || defined(BIQUAD_NEON)
+
+#if defined(BIQUAD_SSE2)
+typedef __m128 vec4;
+#define vec4_load _mm_loadu_ps
+#define vec4_store _mm_storeu_ps
+#define vec4_add _mm_add_ps
+#define vec4_sub _mm_sub_ps
+#define vec4_mul _mm_mul_ps
+#define vec4_set _mm_setr_ps
+#else
+typedef float32x4_t vec4;
+#define vec4_load vld1q_f32
+#define vec4_store vst1q_f32
+#define vec4_add vaddq_f32
+#define vec4_sub vsubq_f32
+#define vec4_mul vmulq_f32
+#define vec4_set(a, b, c, d) ((float32x4_t){a, b, c, d})
+#endif
+
+/**
+ * nb_sections is a constant where this is inlined, so the loop over the
+ * sections unrolls and the states stay in registers
+ */
+static inline __attribute__((always_inline)) void group_process(
+    const float *coeffs, float *states, const int nb_sections,
+    const float *const *in, const size_t in_stride, float *const *out,
+    const size_t out_stride, const int nb_used, const size_t nb_frames) {
+    vec4 s1[BIQUAD_MAX_SECTIONS], s2[BIQUAD_MAX_SECTIONS];
+    for (int j = 0; j < nb_sections; ++j) {
+        s1[j] = vec4_load(states + j * SECTION_STATES);
+        s2[j] = vec4_load(states + j * SECTION_STATES + NB_GROUP_LANES);
+    }
+
+    // the unused lanes read lane 0, their outputs are dropped
+    const float *in4[NB_GROUP_LANES];
+    for (int k = 0; k < NB_GROUP_LANES; ++k) in4[k] = in[k < nb_used ? k : 0];
+
+    float y4[NB_GROUP_LANES];
+    for (size_t i = 0; i < nb_frames; ++i) {
+        const size_t n = i * in_stride;
+        vec4 x = vec4_set(in4[0][n], in4[1][n], in4[2][n], in4[3][n]);
+        for (int j = 0; j < nb_sections; ++j) {
+            const float *c = coeffs + j * SECTION_COEFFS;
+            vec4 y = vec4_add(vec4_mul(vec4_load(c), x), s1[j]);
+            s1[j] = vec4_sub(vec4_add(vec4_mul(vec4_load(c + 4), x), s2[j]),
+                             vec4_mul(vec4_load(c + 12), y));
+            s2[j] = vec4_sub(vec4_mul(vec4_load(c + 8), x),
+                             vec4_mul(vec4_load(c + 16), y));
+            x = y;
+        }
+        vec4_store(y4, x);
+        for (int k = 0; k < nb_used; ++k) out[k][i * out_stride] = y4[k];
+    }
+
+    for (int j = 0; j < nb_sections; ++j) {
+        vec4_store(states + j * SECTION_STATES, s1[j]);
+        vec4_store(states + j * SECTION_STATES + NB_GROUP_LANES, s2[j]);
+    }
+}
+
+#else
+
+static inline __attribute__((always_inline)) void group_process(
+    const float *coeffs, float *states, const int nb_sections,
+    const float *const *in, const size_t in_stride, float *const *out,
+    const size_t out_stride, const int nb_used, const size_t nb_frames) {
+    for (int k = 0; k < nb_used; ++k) {
+        float s1[BIQUAD_MAX_SECTIONS], s2[BIQUAD_MAX_SECTIONS];
+        for (int j = 0; j < nb_sections; ++j) {
+            s1[j] = states[j * SECTION_STATES + k];
+            s2[j] = states[j * SECTION_STATES + NB_GROUP_LANES + k];
+        }
+
+        for (size_t i = 0; i < nb_frames; ++i) {
+            float x = in[k][i * in_stride];
+            for (int j = 0; j < nb_sections; ++j) {
+                const float *c = coeffs + j * SECTION_COEFFS + k;
+                float y = c[0] * x + s1[j];
+                s1[j] = c[4] * x + s2[j] - c[12] * y;
+                s2[j] = c[8] * x - c[16] * y;
+                x = y;
+            }
+            out[k][i * out_stride] = x;
+        }
+
+        for (int j = 0; j < nb_sections; ++j) {
+            states[j * SECTION_STATES + k] = s1[j];
+            states[j * SECTION_STATES + NB_GROUP_LANES + k] = s2[j];
+        }
+    }
+}
+
+#endif
+
+#define GROUP_PROCESS_CASE(n)                                             \
+    case n:                                                               \
+        group_process(coeffs, states, n, in, in_stride, out, out_stride, \
+                      nb_used, nb_frames);                                \
+        break;
+
+static void group_process_n(const float *coeffs, float *states,
+                            int nb_sections, const float *const *in,
+                            size_t in_stride, float *const *out,
+                            size_t out_stride, int nb_used,
+                            size_t nb_frames) {
+    switch (nb_sections) {
+        GROUP_PROCESS_CASE(1)
+        GROUP_PROCESS_CASE(2)
+        GROUP_PROCESS_CASE(3)
+        GROUP_PROCESS_CASE(4)
+        GROUP_PROCESS_CASE(5)
+        GROUP_PROCESS_CASE(6)
+        GROUP_PROCESS_CASE(7)
+        GROUP_PROCESS_CASE(8)
+        default:
+            break;
+    }
+}
+
+// runs the lanes of group g, lane l reads in[l] and writes out[l]
+static void cascade_group(BiquadCascade *inst, int g,
+                          const float *const *in, size_t in_stride,
+                          float *const *out, size_t out_stride,
+                          size_t nb_frames) {
+    int nb_used = inst->nb_lanes - g * NB_GROUP_LANES;
+    if (nb_used > NB_GROUP_LANES) nb_used = NB_GROUP_LANES;
+    group_process_n(
+        inst->coeffs + (size_t)g * inst->nb_sections * SECTION_COEFFS,
+        inst->states + (size_t)g * inst->nb_sections * SECTION_STATES,
+        inst->nb_sections, in + g * NB_GROUP_LANES, in_stride,
+        out + g * NB_GROUP_LANES, out_stride, nb_used, nb_frames);
+}
+
+void biquad_cascade_process(BiquadCascade *inst, float *buffer,
+                            size_t buffer_size) {
+    if (NULL == inst || NULL == buffer) return;
+
+    const int nb_lanes = inst->nb_lanes;
+    float *lanes[nb_lanes];
+    for (int c = 0; c < nb_lanes; ++c) lanes[c] = buffer + c;
+    for (int g = 0; g < inst->nb_groups; ++g) {
+        cascade_group(inst, g, (const float *const *)lanes, nb_lanes, lanes,
+                      nb_lanes, buffer_size / nb_lanes);
+    }
+}
+
+void biquad_cascade_process_bands(BiquadCascade *inst, int channels,
+                                  const float *in, float **out,
+                                  size_t buffer_size) {
+    if (NULL == inst || NULL == in || NULL == out || channels <= 0) return;
+
+    const int nb_lanes = inst->nb_lanes;
+    const float *in_lanes[nb_lanes];
+    float *out_lanes[nb_lanes];
+    for (int l = 0; l < nb_lanes; ++l) {
+        in_lanes[l] = in + l % channels;
+        out_lanes[l] = out[l / channels] + l % channels;
+    }
+    for (int g = 0; g < inst->nb_groups; ++g) {
+        cascade_group(inst, g, in_lanes, channels, out_lanes, channels,
+                      buffer_size / channels);
+    }
+}
+
+void biquad_cascade_set(BiquadCascade *inst, int lane, int section,
+                        const Band *band) {
+    if (NULL == inst || NULL == band || lane < 0 || lane >= inst->nb_lanes ||
+        section < 0 || section >= inst->nb_sections)
+        return;
+
+    const int g = lane / NB_GROUP_LANES;
+    float *c = inst->coeffs +
+               ((size_t)g * inst->nb_sections + section) * SECTION_COEFFS +
+               lane % NB_GROUP_LANES;
+    for (int k = 0; k < 5; ++k) c[k * NB_GROUP_LANES] = band->coeffs[k];
+}
+
+void biquad_cascade_reset(BiquadCascade *inst) {
+    if (NULL == inst) return;
+    memset(inst->states, 0, (size_t)inst->nb_groups * inst->nb_sections *
+                                SECTION_STATES * sizeof(float));
+}
+
+void biquad_cascade_free(BiquadCascade **inst) {
+    if (NULL == inst || NULL == *inst) return;
+    BiquadCascade *self = *inst;
+    if (self->coeffs) free(self->coeffs);
+    if (self->states) free(self->states);
+    free(self);
+    *inst = NULL;
+}
+
+BiquadCascade *biquad_cascade_create(int nb_lanes, int nb_sections) {
+    if (nb_lanes <= 0 || nb_sections <= 0 ||
+        nb_sections > BIQUAD_MAX_SECTIONS)
+        return NULL;
+
+    BiquadCascade *self = (BiquadCascade *)calloc(1, sizeof(BiquadCascade));
+    if (NULL == self) return NULL;
+
+    self->nb_lanes = nb_lanes;
+    self->nb_groups = (nb_lanes + NB_GROUP_LANES - 1) / NB_GROUP_LANES;
+    self->nb_sections = nb_sections;
+    const size_t nb_sets = (size_t)self->nb_groups * nb_sections;
+    self->coeffs = (float *)calloc(nb_sets * SECTION_COEFFS, sizeof(float));
+    self->states = (float *)calloc(nb_sets * SECTION_STATES, sizeof(float));
+    if (NULL == self->coeffs || NULL == self->states) {
+        biquad_cascade_free(&self);
+        return NULL;
+    }
+
+    // b0 = 1, every section passes the signal through
+    for (size_t i = 0; i < nb_sets; ++i) {
+        for (int k = 0; k < NB_GROUP_LANES; ++k)
+            self->coeffs[i * SECTION_COEFFS + k] = 1.0f;
+    }
+    return self;
+}
@@ -0,0 +1,54 @@
+#ifndef AUDIO_EFFECT_BIQUAD_CASCADE_H_
+#define AUDIO_EFFECT_BIQUAD_CASCADE_H_
+#include <stddef.h>
+#include "iir_design.h"
+
+#define BIQUAD_MAX_SECTIONS 8
+
+/**
+ * nb_lanes independent chains of nb_sections biquads in transposed direct
+ * form II. A frame goes through all sections of a lane before the next
+ * frame comes, and four lanes run side by side in one vector, the lanes
+ * are the channels of a signal or the bands of a filter bank.
+ */
+typedef struct BiquadCascadeT BiquadCascade;
+
+/**
+ * @return NULL if out of memory or nb_sections is out of
+ *         [1, BIQUAD_MAX_SECTIONS]
+ */
+BiquadCascade *biquad_cascade_create(int nb_lanes, int nb_sections);
+
+void biquad_cascade_free(BiquadCascade **inst);
+
+/**
+ * @brief set a section of a lane to the coeffs a iir_*_coeffs function
+ *        designed into band, a new cascade passes the signal unchanged
+ */
+void biquad_cascade_set(BiquadCascade *inst, int lane, int section,
+                        const Band *band);
+
+/**
+ * @brief clear the states, the coeffs stay
+ */
+void biquad_cascade_reset(BiquadCascade *inst);
+
+/**
+ * @brief filter interleaved samples in place, lane c filters channel c
+ *
+ * @param buffer_size number of samples, a multiple of nb_lanes
+ */
+void biquad_cascade_process(BiquadCascade *inst, float *buffer,
+                            size_t buffer_size);
+
+/**
+ * @brief split a signal into the bands of a filter bank, lane
+ *        b * channels + c filters channel c of in into out[b]
+ *
+ * @param buffer_size number of samples of in and of each out[b]
+ */
+void biquad_cascade_process_bands(BiquadCascade *inst, int channels,
+                                  const float *in, float **out,
+                                  size_t buffer_size);
+
+#endif  // AUDIO_EFFECT_BIQUAD_CASCADE_H_
@@ -406,4 +406,4 @@ void band_process(Band *self, float *buffer, size_t buffer_size) {
     self->states[1] = s2;
     self->states[2] = s3;
     self->states[3] = s4;
-}
\ No newline at end of file
+}
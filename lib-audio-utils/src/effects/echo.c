@@ -39,112 +39,119 @@
 #include <string.h>
 #include "effect_struct.h"
 #include "tools/fifo.h"
-#include "tools/sdl_mutex.h"
+#include "tools/param_snapshot.h"
 
 #define DELAY_BUFSIZ (50 * 50U * 1024)
 #define MAX_ECHOS 7 /* 24 bit x ( 1 + MAX_ECHOS ) = */
                     /* 24 bit x 8 = 32 bit !!!      */
 
 typedef struct {
-    fifo *fifo_in;
-    fifo *fifo_out;
-    SdlMutex *sdl_mutex;
     bool effect_on;
-
-    int counter;
     int num_delays;
-    sample_type *delay_buf;
     float in_gain, out_gain;
     float delay[MAX_ECHOS], decay[MAX_ECHOS];
-    ptrdiff_t samples[MAX_ECHOS], maxsamples;
+    // the delays in samples, at most DELAY_BUFSIZ
+    ptrdiff_t samples[MAX_ECHOS];
+} params_t;
+
+typedef struct {
+    fifo *fifo_in;
+    fifo *fifo_out;
+    // the copy set() edits, published to the audio thread through snapshot
+    params_t params;
+    ParamSnapshot *snapshot;
+
+    // the last DELAY_BUFSIZ input samples, the delays only index into it
+    ptrdiff_t counter;
+    sample_type *delay_buf;
 } priv_t;
 
-static int echo_getopts(EffectContext *ctx, int argc, const char **argv) {
-    priv_t *priv = (priv_t *)ctx->priv;
+static int echo_getopts(EffectContext *ctx, params_t *params, int argc,
+                        const char **argv) {
     int i = 0;
 
     --argc, ++argv;
-    priv->num_delays = 0;
+    params->num_delays = 0;
 
     if ((argc < 2) || (argc % 2)) {
         LogError("%s\n", show_usage(ctx));
         return AUDIO_EFFECT_EOF;
     }
 
-    sscanf(argv[i++], "%f", &priv->in_gain);
-    sscanf(argv[i++], "%f", &priv->out_gain);
+    sscanf(argv[i++], "%f", &params->in_gain);
+    sscanf(argv[i++], "%f", &params->out_gain);
     while (i < argc) {
-        if (priv->num_delays >= MAX_ECHOS) {
+        if (params->num_delays >= MAX_ECHOS) {
             LogError("echo: to many delays, use less than %i delays",
                      MAX_ECHOS);
             break;
         }
         /* Linux bug and it's cleaner. */
-        sscanf(argv[i++], "%f", &priv->delay[priv->num_delays]);
-        sscanf(argv[i++], "%f", &priv->decay[priv->num_delays]);
-        priv->num_delays++;
+        sscanf(argv[i++], "%f", &params->delay[params->num_delays]);
+        sscanf(argv[i++], "%f", &params->decay[params->num_delays]);
+        params->num_delays++;
     }
     return AUDIO_EFFECT_SUCCESS;
 }
 
-static int echo_start(EffectContext *ctx) {
-    priv_t *priv = (priv_t *)ctx->priv;
+static int echo_check(EffectContext *ctx, params_t *params) {
     float sum_in_volume;
 
-    priv->maxsamples = 0;
-    if (priv->in_gain < 0.0f) {
+    if (params->in_gain < 0.0f) {
         LogError("echo: gain-in must be positive!");
         return AUDIO_EFFECT_EOF;
     }
-    if (priv->in_gain > 1.0f) {
+    if (params->in_gain > 1.0f) {
         LogError("echo: gain-in must be less than 1.0!");
         return AUDIO_EFFECT_EOF;
     }
-    if (priv->out_gain < 0.0f) {
+    if (params->out_gain < 0.0f) {
         LogError("echo: gain-in must be positive!");
         return AUDIO_EFFECT_EOF;
     }
-    for (int i = 0; i < priv->num_delays; i++) {
-        priv->samples[i] = priv->delay[i] * ctx->in_signal.sample_rate / 1000.0;
-        if (priv->samples[i] < 1) {
+    for (int i = 0; i < params->num_delays; i++) {
+        ptrdiff_t samples =
+            params->delay[i] * ctx->in_signal.sample_rate / 1000.0;
+        if (samples < 1) {
             LogError("echo: delay must be positive!");
             return AUDIO_EFFECT_EOF;
         }
-        if (priv->samples[i] > (ptrdiff_t)DELAY_BUFSIZ) {
+        if (samples > (ptrdiff_t)DELAY_BUFSIZ) {
             LogError("echo: delay must be less than %g seconds!",
                      DELAY_BUFSIZ / ctx->in_signal.sample_rate);
             return AUDIO_EFFECT_EOF;
         }
-        if (priv->decay[i] < 0.0f) {
+        params->samples[i] = samples;
+        if (params->decay[i] < 0.0f) {
             LogError("echo: decay must be positive!");
             return AUDIO_EFFECT_EOF;
         }
-        if (priv->decay[i] > 1.0f) {
+        if (params->decay[i] > 1.0f) {
             LogError("echo: decay must be less than 1.0!");
             return AUDIO_EFFECT_EOF;
         }
-        if (priv->samples[i] > priv->maxsamples)
-            priv->maxsamples = priv->samples[i];
-    }
-    if (priv->delay_buf) {
-        free(priv->delay_buf);
-        priv->delay_buf = NULL;
     }
-    priv->delay_buf = calloc(priv->maxsamples, sizeof(sample_type));
 
     /* Be nice and check the hint with warning, if... */
     sum_in_volume = 1.0f;
-    for (int i = 0; i < priv->num_delays; i++) sum_in_volume += priv->decay[i];
-    if (sum_in_volume * priv->in_gain > 1.0f / priv->out_gain)
+    for (int i = 0; i < params->num_delays; i++)
+        sum_in_volume += params->decay[i];
+    if (sum_in_volume * params->in_gain > 1.0f / params->out_gain)
         LogWarning(
             "echo: warning >>> gain-out can cause saturation of output <<<");
-    priv->counter = 0;
-    priv->effect_on = priv->num_delays > 0;
+    params->effect_on = params->num_delays > 0;
 
     return AUDIO_EFFECT_SUCCESS;
 }
 
-static int echo_parseopts(EffectContext *ctx, const char *argvs) {
+// audio thread, once per block
+static const params_t *acquire_params(EffectContext *ctx) {
+    priv_t *priv = (priv_t *)ctx->priv;
+    return param_snapshot_acquire(priv->snapshot, NULL);
+}
+
+static int echo_parseopts(EffectContext *ctx, params_t *params,
+                          const char *argvs) {
 #define MAX_ARGC 50
     const char *argv[MAX_ARGC];
     int argc = 0;
@@ -158,9 +165,9 @@ static int echo_parseopts(EffectContext *ctx, const char *argvs) {
         argv[argc++] = token;
         token = strtok(NULL, " ");
     }
-    int ret = echo_getopts(ctx, argc, argv);
+    int ret = echo_getopts(ctx, params, argc, argv);
     if (ret < 0) goto end;
-    ret = echo_start(ctx);
+    ret = echo_check(ctx, params);
 
 end:
     if (argvs2) free(argvs2);
@@ -175,7 +182,7 @@ static int echo_close(EffectContext *ctx) {
         priv_t *priv = (priv_t *)ctx->priv;
         if (priv->fifo_in) fifo_delete(&priv->fifo_in);
         if (priv->fifo_out) fifo_delete(&priv->fifo_out);
-        if (priv->sdl_mutex) sdl_mutex_free(&priv->sdl_mutex);
+        if (priv->snapshot) param_snapshot_freep(&priv->snapshot);
         if (priv->delay_buf) {
             free(priv->delay_buf);
             priv->delay_buf = NULL;
@@ -201,20 +208,28 @@ static int echo_init(EffectContext *ctx, int argc, const char **argv) {
         ret = AEERROR_NOMEM;
         goto end;
     }
-    priv->sdl_mutex = sdl_mutex_create();
-    if (NULL == priv->sdl_mutex) {
+    // long enough for any delay echo_check lets through
+    priv->delay_buf = (sample_type *)calloc(DELAY_BUFSIZ, sizeof(sample_type));
+    if (NULL == priv->delay_buf) {
+        LogError("%s calloc delay_buf failed.\n", __func__);
         ret = AEERROR_NOMEM;
         goto end;
     }
 
     if (argc > 1 && argv != NULL) {
-        ret = echo_getopts(ctx, argc, argv);
+        ret = echo_getopts(ctx, &priv->params, argc, argv);
         if (ret < 0) goto end;
     } else {
-        priv->in_gain = priv->out_gain = 1.0f;
+        priv->params.in_gain = priv->params.out_gain = 1.0f;
     }
+    ret = echo_check(ctx, &priv->params);
+    if (ret < 0) goto end;
 
-    return echo_start(ctx);
+    priv->snapshot = param_snapshot_create(sizeof(params_t), &priv->params);
+    if (NULL == priv->snapshot) {
+        ret = AEERROR_NOMEM;
+        goto end;
+    }
 
 end:
     if (ret < 0) echo_close(ctx);
@@ -230,17 +245,22 @@ static int echo_set(EffectContext *ctx, const char *key, int flags) {
     if (entry) {
         LogInfo("%s key = %s val = %s\n", __func__, entry->key, entry->value);
 
-        sdl_mutex_lock(priv->sdl_mutex);
+        params_t params = priv->params;
         if (0 == strcasecmp(entry->key, ctx->handler.name)) {
-            ret = echo_parseopts(ctx, entry->value);
+            ret = echo_parseopts(ctx, &params, entry->value);
         } else if (0 == strcasecmp(entry->key, "Switch")) {
             if (0 == strcasecmp(entry->value, "Off")) {
-                priv->effect_on = false;
+                params.effect_on = false;
             } else if (0 == strcasecmp(entry->value, "On")) {
-                priv->effect_on = true;
+                // an echo without delays has nothing to do
+                params.effect_on = params.num_delays > 0;
             }
         }
-        sdl_mutex_unlock(priv->sdl_mutex);
+        if (ret < 0) return ret;
+
+        priv->params = params;
+        if (param_snapshot_publish(priv->snapshot, &params) < 0)
+            return AEERROR_NOMEM;
     }
     return ret;
 }
@@ -262,22 +282,21 @@ static int echo_receive(EffectContext *ctx, void *samples,
     assert(NULL != priv);
     assert(NULL != priv->fifo_in);
 
-    sdl_mutex_lock(priv->sdl_mutex);
-    if (priv->effect_on) {
+    const params_t *params = acquire_params(ctx);
+    if (params->effect_on) {
         size_t nb_samples = fifo_read(priv->fifo_in, samples, max_nb_samples);
         sample_type *ibuf = samples;
         sample_type out;
         for (size_t i = 0; i < nb_samples; ++i) {
-            out = *ibuf * priv->in_gain;
-            for (int j = 0; j < priv->num_delays; ++j) {
-                out += priv->delay_buf[(priv->counter + priv->maxsamples -
-                                        priv->samples[j]) %
-                                       priv->maxsamples] *
-                       priv->decay[j];
+            out = *ibuf * params->in_gain;
+            for (int j = 0; j < params->num_delays; ++j) {
+                ptrdiff_t pos = priv->counter - params->samples[j];
+                if (pos < 0) pos += DELAY_BUFSIZ;
+                out += priv->delay_buf[pos] * params->decay[j];
             }
             priv->delay_buf[priv->counter] = *ibuf;
-            priv->counter = (priv->counter + 1) % priv->maxsamples;
-            *ibuf++ = out * priv->out_gain;
+            if (++priv->counter == (ptrdiff_t)DELAY_BUFSIZ) priv->counter = 0;
+            *ibuf++ = out * params->out_gain;
         }
         fifo_write(priv->fifo_out, samples, nb_samples);
     } else {
@@ -287,7 +306,6 @@ static int echo_receive(EffectContext *ctx, void *samples,
             fifo_write(priv->fifo_out, samples, nb_samples);
         }
     }
-    sdl_mutex_unlock(priv->sdl_mutex);
 
     if (atomic_load(&ctx->return_max_nb_samples) &&
         fifo_occupancy(priv->fifo_out) < max_nb_samples)
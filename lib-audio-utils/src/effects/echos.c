@@ -36,31 +36,37 @@
 #include <string.h>
 #include "effect_struct.h"
 #include "tools/fifo.h"
-#include "tools/sdl_mutex.h"
+#include "tools/param_snapshot.h"
 
 #define DELAY_BUFSIZ (50 * 50U * 1024)
 #define MAX_ECHOS 7 /* 24 bit x ( 1 + MAX_ECHOS ) = */
                     /* 24 bit x 8 = 32 bit !!!      */
 
+typedef struct {
+    bool effect_on;
+    int num_delays;
+    float in_gain, out_gain;
+    float delay[MAX_ECHOS], decay[MAX_ECHOS];
+} params_t;
+
 typedef struct {
     fifo *fifo_in;
     fifo *fifo_out;
-    SdlMutex *sdl_mutex;
-    bool effect_on;
+    // the copy set() edits, published to the audio thread through snapshot
+    params_t params;
+    ParamSnapshot *snapshot;
 
+    // derived from the params by the audio thread
     int counter[MAX_ECHOS];
-    int num_delays;
     sample_type *delay_buf;
-    float in_gain, out_gain;
-    float delay[MAX_ECHOS], decay[MAX_ECHOS];
     ptrdiff_t samples[MAX_ECHOS], pointer[MAX_ECHOS];
     size_t sumsamples;
 } priv_t;
 
-static int echos_getopts(EffectContext *ctx, int argc, const char **argv) {
-    priv_t *priv = (priv_t *)ctx->priv;
+static int echos_getopts(EffectContext *ctx, params_t *params, int argc,
+                         const char **argv) {
     int i = 0;
-    priv->num_delays = 0;
+    params->num_delays = 0;
 
     --argc, ++argv;
     if ((argc < 2) || (argc % 2)) {
@@ -69,58 +75,77 @@ static int echos_getopts(EffectContext *ctx, int argc, const char **argv) {
     }
 
     i = 0;
-    sscanf(argv[i++], "%f", &priv->in_gain);
-    sscanf(argv[i++], "%f", &priv->out_gain);
+    sscanf(argv[i++], "%f", &params->in_gain);
+    sscanf(argv[i++], "%f", &params->out_gain);
     while (i < argc) {
-        /* Linux bug and it's cleaner. */
-        sscanf(argv[i++], "%f", &priv->delay[priv->num_delays]);
-        sscanf(argv[i++], "%f", &priv->decay[priv->num_delays]);
-        priv->num_delays++;
-        if (priv->num_delays > MAX_ECHOS) {
+        if (params->num_delays >= MAX_ECHOS) {
             LogError("echos: to many delays, use less than %i delays",
                      MAX_ECHOS);
             return AUDIO_EFFECT_EOF;
         }
+        /* Linux bug and it's cleaner. */
+        sscanf(argv[i++], "%f", &params->delay[params->num_delays]);
+        sscanf(argv[i++], "%f", &params->decay[params->num_delays]);
+        params->num_delays++;
     }
-    priv->sumsamples = 0;
     return AUDIO_EFFECT_SUCCESS;
 }
 
-static int echos_start(EffectContext *ctx) {
-    priv_t *priv = (priv_t *)ctx->priv;
+static int echos_check(EffectContext *ctx, params_t *params) {
     float sum_in_volume;
 
-    if (priv->in_gain < 0.0) {
+    if (params->in_gain < 0.0) {
         LogError("echos: gain-in must be positive!");
         return AUDIO_EFFECT_EOF;
     }
-    if (priv->in_gain > 1.0) {
+    if (params->in_gain > 1.0) {
         LogError("echos: gain-in must be less than 1.0!");
         return AUDIO_EFFECT_EOF;
     }
-    if (priv->out_gain < 0.0) {
+    if (params->out_gain < 0.0) {
         LogError("echos: gain-in must be positive!");
         return AUDIO_EFFECT_EOF;
     }
-    for (int i = 0; i < priv->num_delays; i++) {
-        priv->samples[i] = priv->delay[i] * ctx->in_signal.sample_rate / 1000.0;
-        if (priv->samples[i] < 1) {
+    for (int i = 0; i < params->num_delays; i++) {
+        ptrdiff_t samples =
+            params->delay[i] * ctx->in_signal.sample_rate / 1000.0;
+        if (samples < 1) {
             LogError("echos: delay must be positive!");
             return AUDIO_EFFECT_EOF;
         }
-        if (priv->samples[i] > (ptrdiff_t)DELAY_BUFSIZ) {
+        if (samples > (ptrdiff_t)DELAY_BUFSIZ) {
             LogError("echos: delay must be less than %g seconds!",
                      DELAY_BUFSIZ / ctx->in_signal.sample_rate);
             return AUDIO_EFFECT_EOF;
         }
-        if (priv->decay[i] < 0.0) {
+        if (params->decay[i] < 0.0) {
             LogError("echos: decay must be positive!");
             return AUDIO_EFFECT_EOF;
         }
-        if (priv->decay[i] > 1.0) {
+        if (params->decay[i] > 1.0) {
             LogError("echos: decay must be less than 1.0!");
             return AUDIO_EFFECT_EOF;
         }
+    }
+    /* Be nice and check the hint with warning, if... */
+    sum_in_volume = 1.0;
+    for (int i = 0; i < params->num_delays; i++)
+        sum_in_volume += params->decay[i];
+    if (sum_in_volume * params->in_gain > 1.0 / params->out_gain)
+        LogWarning(
+            "echos: warning >>> gain-out can cause saturation of output <<<");
+    params->effect_on = params->num_delays > 0;
+
+    return AUDIO_EFFECT_SUCCESS;
+}
+
+static void echos_start(EffectContext *ctx, const params_t *params) {
+    priv_t *priv = (priv_t *)ctx->priv;
+
+    priv->sumsamples = 0;
+    for (int i = 0; i < params->num_delays; i++) {
+        priv->samples[i] =
+            params->delay[i] * ctx->in_signal.sample_rate / 1000.0;
         priv->counter[i] = 0;
         priv->pointer[i] = priv->sumsamples;
         priv->sumsamples += priv->samples[i];
@@ -130,18 +155,19 @@ static int echos_start(EffectContext *ctx) {
         priv->delay_buf = NULL;
     }
     priv->delay_buf = calloc(priv->sumsamples, sizeof(sample_type));
-    /* Be nice and check the hint with warning, if... */
-    sum_in_volume = 1.0;
-    for (int i = 0; i < priv->num_delays; i++) sum_in_volume += priv->decay[i];
-    if (sum_in_volume * priv->in_gain > 1.0 / priv->out_gain)
-        LogWarning(
-            "echos: warning >>> gain-out can cause saturation of output <<<");
-    priv->effect_on = priv->num_delays > 0;
+}
 
-    return AUDIO_EFFECT_SUCCESS;
+// audio thread, once per block
+static const params_t *acquire_params(EffectContext *ctx) {
+    priv_t *priv = (priv_t *)ctx->priv;
+    bool changed = false;
+    const params_t *params = param_snapshot_acquire(priv->snapshot, &changed);
+    if (changed) echos_start(ctx, params);
+    return params;
 }
 
-static int echos_parseopts(EffectContext *ctx, const char *argvs) {
+static int echos_parseopts(EffectContext *ctx, params_t *params,
+                           const char *argvs) {
 #define MAX_ARGC 50
     const char *argv[MAX_ARGC];
     int argc = 0;
@@ -155,9 +181,9 @@ static int echos_parseopts(EffectContext *ctx, const char *argvs) {
         argv[argc++] = token;
         token = strtok(NULL, " ");
     }
-    int ret = echos_getopts(ctx, argc, argv);
+    int ret = echos_getopts(ctx, params, argc, argv);
     if (ret < 0) goto end;
-    ret = echos_start(ctx);
+    ret = echos_check(ctx, params);
 
 end:
     if (argvs2) free(argvs2);
@@ -172,7 +198,7 @@ static int echos_close(EffectContext *ctx) {
         priv_t *priv = (priv_t *)ctx->priv;
         if (priv->fifo_in) fifo_delete(&priv->fifo_in);
         if (priv->fifo_out) fifo_delete(&priv->fifo_out);
-        if (priv->sdl_mutex) sdl_mutex_free(&priv->sdl_mutex);
+        if (priv->snapshot) param_snapshot_freep(&priv->snapshot);
         if (priv->delay_buf) {
             free(priv->delay_buf);
             priv->delay_buf = NULL;
@@ -198,20 +224,21 @@ static int echos_init(EffectContext *ctx, int argc, const char **argv) {
         ret = AEERROR_NOMEM;
         goto end;
     }
-    priv->sdl_mutex = sdl_mutex_create();
-    if (NULL == priv->sdl_mutex) {
-        ret = AEERROR_NOMEM;
-        goto end;
-    }
 
     if (argc > 1 && argv != NULL) {
-        ret = echos_getopts(ctx, argc, argv);
+        ret = echos_getopts(ctx, &priv->params, argc, argv);
         if (ret < 0) goto end;
     } else {
-        priv->in_gain = priv->out_gain = 1.0f;
+        priv->params.in_gain = priv->params.out_gain = 1.0f;
     }
+    ret = echos_check(ctx, &priv->params);
+    if (ret < 0) goto end;
 
-    return echos_start(ctx);
+    priv->snapshot = param_snapshot_create(sizeof(params_t), &priv->params);
+    if (NULL == priv->snapshot) {
+        ret = AEERROR_NOMEM;
+        goto end;
+    }
 
 end:
     if (ret < 0) echos_close(ctx);
@@ -227,17 +254,21 @@ static int echos_set(EffectContext *ctx, const char *key, int flags) {
     if (entry) {
         LogInfo("%s key = %s val = %s\n", __func__, entry->key, entry->value);
 
-        sdl_mutex_lock(priv->sdl_mutex);
+        params_t params = priv->params;
         if (0 == strcasecmp(entry->key, ctx->handler.name)) {
-            ret = echos_parseopts(ctx, entry->value);
+            ret = echos_parseopts(ctx, &params, entry->value);
         } else if (0 == strcasecmp(entry->key, "Switch")) {
             if (0 == strcasecmp(entry->value, "Off")) {
-                priv->effect_on = false;
+                params.effect_on = false;
             } else if (0 == strcasecmp(entry->value, "On")) {
-                priv->effect_on = true;
+                params.effect_on = true;
             }
         }
-        sdl_mutex_unlock(priv->sdl_mutex);
+        if (ret < 0) return ret;
+
+        priv->params = params;
+        if (param_snapshot_publish(priv->snapshot, &params) < 0)
+            return AEERROR_NOMEM;
     }
     return ret;
 }
@@ -259,21 +290,20 @@ static int echos_receive(EffectContext *ctx, void *samples,
     assert(NULL != priv);
     assert(NULL != priv->fifo_in);
 
-    // LogError("%d\n", priv->effect_on);
-    sdl_mutex_lock(priv->sdl_mutex);
-    if (priv->effect_on) {
+    const params_t *params = acquire_params(ctx);
+    if (params->effect_on) {
         size_t nb_samples = fifo_read(priv->fifo_in, samples, max_nb_samples);
         sample_type *ibuf = samples;
         sample_type out;
         for (size_t i = 0; i < nb_samples; ++i) {
-            out = *ibuf * priv->in_gain;
-            for (int j = 0; j < priv->num_delays; ++j) {
+            out = *ibuf * params->in_gain;
+            for (int j = 0; j < params->num_delays; ++j) {
                 out += priv->delay_buf[priv->counter[j] + priv->pointer[j]] *
-                       priv->decay[j];
+                       params->decay[j];
             }
-            out *= priv->out_gain;
+            out *= params->out_gain;
             /* Mix decay of delays and input */
-            for (int j = 0; j < priv->num_delays; j++) {
+            for (int j = 0; j < params->num_delays; j++) {
                 if (j == 0)
                     priv->delay_buf[priv->counter[j] + priv->pointer[j]] =
                         *ibuf;
@@ -284,7 +314,7 @@ static int echos_receive(EffectContext *ctx, void *samples,
                         *ibuf;
             }
             /* Adjust the counters */
-            for (int j = 0; j < priv->num_delays; j++)
+            for (int j = 0; j < params->num_delays; j++)
                 priv->counter[j] = (priv->counter[j] + 1) % priv->samples[j];
             *ibuf++ = out;
         }
@@ -296,7 +326,6 @@ static int echos_receive(EffectContext *ctx, void *samples,
             fifo_write(priv->fifo_out, samples, nb_samples);
         }
     }
-    sdl_mutex_unlock(priv->sdl_mutex);
 
     if (atomic_load(&ctx->return_max_nb_samples) &&
         fifo_occupancy(priv->fifo_out) < max_nb_samples)
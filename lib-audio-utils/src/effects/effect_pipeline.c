@@ -0,0 +1,332 @@
+#include "effect_pipeline.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "voice_effect.h"
+#include "tools/conversion.h"
+#include "tools/sdl_mutex.h"
+#include "tools/spsc_ring.h"
+
+#define WAIT_TIMEOUT_MS 20
+
+typedef struct EffectStage {
+    pthread_t tid;
+    bool started;
+    int index;
+    EffectContext *effect;
+    // output of the stage, read by the next stage or the consumer
+    SpscRing *ring;
+    // set after the last block is committed, status says why
+    volatile bool done;
+    int status;
+    // s16 samples of effects without a process callback
+    short *buffer;
+    // input of the first stage
+    EffectBlock *source_block;
+    struct EffectPipeline *pipeline;
+} EffectStage;
+
+struct EffectPipeline {
+    volatile bool abort;
+    int nb_stages;
+    EffectStage *stages;
+    volatile int nb_waiting;
+    SdlMutex *mutex;
+    EffectSourceFunc source;
+    void *opaque;
+};
+
+static inline bool pipeline_aborted(EffectPipeline *pipeline) {
+    return __atomic_load_n(&pipeline->abort, __ATOMIC_ACQUIRE);
+}
+
+static void pipeline_notify(EffectPipeline *pipeline) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&pipeline->nb_waiting, __ATOMIC_SEQ_CST) > 0) {
+        sdl_mutex_lock(pipeline->mutex);
+        sdl_mutex_broadcast(pipeline->mutex);
+        sdl_mutex_unlock(pipeline->mutex);
+    }
+}
+
+static void pipeline_wait(EffectPipeline *pipeline,
+        bool (*ready)(EffectStage *stage), EffectStage *stage) {
+    sdl_mutex_lock(pipeline->mutex);
+    __atomic_add_fetch(&pipeline->nb_waiting, 1, __ATOMIC_SEQ_CST);
+    if (!pipeline_aborted(pipeline) && !ready(stage))
+        sdl_mutex_wait_timeout(pipeline->mutex, WAIT_TIMEOUT_MS);
+    __atomic_sub_fetch(&pipeline->nb_waiting, 1, __ATOMIC_SEQ_CST);
+    sdl_mutex_unlock(pipeline->mutex);
+}
+
+static bool stage_writable(EffectStage *stage) {
+    return spsc_ring_write_slot(stage->ring) != NULL;
+}
+
+static bool stage_readable(EffectStage *stage) {
+    return spsc_ring_read_slot(stage->ring) != NULL
+        || __atomic_load_n(&stage->done, __ATOMIC_ACQUIRE);
+}
+
+// free block at the output of stage, NULL once aborted
+static EffectBlock *stage_write_slot(EffectStage *stage) {
+    EffectPipeline *pipeline = stage->pipeline;
+    while (!pipeline_aborted(pipeline)) {
+        EffectBlock *block = (EffectBlock *)spsc_ring_write_slot(stage->ring);
+        if (block)
+            return block;
+        pipeline_wait(pipeline, stage_writable, stage);
+    }
+    return NULL;
+}
+
+static void stage_commit(EffectStage *stage, EffectBlock *block,
+        int nb_samples, int channels) {
+    block->nb_samples = nb_samples;
+    block->channels = channels;
+    spsc_ring_commit_write(stage->ring);
+    pipeline_notify(stage->pipeline);
+}
+
+// next block at the output of stage, NULL once it is done or aborted
+static EffectBlock *stage_read_slot(EffectStage *stage) {
+    EffectPipeline *pipeline = stage->pipeline;
+    while (!pipeline_aborted(pipeline)) {
+        EffectBlock *block = (EffectBlock *)spsc_ring_read_slot(stage->ring);
+        if (block)
+            return block;
+        if (__atomic_load_n(&stage->done, __ATOMIC_ACQUIRE)) {
+            // the stage may have committed a block right before done
+            return (EffectBlock *)spsc_ring_read_slot(stage->ring);
+        }
+        pipeline_wait(pipeline, stage_readable, stage);
+    }
+    return NULL;
+}
+
+static void stage_release(EffectStage *stage) {
+    spsc_ring_commit_read(stage->ring);
+    pipeline_notify(stage->pipeline);
+}
+
+// the next input block of stage, less than 0 at the end of the input
+static int stage_input(EffectStage *stage, EffectBlock **block) {
+    EffectPipeline *pipeline = stage->pipeline;
+    if (stage->index == 0) {
+        *block = stage->source_block;
+        return pipeline->source(pipeline->opaque, *block);
+    }
+
+    EffectStage *prev = &pipeline->stages[stage->index - 1];
+    *block = stage_read_slot(prev);
+    if (*block)
+        return 0;
+    return pipeline_aborted(pipeline) ? AEERROR_INVALID_STATE : prev->status;
+}
+
+static void stage_input_release(EffectStage *stage) {
+    if (stage->index > 0)
+        stage_release(&stage->pipeline->stages[stage->index - 1]);
+}
+
+// hands on what the send/receive fifos of the effect give back
+static int stage_drain(EffectStage *stage) {
+    EffectContext *effect = stage->effect;
+    const int channels = effect->in_signal.channels;
+    int ret = 0;
+
+    while ((ret = receive_samples(effect, stage->buffer,
+            MAX_NB_SAMPLES / channels * channels)) > 0) {
+        EffectBlock *out = stage_write_slot(stage);
+        if (!out)
+            return AEERROR_INVALID_STATE;
+        S16ToFloat(stage->buffer, out->samples, ret);
+        stage_commit(stage, out, ret, channels);
+    }
+    return ret;
+}
+
+// hands on what a process effect has left once its input has ended
+static int stage_drain_process(EffectStage *stage) {
+    EffectContext *effect = stage->effect;
+    const int channels = effect->in_signal.channels;
+    int ret = 0;
+    if (NULL == effect->handler.drain)
+        return 0;
+
+    for (;;) {
+        EffectBlock *out = stage_write_slot(stage);
+        if (!out)
+            return AEERROR_INVALID_STATE;
+        if ((ret = drain_samples(effect, out->samples, MAX_NB_SAMPLES)) <= 0)
+            return ret;
+        stage_commit(stage, out, ret, channels);
+    }
+}
+
+static int stage_process(EffectStage *stage, EffectBlock *in) {
+    EffectContext *effect = stage->effect;
+    int nb_samples = in->nb_samples;
+    int channels = in->channels;
+    if (nb_samples <= 0)
+        return 0;
+
+    // the input block is the stage's until it is released
+    if (effect->in_signal.channels < channels) {
+        nb_samples = FoldToMonoFloat(in->samples, nb_samples, channels);
+        channels = 1;
+    }
+
+    if (effect->handler.process) {
+        EffectBlock *out = stage_write_slot(stage);
+        if (!out)
+            return AEERROR_INVALID_STATE;
+        memcpy(out->samples, in->samples, nb_samples * sizeof(float));
+        int ret = process_samples(effect, out->samples, nb_samples);
+        if (ret < 0)
+            return ret;
+        // nothing comes out while a lookahead delay line fills up
+        if (ret > 0)
+            stage_commit(stage, out, ret, channels);
+        return 0;
+    }
+
+    FloatToS16(in->samples, stage->buffer, nb_samples);
+    if (send_samples(effect, stage->buffer, nb_samples) < 0)
+        return -1;
+    return stage_drain(stage);
+}
+
+static void *effect_stage_thread(void *arg) {
+    EffectStage *stage = (EffectStage *)arg;
+    EffectPipeline *pipeline = stage->pipeline;
+    EffectBlock *in = NULL;
+    int ret = 0;
+
+    while ((ret = stage_input(stage, &in)) >= 0) {
+        int err = stage_process(stage, in);
+        stage_input_release(stage);
+        if (err < 0) {
+            if (!pipeline_aborted(pipeline))
+                LogError("%s %s failed.\n", __func__,
+                    stage->effect->handler.name);
+            ret = err;
+            break;
+        }
+    }
+
+    // same as flush()
+    if (!pipeline_aborted(pipeline)) {
+        if (stage->effect->handler.process)
+            stage_drain_process(stage);
+        else
+            stage_drain(stage);
+    }
+
+    stage->status = ret;
+    __atomic_store_n(&stage->done, true, __ATOMIC_RELEASE);
+    pipeline_notify(pipeline);
+    return NULL;
+}
+
+int effect_pipeline_acquire(EffectPipeline *pipeline, EffectBlock **block) {
+    if (!pipeline || !block)
+        return -1;
+
+    EffectStage *last = &pipeline->stages[pipeline->nb_stages - 1];
+    *block = stage_read_slot(last);
+    if (*block)
+        return 0;
+    return pipeline_aborted(pipeline) ? AEERROR_INVALID_STATE : last->status;
+}
+
+void effect_pipeline_release(EffectPipeline *pipeline) {
+    if (!pipeline)
+        return;
+
+    stage_release(&pipeline->stages[pipeline->nb_stages - 1]);
+}
+
+void effect_pipeline_freep(EffectPipeline **pipeline) {
+    if (!pipeline || !*pipeline)
+        return;
+
+    EffectPipeline *self = *pipeline;
+    if (self->mutex) {
+        sdl_mutex_lock(self->mutex);
+        __atomic_store_n(&self->abort, true, __ATOMIC_RELEASE);
+        sdl_mutex_broadcast(self->mutex);
+        sdl_mutex_unlock(self->mutex);
+    }
+
+    if (self->stages) {
+        for (int i = 0; i < self->nb_stages; i++) {
+            EffectStage *stage = &self->stages[i];
+            if (stage->started)
+                pthread_join(stage->tid, NULL);
+            spsc_ring_freep(&stage->ring);
+            if (stage->buffer)
+                free(stage->buffer);
+            if (stage->source_block)
+                free(stage->source_block);
+        }
+        free(self->stages);
+    }
+    sdl_mutex_free(&self->mutex);
+    free(self);
+    *pipeline = NULL;
+}
+
+EffectPipeline *effect_pipeline_create(EffectContext **effects,
+        int nb_effects, EffectSourceFunc source, void *opaque) {
+    if (!effects || nb_effects <= 0 || !source)
+        return NULL;
+
+    EffectPipeline *self = (EffectPipeline *)calloc(1, sizeof(EffectPipeline));
+    if (!self) {
+        LogError("%s calloc EffectPipeline failed.\n", __func__);
+        return NULL;
+    }
+    self->nb_stages = nb_effects;
+    self->source = source;
+    self->opaque = opaque;
+    self->mutex = sdl_mutex_create();
+    self->stages = (EffectStage *)calloc(nb_effects, sizeof(EffectStage));
+    if (!self->mutex || !self->stages) {
+        LogError("%s alloc EffectPipeline failed.\n", __func__);
+        goto fail;
+    }
+
+    for (int i = 0; i < nb_effects; i++) {
+        EffectStage *stage = &self->stages[i];
+        stage->index = i;
+        stage->effect = effects[i];
+        stage->pipeline = self;
+        stage->ring = spsc_ring_create(sizeof(EffectBlock),
+            EFFECT_RING_NB_BLOCKS);
+        stage->buffer = (short *)calloc(MAX_NB_SAMPLES, sizeof(short));
+        if (!stage->ring || !stage->buffer) {
+            LogError("%s alloc stage %d failed.\n", __func__, i);
+            goto fail;
+        }
+    }
+    self->stages[0].source_block = (EffectBlock *)calloc(1, sizeof(EffectBlock));
+    if (!self->stages[0].source_block) {
+        LogError("%s calloc source block failed.\n", __func__);
+        goto fail;
+    }
+
+    for (int i = 0; i < nb_effects; i++) {
+        EffectStage *stage = &self->stages[i];
+        if (pthread_create(&stage->tid, NULL, effect_stage_thread, stage)) {
+            LogError("%s pthread_create stage %d failed.\n", __func__, i);
+            goto fail;
+        }
+        stage->started = true;
+    }
+    return self;
+
+fail:
+    effect_pipeline_freep(&self);
+    return NULL;
+}
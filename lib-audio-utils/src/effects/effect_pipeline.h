@@ -0,0 +1,64 @@
+#ifndef EFFECT_PIPELINE_H_
+#define EFFECT_PIPELINE_H_
+#include <stdbool.h>
+#include "effect_struct.h"
+
+// number of blocks a stage may run ahead of the next one
+#define EFFECT_RING_NB_BLOCKS 8
+
+typedef struct EffectBlock {
+    // valid length of samples, interleaved frames of channels
+    int nb_samples;
+    int channels;
+    float samples[MAX_NB_SAMPLES];
+} EffectBlock;
+
+/**
+ * Runs a chain of effects with every effect on its own thread, so the
+ * chain is as fast as its slowest effect. A stage takes the blocks of the
+ * one before through an SPSC ring and hands its output on the same way,
+ * the first stage also reads the input. When the input ends each stage
+ * drains its effect before it ends, the order flush() drains the chain in
+ * when it runs on one thread.
+ */
+
+/**
+ * Fill block with the next input samples. Called on the first stage.
+ * @return less than 0 at the end of the input, the value
+ *         effect_pipeline_acquire returns when the output is taken
+ */
+typedef int (*EffectSourceFunc)(void *opaque, EffectBlock *block);
+
+typedef struct EffectPipeline EffectPipeline;
+
+/**
+ * @brief take the next output block, waiting for the last stage if needed
+ *
+ * @return 0 on success, what ended the input (PCM_FILE_EOF or an error)
+ *         or the error of a stage once all output is taken,
+ *         AEERROR_INVALID_STATE when the pipeline is aborted
+ */
+int effect_pipeline_acquire(EffectPipeline *pipeline, EffectBlock **block);
+
+/**
+ * @brief give the block taken by effect_pipeline_acquire back
+ */
+void effect_pipeline_release(EffectPipeline *pipeline);
+
+/**
+ * @brief abort and join all stages, then free the pipeline. The effects
+ *        stay owned by the caller.
+ */
+void effect_pipeline_freep(EffectPipeline **pipeline);
+
+/**
+ * @brief start one stage per effect
+ *
+ * @param effects run in array order, used by the stages until
+ *        effect_pipeline_freep
+ * @param source called on the first stage to read the input
+ */
+EffectPipeline *effect_pipeline_create(EffectContext **effects,
+    int nb_effects, EffectSourceFunc source, void *opaque);
+
+#endif  // EFFECT_PIPELINE_H_
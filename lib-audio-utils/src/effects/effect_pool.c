@@ -0,0 +1,115 @@
+#include "effect_pool.h"
+#include <stdlib.h>
+#include <string.h>
+#include "voice_effect.h"
+#include "tools/sdl_mutex.h"
+
+struct EffectPool {
+    int max_nb_idle;
+    int nb_idle;
+    EffectContext **idle;
+    SdlMutex *mutex;
+};
+
+// the pool only sets one param per effect
+static bool effect_matches(const EffectContext *effect, const char *name,
+    const char *key, const char *value, int sample_rate, int channels) {
+    if (strcasecmp(effect->handler.name, name) != 0) return false;
+    if (effect->in_signal.sample_rate != sample_rate
+        || effect->in_signal.channels != channels) return false;
+    if (ae_dict_count(effect->options) != 1) return false;
+
+    AEDictionaryEntry *entry = ae_dict_get(effect->options, key, NULL, 0);
+    return entry && strcmp(entry->value, value) == 0;
+}
+
+static EffectContext *take_idle(EffectPool *pool, const char *name,
+    const char *key, const char *value, int sample_rate, int channels) {
+    EffectContext *effect = NULL;
+
+    sdl_mutex_lock(pool->mutex);
+    for (int i = 0; i < pool->nb_idle; i++) {
+        if (effect_matches(pool->idle[i], name, key, value,
+                sample_rate, channels)) {
+            effect = pool->idle[i];
+            pool->idle[i] = pool->idle[--pool->nb_idle];
+            break;
+        }
+    }
+    sdl_mutex_unlock(pool->mutex);
+    return effect;
+}
+
+EffectContext *effect_pool_acquire(EffectPool *pool, const char *name,
+    const char *key, const char *value, int sample_rate, int channels) {
+    if (!name || !key || !value) return NULL;
+
+    EffectContext *effect = NULL;
+    if (pool) {
+        effect = take_idle(pool, name, key, value, sample_rate, channels);
+        if (effect) return effect;
+    }
+
+    effect = create_effect(find_effect(name), sample_rate, channels);
+    if (!effect) {
+        LogError("%s create effect %s failed.\n", __func__, name);
+        return NULL;
+    }
+
+    if (init_effect(effect, 0, NULL) < 0) {
+        LogError("%s init effect %s failed.\n", __func__, name);
+        free_effect(effect);
+        return NULL;
+    }
+    set_effect(effect, key, value, 0);
+    return effect;
+}
+
+void effect_pool_release(EffectPool *pool, EffectContext *effect) {
+    if (!effect) return;
+
+    if (pool && reset_effect(effect) >= 0) {
+        sdl_mutex_lock(pool->mutex);
+        if (pool->nb_idle < pool->max_nb_idle) {
+            pool->idle[pool->nb_idle++] = effect;
+            effect = NULL;
+        }
+        sdl_mutex_unlock(pool->mutex);
+    }
+
+    free_effect(effect);
+}
+
+void effect_pool_freep(EffectPool **pool) {
+    if (!pool || !*pool) return;
+
+    EffectPool *self = *pool;
+    for (int i = 0; i < self->nb_idle; i++) {
+        free_effect(self->idle[i]);
+    }
+    if (self->idle) free(self->idle);
+    sdl_mutex_free(&self->mutex);
+    free(self);
+    *pool = NULL;
+}
+
+EffectPool *effect_pool_create(int max_nb_idle) {
+    if (max_nb_idle <= 0) return NULL;
+
+    EffectPool *self = (EffectPool *)calloc(1, sizeof(EffectPool));
+    if (!self) {
+        LogError("%s calloc EffectPool failed.\n", __func__);
+        return NULL;
+    }
+
+    self->max_nb_idle = max_nb_idle;
+    self->idle = (EffectContext **)calloc(max_nb_idle,
+        sizeof(EffectContext *));
+    self->mutex = sdl_mutex_create();
+    if (!self->idle || !self->mutex) {
+        LogError("%s alloc EffectPool failed.\n", __func__);
+        effect_pool_freep(&self);
+        return NULL;
+    }
+    return self;
+}
@@ -0,0 +1,40 @@
+#ifndef EFFECT_POOL_H_
+#define EFFECT_POOL_H_
+#include "effect_struct.h"
+
+/**
+ * Keeps the effects of finished clips, so the next clip asking for the
+ * same effect with the same param, sample rate and channels gets an
+ * instance that is already allocated and initialized. A released effect
+ * is reset before it goes back to the pool, effects without a reset
+ * callback are freed. Safe to use from several threads.
+ */
+
+typedef struct EffectPool EffectPool;
+
+/**
+ * @brief take an effect from the pool or create one, set key to value
+ *
+ * @param pool NULL creates a new effect
+ * @return NULL if the effect is unknown or could not be initialized
+ */
+EffectContext *effect_pool_acquire(EffectPool *pool, const char *name,
+    const char *key, const char *value, int sample_rate, int channels);
+
+/**
+ * @brief give back an effect of effect_pool_acquire
+ *
+ * @param pool NULL frees the effect
+ */
+void effect_pool_release(EffectPool *pool, EffectContext *effect);
+
+void effect_pool_freep(EffectPool **pool);
+
+/**
+ * @brief create an effect pool
+ *
+ * @param max_nb_idle most effects kept, more released ones are freed
+ */
+EffectPool *effect_pool_create(int max_nb_idle);
+
+#endif  // EFFECT_POOL_H_
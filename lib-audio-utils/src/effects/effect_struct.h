@@ -30,6 +30,33 @@ struct EffectHandler_T {
                 const size_t nb_samples);
     int (*receive)(EffectContext *ctx, void *samples, const size_t nb_samples);
     int (*close)(EffectContext *ctx);
+
+    /**
+     * optional, for effects that keep the sample count. Processes float
+     * samples in place, skipping the send/receive fifos.
+     * @return number of samples left at the front of samples, fewer than
+     *         nb_samples while a lookahead delay line fills up, the held
+     *         back samples are the latency of the effect
+     */
+    int (*process)(EffectContext *ctx, float *samples, const size_t nb_samples);
+    // largest block process takes, 0 for any size
+    size_t block_size;
+    // takes interleaved samples of any channel count, mono only otherwise
+    bool multichannel;
+    /**
+     * optional, for process effects that hold samples back or ring on.
+     * Once the input has ended, writes what is left as if silence
+     * followed: the held back samples, then the tail.
+     * @return number of samples written, at most nb_samples, 0 when done
+     */
+    int (*drain)(EffectContext *ctx, float *samples, const size_t nb_samples);
+
+    /**
+     * optional, drops everything left of the signal processed so far
+     * (fifos, delay lines, filter memories) and keeps the params and
+     * allocations, so the instance can start on another signal
+     */
+    int (*reset)(EffectContext *ctx);
 };
 
 typedef struct SignalInfoT {
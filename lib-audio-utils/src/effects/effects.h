@@ -5,3 +5,4 @@ EFFECT(reverb)
 EFFECT(limiter)
 EFFECT(minions)
 EFFECT(voice_morph)
+EFFECT(convolver)
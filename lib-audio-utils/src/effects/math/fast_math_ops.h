@@ -1,6 +1,8 @@
 #ifndef FAST_MATH_OPS_H_
 #define FAST_MATH_OPS_H_
 
+#include <math.h>
+
 #define MAGIC 0x5f3759df
 #define THREEHALFS 1.5f
 
@@ -51,4 +53,13 @@ static inline float Log10(const float val, register float* const pTable,
     return ((float)(exp) + pTable[man]) * 0.301029995663981f;
 }
 
+/* fill the log2 refinement table of Log10, 1 << precision entries */
+static inline void FillLog2Table(float* const pTable,
+                                 const unsigned precision) {
+    const int size = 1 << precision;
+    for (int i = 0; i < size; i++) {
+        pTable[i] = log2f(1.0f + (i + 0.5f) / size);
+    }
+}
+
 #endif  // FAST_MATH_OPS_H
@@ -6,7 +6,6 @@
 #include "resample/resample.h"
 #include "tables/recip_table.h"
 #include "tools/fifo.h"
-#include "tools/sdl_mutex.h"
 #include "tools/util.h"
 
 #define SRC_SAMPLE_RATE 44100
@@ -30,13 +29,12 @@ typedef struct {
     fifo *fifo_in;
     fifo *fifo_out;
     fifo *fifo_swr;
-    SdlMutex *sdl_mutex;
     Sola *sola;
     struct SwrContext *swr_ctx;
     uint8_t **src_samples;
     uint8_t **dst_samples;
     int max_dst_nb_samples;
-    bool is_minions_on;
+    atomic_bool is_minions_on;
 } priv_t;
 
 static void sola_free(Sola **sola) {
@@ -158,7 +156,6 @@ static int minions_close(EffectContext *ctx) {
         if (priv->fifo_in) fifo_delete(&priv->fifo_in);
         if (priv->fifo_out) fifo_delete(&priv->fifo_out);
         if (priv->fifo_swr) fifo_delete(&priv->fifo_swr);
-        if (priv->sdl_mutex) sdl_mutex_free(&priv->sdl_mutex);
         if (priv->sola) sola_free(&priv->sola);
         if (priv->swr_ctx) swr_free(&priv->swr_ctx);
         if (priv->src_samples) {
@@ -198,17 +195,12 @@ static int minions_init(EffectContext *ctx, int argc, const char **argv) {
         ret = AEERROR_NOMEM;
         goto end;
     }
-    priv->sdl_mutex = sdl_mutex_create();
-    if (NULL == priv->sdl_mutex) {
-        ret = AEERROR_NOMEM;
-        goto end;
-    }
     priv->sola = (Sola *)calloc(1, sizeof(Sola));
     if (NULL == priv->sola) {
         ret = AEERROR_NOMEM;
         goto end;
     }
-    priv->is_minions_on = false;
+    atomic_store(&priv->is_minions_on, false);
     priv->max_dst_nb_samples = RESAMPLE_FRAME_LEN;
     ret = sola_init(priv->sola, 400, 1.75f);
     ret = resampler_init(1, 1, SRC_SAMPLE_RATE, DST_SAMPLE_RATE,
@@ -231,19 +223,34 @@ static int minions_set(EffectContext *ctx, const char *key, int flags) {
     if (entry) {
         LogInfo("%s key = %s val = %s\n", __func__, entry->key, entry->value);
 
-        sdl_mutex_lock(priv->sdl_mutex);
         if (0 == strcasecmp(entry->key, "Switch")) {
             if (0 == strcasecmp(entry->value, "On")) {
-                priv->is_minions_on = true;
+                atomic_store(&priv->is_minions_on, true);
             } else if (0 == strcasecmp(entry->value, "Off")) {
-                priv->is_minions_on = false;
+                atomic_store(&priv->is_minions_on, false);
             }
         }
-        sdl_mutex_unlock(priv->sdl_mutex);
     }
     return 0;
 }
 
+static int minions_reset(EffectContext *ctx) {
+    assert(NULL != ctx);
+    priv_t *priv = (priv_t *)ctx->priv;
+    if (NULL == priv) return AEERROR_NULL_POINT;
+
+    fifo_clear(priv->fifo_in);
+    fifo_clear(priv->fifo_out);
+    fifo_clear(priv->fifo_swr);
+    Sola *sola = priv->sola;
+    memset(sola->input, 0, sola->in_len * sizeof(int16_t));
+    memset(sola->output, 0, sola->out_len * sizeof(int16_t));
+    memset(sola->frame_update, 0,
+           sola->analysis_window_offset * sizeof(int16_t));
+    // drops the samples buffered in the resampler
+    return swr_init(priv->swr_ctx);
+}
+
 static int minions_send(EffectContext *ctx, const void *samples,
                         const size_t nb_samples) {
     assert(NULL != ctx);
@@ -261,8 +268,7 @@ static int minions_receive(EffectContext *ctx, void *samples,
     assert(NULL != priv);
     assert(NULL != priv->fifo_in);
 
-    if (priv->is_minions_on) {
-        sdl_mutex_lock(priv->sdl_mutex);
+    if (atomic_load(&priv->is_minions_on)) {
         while (fifo_occupancy(priv->fifo_in) >=
                (size_t)priv->sola->analysis_window_offset) {
             fifo_read(priv->fifo_in, priv->sola->frame_update,
@@ -281,7 +287,6 @@ static int minions_receive(EffectContext *ctx, void *samples,
                                      &priv->max_dst_nb_samples, 1);
             if (ret > 0) fifo_write(priv->fifo_out, priv->dst_samples[0], ret);
         }
-        sdl_mutex_unlock(priv->sdl_mutex);
     } else {
         while (fifo_occupancy(priv->fifo_in) > 0) {
             size_t nb_samples =
@@ -309,6 +314,7 @@ const EffectHandler *effect_minions_fn(void) {
                                     .set = minions_set,
                                     .send = minions_send,
                                     .receive = minions_receive,
-                                    .close = minions_close};
+                                    .close = minions_close,
+                                    .reset = minions_reset};
     return &handler;
 }
@@ -1,31 +1,39 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <string.h>
-#include <pthread.h>
 #include "effect_struct.h"
 #include "error_def.h"
 #include "log.h"
 #include "tools/util.h"
 #include "tools/fifo.h"
+#include "tools/param_snapshot.h"
 #include "morph_filter/pitch_tracker/src/pitch_macro.h"
 #include "morph_filter/voice_morph/morph/voice_morph.h"
 
 #define NB_SAMPLES 1024
 #define OUTPUT_BUF_SIZE (1024 << 3)
 
+enum MorphType { NONE_MORPH = 0, ROBOT, BRIGHT, MAN, WOMAN };
+
+typedef struct {
+    enum MorphType type;
+    bool is_morph_on;
+} params_t;
+
 typedef struct {
     VoiceMorph *morph;
+    // the type morph is configured for, -1 before the first one
+    int type;
     bool robot;
     fifo *fifo_in;
     fifo *fifo_out;
     int16_t *in_buf;
     int16_t *out_buf;
-    bool is_morph_on;
-    pthread_mutex_t mutex;
+    // the copy set() edits, published to the audio thread through snapshot
+    params_t params;
+    ParamSnapshot *snapshot;
 } priv_t;
 
-enum MorphType { NONE_MORPH = 0, ROBOT, BRIGHT, MAN, WOMAN };
-
 static void morph_core_free(VoiceMorph **morph) {
     if (!morph || !(*morph)) return;
 
@@ -47,7 +55,7 @@ static int voice_morph_close(EffectContext *ctx) {
     if (priv->fifo_in) fifo_delete(&priv->fifo_in);
     if (priv->fifo_out) fifo_delete(&priv->fifo_out);
     if (priv->morph) morph_core_free(&priv->morph);
-    pthread_mutex_destroy(&priv->mutex);
+    if (priv->snapshot) param_snapshot_freep(&priv->snapshot);
     return 0;
 }
 
@@ -93,8 +101,14 @@ static int voice_morph_init(EffectContext *ctx, int argc, const char **argv) {
     ret = VoiceMorph_Init(priv->morph);
     if (ret < 0) goto end;
 
-    priv->is_morph_on = false;
-    pthread_mutex_init(&priv->mutex, NULL);
+    priv->type = -1;
+    priv->params.type = NONE_MORPH;
+    priv->params.is_morph_on = false;
+    priv->snapshot = param_snapshot_create(sizeof(params_t), &priv->params);
+    if (NULL == priv->snapshot) {
+        ret = AEERROR_NOMEM;
+        goto end;
+    }
 
 end:
     if (ret < 0) voice_morph_close(ctx);
@@ -130,55 +144,81 @@ static int morph_core_set_type(priv_t *priv,
             break;
     }
 
-    pthread_mutex_lock(&priv->mutex);
     ret = VoiceMorph_SetConfig(priv->morph, pitch_coeff);
-    pthread_mutex_unlock(&priv->mutex);
     return ret;
 }
 
-static void voice_morph_set_mode(priv_t *priv, const char *mode) {
+// audio thread, once per block
+static const params_t *acquire_params(priv_t *priv) {
+    bool changed = false;
+    const params_t *params = param_snapshot_acquire(priv->snapshot, &changed);
+    if (changed && (int)params->type != priv->type) {
+        morph_core_set_type(priv, params->type);
+        priv->type = params->type;
+    }
+    return params;
+}
+
+static void voice_morph_set_mode(params_t *params, const char *mode) {
     if (0 == strcasecmp(mode, "None")) {
         LogInfo("%s set original.\n", __func__);
-        morph_core_set_type(priv, NONE_MORPH);
-        priv->is_morph_on = false;
+        params->type = NONE_MORPH;
+        params->is_morph_on = false;
     } else if (0 == strcasecmp(mode, "bright")) {
         LogInfo("%s set bright.\n", __func__);
-        morph_core_set_type(priv, BRIGHT);
-        priv->is_morph_on = false;
+        params->type = BRIGHT;
+        params->is_morph_on = false;
     } else if (0 == strcasecmp(mode, "robot")) {
         LogInfo("%s set robot.\n", __func__);
-        morph_core_set_type(priv, ROBOT);
-        priv->is_morph_on = true;
+        params->type = ROBOT;
+        params->is_morph_on = true;
     } else if (0 == strcasecmp(mode, "man")) {
         LogInfo("%s set man.\n", __func__);
-        morph_core_set_type(priv, MAN);
-        priv->is_morph_on = true;
+        params->type = MAN;
+        params->is_morph_on = true;
     } else if (0 == strcasecmp(mode, "woman")) {
         LogInfo("%s set woman.\n", __func__);
-        morph_core_set_type(priv, WOMAN);
-        priv->is_morph_on = true;
+        params->type = WOMAN;
+        params->is_morph_on = true;
     }
 }
 
 static int voice_morph_set(EffectContext *ctx, const char *key, int flags) {
     assert(NULL != ctx);
 
+    priv_t *priv = (priv_t *)ctx->priv;
     AEDictionaryEntry *entry = ae_dict_get(ctx->options, key, NULL, flags);
     if (entry) {
         LogInfo("%s key = %s val = %s\n", __func__, entry->key, entry->value);
         if (0 == strcasecmp(entry->key, "mode")) {
-            voice_morph_set_mode((priv_t *)ctx->priv, entry->value);
+            voice_morph_set_mode(&priv->params, entry->value);
         } else if (0 == strcasecmp(entry->key, "Switch")) {
             if (0 == strcasecmp(entry->value, "On")) {
-                ((priv_t *)ctx->priv)->is_morph_on = true;
+                priv->params.is_morph_on = true;
             } else if (0 == strcasecmp(entry->value, "Off")) {
-                ((priv_t *)ctx->priv)->is_morph_on = false;
+                priv->params.is_morph_on = false;
             }
         }
+        if (param_snapshot_publish(priv->snapshot, &priv->params) < 0)
+            return AEERROR_NOMEM;
     }
     return 0;
 }
 
+static int voice_morph_reset(EffectContext *ctx) {
+    assert(NULL != ctx);
+    priv_t *priv = (priv_t *)ctx->priv;
+    if (NULL == priv) return AEERROR_NULL_POINT;
+
+    fifo_clear(priv->fifo_in);
+    fifo_clear(priv->fifo_out);
+    int ret = VoiceMorph_Init(priv->morph);
+    if (ret < 0) return ret;
+    // VoiceMorph_Init() also drops the pitch config
+    if (priv->type >= 0) ret = morph_core_set_type(priv, priv->type);
+    return ret;
+}
+
 static int voice_morph_send(EffectContext *ctx, const void *samples,
                             const size_t nb_samples) {
     assert(NULL != ctx);
@@ -198,15 +238,13 @@ static int voice_morph_receive(EffectContext *ctx,
     assert(NULL != priv->fifo_in);
 
     int ret = 0;
-    if (priv->is_morph_on) {
+    if (acquire_params(priv)->is_morph_on) {
         while (fifo_occupancy(priv->fifo_in) > 0) {
             ret = fifo_read(priv->fifo_in, priv->in_buf, NB_SAMPLES);
             int output_size = 0;
-            pthread_mutex_lock(&priv->mutex);
             ret = VoiceMorph_Process(priv->morph,
                     (void*)priv->in_buf, ret << 1,
                     (char*)priv->out_buf, &output_size, priv->robot);
-            pthread_mutex_unlock(&priv->mutex);
             if (ret < 0) {
                 LogError("%s VoiceMorph_Process error %d.\n", __func__, ret);
                 break;
@@ -235,6 +273,7 @@ const EffectHandler *effect_voice_morph_fn(void) {
                                     .set = voice_morph_set,
                                     .send = voice_morph_send,
                                     .receive = voice_morph_receive,
-                                    .close = voice_morph_close};
+                                    .close = voice_morph_close,
+                                    .reset = voice_morph_reset};
     return &handler;
 }
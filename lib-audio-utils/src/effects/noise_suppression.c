@@ -1,3 +1,4 @@
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -6,7 +7,6 @@
 #include "log.h"
 #include "noise_suppression/noise_suppression.h"
 #include "tools/fifo.h"
-#include "tools/sdl_mutex.h"
 #include "tools/util.h"
 
 #define NB_SAMPLES 1024
@@ -17,8 +17,7 @@ typedef struct {
     fifo *fifo_out;
     int16_t *in_buf;
     int16_t *out_buf;
-    SdlMutex *sdl_mutex;
-    bool is_noise_suppression_on;
+    atomic_bool is_noise_suppression_on;
 } priv_t;
 
 static int noise_suppression_close(EffectContext *ctx) {
@@ -41,7 +40,6 @@ static int noise_suppression_close(EffectContext *ctx) {
             free(priv->out_buf);
             priv->out_buf = NULL;
         }
-        if (priv->sdl_mutex) sdl_mutex_free(&priv->sdl_mutex);
     }
 
     return 0;
@@ -89,12 +87,7 @@ static int noise_suppression_init(EffectContext *ctx,
         ret = AEERROR_NOMEM;
         goto end;
     }
-    priv->sdl_mutex = sdl_mutex_create();
-    if (NULL == priv->sdl_mutex) {
-        ret = AEERROR_NOMEM;
-        goto end;
-    }
-    priv->is_noise_suppression_on = false;
+    atomic_store(&priv->is_noise_suppression_on, false);
 
 end:
     if (ret < 0) noise_suppression_close(ctx);
@@ -109,19 +102,27 @@ static int noise_suppression_set(EffectContext *ctx,
     AEDictionaryEntry *entry = ae_dict_get(ctx->options, key, NULL, flags);
     if (entry) {
         LogInfo("%s key = %s val = %s\n", __func__, entry->key, entry->value);
-        sdl_mutex_lock(priv->sdl_mutex);
         if (0 == strcasecmp(entry->key, "Switch")) {
             if (0 == strcasecmp(entry->value, "Off")) {
-                priv->is_noise_suppression_on = false;
+                atomic_store(&priv->is_noise_suppression_on, false);
             } else if (0 == strcasecmp(entry->value, "On")) {
-                priv->is_noise_suppression_on = true;
+                atomic_store(&priv->is_noise_suppression_on, true);
             }
         }
-        sdl_mutex_unlock(priv->sdl_mutex);
     }
     return 0;
 }
 
+static int noise_suppression_reset(EffectContext *ctx) {
+    if(NULL == ctx) return -1;
+    priv_t *priv = (priv_t *)ctx->priv;
+    if (NULL == priv) return AEERROR_NULL_POINT;
+
+    fifo_clear(priv->fifo_in);
+    fifo_clear(priv->fifo_out);
+    return XmNs_Reset(priv->ns);
+}
+
 static int noise_suppression_send(EffectContext *ctx,
         const void *samples, const size_t nb_samples) {
     if(!ctx) return -1;
@@ -138,8 +139,7 @@ static int noise_suppression_receive(EffectContext *ctx,
     priv_t *priv = (priv_t *)ctx->priv;
     if(!priv || !priv->fifo_out) return ret;
 
-    sdl_mutex_lock(priv->sdl_mutex);
-    if (priv->is_noise_suppression_on) {
+    if (atomic_load(&priv->is_noise_suppression_on)) {
         while (fifo_occupancy(priv->fifo_in) > 0) {
             ret = fifo_read(priv->fifo_in, priv->in_buf, NB_SAMPLES);
             if (ret > 0) {
@@ -156,7 +156,6 @@ static int noise_suppression_receive(EffectContext *ctx,
             fifo_write(priv->fifo_out, priv->out_buf, nb_samples);
         }
     }
-    sdl_mutex_unlock(priv->sdl_mutex);
 
     if (atomic_load(&ctx->return_max_nb_samples) &&
         fifo_occupancy(priv->fifo_out) < max_nb_samples) return 0;
@@ -172,6 +171,7 @@ const EffectHandler *effect_noise_suppression_fn(void) {
                                     .set = noise_suppression_set,
                                     .send = noise_suppression_send,
                                     .receive = noise_suppression_receive,
-                                    .close = noise_suppression_close};
+                                    .close = noise_suppression_close,
+                                    .reset = noise_suppression_reset};
     return &handler;
 }
@@ -39,6 +39,21 @@ int XmNs_Init(NsHandle* NS_inst, uint32_t fs) {
 	return WebRtcNs_InitCore((NSinst_t *) NS_inst, fs);
 }
 
+int XmNs_Reset(NsHandle* NS_inst) {
+	NSinst_t *p = (NSinst_t *)NS_inst;
+	if (p == NULL || p->initFlag != 1) return -1;
+
+	int mode = p->aggrMode;
+	fifo_clear(p->f_in);
+	fifo_clear(p->f_out);
+	memset(p->filter_state1, 0, sizeof(p->filter_state1));
+	memset(p->filter_state12, 0, sizeof(p->filter_state12));
+	memset(p->Synthesis_state1, 0, sizeof(p->Synthesis_state1));
+	memset(p->Synthesis_state12, 0, sizeof(p->Synthesis_state12));
+	if (WebRtcNs_InitCore(p, p->fs) < 0) return -1;
+	return WebRtcNs_set_policy_core(p, mode);
+}
+
 int XmNs_set_policy(NsHandle* NS_inst, enum NsMode mode) {
 	return WebRtcNs_set_policy_core((NSinst_t *) NS_inst, mode);
 }
@@ -71,6 +71,18 @@ int XmNs_Free(NsHandle* NS_inst);
  */
 int XmNs_Init(NsHandle* NS_inst, uint32_t fs);
 
+/*
+ * This clears the state of an initialized instance for a new signal, the
+ * sampling frequency and the policy are kept.
+ *
+ * Input:
+ *      - NS_inst       : Initialized instance
+ *
+ * Return value         :  0 - Ok
+ *                        -1 - Error
+ */
+int XmNs_Reset(NsHandle* NS_inst);
+
 
 /*
  * This changes the aggressiveness of the noise suppression method.
@@ -84,8 +84,9 @@ int WebRtcNs_InitCore(NSinst_t* inst, uint32_t fs_in) {
   if (inst == NULL) {
     return -1;
   }
-  inst->f_in= fifo_create(sizeof(short));
-  inst->f_out= fifo_create(sizeof(short));
+  // kept when the instance is initialized again
+  if (!inst->f_in) inst->f_in= fifo_create(sizeof(short));
+  if (!inst->f_out) inst->f_out= fifo_create(sizeof(short));
   // Initialization of struct
   if (fs == 8000 || fs == 16000 || fs == 32000) {
     inst->fs = fs;
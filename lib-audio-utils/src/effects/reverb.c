@@ -4,94 +4,314 @@
 #include <string.h>
 #include "effect_struct.h"
 #include "tools/fifo.h"
-#include "tools/sdl_mutex.h"
+#include "tools/param_snapshot.h"
 #include "tools/util.h"
 #include "tools/conversion.h"
 
-#define MAX_SAMPLE_SIZE 2048
-
-typedef struct {
-    size_t size;
-    sample_type *buffer;
-    sample_type *ptr;
-    sample_type store;
-} filter_t;
-
-/* gcc -O2 will inline this */
-static sample_type comb_process(filter_t *filter, const sample_type input,
-                                const float feedback, const float hf_damping) {
-    sample_type output = *filter->ptr;
-    filter->store = output + (filter->store - output) * hf_damping;
-    *filter->ptr = input + filter->store * feedback;
-    if (--filter->ptr < filter->buffer) filter->ptr += filter->size;
-    return output;
-}
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define REVERB_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define REVERB_NEON
+#endif
 
-/* gcc -O2 will inline this */
-static sample_type allpass_process(filter_t *filter, const sample_type input) {
-    sample_type output = *filter->ptr;
-    *filter->ptr = input + output * 0.5f;
-    if (--filter->ptr < filter->buffer) filter->ptr += filter->size;
-    return output - input;
-}
+#define MAX_SAMPLE_SIZE 2048
+#define MAX_PRE_DELAY_MS 500
+// frames the filters take at once
+#define FILTER_BLOCK_SIZE 256
 
 /* Filter delay lengths in samples (44100Hz sample-rate) */
 static const size_t comb_lengths[] = {1116, 1188, 1277, 1356,
                                       1422, 1491, 1557, 1617};
 static const size_t allpass_lengths[] = {225, 341, 441, 556};
+/* Added to the lengths of each further channel, decorrelates the tails */
+static const size_t stereo_spread = 23;
+
+#define NB_COMBS array_length(comb_lengths)
+#define NB_ALLPASSES array_length(allpass_lengths)
 
 typedef struct {
-    filter_t comb[array_length(comb_lengths)];
-    filter_t allpass[array_length(allpass_lengths)];
+    size_t size;
+    // the sample read and then written next
+    size_t pos;
+    sample_type *buffer;
+} delay_line_t;
+
+/**
+ * Every filter reads a sample written size samples before, so a filter
+ * runs over a whole block before the next one starts, and over four
+ * samples at once as long as its delay line is that long.
+ */
+typedef struct {
+    delay_line_t comb[NB_COMBS];
+    delay_line_t allpass[NB_ALLPASSES];
+    // lowpass state of each comb
+    sample_type comb_store[NB_COMBS];
+    // one channel of the input block, the wet signal of it
+    sample_type in[FILTER_BLOCK_SIZE];
+    sample_type wet[FILTER_BLOCK_SIZE];
 } filter_array_t;
 
-static void filter_array_create(filter_array_t *p, float sample_rate,
-                                float room_scale) {
+static size_t comb_size(float sample_rate, float room_scale, size_t i,
+                        size_t spread) {
     /* Compensate for actual sample-rate */
     float r = sample_rate * (1 / 44100.0f);
+    size_t size = (size_t)(room_scale * r * (comb_lengths[i] + spread) + 0.5f);
+    return size < 1 ? 1 : size;
+}
 
-    for (size_t i = 0; i < array_length(comb_lengths); ++i) {
-        filter_t *pcomb = &p->comb[i];
-        pcomb->size = (size_t)(room_scale * r * (comb_lengths[i]) + 0.5f);
-        pcomb->ptr = pcomb->buffer =
-            (sample_type *)calloc(pcomb->size, sizeof(sample_type));
+// allocates the combs for the largest room, room_scale 1
+static int filter_array_create(filter_array_t *p, float sample_rate,
+                               size_t spread) {
+    float r = sample_rate * (1 / 44100.0f);
+
+    for (size_t i = 0; i < NB_COMBS; ++i) {
+        delay_line_t *pcomb = &p->comb[i];
+        pcomb->size = comb_size(sample_rate, 1.0f, i, spread);
+        pcomb->pos = 0;
+        pcomb->buffer = (sample_type *)calloc(pcomb->size, sizeof(sample_type));
+        if (NULL == pcomb->buffer) return AEERROR_NOMEM;
+        p->comb_store[i] = 0.0f;
     }
-    for (size_t i = 0; i < array_length(allpass_lengths); ++i) {
-        filter_t *pallpass = &p->allpass[i];
-        pallpass->size = (size_t)(r * (allpass_lengths[i]) + 0.5f);
-        pallpass->ptr = pallpass->buffer =
+    for (size_t i = 0; i < NB_ALLPASSES; ++i) {
+        delay_line_t *pallpass = &p->allpass[i];
+        pallpass->size = (size_t)(r * (allpass_lengths[i] + spread) + 0.5f);
+        if (pallpass->size < 1) pallpass->size = 1;
+        pallpass->pos = 0;
+        pallpass->buffer =
             (sample_type *)calloc(pallpass->size, sizeof(sample_type));
+        if (NULL == pallpass->buffer) return AEERROR_NOMEM;
+    }
+    return 0;
+}
+
+/**
+ * Resizes the combs within the buffers filter_array_create() allocated.
+ * What they hold stays, so the tail goes on in the new room; a comb that
+ * grows reads silence where it had no samples.
+ */
+static void filter_array_set_room(filter_array_t *p, float sample_rate,
+                                  float room_scale, size_t spread) {
+    for (size_t i = 0; i < NB_COMBS; ++i) {
+        delay_line_t *pcomb = &p->comb[i];
+        const size_t size = comb_size(sample_rate, room_scale, i, spread);
+        if (size > pcomb->size) {
+            memset(pcomb->buffer + pcomb->size, 0,
+                   (size - pcomb->size) * sizeof(sample_type));
+        }
+        pcomb->size = size;
+        if (pcomb->pos >= size) pcomb->pos = 0;
+    }
+}
+
+#if defined(REVERB_SSE2)
+// moves the lanes of x up by n, zeros come in at lane 0
+#define SHIFT_LANES(x, n) \
+    _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(x), 4 * (n)))
+#elif defined(REVERB_NEON)
+#define SHIFT_LANES(x, n) vextq_f32(vdupq_n_f32(0.0f), x, 4 - (n))
+#endif
+
+/**
+ * The combs over n frames none of their delay lines wraps in. A comb
+ * writes back input + store * feedback, the lowpass
+ *   store[t] = delayed[t] * (1 - d) + store[t - 1] * d
+ * of four frames is a prefix scan of delayed * (1 - d) plus the last
+ * store scaled by d, d^2, d^3, d^4.
+ * @return number of frames done, the rest of n is less than four
+ */
+static size_t combs_process_x4(filter_array_t *p, const sample_type *input,
+                               sample_type *wet, const size_t n,
+                               const float feedback, const float hf_damping) {
+    size_t k = 0;
+#if defined(REVERB_SSE2) || defined(REVERB_NEON)
+    const float d = hf_damping;
+    sample_type *buf[NB_COMBS];
+    for (size_t i = 0; i < NB_COMBS; ++i)
+        buf[i] = p->comb[i].buffer + p->comb[i].pos;
+#endif
+#if defined(REVERB_SSE2)
+    const __m128 keep = _mm_set1_ps(1.0f - d);
+    const __m128 d1 = _mm_set1_ps(d);
+    const __m128 d2 = _mm_set1_ps(d * d);
+    const __m128 dpow = _mm_setr_ps(d, d * d, d * d * d, d * d * d * d);
+    const __m128 fb = _mm_set1_ps(feedback);
+    __m128 store[NB_COMBS];
+    for (size_t i = 0; i < NB_COMBS; ++i)
+        store[i] = _mm_set1_ps(p->comb_store[i]);
+
+    for (; k + 4 <= n; k += 4) {
+        const __m128 in = _mm_loadu_ps(input + k);
+        __m128 sum = _mm_setzero_ps();
+        for (size_t i = 0; i < NB_COMBS; ++i) {
+            __m128 delayed = _mm_loadu_ps(buf[i] + k);
+            sum = _mm_add_ps(sum, delayed);
+            __m128 x = _mm_mul_ps(delayed, keep);
+            x = _mm_add_ps(x, _mm_mul_ps(SHIFT_LANES(x, 1), d1));
+            x = _mm_add_ps(x, _mm_mul_ps(SHIFT_LANES(x, 2), d2));
+            x = _mm_add_ps(x, _mm_mul_ps(store[i], dpow));
+            store[i] = _mm_shuffle_ps(x, x, _MM_SHUFFLE(3, 3, 3, 3));
+            _mm_storeu_ps(buf[i] + k, _mm_add_ps(in, _mm_mul_ps(x, fb)));
+        }
+        _mm_storeu_ps(wet + k, sum);
     }
+
+    for (size_t i = 0; i < NB_COMBS; ++i)
+        p->comb_store[i] = _mm_cvtss_f32(store[i]);
+#elif defined(REVERB_NEON)
+    const float32x4_t keep = vdupq_n_f32(1.0f - d);
+    const float32x4_t d1 = vdupq_n_f32(d);
+    const float32x4_t d2 = vdupq_n_f32(d * d);
+    const float dpow_lanes[4] = {d, d * d, d * d * d, d * d * d * d};
+    const float32x4_t dpow = vld1q_f32(dpow_lanes);
+    const float32x4_t fb = vdupq_n_f32(feedback);
+    float32x4_t store[NB_COMBS];
+    for (size_t i = 0; i < NB_COMBS; ++i)
+        store[i] = vdupq_n_f32(p->comb_store[i]);
+
+    for (; k + 4 <= n; k += 4) {
+        const float32x4_t in = vld1q_f32(input + k);
+        float32x4_t sum = vdupq_n_f32(0.0f);
+        for (size_t i = 0; i < NB_COMBS; ++i) {
+            float32x4_t delayed = vld1q_f32(buf[i] + k);
+            sum = vaddq_f32(sum, delayed);
+            float32x4_t x = vmulq_f32(delayed, keep);
+            x = vmlaq_f32(x, SHIFT_LANES(x, 1), d1);
+            x = vmlaq_f32(x, SHIFT_LANES(x, 2), d2);
+            x = vmlaq_f32(x, store[i], dpow);
+            store[i] = vdupq_n_f32(vgetq_lane_f32(x, 3));
+            vst1q_f32(buf[i] + k, vmlaq_f32(in, x, fb));
+        }
+        vst1q_f32(wet + k, sum);
+    }
+
+    for (size_t i = 0; i < NB_COMBS; ++i)
+        p->comb_store[i] = vgetq_lane_f32(store[i], 0);
+#endif
+    return k;
 }
 
+// wet = sum of the combs over n frames of input
+static void combs_process(filter_array_t *p, const sample_type *input,
+                          sample_type *wet, size_t n, const float feedback,
+                          const float hf_damping) {
+    while (n > 0) {
+        // up to the first delay line that wraps
+        size_t len = n;
+        for (size_t i = 0; i < NB_COMBS; ++i) {
+            size_t left = p->comb[i].size - p->comb[i].pos;
+            if (left < len) len = left;
+        }
+
+        size_t k = combs_process_x4(p, input, wet, len, feedback, hf_damping);
+        for (; k < len; ++k) {
+            sample_type sum = 0.0f;
+            for (size_t i = 0; i < NB_COMBS; ++i) {
+                sample_type *ptr = p->comb[i].buffer + p->comb[i].pos + k;
+                sample_type delayed = *ptr;
+                sum += delayed;
+                p->comb_store[i] =
+                    delayed + (p->comb_store[i] - delayed) * hf_damping;
+                *ptr = input[k] + p->comb_store[i] * feedback;
+            }
+            wet[k] = sum;
+        }
+
+        for (size_t i = 0; i < NB_COMBS; ++i) {
+            delay_line_t *line = &p->comb[i];
+            line->pos += len;
+            if (line->pos == line->size) line->pos = 0;
+        }
+        input += len;
+        wet += len;
+        n -= len;
+    }
+}
+
+// runs the n samples of x through an allpass in place, n <= line->size
+static void allpass_process(delay_line_t *line, sample_type *x, size_t n) {
+    while (n > 0) {
+        size_t len = line->size - line->pos;
+        if (len > n) len = n;
+        sample_type *buf = line->buffer + line->pos;
+        size_t k = 0;
+#if defined(REVERB_SSE2)
+        const __m128 half = _mm_set1_ps(0.5f);
+        for (; k + 4 <= len; k += 4) {
+            __m128 in = _mm_loadu_ps(x + k);
+            __m128 out = _mm_loadu_ps(buf + k);
+            _mm_storeu_ps(buf + k, _mm_add_ps(in, _mm_mul_ps(out, half)));
+            _mm_storeu_ps(x + k, _mm_sub_ps(out, in));
+        }
+#elif defined(REVERB_NEON)
+        const float32x4_t half = vdupq_n_f32(0.5f);
+        for (; k + 4 <= len; k += 4) {
+            float32x4_t in = vld1q_f32(x + k);
+            float32x4_t out = vld1q_f32(buf + k);
+            vst1q_f32(buf + k, vmlaq_f32(in, out, half));
+            vst1q_f32(x + k, vsubq_f32(out, in));
+        }
+#endif
+        for (; k < len; ++k) {
+            sample_type out = buf[k];
+            buf[k] = x[k] + out * 0.5f;
+            x[k] = out - x[k];
+        }
+        line->pos += len;
+        if (line->pos == line->size) line->pos = 0;
+        x += len;
+        n -= len;
+    }
+}
+
+// input and output are interleaved, one frame every stride samples,
+// length is at most FILTER_BLOCK_SIZE
 static void filter_array_process(filter_array_t *p, size_t length,
                                  sample_type const *input, sample_type *output,
-                                 float const feedback, float const hf_damping,
-                                 float const gain) {
-    while (length--) {
-        sample_type out = 0.0f;
-        sample_type in = *input++;
-        size_t i = array_length(comb_lengths) - 1;
-        do {
-            out += comb_process(p->comb + i, in, feedback, hf_damping);
-        } while (i--);
-
-        i = array_length(allpass_lengths) - 1;
-        do {
-            out = allpass_process(p->allpass + i, out);
-        } while (i--);
-        *output++ = out * gain;
+                                 const size_t stride, float const feedback,
+                                 float const hf_damping, float const gain) {
+    for (size_t k = 0; k < length; ++k) {
+        p->in[k] = *input;
+        input += stride;
+    }
+
+    combs_process(p, p->in, p->wet, length, feedback, hf_damping);
+    size_t i = NB_ALLPASSES - 1;
+    do {
+        allpass_process(p->allpass + i, p->wet, length);
+    } while (i--);
+
+    for (size_t k = 0; k < length; ++k) {
+        *output = p->wet[k] * gain;
+        output += stride;
+    }
+}
+
+static void filter_array_clear(filter_array_t *p) {
+    for (size_t i = 0; i < NB_COMBS; ++i) {
+        delay_line_t *pcomb = &p->comb[i];
+        p->comb_store[i] = 0.0f;
+        if (NULL == pcomb->buffer) continue;
+        memset(pcomb->buffer, 0, pcomb->size * sizeof(sample_type));
+        pcomb->pos = 0;
+    }
+    for (size_t i = 0; i < NB_ALLPASSES; ++i) {
+        delay_line_t *pallpass = &p->allpass[i];
+        if (NULL == pallpass->buffer) continue;
+        memset(pallpass->buffer, 0, pallpass->size * sizeof(sample_type));
+        pallpass->pos = 0;
     }
 }
 
 static void filter_array_delete(filter_array_t *p) {
-    for (size_t i = 0; i < array_length(allpass_lengths); ++i) {
+    for (size_t i = 0; i < NB_ALLPASSES; ++i) {
         if ((&p->allpass[i])->buffer) {
             free((&p->allpass[i])->buffer);
             (&p->allpass[i])->buffer = NULL;
         }
     }
-    for (size_t i = 0; i < array_length(comb_lengths); ++i) {
+    for (size_t i = 0; i < NB_COMBS; ++i) {
         if ((&p->comb[i])->buffer) {
             free((&p->comb[i])->buffer);
             (&p->comb[i])->buffer = NULL;
@@ -100,22 +320,32 @@ static void filter_array_delete(filter_array_t *p) {
 }
 
 typedef struct {
-    fifo *fifo_in;
-    fifo *fifo_out;
-    SdlMutex *sdl_mutex;
     bool effect_on;
-
     bool wet_only;
     float reverberance;
     float hf_damping;
     float room_scale;
     float pre_delay_ms;
     float wet_gain_dB;
+} params_t;
 
+typedef struct {
+    fifo *fifo_in;
+    fifo *fifo_out;
+    // the copy set() edits, published to the audio thread through snapshot
+    params_t params;
+    ParamSnapshot *snapshot;
+
+    // derived from the params by the audio thread
     float feedback;
+    float hf_damping;
     float gain;
     size_t delay_samples;
-    filter_array_t filter_array;
+    // the pre-delay of the process path, long enough for MAX_PRE_DELAY_MS
+    delay_line_t pre_delay;
+    size_t pre_delay_samples;
+    // one for each channel
+    filter_array_t *filter_arrays;
 
     short *fix_buffer;
 
@@ -123,10 +353,9 @@ typedef struct {
     sample_type wet_buf[MAX_SAMPLE_SIZE];
 } priv_t;
 
-static int reverb_getopts(EffectContext *ctx, int argc, const char **argv) {
+// NUMERIC_PARAMETER() stores into priv->name
+static int reverb_getopts(params_t *priv, int argc, const char **argv) {
     LogInfo("%s.\n", __func__);
-    priv_t *priv = (priv_t *)ctx->priv;
-
     priv->reverberance = priv->hf_damping = 50; /* Set non-zero defaults */
     priv->room_scale = 100;
 
@@ -138,50 +367,100 @@ static int reverb_getopts(EffectContext *ctx, int argc, const char **argv) {
         NUMERIC_PARAMETER(reverberance, 0, 100)
         NUMERIC_PARAMETER(hf_damping, 0, 100)
         NUMERIC_PARAMETER(room_scale, 0, 100)
-        NUMERIC_PARAMETER(pre_delay_ms, 0, 500)
+        NUMERIC_PARAMETER(pre_delay_ms, 0, MAX_PRE_DELAY_MS)
         NUMERIC_PARAMETER(wet_gain_dB, -10, 10)
     } while (0);
 
     return argc ? AUDIO_EFFECT_EOF : AUDIO_EFFECT_SUCCESS;
 }
 
-static int reverb_start(EffectContext *ctx) {
+// 预留delay_samples
+static void reverb_set_delay(priv_t *priv, const size_t delay_samples) {
+    while (priv->delay_samples < delay_samples) {
+        size_t nb_samples = delay_samples - priv->delay_samples;
+        if (nb_samples > MAX_SAMPLE_SIZE) nb_samples = MAX_SAMPLE_SIZE;
+        memset(priv->fix_buffer, 0, nb_samples * sizeof(short));
+        fifo_write(priv->fifo_in, priv->fix_buffer, nb_samples);
+        priv->delay_samples += nb_samples;
+    }
+    while (priv->delay_samples > delay_samples) {
+        size_t nb_samples = priv->delay_samples - delay_samples;
+        if (nb_samples > MAX_SAMPLE_SIZE) nb_samples = MAX_SAMPLE_SIZE;
+        fifo_read(priv->fifo_in, priv->fix_buffer, nb_samples);
+        priv->delay_samples -= nb_samples;
+    }
+}
+
+static void reverb_start(EffectContext *ctx, const params_t *params) {
     LogInfo("%s.\n", __func__);
     priv_t *priv = (priv_t *)ctx->priv;
+    const int channels = ctx->in_signal.channels;
     size_t delay_samples =
-        priv->pre_delay_ms / 1000 * ctx->in_signal.sample_rate + 0.5f;
-    float scale = priv->room_scale / 100.0f * 0.9f + 0.1f;
+        (size_t)(params->pre_delay_ms / 1000 * ctx->in_signal.sample_rate +
+                 0.5f) * channels;
+    float scale = params->room_scale / 100.0f * 0.9f + 0.1f;
     /* Set minimum feedback */
     float a = -1 / log(1 - /**/ 0.3f /**/);
     /* Set maximum feedback */
     float b = 100 / (log(1 - /**/ 0.98f /**/) * a + 1);
 
-    priv->hf_damping = priv->hf_damping / 100 * 0.3f + 0.2f;
-    priv->feedback = 1 - expf((priv->reverberance - b) / (a * b));
-    priv->gain = dB_to_linear(priv->wet_gain_dB) * 0.015f;
-
-    // 预留delay_samples
-    if (priv->delay_samples < delay_samples) {
-        short *tmp_samples = (short *)calloc(
-            delay_samples - priv->delay_samples, sizeof(short));
-        fifo_write(priv->fifo_in, tmp_samples,
-                   delay_samples - priv->delay_samples);
-        free(tmp_samples);
-    } else if (priv->delay_samples > delay_samples) {
-        short *tmp_samples = (short *)calloc(
-            delay_samples - priv->delay_samples, sizeof(short));
-        fifo_read(priv->fifo_in, tmp_samples,
-                  delay_samples - priv->delay_samples);
-        free(tmp_samples);
-    }
-    priv->delay_samples = delay_samples;
-
-    filter_array_delete(&priv->filter_array);
-    filter_array_create(&priv->filter_array, ctx->in_signal.sample_rate, scale);
-    return AUDIO_EFFECT_SUCCESS;
+    priv->hf_damping = params->hf_damping / 100 * 0.3f + 0.2f;
+    priv->feedback = 1 - expf((params->reverberance - b) / (a * b));
+    priv->gain = dB_to_linear(params->wet_gain_dB) * 0.015f;
+
+    reverb_set_delay(priv, delay_samples);
+    priv->pre_delay_samples = delay_samples;
+    for (int c = 0; c < channels; ++c) {
+        filter_array_set_room(priv->filter_arrays + c,
+                              ctx->in_signal.sample_rate, scale,
+                              c * stereo_spread);
+    }
+}
+
+static void reverb_filter(EffectContext *ctx, const sample_type *input,
+                          sample_type *output, const size_t nb_samples) {
+    priv_t *priv = (priv_t *)ctx->priv;
+    const int channels = ctx->in_signal.channels;
+    const size_t nb_frames = nb_samples / channels;
+    for (size_t i = 0; i < nb_frames; i += FILTER_BLOCK_SIZE) {
+        size_t n = nb_frames - i;
+        if (n > FILTER_BLOCK_SIZE) n = FILTER_BLOCK_SIZE;
+        const size_t offset = i * channels;
+        for (int c = 0; c < channels; ++c) {
+            filter_array_process(priv->filter_arrays + c, n,
+                                 input + offset + c, output + offset + c,
+                                 channels, priv->feedback, priv->hf_damping,
+                                 priv->gain);
+        }
+    }
+}
+
+// delays samples by delay, which is below the size of line
+static void pre_delay_process(delay_line_t *line, const size_t delay,
+                              sample_type *samples, const size_t nb_samples) {
+    if (0 == delay) return;
+
+    size_t pos = line->pos;
+    for (size_t i = 0; i < nb_samples; ++i) {
+        line->buffer[pos] = samples[i];
+        samples[i] = line->buffer[pos >= delay ? pos - delay
+                                               : pos + line->size - delay];
+        if (++pos == line->size) pos = 0;
+    }
+    line->pos = pos;
+}
+
+// audio thread, once per block
+static const params_t *acquire_params(EffectContext *ctx) {
+    priv_t *priv = (priv_t *)ctx->priv;
+    bool changed = false;
+    const params_t *params = param_snapshot_acquire(priv->snapshot, &changed);
+    if (changed) reverb_start(ctx, params);
+    return params;
 }
 
-static int reverb_parseopts(EffectContext *ctx, const char *argvs) {
+static int reverb_parseopts(EffectContext *ctx, params_t *params,
+                            const char *argvs) {
 #define MAX_ARGC 50
     const char *argv[MAX_ARGC];
     int argc = 0;
@@ -195,11 +474,7 @@ static int reverb_parseopts(EffectContext *ctx, const char *argvs) {
         argv[argc++] = token;
         token = strtok(NULL, " ");
     }
-    int ret = reverb_getopts(ctx, argc, argv);
-    if (ret < 0) goto end;
-    ret = reverb_start(ctx);
-
-end:
+    int ret = reverb_getopts(params, argc, argv);
     if (argvs2) free(argvs2);
     return ret;
 }
@@ -212,12 +487,21 @@ static int reverb_close(EffectContext *ctx) {
         priv_t *priv = (priv_t *)ctx->priv;
         if (priv->fifo_in) fifo_delete(&priv->fifo_in);
         if (priv->fifo_out) fifo_delete(&priv->fifo_out);
-        if (priv->sdl_mutex) sdl_mutex_free(&priv->sdl_mutex);
+        if (priv->snapshot) param_snapshot_freep(&priv->snapshot);
         if (priv->fix_buffer) {
             free(priv->fix_buffer);
             priv->fix_buffer = NULL;
         }
-        filter_array_delete(&priv->filter_array);
+        if (priv->pre_delay.buffer) {
+            free(priv->pre_delay.buffer);
+            priv->pre_delay.buffer = NULL;
+        }
+        if (priv->filter_arrays) {
+            for (int c = 0; c < ctx->in_signal.channels; ++c)
+                filter_array_delete(priv->filter_arrays + c);
+            free(priv->filter_arrays);
+            priv->filter_arrays = NULL;
+        }
     }
     return 0;
 }
@@ -239,38 +523,64 @@ static int reverb_init(EffectContext *ctx, int argc, const char **argv) {
         ret = AEERROR_NOMEM;
         goto end;
     }
-    priv->sdl_mutex = sdl_mutex_create();
-    if (NULL == priv->sdl_mutex) {
-        ret = AEERROR_NOMEM;
-        goto end;
-    }
-
     priv->fix_buffer = (short *)calloc(MAX_SAMPLE_SIZE, sizeof(short));
     if (NULL == priv->fix_buffer) {
         LogError("%s calloc fix_buffer failed.\n", __func__);
+        ret = AEERROR_NOMEM;
+        goto end;
+    }
+    priv->pre_delay.size =
+        ((size_t)(MAX_PRE_DELAY_MS / 1000.0f * ctx->in_signal.sample_rate +
+                  0.5f) + 1) * ctx->in_signal.channels;
+    priv->pre_delay.buffer =
+        (sample_type *)calloc(priv->pre_delay.size, sizeof(sample_type));
+    if (NULL == priv->pre_delay.buffer) {
+        LogError("%s calloc pre_delay failed.\n", __func__);
+        ret = AEERROR_NOMEM;
+        goto end;
+    }
+    priv->filter_arrays = (filter_array_t *)calloc(ctx->in_signal.channels,
+                                                   sizeof(filter_array_t));
+    if (NULL == priv->filter_arrays) {
+        LogError("%s calloc filter_arrays failed.\n", __func__);
+        ret = AEERROR_NOMEM;
         goto end;
     }
+    for (int c = 0; c < ctx->in_signal.channels; ++c) {
+        ret = filter_array_create(priv->filter_arrays + c,
+                                  ctx->in_signal.sample_rate,
+                                  c * stereo_spread);
+        if (ret < 0) {
+            LogError("%s filter_array_create failed.\n", __func__);
+            goto end;
+        }
+    }
 
     if (argc > 1 && argv != NULL) {
-        ret = reverb_getopts(ctx, argc, argv);
+        ret = reverb_getopts(&priv->params, argc, argv);
         if (ret < 0) goto end;
     }
 
-    return reverb_start(ctx);
+    // the audio thread sizes the filters when it first reads the params
+    priv->snapshot = param_snapshot_create(sizeof(params_t), &priv->params);
+    if (NULL == priv->snapshot) {
+        ret = AEERROR_NOMEM;
+        goto end;
+    }
 
 end:
     if (ret < 0) reverb_close(ctx);
     return ret;
 }
 
-static void reverb_set_mode(EffectContext *ctx, const char *mode) {
+static void reverb_set_mode(EffectContext *ctx, params_t *params,
+                            const char *mode) {
     LogInfo("%s mode = %s.\n", __func__, mode);
-    priv_t *priv = (priv_t *)ctx->priv;
     if (0 == strcasecmp(mode, "Original")) {
-        priv->effect_on = false;
+        params->effect_on = false;
     } else {
-        reverb_parseopts(ctx, REVERB_PARAMS);
-        priv->effect_on = true;
+        reverb_parseopts(ctx, params, REVERB_PARAMS);
+        params->effect_on = true;
     }
 }
 
@@ -283,24 +593,47 @@ static int reverb_set(EffectContext *ctx, const char *key, int flags) {
     if (entry) {
         LogInfo("%s key = %s val = %s\n", __func__, entry->key, entry->value);
 
-        sdl_mutex_lock(priv->sdl_mutex);
+        // a bad option string leaves the published params unchanged
+        params_t params = priv->params;
         if (0 == strcasecmp(entry->key, ctx->handler.name)) {
-            ret = reverb_parseopts(ctx, entry->value);
+            ret = reverb_parseopts(ctx, &params, entry->value);
         } else if (0 == strcasecmp(entry->key, "Switch")) {
             if (0 == strcasecmp(entry->value, "Off")) {
-                priv->effect_on = false;
+                params.effect_on = false;
             } else if (0 == strcasecmp(entry->value, "On")) {
-                priv->effect_on = true;
+                params.effect_on = true;
             }
         } else if (0 == strcasecmp(entry->key, "mode")) {
-            reverb_set_mode(ctx, entry->value);
+            reverb_set_mode(ctx, &params, entry->value);
         }
+        if (ret < 0) return ret;
 
-        sdl_mutex_unlock(priv->sdl_mutex);
+        priv->params = params;
+        if (param_snapshot_publish(priv->snapshot, &params) < 0)
+            return AEERROR_NOMEM;
     }
     return ret;
 }
 
+static int reverb_reset(EffectContext *ctx) {
+    assert(NULL != ctx);
+    priv_t *priv = (priv_t *)ctx->priv;
+    if (NULL == priv) return AEERROR_NULL_POINT;
+
+    // the pre-delay is silence queued in fifo_in, queue it again
+    const size_t delay_samples = priv->delay_samples;
+    fifo_clear(priv->fifo_in);
+    fifo_clear(priv->fifo_out);
+    priv->delay_samples = 0;
+    reverb_set_delay(priv, delay_samples);
+    memset(priv->pre_delay.buffer, 0,
+           priv->pre_delay.size * sizeof(sample_type));
+    priv->pre_delay.pos = 0;
+    for (int c = 0; c < ctx->in_signal.channels; ++c)
+        filter_array_clear(priv->filter_arrays + c);
+    return 0;
+}
+
 static int reverb_send(EffectContext *ctx, const void *samples,
                        const size_t nb_samples) {
     assert(NULL != ctx);
@@ -308,6 +641,8 @@ static int reverb_send(EffectContext *ctx, const void *samples,
     assert(NULL != priv);
     assert(NULL != priv->fifo_in);
 
+    // a new pre-delay goes in ahead of these samples
+    acquire_params(ctx);
     return fifo_write(priv->fifo_in, samples, nb_samples);
 }
 
@@ -318,16 +653,16 @@ static int reverb_receive(EffectContext *ctx, void *samples,
     assert(NULL != priv);
     assert(NULL != priv->fifo_in);
 
-    sdl_mutex_lock(priv->sdl_mutex);
-    if (priv->effect_on) {
-        size_t nb_samples =
-            fifo_read(priv->fifo_in, priv->fix_buffer, MAX_SAMPLE_SIZE);
+    // whole frames only
+    const size_t block = MAX_SAMPLE_SIZE / ctx->in_signal.channels *
+                         ctx->in_signal.channels;
+    const params_t *params = acquire_params(ctx);
+    if (params->effect_on) {
+        size_t nb_samples = fifo_read(priv->fifo_in, priv->fix_buffer, block);
         S16ToFloat(priv->fix_buffer, priv->dry_buf, nb_samples);
         while (nb_samples > 0) {
-            filter_array_process(&priv->filter_array, nb_samples, priv->dry_buf,
-                                 priv->wet_buf, priv->feedback,
-                                 priv->hf_damping, priv->gain);
-            if (!priv->wet_only) {
+            reverb_filter(ctx, priv->dry_buf, priv->wet_buf, nb_samples);
+            if (!params->wet_only) {
                 sample_type *dry_buffer = priv->dry_buf;
                 sample_type *wet_buffer = priv->wet_buf;
                 for (size_t i = 0; i < nb_samples; ++i) {
@@ -338,8 +673,7 @@ static int reverb_receive(EffectContext *ctx, void *samples,
             }
             FloatToS16(priv->wet_buf, priv->fix_buffer, nb_samples);
             fifo_write(priv->fifo_out, priv->fix_buffer, nb_samples);
-            nb_samples =
-                fifo_read(priv->fifo_in, priv->fix_buffer, MAX_SAMPLE_SIZE);
+            nb_samples = fifo_read(priv->fifo_in, priv->fix_buffer, block);
             S16ToFloat(priv->fix_buffer, priv->dry_buf, nb_samples);
         }
     } else {
@@ -349,7 +683,6 @@ static int reverb_receive(EffectContext *ctx, void *samples,
             fifo_write(priv->fifo_out, priv->fix_buffer, nb_samples);
         }
     }
-    sdl_mutex_unlock(priv->sdl_mutex);
 
     if (atomic_load(&ctx->return_max_nb_samples) &&
         fifo_occupancy(priv->fifo_out) < max_nb_samples)
@@ -358,6 +691,30 @@ static int reverb_receive(EffectContext *ctx, void *samples,
     return fifo_read(priv->fifo_out, samples, max_nb_samples);
 }
 
+static int reverb_process(EffectContext *ctx, float *samples,
+                          const size_t nb_samples) {
+    assert(NULL != ctx);
+    priv_t *priv = (priv_t *)ctx->priv;
+    assert(NULL != priv);
+    assert(nb_samples <= MAX_SAMPLE_SIZE);
+
+    const params_t *params = acquire_params(ctx);
+    // like the silence send() queues ahead of the input, which is there
+    // whether the effect is on or not
+    pre_delay_process(&priv->pre_delay, priv->pre_delay_samples, samples,
+                      nb_samples);
+    if (params->effect_on) {
+        reverb_filter(ctx, samples, priv->wet_buf, nb_samples);
+        if (params->wet_only) {
+            memcpy(samples, priv->wet_buf, nb_samples * sizeof(sample_type));
+        } else {
+            for (size_t i = 0; i < nb_samples; ++i)
+                samples[i] += priv->wet_buf[i];
+        }
+    }
+    return nb_samples;
+}
+
 const EffectHandler *effect_reverb_fn(void) {
     static EffectHandler handler = {.name = "reverb",
                                     .usage =
@@ -373,6 +730,10 @@ const EffectHandler *effect_reverb_fn(void) {
                                     .set = reverb_set,
                                     .send = reverb_send,
                                     .receive = reverb_receive,
-                                    .close = reverb_close};
+                                    .close = reverb_close,
+                                    .process = reverb_process,
+                                    .block_size = MAX_SAMPLE_SIZE,
+                                    .multichannel = true,
+                                    .reset = reverb_reset};
     return &handler;
 }
@@ -93,6 +93,52 @@ int receive_samples(EffectContext *ctx, void *samples,
     return ctx->handler.receive(ctx, samples, max_nb_samples);
 }
 
+int process_samples(EffectContext *ctx, float *samples,
+                    const size_t nb_samples) {
+    if (NULL == ctx || NULL == ctx->handler.process) {
+        return -1;
+    }
+
+    // a block always ends on a frame boundary
+    const size_t channels =
+        ctx->in_signal.channels > 0 ? ctx->in_signal.channels : 1;
+    const size_t block_size = ctx->handler.block_size / channels * channels;
+    if (0 == block_size || nb_samples <= block_size)
+        return ctx->handler.process(ctx, samples, nb_samples);
+
+    size_t nb_out = 0;
+    for (size_t i = 0; i < nb_samples; i += block_size) {
+        size_t n = nb_samples - i < block_size ? nb_samples - i : block_size;
+        int ret = ctx->handler.process(ctx, samples + i, n);
+        if (ret < 0) return ret;
+        if (nb_out != i)
+            memmove(samples + nb_out, samples + i, ret * sizeof(float));
+        nb_out += ret;
+    }
+    return nb_out;
+}
+
+int drain_samples(EffectContext *ctx, float *samples,
+                  const size_t max_nb_samples) {
+    if (NULL == ctx || NULL == ctx->handler.drain) {
+        return -1;
+    }
+
+    // whole frames only
+    const size_t channels =
+        ctx->in_signal.channels > 0 ? ctx->in_signal.channels : 1;
+    return ctx->handler.drain(ctx, samples,
+                              max_nb_samples / channels * channels);
+}
+
+int reset_effect(EffectContext *ctx) {
+    if (NULL == ctx || NULL == ctx->handler.reset) {
+        return -1;
+    }
+
+    return ctx->handler.reset(ctx);
+}
+
 void free_effect(EffectContext *ctx) {
     if (NULL == ctx) return;
     ctx->handler.close(ctx);
@@ -18,6 +18,28 @@ int send_samples(EffectContext *ctx, const void *samples,
                  const size_t nb_samples);
 int receive_samples(EffectContext *ctx, void *samples,
                     const size_t max_nb_samples);
+/**
+ * @brief process float samples in place, split into blocks the effect takes
+ *
+ * @return number of samples at the front of samples, < 0 if the effect
+ *         has no process callback
+ */
+int process_samples(EffectContext *ctx, float *samples,
+                    const size_t nb_samples);
+/**
+ * @brief take what a process effect has left after the end of the input
+ *
+ * @return number of samples written to samples, 0 once nothing is left,
+ *         < 0 if the effect has no drain callback
+ */
+int drain_samples(EffectContext *ctx, float *samples,
+                  const size_t max_nb_samples);
+/**
+ * @brief clear the state of ctx for a new signal, keeping its params
+ *
+ * @return < 0 if the effect has no reset callback
+ */
+int reset_effect(EffectContext *ctx);
 void free_effect(EffectContext *ctx);
 
 #endif  // AUDIO_EFFECTS_H_
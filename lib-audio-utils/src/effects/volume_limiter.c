@@ -9,31 +9,48 @@
 #include "log.h"
 #include "beautify/limiter.h"
 #include "tools/fifo.h"
-#include "tools/sdl_mutex.h"
+#include "tools/param_snapshot.h"
 #include "tools/conversion.h"
 
 typedef struct {
-    Limiter *limiter;
-    fifo *fifo_in;
-    fifo *fifo_out;
-    SdlMutex *sdl_mutex;
-
     float limiter_threshold_in_dB;
     float output_gain_in_dB;
     float attack_time_in_ms;
     float decay_time_in_ms;
+    bool effect_on;
+} params_t;
+
+typedef struct {
+    Limiter *limiter;
+    fifo *fifo_in;
+    fifo *fifo_out;
+    // the copy set() edits, published to the audio thread through snapshot
+    params_t params;
+    ParamSnapshot *snapshot;
 
     float flp_buffer[MAX_NB_SAMPLES];
     short fix_buffer[MAX_NB_SAMPLES];
-    bool effect_on;
 } priv_t;
 
-static void init_parameter(priv_t *priv) {
-    assert(NULL != priv);
-    priv->limiter_threshold_in_dB = -0.5f;
-    priv->output_gain_in_dB = 0.0f;
-    priv->attack_time_in_ms = 0.0f;
-    priv->decay_time_in_ms = 0.0f;
+static void init_parameter(params_t *params) {
+    assert(NULL != params);
+    params->limiter_threshold_in_dB = -0.5f;
+    params->output_gain_in_dB = 0.0f;
+    params->attack_time_in_ms = 0.0f;
+    params->decay_time_in_ms = 0.0f;
+    params->effect_on = false;
+}
+
+// audio thread, once per block
+static const params_t *acquire_params(priv_t *priv) {
+    bool changed = false;
+    const params_t *params = param_snapshot_acquire(priv->snapshot, &changed);
+    if (changed) {
+        LimiterSet(priv->limiter, params->limiter_threshold_in_dB,
+            params->attack_time_in_ms, params->decay_time_in_ms,
+            params->output_gain_in_dB);
+    }
+    return params;
 }
 
 static int limiter_close(EffectContext *ctx) {
@@ -45,7 +62,7 @@ static int limiter_close(EffectContext *ctx) {
         if (priv->limiter) LimiterFree(&priv->limiter);
         if (priv->fifo_in) fifo_delete(&priv->fifo_in);
         if (priv->fifo_out) fifo_delete(&priv->fifo_out);
-        if (priv->sdl_mutex) sdl_mutex_free(&priv->sdl_mutex);
+        if (priv->snapshot) param_snapshot_freep(&priv->snapshot);
     }
     return 0;
 }
@@ -60,7 +77,8 @@ static int limiter_init(EffectContext *ctx, int argc, const char **argv) {
     if (NULL == priv) return AEERROR_NULL_POINT;
 
     int ret = 0;
-    priv->limiter = LimiterCreate(ctx->in_signal.sample_rate);
+    priv->limiter = LimiterCreate(ctx->in_signal.sample_rate,
+                                  ctx->in_signal.channels);
     if (NULL == priv->limiter) {
         ret = AEERROR_NOMEM;
         goto end;
@@ -77,14 +95,14 @@ static int limiter_init(EffectContext *ctx, int argc, const char **argv) {
         ret = AEERROR_NOMEM;
         goto end;
     }
-    priv->sdl_mutex = sdl_mutex_create();
-    if (NULL == priv->sdl_mutex) {
+
+    init_parameter(&priv->params);
+    priv->snapshot = param_snapshot_create(sizeof(params_t), &priv->params);
+    if (NULL == priv->snapshot) {
         ret = AEERROR_NOMEM;
         goto end;
     }
 
-    init_parameter(priv);
-
 end:
     if (ret < 0) limiter_close(ctx);
     return ret;
@@ -99,28 +117,37 @@ static int limiter_set(EffectContext *ctx, const char *key,
     if (entry) {
         LogInfo("%s key = %s val = %s\n", __func__, entry->key, entry->value);
 
-        sdl_mutex_lock(priv->sdl_mutex);
+        params_t *params = &priv->params;
         if (0 == strcasecmp(entry->key, "limiter_threshold_in_dB")) {
-            priv->limiter_threshold_in_dB = strtod(entry->value, NULL);
+            params->limiter_threshold_in_dB = strtod(entry->value, NULL);
         } else if (0 == strcasecmp(entry->key, "output_gain_in_dB")) {
-            priv->output_gain_in_dB = strtod(entry->value, NULL);
+            params->output_gain_in_dB = strtod(entry->value, NULL);
         } else if (0 == strcasecmp(entry->key, "attack_time_in_ms")) {
-            priv->attack_time_in_ms = strtod(entry->value, NULL);
+            params->attack_time_in_ms = strtod(entry->value, NULL);
         } else if (0 == strcasecmp(entry->key, "decay_time_in_ms")) {
-            priv->decay_time_in_ms = strtod(entry->value, NULL);
+            params->decay_time_in_ms = strtod(entry->value, NULL);
         } else if (0 == strcasecmp(entry->key, "Switch")) {
             if (0 == strcasecmp(entry->value, "Off")) {
-                priv->effect_on = false;
+                params->effect_on = false;
             } else if (0 == strcasecmp(entry->value, "On")) {
-                priv->effect_on = true;
+                params->effect_on = true;
             }
         }
-        sdl_mutex_unlock(priv->sdl_mutex);
+        if (param_snapshot_publish(priv->snapshot, params) < 0)
+            return AEERROR_NOMEM;
     }
 
-    LimiterSet(priv->limiter, priv->limiter_threshold_in_dB,
-            priv->attack_time_in_ms, priv->decay_time_in_ms, priv->output_gain_in_dB);
+    return 0;
+}
+
+static int limiter_reset(EffectContext *ctx) {
+    assert(NULL != ctx);
+    priv_t *priv = (priv_t *)ctx->priv;
+    if (NULL == priv) return AEERROR_NULL_POINT;
 
+    fifo_clear(priv->fifo_in);
+    fifo_clear(priv->fifo_out);
+    LimiterReset(priv->limiter);
     return 0;
 }
 
@@ -143,15 +170,18 @@ static int limiter_receive(EffectContext *ctx, void *samples,
     assert(NULL != priv->fifo_in);
     assert(NULL != priv->fifo_out);
 
-    sdl_mutex_lock(priv->sdl_mutex);
-    if (priv->effect_on) {
-        int nb_samples = fifo_read(priv->fifo_in, priv->fix_buffer, MAX_NB_SAMPLES);
+    // whole frames only
+    const int block = MAX_NB_SAMPLES / ctx->in_signal.channels *
+                      ctx->in_signal.channels;
+    const params_t *params = acquire_params(priv);
+    if (params->effect_on) {
+        int nb_samples = fifo_read(priv->fifo_in, priv->fix_buffer, block);
         while (nb_samples > 0) {
             S16ToFloat(priv->fix_buffer, priv->flp_buffer, nb_samples);
             nb_samples = LimiterProcess(priv->limiter, priv->flp_buffer, nb_samples);
             FloatToS16(priv->flp_buffer, priv->fix_buffer, nb_samples);
             fifo_write(priv->fifo_out, priv->fix_buffer, nb_samples);
-            nb_samples = fifo_read(priv->fifo_in, priv->fix_buffer, MAX_NB_SAMPLES);
+            nb_samples = fifo_read(priv->fifo_in, priv->fix_buffer, block);
         }
     } else {
         while (fifo_occupancy(priv->fifo_in) > 0) {
@@ -159,7 +189,6 @@ static int limiter_receive(EffectContext *ctx, void *samples,
             fifo_write(priv->fifo_out, priv->fix_buffer, nb_samples);
         }
     }
-    sdl_mutex_unlock(priv->sdl_mutex);
 
     if (atomic_load(&ctx->return_max_nb_samples) &&
         fifo_occupancy(priv->fifo_out) < max_nb_samples)
@@ -167,6 +196,16 @@ static int limiter_receive(EffectContext *ctx, void *samples,
     return fifo_read(priv->fifo_out, samples, max_nb_samples);
 }
 
+static int limiter_process(EffectContext *ctx, float *samples,
+                           const size_t nb_samples) {
+    assert(NULL != ctx);
+    priv_t *priv = (priv_t *)ctx->priv;
+    assert(NULL != priv);
+
+    if (!acquire_params(priv)->effect_on) return nb_samples;
+    return LimiterProcess(priv->limiter, samples, nb_samples);
+}
+
 const EffectHandler *effect_limiter_fn(void) {
     static EffectHandler handler = {.name = "limiter",
                                     .usage = "",
@@ -175,7 +214,10 @@ const EffectHandler *effect_limiter_fn(void) {
                                     .set = limiter_set,
                                     .send = limiter_send,
                                     .receive = limiter_receive,
-                                    .close = limiter_close};
+                                    .close = limiter_close,
+                                    .process = limiter_process,
+                                    .multichannel = true,
+                                    .reset = limiter_reset};
     return &handler;
 }
 
@@ -2,18 +2,20 @@
 #include <string.h>
 #include "log.h"
 #include "tools/util.h"
+#include "tools/conversion.h"
 #include "codec/ffmpeg_utils.h"
 
-#define DEFAULT_CHANNEL_NUMBER 1
-
 static void ae_free(XmEffectContext *ctx) {
     LogInfo("%s\n", __func__);
     if (NULL == ctx)
         return;
 
+    // the stages use the effects and the decoder until joined
+    effect_pipeline_freep(&ctx->pipeline);
+
     for (short i = 0; i < MAX_NB_EFFECTS; ++i) {
         if (ctx->effects[i]) {
-            free_effect(ctx->effects[i]);
+            effect_pool_release(ctx->pool, ctx->effects[i]);
             ctx->effects[i] = NULL;
         }
     }
@@ -25,161 +27,208 @@ static void ae_free(XmEffectContext *ctx) {
         }
     }
 
+    for (int i = 0; i <= MAX_NB_EFFECTS; i++) {
+        if (ctx->flp_buffer[i]) {
+            free(ctx->flp_buffer[i]);
+            ctx->flp_buffer[i] = NULL;
+        }
+    }
+
     if (ctx->audio_fifo) {
         fifo_delete(&ctx->audio_fifo);
     }
 }
 
-static void flush(XmEffectContext *ctx) {
-    LogInfo("%s start.\n", __func__);
-    if (!ctx)
-        return;
+static int write_fifo(XmEffectContext *ctx, float *samples,
+    int nb_samples, int channels) {
+    if (nb_samples <= 0) return 0;
 
-    short *buffer = ctx->buffer[EffectsPcm];
-    while (1) {
-        int receive_len = 0;
-        for (int i = 0; i < MAX_NB_EFFECTS; ++i) {
-            if (NULL == ctx->effects[i]) {
-                continue;
-            }
+    if (channels != ctx->dst_channels && channels != 1) {
+        nb_samples = FoldToMonoFloat(samples, nb_samples, channels);
+        channels = 1;
+    }
 
-            bool is_last_effect = true;
-            receive_len = receive_samples(ctx->effects[i],
-                buffer, MAX_NB_SAMPLES);
-            while (receive_len > 0) {
-                for (short j = i + 1; j < MAX_NB_EFFECTS; ++j) {
-                    if (NULL != ctx->effects[j]) {
-                        receive_len = send_samples(ctx->effects[j],
-                            buffer, receive_len);
-                        if (receive_len < 0) {
-                            LogError("%s send_samples to the next effect failed\n",__func__);
-                            goto end;
-                        }
-                        is_last_effect = false;
-                        receive_len = receive_samples(ctx->effects[i],
-                            buffer, MAX_NB_SAMPLES);
-                        break;
-                    }
-                }
-                if (is_last_effect) break;
-            }
+    short *buffer = ctx->buffer[RawPcm];
+    FloatToS16(samples, buffer, nb_samples);
+    if (channels == 1 && ctx->dst_channels == 2) {
+        MonoToStereoS16(ctx->buffer[FifoPcm], buffer, nb_samples);
+        nb_samples = nb_samples << 1;
+        buffer = ctx->buffer[FifoPcm];
+    }
+    return fifo_write(ctx->audio_fifo, buffer, nb_samples);
+}
+
+static int drain_effect(XmEffectContext *ctx, int index);
+
+/**
+ * Runs samples through the effects from first on and writes the result to
+ * audio_fifo. Effects with a process callback work on samples in place, one
+ * after another. An effect that changes the sample count goes through its
+ * send/receive fifos, and what it gives back continues from the next one.
+ * samples keep their channels until an effect that only takes mono comes
+ * up, from there on the chain runs on the folded down signal.
+ */
+static int run_effects(XmEffectContext *ctx, int first,
+    float *samples, int nb_samples, int channels) {
+    for (int i = first; i < MAX_NB_EFFECTS && nb_samples > 0; ++i) {
+        EffectContext *effect = ctx->effects[i];
+        if (NULL == effect) continue;
+
+        if (effect->in_signal.channels < channels) {
+            nb_samples = FoldToMonoFloat(samples, nb_samples, channels);
+            channels = 1;
         }
 
-        if (receive_len > 0) {
-            if (ctx->dst_channels == 2) {
-                MonoToStereoS16(ctx->buffer[FifoPcm], buffer, receive_len);
-                receive_len = receive_len << 1;
-                buffer = ctx->buffer[FifoPcm];
+        if (effect->handler.process) {
+            nb_samples = process_samples(effect, samples, nb_samples);
+            if (nb_samples < 0) {
+                LogError("%s process_samples failed\n", __func__);
+                return nb_samples;
             }
-            int ret = fifo_write(ctx->audio_fifo, buffer, receive_len);
-            if (ret < 0) goto end;
-        } else {
-            goto end;
+            continue;
+        }
+
+        FloatToS16(samples, ctx->buffer[EffectsPcm], nb_samples);
+        if (send_samples(effect, ctx->buffer[EffectsPcm], nb_samples) < 0) {
+            LogError("%s send_samples failed\n", __func__);
+            return -1;
         }
+        return drain_effect(ctx, i);
     }
-end:
-    LogInfo("%s end.\n", __func__);
-    ctx->flush = true;
-    return;
+
+    return write_fifo(ctx, samples, nb_samples, channels);
 }
 
-static int add_effects(XmEffectContext *ctx, short *buffer, int buffer_len) {
-    int ret = -1;
-    if (!ctx || !buffer || buffer_len <= 0) return -1;
+static int drain_effect(XmEffectContext *ctx, int index) {
+    short *buffer = ctx->buffer[EffectsPcm];
+    float *samples = ctx->flp_buffer[index];
+    const int channels = ctx->effects[index]->in_signal.channels;
+    int ret = 0;
+
+    while ((ret = receive_samples(ctx->effects[index],
+            buffer, MAX_NB_SAMPLES / channels * channels)) > 0) {
+        S16ToFloat(buffer, samples, ret);
+        if ((ret = run_effects(ctx, index + 1, samples, ret, channels)) < 0)
+            return ret;
+    }
+    return ret;
+}
 
-    bool find_valid_effect = false;
-    for (int i = 0; i < MAX_NB_EFFECTS; ++i) {
-        if (NULL != ctx->effects[i]) {
-            if(send_samples(ctx->effects[i], buffer, buffer_len) < 0) {
-                LogError("%s send_samples to the first effect failed\n",
-                    __func__);
-                ret = -1;
-                return ret;
-            }
-            find_valid_effect = true;
-            break;
-        }
+// what a process effect has left once the input has ended
+static int drain_process_effect(XmEffectContext *ctx, int index) {
+    EffectContext *effect = ctx->effects[index];
+    float *samples = ctx->flp_buffer[index];
+    const int channels = effect->in_signal.channels;
+    int ret = 0;
+    if (NULL == effect->handler.drain)
+        return 0;
+
+    while ((ret = drain_samples(effect, samples, MAX_NB_SAMPLES)) > 0) {
+        if ((ret = run_effects(ctx, index + 1, samples, ret, channels)) < 0)
+            return ret;
     }
-    if (!find_valid_effect) return buffer_len;
+    return ret;
+}
 
-    int receive_len = 0;
-    for (int i = 0; i < MAX_NB_EFFECTS; ++i) {
-        if (NULL == ctx->effects[i]) {
-            continue;
-        }
+static void flush(XmEffectContext *ctx) {
+    LogInfo("%s start.\n", __func__);
+    if (!ctx)
+        return;
 
-        bool is_last_effect = true;
-        receive_len = receive_samples(ctx->effects[i],
-            buffer, MAX_NB_SAMPLES);
-        while (receive_len > 0) {
-            for (short j = i + 1; j < MAX_NB_EFFECTS; ++j) {
-                if (NULL != ctx->effects[j]) {
-                    receive_len = send_samples(ctx->effects[j],
-                        buffer, receive_len);
-                    if (receive_len < 0) {
-                        LogError("%s send_samples to the next effect failed\n",
-                            __func__);
-                        ret = -1;
-                        return ret;
-                    }
-                    is_last_effect = false;
-                    receive_len = receive_samples(ctx->effects[i],
-                        buffer, MAX_NB_SAMPLES);
-                    break;
-                }
-            }
-            if (is_last_effect) break;
-        }
+    // in chain order, what an effect gives back still goes through the
+    // ones after it; the stages of a pipeline drain their effects
+    // themselves
+    for (int i = 0; i < MAX_NB_EFFECTS && !ctx->pipeline; ++i) {
+        if (NULL == ctx->effects[i])
+            continue;
+        int ret = ctx->effects[i]->handler.process
+            ? drain_process_effect(ctx, i) : drain_effect(ctx, i);
+        if (ret < 0) break;
     }
 
-    ret = receive_len;
-    return ret;
+    LogInfo("%s end.\n", __func__);
+    ctx->flush = true;
+    return;
 }
 
-static int read_pcm_frame(XmEffectContext *ctx, short *buffer) {
+static int read_pcm_frame(XmEffectContext *ctx, float *buffer) {
     if (!ctx || !buffer || !ctx->decoder) return -1;
 
     int read_len = MAX_NB_SAMPLES;
-    return IAudioDecoder_get_pcm_frame(ctx->decoder,
+    return IAudioDecoder_get_pcm_frame_flt(ctx->decoder,
         buffer, read_len, false);
 }
 
-static int add_effects_and_write_fifo(XmEffectContext *ctx) {
-    int ret = -1, read_len = 0;
-    short *buffer = ctx->buffer[RawPcm];
-    if (!ctx || !ctx->audio_fifo) return -1;
+// reads the input of the first pipeline stage
+static int read_pcm_block(void *opaque, EffectBlock *block) {
+    XmEffectContext *ctx = (XmEffectContext *)opaque;
+    int ret = read_pcm_frame(ctx, block->samples);
+    if (ret < 0) return ret;
 
-    if ((ret = read_pcm_frame(ctx, buffer)) < 0) {
+    block->nb_samples = ret;
+    block->channels = ctx->decoder->out_nb_channels;
+    return ret;
+}
+
+static int pipeline_write_fifo(XmEffectContext *ctx) {
+    EffectBlock *block = NULL;
+    int ret = effect_pipeline_acquire(ctx->pipeline, &block);
+    if (ret < 0) {
         if (ret != PCM_FILE_EOF)
-            LogError("%s read_pcm_frame failed.\n", __func__);
+            LogError("%s effect_pipeline_acquire failed.\n", __func__);
         return ret;
     }
 
-    if (ctx->decoder->out_nb_channels == 2) {
-        read_len = ret >> 1;
-        StereoToMonoS16(ctx->buffer[EffectsPcm], buffer, read_len);
-        buffer = ctx->buffer[EffectsPcm];
-    } else if(ctx->decoder->out_nb_channels == 1) {
-        read_len = ret;
+    ret = write_fifo(ctx, block->samples, block->nb_samples, block->channels);
+    effect_pipeline_release(ctx->pipeline);
+    return ret;
+}
+
+static int pipeline_init(XmEffectContext *ctx) {
+    EffectContext *effects[MAX_NB_EFFECTS];
+    int nb_effects = 0;
+    for (int i = 0; i < MAX_NB_EFFECTS; ++i) {
+        if (ctx->effects[i]) effects[nb_effects++] = ctx->effects[i];
     }
+    if (nb_effects == 0) return 0;
+
+    ctx->pipeline = effect_pipeline_create(effects, nb_effects,
+        read_pcm_block, ctx);
+    return ctx->pipeline ? 0 : -1;
+}
+
+static int add_effects_and_write_fifo(XmEffectContext *ctx) {
+    int ret = -1;
+    if (!ctx || !ctx->audio_fifo) return -1;
+    float *buffer = ctx->flp_buffer[MAX_NB_EFFECTS];
 
-    if ((ret = add_effects(ctx, buffer, read_len)) < 0) {
-        LogError("%s add_effects failed.\n", __func__);
+    if ((ret = read_pcm_frame(ctx, buffer)) < 0) {
+        if (ret != PCM_FILE_EOF)
+            LogError("%s read_pcm_frame failed.\n", __func__);
         return ret;
     }
 
-    if (ctx->dst_channels == 2) {
-        MonoToStereoS16(ctx->buffer[FifoPcm], buffer, ret);
-        read_len = ret << 1;
-        buffer = ctx->buffer[FifoPcm];
-    } else if(ctx->dst_channels == 1) {
-        read_len = ret;
+    if ((ret = run_effects(ctx, 0, buffer, ret,
+            ctx->decoder->out_nb_channels)) < 0) {
+        LogError("%s run_effects failed.\n", __func__);
+        return ret;
     }
-
-    ret = fifo_write(ctx->audio_fifo, buffer, read_len);
     return ret;
 }
 
+// the effect and the param effects_info sets, by EffectType
+static const struct {
+    const char *name;
+    const char *key;
+} chain_effects[MAX_NB_EFFECTS] = {
+    [NoiseSuppression] = {"noise_suppression", "Switch"},
+    [Beautify] = {"beautify", "mode"},
+    [Minions] = {"minions", "Switch"},
+    [VoiceMorph] = {"voice_morph", "mode"},
+    [Reverb] = {"reverb", "mode"},
+    [VolumeLimiter] = {"limiter", "Switch"},
+};
+
 static int voice_effects_init(XmEffectContext *ctx,
     char **effects_info, int dst_sample_rate, int dst_channels) {
     LogInfo("%s\n", __func__);
@@ -188,7 +237,7 @@ static int voice_effects_init(XmEffectContext *ctx,
 
     for (int i = 0; i < MAX_NB_EFFECTS; ++i) {
         if (ctx->effects[i]) {
-            free_effect(ctx->effects[i]);
+            effect_pool_release(ctx->pool, ctx->effects[i]);
             ctx->effects[i] = NULL;
         }
     }
@@ -196,60 +245,22 @@ static int voice_effects_init(XmEffectContext *ctx,
     for (int i = 0; i < MAX_NB_EFFECTS; ++i) {
         if (NULL == effects_info[i]) continue;
 
-        switch (i) {
-            case NoiseSuppression:
-                ctx->effects[NoiseSuppression] = create_effect(
-                    find_effect("noise_suppression"), dst_sample_rate,
-                    dst_channels);
-                init_effect(ctx->effects[NoiseSuppression], 0, NULL);
-                set_effect(ctx->effects[NoiseSuppression], "Switch",
-                    effects_info[i], 0);
-                break;
-            case Beautify:
-                ctx->effects[Beautify] = create_effect(
-                    find_effect("beautify"), dst_sample_rate,
-                    dst_channels);
-                init_effect(ctx->effects[Beautify], 0, NULL);
-                set_effect(ctx->effects[Beautify], "mode",
-                    effects_info[i], 0);
-                break;
-            case Reverb:
-                ctx->effects[Reverb] = create_effect(
-                    find_effect("reverb"), dst_sample_rate,
-                    dst_channels);
-                init_effect(ctx->effects[Reverb], 0, NULL);
-                set_effect(ctx->effects[Reverb], "mode",
-                    effects_info[i], 0);
-                break;
-            case VolumeLimiter:
-                ctx->effects[VolumeLimiter] = create_effect(
-                    find_effect("limiter"), dst_sample_rate,
-                    dst_channels);
-                init_effect(ctx->effects[VolumeLimiter], 0, NULL);
-                set_effect(ctx->effects[VolumeLimiter], "Switch",
-                    effects_info[i], 0);
-                break;
-            case Minions:
-                ctx->effects[Minions] = create_effect(
-                    find_effect("minions"), dst_sample_rate,
-                    dst_channels);
-                init_effect(ctx->effects[Minions], 0, NULL);
-                set_effect(ctx->effects[Minions], "Switch",
-                    effects_info[i], 0);
-                break;
-            case VoiceMorph:
-                ctx->effects[VoiceMorph] = create_effect(
-                    find_effect("voice_morph"), dst_sample_rate,
-                    dst_channels);
-                init_effect(ctx->effects[VoiceMorph], 0, NULL);
-                set_effect(ctx->effects[VoiceMorph], "mode",
-                    effects_info[i], 0);
-                break;
-            default:
-                LogWarning("%s unsupported effect %s\n", __func__,
-                    effects_info[i]);
-                break;
+        // effects that only take mono get a folded down signal,
+        // see run_effects()
+        const EffectHandler *handler = find_effect(chain_effects[i].name);
+        if (NULL == handler) {
+            LogWarning("%s unsupported effect %s\n", __func__,
+                effects_info[i]);
+            continue;
         }
+        ctx->effects[i] = effect_pool_acquire(ctx->pool,
+            chain_effects[i].name, chain_effects[i].key, effects_info[i],
+            dst_sample_rate, handler->multichannel ? dst_channels : 1);
+
+        // the effects run in index order, once folded down the rest
+        // of the chain is mono
+        if (ctx->effects[i])
+            dst_channels = ctx->effects[i]->in_signal.channels;
     }
 
     return 0;
@@ -265,7 +276,7 @@ static int init(XmEffectContext *ctx, char **effects_info)
     IAudioDecoder *decoder = ctx->decoder;
 
     if ((ret = voice_effects_init(ctx, effects_info,
-        decoder->out_sample_rate, DEFAULT_CHANNEL_NUMBER)) < 0) {
+        decoder->out_sample_rate, decoder->out_nb_channels)) < 0) {
         LogError("%s voice_effects_init failed.\n", __func__);
         goto fail;
     }
@@ -279,14 +290,28 @@ static int init(XmEffectContext *ctx, char **effects_info)
         }
     }
 
-    // Allocate buffer for audio fifo
-    ctx->audio_fifo = fifo_create((size_t)(decoder->out_bits_per_sample >> 3));
+    for (int i = 0; i <= MAX_NB_EFFECTS; i++) {
+        ctx->flp_buffer[i] = (float *)calloc(sizeof(float), MAX_NB_SAMPLES);
+        if (!ctx->flp_buffer[i]) {
+            LogError("%s calloc flp_buffer[%d] failed.\n", __func__, i);
+            ret = AEERROR_NOMEM;
+            goto fail;
+        }
+    }
+
+    // Allocate buffer for audio fifo, it holds the s16 output of the chain
+    // whatever format the decoder produces
+    ctx->audio_fifo = fifo_create(sizeof(short));
     if (!ctx->audio_fifo) {
         LogError("%s Could not allocate audio FIFO\n", __func__);
         ret = AEERROR_NOMEM;
         goto fail;
     }
 
+    if (ctx->pipelined && pipeline_init(ctx) < 0)
+        LogWarning("%s pipeline_init failed, "
+            "running the effects on the calling thread\n", __func__);
+
     ret = 0;
 fail:
     return ret;
@@ -309,7 +334,8 @@ int audio_effect_get_frame(XmEffectContext *ctx,
         return ret;
 
     while (fifo_occupancy(ctx->audio_fifo) < (size_t) buffer_size_in_short) {
-        ret = add_effects_and_write_fifo(ctx);
+        ret = ctx->pipeline ? pipeline_write_fifo(ctx)
+            : add_effects_and_write_fifo(ctx);
         if (ret < 0) {
             if (!ctx->flush) flush(ctx);
             if (0 < fifo_occupancy(ctx->audio_fifo)) {
@@ -325,6 +351,14 @@ end:
     return ret;
 }
 
+void audio_effect_set_pipeline(XmEffectContext *ctx, bool enable) {
+    LogInfo("%s enable %d\n", __func__, enable);
+    if (!ctx)
+        return;
+
+    ctx->pipelined = enable;
+}
+
 int audio_effect_init(XmEffectContext *ctx,
     IAudioDecoder *decoder, char **effects_info, int dst_channels) {
     if (!ctx || !decoder || !effects_info)
@@ -335,7 +369,7 @@ int audio_effect_init(XmEffectContext *ctx,
     return init(ctx, effects_info);
 }
 
-XmEffectContext *audio_effect_create() {
+XmEffectContext *audio_effect_create(EffectPool *pool) {
     XmEffectContext *self =
         (XmEffectContext *)calloc(1, sizeof(XmEffectContext));
     if (NULL == self) {
@@ -343,5 +377,6 @@ XmEffectContext *audio_effect_create() {
         return NULL;
     }
 
+    self->pool = pool;
     return self;
 }
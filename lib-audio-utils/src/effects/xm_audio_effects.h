@@ -8,6 +8,8 @@
 #include "effects/effect_struct.h"
 #include "codec/idecoder.h"
 #include "effects/voice_effect.h"
+#include "effects/effect_pool.h"
+#include "effects/effect_pipeline.h"
 
 enum BuffersType {
     RawPcm = 0,
@@ -30,9 +32,16 @@ typedef struct XmEffectContext {
     volatile bool flush;
     int dst_channels;
     short *buffer[NB_BUFFERS];
+    // what each fifo effect gives back, the last one for the decoded input
+    float *flp_buffer[MAX_NB_EFFECTS + 1];
     EffectContext *effects[MAX_NB_EFFECTS];
     IAudioDecoder *decoder;
     fifo *audio_fifo;
+    // where the effects come from and go back to, may be NULL
+    EffectPool *pool;
+    // run every effect on its own thread, see audio_effect_set_pipeline()
+    bool pipelined;
+    EffectPipeline *pipeline;
 } XmEffectContext;
 
 /**
@@ -54,6 +63,16 @@ void audio_effect_freep(XmEffectContext **ctx);
 int audio_effect_get_frame(XmEffectContext *ctx,
     short *buffer, int buffer_size_in_short);
 
+/**
+ * @brief run each effect on its own thread, the effects hand the samples
+ *        on through lock-free rings. Faster for chains of heavy effects,
+ *        costs one thread per effect. Call it before audio_effect_init.
+ *
+ * @param ctx XmEffectContext
+ * @param enable false(default) runs the chain in audio_effect_get_frame
+ */
+void audio_effect_set_pipeline(XmEffectContext *ctx, bool enable);
+
 /**
  * @brief init XmEffectContext
  *
@@ -69,8 +88,10 @@ int audio_effect_init(XmEffectContext *ctx,
 /**
  * @brief create XmEffectContext
  *
+ * @param pool shared by the contexts, must outlive them, NULL to create
+ *        and free the effects with the context
  * @return XmEffectContext*
  */
-XmEffectContext *audio_effect_create();
+XmEffectContext *audio_effect_create(EffectPool *pool);
 
 #endif  // XM_AUDIO_EFFECTS_H_
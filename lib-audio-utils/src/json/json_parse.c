@@ -3,11 +3,11 @@
 #include "tools/util.h"
 #include <string.h>
 #include <stdlib.h>
+#include <limits.h>
 #include "codec/ffmpeg_utils.h"
 
-static const char *web_tracks_name[MAX_NB_TRACKS] = {
-    "track0", "track1", "track2", "track3", "track4"
-};
+// web config names the tracks "track0", "track1" ... in mixing order
+#define WEB_TRACK_PREFIX "track"
 
 #define PHONE_NB_TRACKS 3
 static const char *phone_tracks_name[PHONE_NB_TRACKS] = {
@@ -256,150 +256,176 @@ end:
     return 0;
 }
 
-static int phone_json_parse(cJSON *json, MixerEffects *mixer_effects) {
-    LogInfo("%s\n", __func__);
+static int tracks_parse(MixerEffects *mixer_effects, cJSON **tracks,
+        const char **tracks_name, const bool *loops, int nb_tracks) {
     int ret = -1;
-    if (!json || !mixer_effects) {
+    if (!mixer_effects || !tracks || !tracks_name || nb_tracks <= 0) {
         return ret;
     }
 
-    cJSON *root_json = json;
-    cJSON *tracks[PHONE_NB_TRACKS];
-    cJSON *tracks_childs[PHONE_NB_TRACKS];
-    memset(tracks, 0, sizeof(tracks));
-    memset(tracks_childs, 0, sizeof(tracks_childs));
+    if ((ret = MixerEffects_init(mixer_effects, nb_tracks)) < 0) {
+        LogError("%s MixerEffects_init failed\n", __func__);
+        return ret;
+    }
 
-    for (int i = 0; i < PHONE_NB_TRACKS; i++) {
-        tracks[i] = cJSON_GetObjectItemCaseSensitive(
-                root_json, phone_tracks_name[i]);
-        if (!tracks[i]) {
+    AudioSourceQueue *queue = AudioSourceQueue_create();
+    cJSON **tracks_childs = (cJSON **)calloc(nb_tracks, sizeof(cJSON *));
+    if (!queue || !tracks_childs) {
+        LogError("%s alloc queue or tracks_childs failed\n", __func__);
+        ret = -1;
+        goto end;
+    }
+
+    for (int i = 0; i < nb_tracks; i++) {
+        cJSON *track = tracks[i];
+        if (!track) {
             continue;
         }
 
-        if (NULL != tracks[i]->valuestring) {
+        if (NULL != track->valuestring) {
             LogInfo("%s %s valuestring %s\n", __func__,
-                phone_tracks_name[i], tracks[i]->valuestring);
+                tracks_name[i], track->valuestring);
         }
 
-        if (tracks[i]->child == NULL && NULL != tracks[i]->valuestring) {
-            tracks_childs[i] = cJSON_Parse(tracks[i]->valuestring);
+        if (track->child == NULL && NULL != track->valuestring) {
+            tracks_childs[i] = cJSON_Parse(track->valuestring);
             if (tracks_childs[i] == NULL) {
                 LogError("%s cJSON_Parse %s valuestring failed, continue.\n",
-                    __func__, phone_tracks_name[i]);
+                    __func__, tracks_name[i]);
                 continue;
             }
-            tracks[i] = tracks_childs[i];
+            track = tracks_childs[i];
         }
 
-        bool loop = true;
-        if (!strcasecmp(phone_tracks_name[i], "record")) loop = false;
-        if (parse_audio_source(
-                tracks[i], mixer_effects->sourceQueue[i], loop) < 0) {
+        AudioSourceQueue_flush(queue);
+        if (parse_audio_source(track, queue, loops[i]) < 0) {
             LogError("%s parse %s source failed, continue.\n",
-                __func__, phone_tracks_name[i]);
+                __func__, tracks_name[i]);
             continue;
         }
 
-        int end_time_ms = AudioSourceQueue_get_end_time_ms(
-            mixer_effects->sourceQueue[i]);
+        int end_time_ms = AudioSourceQueue_get_end_time_ms(queue);
         if (mixer_effects->duration_ms < end_time_ms) {
             mixer_effects->duration_ms = end_time_ms;
         }
+
+        // the clips and their strings move into the track, no copy
+        if ((ret = MixerTrack_set_clips(
+                &mixer_effects->tracks[i], queue)) < 0) {
+            LogError("%s MixerTrack_set_clips %s failed\n",
+                __func__, tracks_name[i]);
+            goto end;
+        }
     }
 
-    for (int i = 0; i < PHONE_NB_TRACKS; i++) {
-        if (AudioSourceQueue_size(mixer_effects->sourceQueue[i]) > 0) {
+    ret = -1;
+    for (int i = 0; i < nb_tracks; i++) {
+        if (mixer_effects->tracks[i].nb_clips > 0) {
             ret = 0;
             break;
-        } else {
-            ret = -1;
         }
     }
 
-    for (int i = 0; i < PHONE_NB_TRACKS; i++) {
-        if (tracks_childs[i] != NULL) {
-            cJSON_Delete(tracks_childs[i]);
-        }
-    }
-    if (ret >= 0) {
-        for (int i = 0; i < MAX_NB_TRACKS; i++) {
-            AudioSourceQueue_copy(mixer_effects->sourceQueue[i],
-                mixer_effects->sourceQueueBackup[i]);
+end:
+    if (tracks_childs) {
+        for (int i = 0; i < nb_tracks; i++) {
+            if (tracks_childs[i] != NULL) {
+                cJSON_Delete(tracks_childs[i]);
+            }
         }
+        free(tracks_childs);
     }
+    AudioSourceQueue_freep(&queue);
     return ret;
 }
 
-static int web_json_parse(cJSON *json, MixerEffects *mixer_effects) {
+static int phone_json_parse(cJSON *json, MixerEffects *mixer_effects) {
     LogInfo("%s\n", __func__);
-    int ret = -1;
     if (!json || !mixer_effects) {
-        return ret;
+        return -1;
     }
 
-    cJSON *root_json = json;
-    cJSON *tracks[MAX_NB_TRACKS];
-    cJSON *tracks_childs[MAX_NB_TRACKS];
-    memset(tracks, 0, sizeof(tracks));
-    memset(tracks_childs, 0, sizeof(tracks_childs));
-
-    for (int i = 0; i < MAX_NB_TRACKS; i++) {
+    cJSON *tracks[PHONE_NB_TRACKS];
+    bool loops[PHONE_NB_TRACKS];
+    for (int i = 0; i < PHONE_NB_TRACKS; i++) {
         tracks[i] = cJSON_GetObjectItemCaseSensitive(
-                root_json, web_tracks_name[i]);
-        if (!tracks[i]) {
-            continue;
-        }
-
-        if (NULL != tracks[i]->valuestring) {
-            LogInfo("%s %s valuestring %s\n", __func__,
-                web_tracks_name[i], tracks[i]->valuestring);
-        }
+                json, phone_tracks_name[i]);
+        loops[i] = strcasecmp(phone_tracks_name[i], "record") != 0;
+    }
 
-        if (tracks[i]->child == NULL && NULL != tracks[i]->valuestring) {
-            tracks_childs[i] = cJSON_Parse(tracks[i]->valuestring);
-            if (tracks_childs[i] == NULL) {
-                LogError("%s cJSON_Parse %s valuestring failed, continue.\n",
-                    __func__, web_tracks_name[i]);
-                continue;
-            }
-            tracks[i] = tracks_childs[i];
-        }
+    return tracks_parse(mixer_effects, tracks,
+        phone_tracks_name, loops, PHONE_NB_TRACKS);
+}
 
-        if (parse_audio_source(
-                tracks[i], mixer_effects->sourceQueue[i], false) < 0) {
-            LogError("%s parse %s source failed, continue.\n",
-                __func__, web_tracks_name[i]);
-            continue;
-        }
+// "track<N>", returns N or -1
+static int web_track_index(const char *name) {
+    if (!name || strncmp(name, WEB_TRACK_PREFIX, strlen(WEB_TRACK_PREFIX)))
+        return -1;
 
-        int end_time_ms = AudioSourceQueue_get_end_time_ms(
-            mixer_effects->sourceQueue[i]);
-        if (mixer_effects->duration_ms < end_time_ms) {
-            mixer_effects->duration_ms = end_time_ms;
-        }
+    const char *p = name + strlen(WEB_TRACK_PREFIX);
+    if (*p == '\0')
+        return -1;
+    int index = 0;
+    for (; *p; p++) {
+        if (*p < '0' || *p > '9' || index > (INT_MAX - 9) / 10)
+            return -1;
+        index = index * 10 + (*p - '0');
     }
+    return index;
+}
 
-    for (int i = 0; i < MAX_NB_TRACKS; i++) {
-        if (AudioSourceQueue_size(mixer_effects->sourceQueue[i]) > 0) {
-            ret = 0;
-            break;
-        } else {
-            ret = -1;
-        }
+typedef struct WebTrack {
+    int index;
+    cJSON *json;
+} WebTrack;
+
+static int cmp_web_track(const void *a, const void *b) {
+    return ((const WebTrack *)a)->index - ((const WebTrack *)b)->index;
+}
+
+static int web_json_parse(cJSON *json, int nb_tracks,
+        MixerEffects *mixer_effects) {
+    LogInfo("%s nb_tracks %d\n", __func__, nb_tracks);
+    int ret = -1;
+    if (!json || !mixer_effects || nb_tracks <= 0) {
+        return ret;
     }
 
-    for (int i = 0; i < MAX_NB_TRACKS; i++) {
-        if (tracks_childs[i] != NULL) {
-            cJSON_Delete(tracks_childs[i]);
-        }
+    WebTrack *web_tracks = (WebTrack *)calloc(nb_tracks, sizeof(WebTrack));
+    cJSON **tracks = (cJSON **)calloc(nb_tracks, sizeof(cJSON *));
+    const char **tracks_name =
+        (const char **)calloc(nb_tracks, sizeof(char *));
+    bool *loops = (bool *)calloc(nb_tracks, sizeof(bool));
+    if (!web_tracks || !tracks || !tracks_name || !loops) {
+        LogError("%s calloc tracks failed\n", __func__);
+        goto end;
     }
 
-    if (ret >= 0) {
-        for (int i = 0; i < MAX_NB_TRACKS; i++) {
-            AudioSourceQueue_copy(mixer_effects->sourceQueue[i],
-                mixer_effects->sourceQueueBackup[i]);
+    // the order of the tracks is the mixing order
+    int n = 0;
+    cJSON *item = NULL;
+    cJSON_ArrayForEach(item, json)
+    {
+        int index = web_track_index(item->string);
+        if (index >= 0 && n < nb_tracks) {
+            web_tracks[n].index = index;
+            web_tracks[n].json = item;
+            n++;
         }
     }
+    qsort(web_tracks, n, sizeof(WebTrack), cmp_web_track);
+    for (int i = 0; i < n; i++) {
+        tracks[i] = web_tracks[i].json;
+        tracks_name[i] = web_tracks[i].json->string;
+        loops[i] = false;
+    }
+
+    ret = tracks_parse(mixer_effects, tracks, tracks_name, loops, n);
+end:
+    if (web_tracks) free(web_tracks);
+    if (tracks) free(tracks);
+    if (tracks_name) free(tracks_name);
+    if (loops) free(loops);
     return ret;
 }
 
@@ -411,8 +437,6 @@ int json_parse(MixerEffects *mixer_effects, const char *json_file_addr) {
 
     char *content = NULL;
     cJSON *root_json = NULL;
-    cJSON *tracks[MAX_NB_TRACKS];
-    memset(tracks, 0, sizeof(tracks));
 
     content = ae_read_file_to_string(json_file_addr);
     if (NULL == content) {
@@ -429,20 +453,17 @@ int json_parse(MixerEffects *mixer_effects, const char *json_file_addr) {
         goto end;
     }
 
-    bool is_web_json = false;
-    for (int i = 0; i < MAX_NB_TRACKS; i++) {
-        tracks[i] = cJSON_GetObjectItemCaseSensitive(
-            root_json, web_tracks_name[i]);
-        if (!tracks[i]) {
-            continue;
-        } else {
-            is_web_json = true;
-            break;
+    int nb_web_tracks = 0;
+    cJSON *item = NULL;
+    cJSON_ArrayForEach(item, root_json)
+    {
+        if (web_track_index(item->string) >= 0) {
+            nb_web_tracks++;
         }
     }
 
-    if (is_web_json) {
-        ret = web_json_parse(root_json, mixer_effects);
+    if (nb_web_tracks > 0) {
+        ret = web_json_parse(root_json, nb_web_tracks, mixer_effects);
     } else {
         ret = phone_json_parse(root_json, mixer_effects);
     }
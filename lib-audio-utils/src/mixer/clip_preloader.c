@@ -0,0 +1,220 @@
+#include "clip_preloader.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "error_def.h"
+#include "log.h"
+#include "tools/sdl_mutex.h"
+
+enum SlotState {
+    SLOT_EMPTY,
+    SLOT_REQUESTED,
+    SLOT_LOADING,
+    SLOT_READY
+};
+
+typedef struct ClipSlot {
+    enum SlotState state;
+    int clip_index;
+    // last clip the track asked for, earlier requests come too late
+    int taken;
+    AudioSource source;
+} ClipSlot;
+
+struct ClipPreloader {
+    bool abort;
+    int nb_tracks;
+    ClipSlot *slots;
+    SdlMutex *mutex;
+    pthread_t tid;
+    bool started;
+    ClipOpenFunc open;
+    void *opaque;
+};
+
+static ClipSlot *find_requested_l(ClipPreloader *loader) {
+    for (int i = 0; i < loader->nb_tracks; i++) {
+        if (loader->slots[i].state == SLOT_REQUESTED)
+            return &loader->slots[i];
+    }
+    return NULL;
+}
+
+static void *clip_preloader_thread(void *arg) {
+    ClipPreloader *loader = (ClipPreloader *)arg;
+
+    sdl_mutex_lock(loader->mutex);
+    while (!loader->abort) {
+        ClipSlot *slot = find_requested_l(loader);
+        if (!slot) {
+            sdl_mutex_wait(loader->mutex);
+            continue;
+        }
+
+        slot->state = SLOT_LOADING;
+        AudioSource source = slot->source;
+        sdl_mutex_unlock(loader->mutex);
+
+        int ret = loader->open(loader->opaque, &source);
+
+        sdl_mutex_lock(loader->mutex);
+        if (ret < 0) {
+            AudioSource_release(&source);
+            slot->state = SLOT_EMPTY;
+        } else {
+            slot->source = source;
+            slot->state = SLOT_READY;
+        }
+        sdl_mutex_broadcast(loader->mutex);
+    }
+    sdl_mutex_unlock(loader->mutex);
+
+    return NULL;
+}
+
+void clip_preloader_request(ClipPreloader *loader, int track_index,
+        int clip_index, const AudioSource *clip) {
+    if (!loader || !clip || track_index < 0
+            || track_index >= loader->nb_tracks)
+        return;
+
+    AudioSource stale;
+    bool has_stale = false;
+    ClipSlot *slot = &loader->slots[track_index];
+
+    sdl_mutex_lock(loader->mutex);
+    if (clip_index <= slot->taken
+            || (slot->clip_index == clip_index && slot->state != SLOT_EMPTY)) {
+        sdl_mutex_unlock(loader->mutex);
+        return;
+    }
+    if (slot->state == SLOT_LOADING) {
+        // let the other clip finish, it is dropped by the next request
+        sdl_mutex_unlock(loader->mutex);
+        return;
+    }
+    if (slot->state == SLOT_READY) {
+        stale = slot->source;
+        has_stale = true;
+    }
+    slot->source = *clip;
+    slot->source.decoder = NULL;
+    slot->source.effects_ctx = NULL;
+    slot->clip_index = clip_index;
+    slot->state = SLOT_REQUESTED;
+    sdl_mutex_broadcast(loader->mutex);
+    sdl_mutex_unlock(loader->mutex);
+
+    if (has_stale)
+        AudioSource_release(&stale);
+}
+
+int clip_preloader_take(ClipPreloader *loader, int track_index,
+        int clip_index, AudioSource *source) {
+    if (!loader || !source || track_index < 0
+            || track_index >= loader->nb_tracks)
+        return -1;
+
+    int ret = -1;
+    ClipSlot *slot = &loader->slots[track_index];
+
+    sdl_mutex_lock(loader->mutex);
+    if (slot->taken < clip_index) slot->taken = clip_index;
+    if (slot->clip_index == clip_index) {
+        // opening is already half way, waiting is cheaper than a second open
+        while (slot->state == SLOT_LOADING && !loader->abort)
+            sdl_mutex_wait(loader->mutex);
+        if (slot->state == SLOT_READY) {
+            *source = slot->source;
+            ret = 0;
+        }
+        if (slot->state != SLOT_LOADING) {
+            memset(&slot->source, 0, sizeof(AudioSource));
+            slot->state = SLOT_EMPTY;
+        }
+    }
+    sdl_mutex_unlock(loader->mutex);
+
+    return ret;
+}
+
+void clip_preloader_flush(ClipPreloader *loader) {
+    if (!loader)
+        return;
+
+    sdl_mutex_lock(loader->mutex);
+    for (int i = 0; i < loader->nb_tracks; i++) {
+        ClipSlot *slot = &loader->slots[i];
+        while (slot->state == SLOT_LOADING)
+            sdl_mutex_wait(loader->mutex);
+        if (slot->state == SLOT_READY)
+            AudioSource_release(&slot->source);
+        memset(&slot->source, 0, sizeof(AudioSource));
+        slot->state = SLOT_EMPTY;
+        slot->taken = -1;
+    }
+    sdl_mutex_unlock(loader->mutex);
+}
+
+void clip_preloader_freep(ClipPreloader **loader) {
+    if (!loader || !*loader)
+        return;
+    ClipPreloader *self = *loader;
+
+    if (self->started) {
+        sdl_mutex_lock(self->mutex);
+        self->abort = true;
+        sdl_mutex_broadcast(self->mutex);
+        sdl_mutex_unlock(self->mutex);
+        pthread_join(self->tid, NULL);
+    }
+    if (self->slots) {
+        for (int i = 0; i < self->nb_tracks; i++) {
+            if (self->slots[i].state == SLOT_READY)
+                AudioSource_release(&self->slots[i].source);
+        }
+        free(self->slots);
+    }
+    sdl_mutex_free(&self->mutex);
+    free(self);
+    *loader = NULL;
+}
+
+ClipPreloader *clip_preloader_create(int nb_tracks,
+        ClipOpenFunc open, void *opaque) {
+    LogInfo("%s nb_tracks %d.\n", __func__, nb_tracks);
+    if (nb_tracks <= 0 || !open)
+        return NULL;
+
+    ClipPreloader *loader = (ClipPreloader *)calloc(1, sizeof(ClipPreloader));
+    if (!loader) {
+        LogError("%s calloc ClipPreloader failed.\n", __func__);
+        return NULL;
+    }
+
+    loader->nb_tracks = nb_tracks;
+    loader->open = open;
+    loader->opaque = opaque;
+    loader->mutex = sdl_mutex_create();
+    loader->slots = (ClipSlot *)calloc(nb_tracks, sizeof(ClipSlot));
+    if (!loader->mutex || !loader->slots) {
+        LogError("%s alloc preloader members failed.\n", __func__);
+        goto fail;
+    }
+    for (int i = 0; i < nb_tracks; i++) {
+        loader->slots[i].clip_index = -1;
+        loader->slots[i].taken = -1;
+    }
+
+    if (pthread_create(&loader->tid, NULL,
+            clip_preloader_thread, loader) != 0) {
+        LogError("%s pthread_create failed.\n", __func__);
+        goto fail;
+    }
+    loader->started = true;
+
+    return loader;
+fail:
+    clip_preloader_freep(&loader);
+    return NULL;
+}
@@ -0,0 +1,47 @@
+#ifndef _CLIP_PRELOADER_H_
+#define _CLIP_PRELOADER_H_
+#include "source/audio_source.h"
+
+/**
+ * Opens the next clip of each track on a background thread, so the mixer
+ * only swaps the prepared AudioSource in at the clip boundary. Every track
+ * has one slot, requested by the mixing thread and taken by the thread
+ * that produces the track.
+ */
+
+/**
+ * Open the decoder and effects of source. Called on the preload thread.
+ */
+typedef int (*ClipOpenFunc)(void *opaque, AudioSource *source);
+
+typedef struct ClipPreloader ClipPreloader;
+
+/**
+ * @brief ask for clip clip_index of a track to be opened in the background,
+ *        ignored if the slot of the track is busy with the same clip or
+ *        the track has already taken clip_index or a later clip
+ *
+ * @param clip shallow copied, its strings must outlive the preloader
+ */
+void clip_preloader_request(ClipPreloader *loader, int track_index,
+    int clip_index, const AudioSource *clip);
+
+/**
+ * @brief move the prepared clip into source
+ *
+ * @return 0 if clip_index was ready, less than 0 if the caller has to open
+ *         the clip itself
+ */
+int clip_preloader_take(ClipPreloader *loader, int track_index,
+    int clip_index, AudioSource *source);
+
+/**
+ * @brief wait for the clip being opened and release all prepared clips
+ */
+void clip_preloader_flush(ClipPreloader *loader);
+
+void clip_preloader_freep(ClipPreloader **loader);
+ClipPreloader *clip_preloader_create(int nb_tracks,
+    ClipOpenFunc open, void *opaque);
+
+#endif
@@ -0,0 +1,171 @@
+#include "mix_bus.h"
+#include <math.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define MIX_BUS_AVX2
+#endif
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define MIX_BUS_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define MIX_BUS_NEON
+#endif
+
+#define S16_MAX 32767.0f
+#define S16_MIN (-32768.0f)
+
+static inline short float_to_s16(float v) {
+    if (v >= S16_MAX) return 32767;
+    if (v <= S16_MIN) return -32768;
+    return (short)lrintf(v);
+}
+
+void mix_bus_accumulate_s16(float *dst, const short *src, int nb_samples) {
+    if (!dst || !src || nb_samples <= 0)
+        return;
+    int i = 0;
+
+#if defined(MIX_BUS_AVX2)
+    for (; i + 16 <= nb_samples; i += 16) {
+        __m256i s = _mm256_loadu_si256((const __m256i *)(src + i));
+        __m256 lo = _mm256_cvtepi32_ps(
+            _mm256_cvtepi16_epi32(_mm256_castsi256_si128(s)));
+        __m256 hi = _mm256_cvtepi32_ps(
+            _mm256_cvtepi16_epi32(_mm256_extracti128_si256(s, 1)));
+        _mm256_storeu_ps(dst + i,
+            _mm256_add_ps(_mm256_loadu_ps(dst + i), lo));
+        _mm256_storeu_ps(dst + i + 8,
+            _mm256_add_ps(_mm256_loadu_ps(dst + i + 8), hi));
+    }
+#endif
+#if defined(MIX_BUS_SSE2)
+    for (; i + 8 <= nb_samples; i += 8) {
+        __m128i s = _mm_loadu_si128((const __m128i *)(src + i));
+        // sign extend by placing each short in the upper half of an int32
+        __m128 lo = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16));
+        __m128 hi = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16));
+        _mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(dst + i), lo));
+        _mm_storeu_ps(dst + i + 4, _mm_add_ps(_mm_loadu_ps(dst + i + 4), hi));
+    }
+#elif defined(MIX_BUS_NEON)
+    for (; i + 8 <= nb_samples; i += 8) {
+        int16x8_t s = vld1q_s16(src + i);
+        float32x4_t lo = vcvtq_f32_s32(vmovl_s16(vget_low_s16(s)));
+        float32x4_t hi = vcvtq_f32_s32(vmovl_s16(vget_high_s16(s)));
+        vst1q_f32(dst + i, vaddq_f32(vld1q_f32(dst + i), lo));
+        vst1q_f32(dst + i + 4, vaddq_f32(vld1q_f32(dst + i + 4), hi));
+    }
+#endif
+    for (; i < nb_samples; i++) {
+        dst[i] += src[i];
+    }
+}
+
+float mix_bus_peak(const float *src, int nb_samples) {
+    if (!src || nb_samples <= 0)
+        return 0.0f;
+    float peak = 0.0f;
+    int i = 0;
+
+#if defined(MIX_BUS_SSE2)
+    const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+    __m128 vmax = _mm_setzero_ps();
+    for (; i + 4 <= nb_samples; i += 4) {
+        vmax = _mm_max_ps(vmax, _mm_and_ps(_mm_loadu_ps(src + i), abs_mask));
+    }
+    float lanes[4];
+    _mm_storeu_ps(lanes, vmax);
+    for (int k = 0; k < 4; k++) {
+        if (lanes[k] > peak) peak = lanes[k];
+    }
+#elif defined(MIX_BUS_NEON)
+    float32x4_t vmax = vdupq_n_f32(0.0f);
+    for (; i + 4 <= nb_samples; i += 4) {
+        vmax = vmaxq_f32(vmax, vabsq_f32(vld1q_f32(src + i)));
+    }
+    float32x2_t m = vpmax_f32(vget_low_f32(vmax), vget_high_f32(vmax));
+    m = vpmax_f32(m, m);
+    peak = vget_lane_f32(m, 0);
+#endif
+    for (; i < nb_samples; i++) {
+        float v = fabsf(src[i]);
+        if (v > peak) peak = v;
+    }
+    return peak;
+}
+
+static void mix_bus_to_s16_const(const float *src, short *dst,
+        int nb_samples, float gain) {
+    int i = 0;
+
+#if defined(MIX_BUS_SSE2)
+    const __m128 g = _mm_set1_ps(gain);
+    const __m128 vmax = _mm_set1_ps(S16_MAX);
+    const __m128 vmin = _mm_set1_ps(S16_MIN);
+    for (; i + 8 <= nb_samples; i += 8) {
+        __m128 a = _mm_mul_ps(_mm_loadu_ps(src + i), g);
+        __m128 b = _mm_mul_ps(_mm_loadu_ps(src + i + 4), g);
+        a = _mm_max_ps(_mm_min_ps(a, vmax), vmin);
+        b = _mm_max_ps(_mm_min_ps(b, vmax), vmin);
+        __m128i s = _mm_packs_epi32(_mm_cvtps_epi32(a), _mm_cvtps_epi32(b));
+        _mm_storeu_si128((__m128i *)(dst + i), s);
+    }
+#elif defined(MIX_BUS_NEON)
+    const float32x4_t vmax = vdupq_n_f32(S16_MAX);
+    const float32x4_t vmin = vdupq_n_f32(S16_MIN);
+    for (; i + 8 <= nb_samples; i += 8) {
+        float32x4_t a = vmulq_n_f32(vld1q_f32(src + i), gain);
+        float32x4_t b = vmulq_n_f32(vld1q_f32(src + i + 4), gain);
+        a = vmaxq_f32(vminq_f32(a, vmax), vmin);
+        b = vmaxq_f32(vminq_f32(b, vmax), vmin);
+#if defined(__aarch64__)
+        int32x4_t ia = vcvtnq_s32_f32(a);
+        int32x4_t ib = vcvtnq_s32_f32(b);
+#else
+        int32x4_t ia = vcvtq_s32_f32(a);
+        int32x4_t ib = vcvtq_s32_f32(b);
+#endif
+        vst1q_s16(dst + i, vcombine_s16(vqmovn_s32(ia), vqmovn_s32(ib)));
+    }
+#endif
+    for (; i < nb_samples; i++) {
+        dst[i] = float_to_s16(src[i] * gain);
+    }
+}
+
+void mix_bus_to_s16(const float *src, short *dst, int nb_samples,
+        int nb_channels, float gain_start, float gain_end) {
+    if (!src || !dst || nb_samples <= 0 || nb_channels <= 0)
+        return;
+
+    if (gain_start == gain_end) {
+        mix_bus_to_s16_const(src, dst, nb_samples, gain_start);
+        return;
+    }
+
+    int nb_frames = nb_samples / nb_channels;
+    float gain = gain_start;
+    float step = nb_frames > 0 ? (gain_end - gain_start) / nb_frames : 0.0f;
+    for (int i = 0; i < nb_frames; i++) {
+        for (int c = 0; c < nb_channels; c++) {
+            dst[i * nb_channels + c] =
+                float_to_s16(src[i * nb_channels + c] * gain);
+        }
+        gain += step;
+    }
+    for (int i = nb_frames * nb_channels; i < nb_samples; i++) {
+        dst[i] = float_to_s16(src[i] * gain_end);
+    }
+}
+
+float mix_bus_update_factor(float factor, float peak) {
+    if (factor < 1.0f) {
+        factor += (1.0f - factor) / 32.0f;
+    }
+    if (peak * factor > S16_MAX) {
+        factor = S16_MAX / peak;
+    }
+    return factor;
+}
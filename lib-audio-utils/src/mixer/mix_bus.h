@@ -0,0 +1,32 @@
+#ifndef _MIX_BUS_H_
+#define _MIX_BUS_H_
+
+/**
+ * Float mix bus. Samples stay in S16 scale ([-32768, 32767]) so tracks can
+ * be accumulated without any intermediate saturation.
+ */
+
+/**
+ * @brief dst[i] += src[i] for nb_samples interleaved samples
+ */
+void mix_bus_accumulate_s16(float *dst, const short *src, int nb_samples);
+
+/**
+ * @brief Get the max absolute sample value of the bus
+ */
+float mix_bus_peak(const float *src, int nb_samples);
+
+/**
+ * @brief Convert the bus to S16 with saturation, applying a gain ramped
+ *        linearly from gain_start to gain_end every nb_channels samples
+ */
+void mix_bus_to_s16(const float *src, short *dst, int nb_samples,
+        int nb_channels, float gain_start, float gain_end);
+
+/**
+ * @brief Update the bus gain factor so that peak * factor fits S16,
+ *        recovering slowly towards 1.0 like UpdateFactorS16
+ */
+float mix_bus_update_factor(float factor, float peak);
+
+#endif
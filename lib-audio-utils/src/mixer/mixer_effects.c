@@ -0,0 +1,113 @@
+#include "mixer_effects.h"
+#include <stdlib.h>
+#include <string.h>
+#include "error_def.h"
+#include "log.h"
+
+static void MixerTrack_free(MixerTrack *track) {
+    if (NULL == track)
+        return;
+
+    if (track->source) {
+        AudioSource_release(track->source);
+        free(track->source);
+        track->source = NULL;
+    }
+    if (track->clips) {
+        for (int i = 0; i < track->nb_clips; i++) {
+            AudioSource_free(&track->clips[i]);
+        }
+        free(track->clips);
+        track->clips = NULL;
+    }
+    if (track->clips_end_ms) {
+        free(track->clips_end_ms);
+        track->clips_end_ms = NULL;
+    }
+    track->nb_clips = 0;
+    track->next_clip = 0;
+}
+
+int MixerTrack_set_clips(MixerTrack *track, AudioSourceQueue *queue) {
+    if (NULL == track || NULL == queue)
+        return -1;
+
+    int size = AudioSourceQueue_size(queue);
+    if (size <= 0)
+        return 0;
+
+    track->clips = (AudioSource *)calloc(size, sizeof(AudioSource));
+    track->clips_end_ms = (int *)calloc(size, sizeof(int));
+    if (!track->clips || !track->clips_end_ms) {
+        LogError("%s alloc clips failed.\n", __func__);
+        return AEERROR_NOMEM;
+    }
+
+    int n = 0;
+    while (n < size && AudioSourceQueue_get(queue, &track->clips[n]) > 0) {
+        int end_ms = track->clips[n].end_time_ms;
+        if (n > 0 && track->clips_end_ms[n - 1] > end_ms)
+            end_ms = track->clips_end_ms[n - 1];
+        track->clips_end_ms[n] = end_ms;
+        n++;
+    }
+    track->nb_clips = n;
+    track->next_clip = 0;
+    return 0;
+}
+
+int MixerTrack_find_clip(MixerTrack *track, int time_ms) {
+    if (NULL == track)
+        return 0;
+
+    int lo = 0, hi = track->nb_clips;
+    while (lo < hi) {
+        int mid = (lo + hi) >> 1;
+        if (track->clips_end_ms[mid] <= time_ms) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+void MixerEffects_free(MixerEffects *mixer) {
+    LogInfo("%s\n", __func__);
+    if (NULL == mixer)
+        return;
+
+    if (mixer->tracks) {
+        for (int i = 0; i < mixer->nb_tracks; i++) {
+            MixerTrack_free(&mixer->tracks[i]);
+        }
+        free(mixer->tracks);
+    }
+    memset(mixer, 0, sizeof(MixerEffects));
+}
+
+int MixerEffects_init(MixerEffects *mixer, int nb_tracks) {
+    LogInfo("%s nb_tracks %d\n", __func__, nb_tracks);
+    int ret = -1;
+    if (NULL == mixer || nb_tracks <= 0)
+        return ret;
+
+    MixerEffects_free(mixer);
+
+    mixer->nb_tracks = nb_tracks;
+    mixer->tracks = (MixerTrack *)calloc(nb_tracks, sizeof(MixerTrack));
+    if (!mixer->tracks) {
+        LogError("%s alloc tracks failed.\n", __func__);
+        goto fail;
+    }
+
+    for (int i = 0; i < nb_tracks; i++) {
+        mixer->tracks[i].source = (AudioSource *)calloc(1, sizeof(AudioSource));
+        if (NULL == mixer->tracks[i].source) {
+            LogError("%s alloc AudioSource failed.\n", __func__);
+            goto fail;
+        }
+    }
+
+    return 0;
+fail:
+    MixerEffects_free(mixer);
+    return ret;
+}
@@ -4,14 +4,39 @@
 
 // Limit the maximum duration of a mix
 //#define MAX_DURATION_MIX_IN_MS (50*60*1000)
-#define MAX_NB_TRACKS 5
+
+typedef struct MixerTrack {
+    // clips sorted by start time, immutable after json_parse
+    AudioSource *clips;
+    // max end time of clips[0..i], non-decreasing for binary search
+    int *clips_end_ms;
+    int nb_clips;
+    // index of the next clip to open
+    int next_clip;
+    // playing clip, a shallow copy of one of the clips
+    AudioSource *source;
+} MixerTrack;
 
 typedef struct MixerEffects {
     int duration_ms;
     int nb_tracks;
-    AudioSource *source[MAX_NB_TRACKS];
-    AudioSourceQueue *sourceQueue[MAX_NB_TRACKS];
-    AudioSourceQueue *sourceQueueBackup[MAX_NB_TRACKS];
+    MixerTrack *tracks;
 } MixerEffects;
 
+/**
+ * @brief move the sorted clips of queue into the track
+ */
+int MixerTrack_set_clips(MixerTrack *track, AudioSourceQueue *queue);
+
+/**
+ * @brief index of the first clip ending after time_ms, nb_clips if none
+ */
+int MixerTrack_find_clip(MixerTrack *track, int time_ms);
+
+/**
+ * @brief allocate nb_tracks empty tracks, freeing the previous ones
+ */
+int MixerEffects_init(MixerEffects *mixer, int nb_tracks);
+void MixerEffects_free(MixerEffects *mixer);
+
 #endif
@@ -0,0 +1,268 @@
+#include "mixer_schedule.h"
+#include <stdlib.h>
+#include <string.h>
+#include "error_def.h"
+#include "log.h"
+
+struct MixerSchedule {
+    int nb_tracks;
+    // grouped by track and sorted by start time after build
+    TrackInterval *intervals;
+    int nb_intervals;
+    int capacity;
+    // intervals of track i are [track_offset[i], track_offset[i + 1])
+    int *track_offset;
+    // interval indexes sorted by start time
+    int *by_start;
+    bool built;
+};
+
+static int cmp_track_start(const void *a, const void *b) {
+    const TrackInterval *x = (const TrackInterval *)a;
+    const TrackInterval *y = (const TrackInterval *)b;
+    if (x->track != y->track)
+        return x->track - y->track;
+    return x->start_ms - y->start_ms;
+}
+
+// the start order keeps the interval index in end_ms
+static int cmp_start(const void *a, const void *b) {
+    const TrackInterval *x = (const TrackInterval *)a;
+    const TrackInterval *y = (const TrackInterval *)b;
+    if (x->start_ms != y->start_ms)
+        return x->start_ms - y->start_ms;
+    return x->track - y->track;
+}
+
+int mixer_schedule_add(MixerSchedule *sched,
+        int track, int start_ms, int end_ms) {
+    if (!sched || sched->built || track < 0 || track >= sched->nb_tracks)
+        return -1;
+    if (end_ms <= start_ms)
+        return 0;
+
+    if (sched->nb_intervals == sched->capacity) {
+        int capacity = sched->capacity > 0 ? sched->capacity << 1 : 16;
+        TrackInterval *intervals = (TrackInterval *)realloc(
+            sched->intervals, capacity * sizeof(TrackInterval));
+        if (!intervals)
+            return AEERROR_NOMEM;
+        sched->intervals = intervals;
+        sched->capacity = capacity;
+    }
+
+    TrackInterval *interval = &sched->intervals[sched->nb_intervals++];
+    interval->track = track;
+    interval->start_ms = start_ms;
+    interval->end_ms = end_ms;
+    return 0;
+}
+
+int mixer_schedule_build(MixerSchedule *sched, int block_duration_ms) {
+    if (!sched || sched->built)
+        return -1;
+
+    qsort(sched->intervals, sched->nb_intervals,
+        sizeof(TrackInterval), cmp_track_start);
+
+    // extend each clip by one block, and merge the clips of a track that
+    // are less than one block apart so a track has one active interval
+    int n = 0;
+    for (int i = 0; i < sched->nb_intervals; i++) {
+        TrackInterval cur = sched->intervals[i];
+        cur.end_ms += block_duration_ms;
+        if (n > 0 && sched->intervals[n - 1].track == cur.track
+                && cur.start_ms < sched->intervals[n - 1].end_ms
+                + block_duration_ms) {
+            if (cur.end_ms > sched->intervals[n - 1].end_ms)
+                sched->intervals[n - 1].end_ms = cur.end_ms;
+        } else {
+            sched->intervals[n++] = cur;
+        }
+    }
+    sched->nb_intervals = n;
+
+    for (int i = 0, j = 0; i <= sched->nb_tracks; i++) {
+        while (j < n && sched->intervals[j].track < i) j++;
+        sched->track_offset[i] = j;
+    }
+
+    sched->by_start = (int *)calloc(n > 0 ? n : 1, sizeof(int));
+    TrackInterval *order =
+        (TrackInterval *)calloc(n > 0 ? n : 1, sizeof(TrackInterval));
+    if (!sched->by_start || !order) {
+        if (order) free(order);
+        return AEERROR_NOMEM;
+    }
+    for (int i = 0; i < n; i++) {
+        order[i] = sched->intervals[i];
+        order[i].end_ms = i;
+    }
+    qsort(order, n, sizeof(TrackInterval), cmp_start);
+    for (int i = 0; i < n; i++) {
+        sched->by_start[i] = order[i].end_ms;
+    }
+    free(order);
+
+    sched->built = true;
+    return 0;
+}
+
+enum TrackState mixer_schedule_track_state(MixerSchedule *sched,
+        int track, int t, int d) {
+    if (!sched || !sched->built || track < 0 || track >= sched->nb_tracks)
+        return TRACK_FINISHED;
+
+    const TrackInterval *iv = sched->intervals;
+    int lo = sched->track_offset[track];
+    int hi = sched->track_offset[track + 1];
+    int end = hi;
+    // find the last interval starting before t + d
+    while (lo < hi) {
+        int mid = (lo + hi) >> 1;
+        if (iv[mid].start_ms < t + d) lo = mid + 1;
+        else hi = mid;
+    }
+
+    int idx = lo - 1;
+    if (idx >= sched->track_offset[track] && iv[idx].end_ms > t)
+        return TRACK_ACTIVE;
+    return lo < end ? TRACK_IDLE : TRACK_FINISHED;
+}
+
+int mixer_schedule_next_start_ms(MixerSchedule *sched,
+        ScheduleCursor *cursor) {
+    if (!sched || !cursor || cursor->next >= sched->nb_intervals)
+        return -1;
+    return sched->intervals[sched->by_start[cursor->next]].start_ms;
+}
+
+int mixer_schedule_advance(MixerSchedule *sched,
+        ScheduleCursor *cursor, int t, int d) {
+    if (!sched || !cursor || !sched->built)
+        return 0;
+    const TrackInterval *iv = sched->intervals;
+
+    int n = 0;
+    for (int i = 0; i < cursor->nb_active; i++) {
+        if (iv[cursor->active[i]].end_ms > t)
+            cursor->active[n++] = cursor->active[i];
+    }
+    cursor->nb_active = n;
+
+    while (cursor->next < sched->nb_intervals
+            && iv[sched->by_start[cursor->next]].start_ms < t + d) {
+        int index = sched->by_start[cursor->next++];
+        if (iv[index].end_ms <= t)
+            continue;
+
+        int pos = cursor->nb_active;
+        while (pos > 0
+                && iv[cursor->active[pos - 1]].track > iv[index].track) {
+            cursor->active[pos] = cursor->active[pos - 1];
+            pos--;
+        }
+        cursor->active[pos] = index;
+        cursor->nb_active++;
+    }
+    return cursor->nb_active;
+}
+
+int mixer_schedule_active_track(MixerSchedule *sched,
+        ScheduleCursor *cursor, int i) {
+    if (!sched || !cursor || i < 0 || i >= cursor->nb_active)
+        return -1;
+    return sched->intervals[cursor->active[i]].track;
+}
+
+void mixer_schedule_cursor_reset(ScheduleCursor *cursor) {
+    if (!cursor)
+        return;
+    cursor->next = 0;
+    cursor->nb_active = 0;
+}
+
+void mixer_schedule_cursor_seek(MixerSchedule *sched,
+        ScheduleCursor *cursor, int t) {
+    mixer_schedule_cursor_reset(cursor);
+    if (!sched || !cursor || !cursor->active || !sched->built)
+        return;
+    const TrackInterval *iv = sched->intervals;
+
+    // the intervals starting before t are behind the cursor
+    int lo = 0, hi = sched->nb_intervals;
+    while (lo < hi) {
+        int mid = (lo + hi) >> 1;
+        if (iv[sched->by_start[mid]].start_ms < t) lo = mid + 1;
+        else hi = mid;
+    }
+    cursor->next = lo;
+
+    // of those, a track has at most one still running at t
+    for (int track = 0; track < sched->nb_tracks; track++) {
+        int first = sched->track_offset[track];
+        lo = first;
+        hi = sched->track_offset[track + 1];
+        while (lo < hi) {
+            int mid = (lo + hi) >> 1;
+            if (iv[mid].start_ms < t) lo = mid + 1;
+            else hi = mid;
+        }
+        if (lo > first && iv[lo - 1].end_ms > t)
+            cursor->active[cursor->nb_active++] = lo - 1;
+    }
+}
+
+void mixer_schedule_cursor_free(ScheduleCursor *cursor) {
+    if (!cursor)
+        return;
+    if (cursor->active) {
+        free(cursor->active);
+        cursor->active = NULL;
+    }
+    mixer_schedule_cursor_reset(cursor);
+}
+
+int mixer_schedule_cursor_init(MixerSchedule *sched, ScheduleCursor *cursor) {
+    if (!sched || !cursor)
+        return -1;
+
+    mixer_schedule_cursor_free(cursor);
+    cursor->active = (int *)calloc(
+        sched->nb_tracks > 0 ? sched->nb_tracks : 1, sizeof(int));
+    if (!cursor->active)
+        return AEERROR_NOMEM;
+    return 0;
+}
+
+void mixer_schedule_freep(MixerSchedule **sched) {
+    if (!sched || !*sched)
+        return;
+    MixerSchedule *self = *sched;
+
+    if (self->intervals) free(self->intervals);
+    if (self->track_offset) free(self->track_offset);
+    if (self->by_start) free(self->by_start);
+    free(self);
+    *sched = NULL;
+}
+
+MixerSchedule *mixer_schedule_create(int nb_tracks) {
+    if (nb_tracks <= 0)
+        return NULL;
+
+    MixerSchedule *self = (MixerSchedule *)calloc(1, sizeof(MixerSchedule));
+    if (!self) {
+        LogError("%s calloc MixerSchedule failed.\n", __func__);
+        return NULL;
+    }
+
+    self->nb_tracks = nb_tracks;
+    self->track_offset = (int *)calloc(nb_tracks + 1, sizeof(int));
+    if (!self->track_offset) {
+        LogError("%s calloc track_offset failed.\n", __func__);
+        mixer_schedule_freep(&self);
+        return NULL;
+    }
+    return self;
+}
@@ -0,0 +1,92 @@
+#ifndef _MIXER_SCHEDULE_H_
+#define _MIXER_SCHEDULE_H_
+#include <stdbool.h>
+
+/**
+ * Timeline index of the tracks. The clips of a track are merged into
+ * intervals, extended by one block so the block right after a clip still
+ * reaches the track and releases its source. A track is active for the
+ * block [t, t + d) when one of its intervals satisfies start < t + d and
+ * end > t. The index is built once and never modified, every thread keeps
+ * its own ScheduleCursor.
+ */
+
+typedef struct TrackInterval {
+    int track;
+    int start_ms;
+    int end_ms;
+} TrackInterval;
+
+typedef struct MixerSchedule MixerSchedule;
+
+typedef struct ScheduleCursor {
+    // next interval in start order that is not active yet
+    int next;
+    // active intervals, sorted by track
+    int nb_active;
+    int *active;
+} ScheduleCursor;
+
+enum TrackState {
+    TRACK_FINISHED = -1,
+    TRACK_IDLE,
+    TRACK_ACTIVE
+};
+
+/**
+ * @brief add a clip window of a track, only before mixer_schedule_build
+ */
+int mixer_schedule_add(MixerSchedule *sched,
+    int track, int start_ms, int end_ms);
+
+/**
+ * @brief sort and merge the clip windows
+ *
+ * @param block_duration_ms nominal duration of a mixing block
+ */
+int mixer_schedule_build(MixerSchedule *sched, int block_duration_ms);
+
+/**
+ * @brief state of one track for the block [t, t + d), lock free
+ */
+enum TrackState mixer_schedule_track_state(MixerSchedule *sched,
+    int track, int t, int d);
+
+/**
+ * @brief start time of the first interval beginning at or after t,
+ *        -1 if there is none
+ */
+int mixer_schedule_next_start_ms(MixerSchedule *sched,
+    ScheduleCursor *cursor);
+
+/**
+ * @brief update the active intervals for the block [t, t + d),
+ *        t must not decrease between two calls without a reset
+ *
+ * @return number of active tracks
+ */
+int mixer_schedule_advance(MixerSchedule *sched,
+    ScheduleCursor *cursor, int t, int d);
+
+/**
+ * @brief track of the i-th active interval
+ */
+int mixer_schedule_active_track(MixerSchedule *sched,
+    ScheduleCursor *cursor, int i);
+
+void mixer_schedule_cursor_reset(ScheduleCursor *cursor);
+
+/**
+ * @brief place the cursor at t, so the next advance starts from t without
+ *        scanning the intervals before it
+ */
+void mixer_schedule_cursor_seek(MixerSchedule *sched,
+    ScheduleCursor *cursor, int t);
+
+void mixer_schedule_cursor_free(ScheduleCursor *cursor);
+int mixer_schedule_cursor_init(MixerSchedule *sched, ScheduleCursor *cursor);
+
+void mixer_schedule_freep(MixerSchedule **sched);
+MixerSchedule *mixer_schedule_create(int nb_tracks);
+
+#endif
@@ -0,0 +1,477 @@
+#if defined(__ANDROID__) || defined (__linux__)
+#include "segment_render.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "xm_audio_mixer.h"
+#include "codec/ffmpeg_utils.h"
+#include "codec/audio_encoder.h"
+#include "codec/muxer_config.h"
+#include "error_def.h"
+#include "log.h"
+
+// samples per AAC frame
+#define AAC_FRAME_SIZE 1024
+// frames a segment is rendered past its end, the last kept packets
+// have to see the same input as in a sequential render
+#define TAIL_NB_FRAMES 4
+#define MAX_NB_SEGMENTS 64
+#define DEFAULT_OVERLAP_MS 3000
+// same bit rates as AudioMuxer
+#define MONO_BIT_RATE 64000
+#define STEREO_BIT_RATE 128000
+
+typedef struct Segment {
+    pthread_t tid;
+    bool started;
+    struct SegmentRender *sr;
+    XmMixerContext *mixer;
+    // samples rendered, the tail is cut by the next segment
+    int64_t render_start;
+    int64_t render_end;
+    // samples kept in the output, end less than 0 means the end of the mix
+    int64_t start;
+    int64_t end;
+    char *file_path;
+    int ret;
+} Segment;
+
+struct SegmentRender {
+    volatile bool abort;
+    int nb_segments;
+    int overlap_ms;
+    int encoder_type;
+    int sample_rate;
+    int channels;
+    int duration_ms;
+    char *in_config_path;
+    Segment *segments;
+    int nb_running;
+    pthread_mutex_t mutex;
+};
+
+static int64_t gcd64(int64_t a, int64_t b) {
+    while (b) {
+        int64_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+static int64_t align_up(int64_t value, int64_t unit) {
+    return (value + unit - 1) / unit * unit;
+}
+
+static bool is_aborted(SegmentRender *sr) {
+    return __atomic_load_n(&sr->abort, __ATOMIC_ACQUIRE);
+}
+
+static void segments_free(SegmentRender *sr) {
+    if (!sr->segments)
+        return;
+
+    for (int i = 0; i < sr->nb_running; i++) {
+        Segment *seg = &sr->segments[i];
+        if (seg->file_path) {
+            remove(seg->file_path);
+            free(seg->file_path);
+        }
+        xm_audio_mixer_freep(&seg->mixer);
+    }
+    free(sr->segments);
+    sr->segments = NULL;
+    sr->nb_running = 0;
+}
+
+static int probe_project(SegmentRender *sr) {
+    int ret = -1;
+    XmMixerContext *mixer = xm_audio_mixer_create();
+    if (!mixer) {
+        LogError("%s xm_audio_mixer_create failed.\n", __func__);
+        return AEERROR_NOMEM;
+    }
+
+    if ((ret = xm_audio_mixer_init(mixer, sr->in_config_path)) < 0) {
+        LogError("%s xm_audio_mixer_init failed.\n", __func__);
+        goto end;
+    }
+    xm_audio_mixer_get_output_info(mixer,
+        &sr->duration_ms, &sr->sample_rate, &sr->channels);
+    ret = sr->duration_ms > 0 ? 0 : -1;
+
+end:
+    xm_audio_mixer_freep(&mixer);
+    return ret;
+}
+
+// Split the mix into segments whose boundaries are whole AAC frames and
+// whole milliseconds, so the mixer can seek to them exactly
+static int plan_segments(SegmentRender *sr, const char *out_file_path) {
+    int64_t rate = sr->sample_rate;
+    int64_t ms_unit = rate / gcd64(rate, 1000);
+    int64_t unit = ms_unit / gcd64(ms_unit, AAC_FRAME_SIZE) * AAC_FRAME_SIZE;
+    int64_t total = (int64_t)sr->duration_ms * rate / 1000;
+    int64_t tail = align_up(TAIL_NB_FRAMES * AAC_FRAME_SIZE, unit);
+    int64_t overlap = align_up((int64_t)sr->overlap_ms * rate / 1000, unit);
+    if (overlap < tail) overlap = tail;
+
+    int64_t bounds[MAX_NB_SEGMENTS + 1];
+    int nb = 0;
+    bounds[nb++] = 0;
+    for (int k = 1; k < sr->nb_segments; k++) {
+        int64_t b = total * k / sr->nb_segments / unit * unit;
+        if (b > bounds[nb - 1] && b + tail < total)
+            bounds[nb++] = b;
+    }
+
+    sr->segments = (Segment *)calloc(nb, sizeof(Segment));
+    if (!sr->segments) {
+        LogError("%s calloc segments failed.\n", __func__);
+        return AEERROR_NOMEM;
+    }
+
+    size_t path_len = strlen(out_file_path) + 32;
+    for (int k = 0; k < nb; k++) {
+        Segment *seg = &sr->segments[k];
+        seg->sr = sr;
+        seg->start = bounds[k];
+        seg->end = k + 1 < nb ? bounds[k + 1] : -1;
+        seg->render_start = seg->start > overlap ? seg->start - overlap : 0;
+        seg->render_end = seg->end >= 0 ? seg->end + tail : -1;
+        seg->file_path = (char *)calloc(1, path_len);
+        if (!seg->file_path) {
+            sr->nb_running = k + 1;
+            return AEERROR_NOMEM;
+        }
+        snprintf(seg->file_path, path_len, "%s.seg%d.m4a", out_file_path, k);
+        LogInfo("%s segment %d keeps [%lld, %lld) renders [%lld, %lld).\n",
+            __func__, k, (long long)seg->start, (long long)seg->end,
+            (long long)seg->render_start, (long long)seg->render_end);
+    }
+    sr->nb_running = nb;
+    return nb;
+}
+
+static void *segment_thread(void *arg) {
+    Segment *seg = (Segment *)arg;
+    SegmentRender *sr = seg->sr;
+    int64_t rate = sr->sample_rate;
+    XmMixerContext *mixer = NULL;
+
+    seg->ret = -1;
+    if (!(mixer = xm_audio_mixer_create())) {
+        seg->ret = AEERROR_NOMEM;
+        return NULL;
+    }
+    pthread_mutex_lock(&sr->mutex);
+    seg->mixer = mixer;
+    if (sr->abort) xm_audio_mixer_stop(mixer);
+    pthread_mutex_unlock(&sr->mutex);
+
+    if ((seg->ret = xm_audio_mixer_init(mixer, sr->in_config_path)) < 0) {
+        LogError("%s xm_audio_mixer_init failed.\n", __func__);
+        return NULL;
+    }
+    if (is_aborted(sr)) {
+        seg->ret = 0;
+        return NULL;
+    }
+
+    int start_ms = seg->render_start * 1000 / rate;
+    int end_ms = seg->render_end >= 0 ? seg->render_end * 1000 / rate : -1;
+    seg->ret = xm_audio_mixer_mix_range(mixer, seg->file_path,
+        sr->encoder_type, start_ms, end_ms);
+    if (seg->ret < 0)
+        LogError("%s segment [%d, %d) failed.\n", __func__, start_ms, end_ms);
+    return NULL;
+}
+
+static int open_segment_input(AVFormatContext **ifmt, const char *path) {
+    int ret = -1;
+    AVDictionary *opts = NULL;
+    // keep the priming packets, packets are matched by their index
+    av_dict_set(&opts, "ignore_editlist", "1", 0);
+    ret = avformat_open_input(ifmt, path, NULL, &opts);
+    av_dict_free(&opts);
+    if (ret < 0) {
+        LogError("%s avformat_open_input %s failed.\n", __func__, path);
+        return ret;
+    }
+
+    if ((ret = avformat_find_stream_info(*ifmt, NULL)) < 0) {
+        LogError("%s avformat_find_stream_info failed.\n", __func__);
+        return ret;
+    }
+    return FindFirstStream(*ifmt, AVMEDIA_TYPE_AUDIO);
+}
+
+static int open_stitch_output(SegmentRender *sr, const char *path,
+        AVFormatContext **ofmt, AVCodecContext **enc) {
+    int ret = -1;
+    if ((ret = avformat_alloc_output_context2(ofmt, NULL,
+            MUXER_AUDIO_MP4, path)) < 0) {
+        LogError("%s avformat_alloc_output_context2 %s failed.\n",
+            __func__, path);
+        return ret;
+    }
+
+    // an encoder opened like AudioMuxer does gives the same stream header
+    int bit_rate = sr->channels >= 2 ? STEREO_BIT_RATE : MONO_BIT_RATE;
+    if ((ret = FindAndOpenAudioEncoder(enc, AV_CODEC_ID_AAC, bit_rate,
+            sr->channels, sr->sample_rate)) < 0) {
+        LogError("%s FindAndOpenAudioEncoder failed.\n", __func__);
+        return ret;
+    }
+    if ((ret = AddAudioStream(*ofmt, *enc)) < 0) {
+        LogError("%s AddAudioStream failed.\n", __func__);
+        return ret;
+    }
+    av_opt_set(*ofmt, "movflags", "faststart", AV_OPT_SEARCH_CHILDREN);
+
+    if (!((*ofmt)->oformat->flags & AVFMT_NOFILE)) {
+        if ((ret = avio_open(&(*ofmt)->pb, path, AVIO_FLAG_WRITE)) < 0) {
+            LogError("%s avio_open %s failed.\n", __func__, path);
+            return ret;
+        }
+    }
+
+    if ((ret = avformat_write_header(*ofmt, NULL)) < 0) {
+        LogError("%s avformat_write_header failed.\n", __func__);
+    }
+    return ret;
+}
+
+// Copy the packets of seg that belong to [start, end) into the output,
+// with the timestamps the sequential encoder would have given them
+static int stitch_segment(SegmentRender *sr, Segment *seg,
+        AVFormatContext *ofmt, AVCodecContext *enc) {
+    int ret = -1;
+    AVFormatContext *ifmt = NULL;
+    AVPacket pkt;
+    InitPacket(&pkt);
+
+    int stream_index = open_segment_input(&ifmt, seg->file_path);
+    if (stream_index < 0) {
+        ret = stream_index;
+        goto end;
+    }
+
+    AVRational in_tb = ifmt->streams[stream_index]->time_base;
+    AVStream *out_stream = ofmt->streams[0];
+    int64_t first = seg->start / AAC_FRAME_SIZE;
+    int64_t last = seg->end >= 0 ? seg->end / AAC_FRAME_SIZE : INT64_MAX;
+    int64_t n = seg->render_start / AAC_FRAME_SIZE;
+
+    ret = 0;
+    while (n < last && !is_aborted(sr)) {
+        if ((ret = av_read_frame(ifmt, &pkt)) < 0) {
+            ret = ret == AVERROR_EOF ? 0 : ret;
+            break;
+        }
+        if (pkt.stream_index != stream_index) {
+            av_packet_unref(&pkt);
+            continue;
+        }
+
+        if (n >= first) {
+            int64_t duration = av_rescale_q(pkt.duration,
+                in_tb, enc->time_base);
+            pkt.stream_index = out_stream->index;
+            pkt.pts = pkt.dts = n * AAC_FRAME_SIZE - enc->initial_padding;
+            pkt.duration = duration > 0 ? duration : AAC_FRAME_SIZE;
+            av_packet_rescale_ts(&pkt, enc->time_base, out_stream->time_base);
+            pkt.pos = -1;
+            if ((ret = av_interleaved_write_frame(ofmt, &pkt)) < 0) {
+                LogError("%s av_interleaved_write_frame failed.\n", __func__);
+                break;
+            }
+        }
+        av_packet_unref(&pkt);
+        n++;
+    }
+
+    if (ret >= 0 && seg->end >= 0 && n < last && !is_aborted(sr)) {
+        LogError("%s %s ends at packet %lld before %lld.\n", __func__,
+            seg->file_path, (long long)n, (long long)last);
+        ret = -1;
+    }
+
+end:
+    av_packet_unref(&pkt);
+    if (ifmt) avformat_close_input(&ifmt);
+    return ret;
+}
+
+static int stitch_segments(SegmentRender *sr, const char *out_file_path) {
+    int ret = -1;
+    AVFormatContext *ofmt = NULL;
+    AVCodecContext *enc = NULL;
+
+    if ((ret = open_stitch_output(sr, out_file_path, &ofmt, &enc)) < 0)
+        goto end;
+
+    for (int k = 0; k < sr->nb_running && !is_aborted(sr); k++) {
+        if ((ret = stitch_segment(sr, &sr->segments[k], ofmt, enc)) < 0) {
+            LogError("%s stitch segment %d failed.\n", __func__, k);
+            goto end;
+        }
+    }
+
+    if ((ret = av_write_trailer(ofmt)) < 0) {
+        LogError("%s av_write_trailer failed.\n", __func__);
+    }
+
+end:
+    if (enc) avcodec_free_context(&enc);
+    if (ofmt) {
+        if (!(ofmt->oformat->flags & AVFMT_NOFILE))
+            avio_closep(&ofmt->pb);
+        avformat_free_context(ofmt);
+    }
+    return ret;
+}
+
+int segment_render_run(SegmentRender *sr, const char *in_config_path,
+        const char *out_file_path, int encoder_type) {
+    LogInfo("%s nb_segments %d, overlap_ms %d.\n", __func__,
+        sr ? sr->nb_segments : 0, sr ? sr->overlap_ms : 0);
+    int ret = -1;
+    if (!sr || !in_config_path || !out_file_path)
+        return ret;
+
+    // the packets of other encoders can not be matched by index
+    if (encoder_type != ENCODER_FFMPEG) {
+        LogError("%s encoder_type %d is not supported.\n",
+            __func__, encoder_type);
+        return -1;
+    }
+
+    // stopped before the run started, abort stays set for good
+    if (is_aborted(sr))
+        return 0;
+
+    pthread_mutex_lock(&sr->mutex);
+    segments_free(sr);
+    sr->encoder_type = encoder_type;
+    if (sr->in_config_path) free(sr->in_config_path);
+    sr->in_config_path = strdup(in_config_path);
+    pthread_mutex_unlock(&sr->mutex);
+    if (!sr->in_config_path)
+        return AEERROR_NOMEM;
+
+    if ((ret = probe_project(sr)) < 0) {
+        LogError("%s probe_project failed.\n", __func__);
+        return ret;
+    }
+
+    pthread_mutex_lock(&sr->mutex);
+    ret = plan_segments(sr, out_file_path);
+    pthread_mutex_unlock(&sr->mutex);
+    if (ret < 0)
+        goto end;
+
+    for (int k = 0; k < sr->nb_running; k++) {
+        Segment *seg = &sr->segments[k];
+        if (pthread_create(&seg->tid, NULL, segment_thread, seg) != 0) {
+            LogError("%s pthread_create failed.\n", __func__);
+            segment_render_stop(sr);
+            ret = -1;
+            break;
+        }
+        seg->started = true;
+    }
+
+    for (int k = 0; k < sr->nb_running; k++) {
+        Segment *seg = &sr->segments[k];
+        if (!seg->started)
+            continue;
+        pthread_join(seg->tid, NULL);
+        seg->started = false;
+        if (seg->ret < 0 && ret >= 0)
+            ret = seg->ret;
+    }
+    if (ret < 0 || is_aborted(sr))
+        goto end;
+
+    if ((ret = stitch_segments(sr, out_file_path)) < 0) {
+        LogError("%s stitch_segments failed.\n", __func__);
+    }
+
+end:
+    pthread_mutex_lock(&sr->mutex);
+    for (int k = 0; k < sr->nb_running; k++) {
+        Segment *seg = &sr->segments[k];
+        if (seg->file_path) remove(seg->file_path);
+    }
+    pthread_mutex_unlock(&sr->mutex);
+    return ret < 0 ? ret : 0;
+}
+
+int segment_render_get_progress(SegmentRender *sr) {
+    if (!sr)
+        return 0;
+
+    int64_t done = 0, total = 0;
+    pthread_mutex_lock(&sr->mutex);
+    for (int k = 0; k < sr->nb_running; k++) {
+        Segment *seg = &sr->segments[k];
+        int64_t end = seg->render_end >= 0 ? seg->render_end
+            : (int64_t)sr->duration_ms * sr->sample_rate / 1000;
+        int64_t len = end - seg->render_start;
+        total += len;
+        if (seg->mixer)
+            done += len * xm_audio_mixer_get_progress(seg->mixer) / 100;
+    }
+    pthread_mutex_unlock(&sr->mutex);
+
+    return total > 0 ? done * 100 / total : 0;
+}
+
+void segment_render_stop(SegmentRender *sr) {
+    LogInfo("%s\n", __func__);
+    if (!sr)
+        return;
+
+    pthread_mutex_lock(&sr->mutex);
+    __atomic_store_n(&sr->abort, true, __ATOMIC_RELEASE);
+    for (int k = 0; k < sr->nb_running; k++) {
+        xm_audio_mixer_stop(sr->segments[k].mixer);
+    }
+    pthread_mutex_unlock(&sr->mutex);
+}
+
+bool segment_render_is_stopped(SegmentRender *sr) {
+    return sr ? is_aborted(sr) : false;
+}
+
+void segment_render_freep(SegmentRender **sr) {
+    if (!sr || !*sr)
+        return;
+    SegmentRender *self = *sr;
+
+    segments_free(self);
+    if (self->in_config_path) free(self->in_config_path);
+    pthread_mutex_destroy(&self->mutex);
+    free(self);
+    *sr = NULL;
+}
+
+SegmentRender *segment_render_create(int nb_segments, int overlap_ms) {
+    LogInfo("%s nb_segments %d, overlap_ms %d.\n", __func__,
+        nb_segments, overlap_ms);
+    SegmentRender *self = (SegmentRender *)calloc(1, sizeof(SegmentRender));
+    if (!self) {
+        LogError("%s calloc SegmentRender failed.\n", __func__);
+        return NULL;
+    }
+
+    if (nb_segments < 1) nb_segments = 1;
+    if (nb_segments > MAX_NB_SEGMENTS) nb_segments = MAX_NB_SEGMENTS;
+    self->nb_segments = nb_segments;
+    self->overlap_ms = overlap_ms > 0 ? overlap_ms : DEFAULT_OVERLAP_MS;
+    pthread_mutex_init(&self->mutex, NULL);
+    return self;
+}
+#endif
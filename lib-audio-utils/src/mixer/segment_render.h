@@ -0,0 +1,55 @@
+#if defined(__ANDROID__) || defined (__linux__)
+
+#ifndef _SEGMENT_RENDER_H_
+#define _SEGMENT_RENDER_H_
+#include <stdbool.h>
+
+/**
+ * Renders one mixer project as several segments in parallel. Every segment
+ * is mixed and AAC encoded on its own thread, starting overlap_ms before
+ * the segment so the effects and the encoder are warmed up, and running a
+ * few frames past its end. The segment boundaries fall on AAC frames, so
+ * the packets of the segments are stitched into one mp4 with the same
+ * timestamps as a sequential render.
+ */
+
+typedef struct SegmentRender SegmentRender;
+
+/**
+ * @brief render in_config_path into out_file_path
+ *
+ * @param encoder_type only the ffmpeg encoder, other encoders are rejected
+ * @return Less than 0 means failure
+ */
+int segment_render_run(SegmentRender *sr, const char *in_config_path,
+    const char *out_file_path, int encoder_type);
+
+/**
+ * @brief progress of the whole render in percent
+ */
+int segment_render_get_progress(SegmentRender *sr);
+
+/**
+ * @brief stop all segments, segment_render_run returns without output,
+ *        also if it is called after the stop
+ */
+void segment_render_stop(SegmentRender *sr);
+
+/**
+ * @brief true if the last run was stopped
+ */
+bool segment_render_is_stopped(SegmentRender *sr);
+
+void segment_render_freep(SegmentRender **sr);
+
+/**
+ * @brief create SegmentRender
+ *
+ * @param nb_segments number of segments rendered in parallel
+ * @param overlap_ms warm up time before each segment,
+ *        less than or equal to 0 uses the default
+ */
+SegmentRender *segment_render_create(int nb_segments, int overlap_ms);
+
+#endif
+#endif
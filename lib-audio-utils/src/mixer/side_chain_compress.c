@@ -1,49 +1,112 @@
 #include "side_chain_compress.h"
 #include <math.h>
+#include <pthread.h>
+#include "effects/math/fast_math_ops.h"
 
-void side_chain_compress(short *voice, short *bgm, float *bgm_yl_prev,
+#define LOG_TABLE_PRECISION 10
+#define MIN_LEVEL_DB (-120.0f)
+
+static float log_table[1 << LOG_TABLE_PRECISION];
+static pthread_once_t log_table_once = PTHREAD_ONCE_INIT;
+
+static void log_table_init(void) {
+    FillLog2Table(log_table, LOG_TABLE_PRECISION);
+}
+
+static inline float db_to_gain(float db) {
+    // 10 ^ (db / 20)
+    return expf(db * 0.115129255f);
+}
+
+static void update_ballistics(SideChain *sc, int sample_rate,
+        float attack_ms, float release_ms) {
+    if (sc->sample_rate == sample_rate && sc->attack_ms == attack_ms
+            && sc->release_ms == release_ms)
+        return;
+
+    sc->sample_rate = sample_rate;
+    sc->attack_ms = attack_ms;
+    sc->release_ms = release_ms;
+    sc->alpha_attack = expf(-SIDE_CHAIN_CONTROL_FRAMES
+        / (0.001f * sample_rate * attack_ms));
+    sc->alpha_release = expf(-SIDE_CHAIN_CONTROL_FRAMES
+        / (0.001f * sample_rate * release_ms));
+}
+
+static inline int peak_s16(const short *src, int len) {
+    int peak = 0;
+    for (int i = 0; i < len; i++) {
+        int v = src[i] < 0 ? -src[i] : src[i];
+        peak = v > peak ? v : peak;
+    }
+    return peak;
+}
+
+static inline void apply_ramp(short *dst, int nb_frames, int nb_channels,
+        float gain, float step) {
+    for (int i = 0; i < nb_frames; i++) {
+        gain += step;
+        for (int c = 0; c < nb_channels; c++) {
+            float v = dst[c] * gain;
+            v = v > 32767.0f ? 32767.0f : (v < -32768.0f ? -32768.0f : v);
+            dst[c] = (short)v;
+        }
+        dst += nb_channels;
+    }
+}
+
+void side_chain_reset(SideChain *sc, float makeup_gain) {
+    if (!sc)
+        return;
+
+    sc->yl_prev = MAKEUP_GAIN_MAX_DB * makeup_gain;
+    sc->gain_prev = 1.0f;
+}
+
+void side_chain_compress(SideChain *sc, const short *key, short *bgm,
         int buffer_size, int sample_rate, int nb_channels, float threshold,
         float ratio, float attack_ms, float release_ms, float makeup_gain) {
-    if (!voice || !bgm) {
+    if (!sc || !key || !bgm || nb_channels <= 0) {
         return;
     }
-    //used in control voltage calculation
-    float xg, xl, yg, yl;
-    //Previous sample used for gain smoothing
-    float yl_prev = *bgm_yl_prev;
-    //Output control voltage used for compression
-    float gain = 1.0f;
-    // Compression : calculates the control voltage
-    float alphaAttack = exp(-1 / (0.001 * sample_rate * attack_ms));
-    float alphaRelease = exp(-1 / (0.001 * sample_rate * release_ms));
-
-    for (int i = 0; i < buffer_size;)
-    {
-	float voice_flp = voice[i] / (float)32767;
-	// Level detection- estimate level using peak detector
-	if (fabs(voice_flp) < 0.000001) xg = -120;
-	else xg = 20 * log10(fabs(voice_flp));
-
-	// Gain computer- static apply input/output curve
-	if (xg >= threshold) yg = threshold + (xg - threshold) / ratio;
-	else yg = xg;
-
-	xl = xg - yg;
-	// Ballistics- smoothing of the gain
-	if (xl > yl_prev) yl = alphaAttack * yl_prev + (1 - alphaAttack) * xl;
-	else yl = alphaRelease * yl_prev + (1 - alphaRelease) * xl;
-	// find control
-	gain = pow(10, ((MAKEUP_GAIN_MAX_DB * makeup_gain  - yl) / 20));
-	yl_prev = yl;
-	if (nb_channels == 2) {
-	    bgm[i] = bgm[i] * gain;
-	    if (i + 1 < buffer_size) bgm[i + 1] =bgm[i + 1] * gain;
-	    i += 2;
-	} else {
-	    bgm[i] =bgm[i] * gain;
-	    ++ i;
-	}
+    pthread_once(&log_table_once, log_table_init);
+    update_ballistics(sc, sample_rate, attack_ms, release_ms);
+
+    float makeup_db = MAKEUP_GAIN_MAX_DB * makeup_gain;
+    float yl_prev = sc->yl_prev;
+    float gain_prev = sc->gain_prev;
+    int nb_frames = buffer_size / nb_channels;
+
+    for (int i = 0; i < nb_frames; i += SIDE_CHAIN_CONTROL_FRAMES) {
+        int len = nb_frames - i < SIDE_CHAIN_CONTROL_FRAMES ?
+            nb_frames - i : SIDE_CHAIN_CONTROL_FRAMES;
+        const short *k = key + i * nb_channels;
+        short *b = bgm + i * nb_channels;
+
+        // Level detection- peak of the key over the control period
+        int peak = peak_s16(k, len * nb_channels);
+        float xg = MIN_LEVEL_DB;
+        if (peak > 0)
+            xg = 20.0f * Log10(peak / 32767.0f, log_table,
+                LOG_TABLE_PRECISION);
+
+        // Gain computer- static apply input/output curve
+        float yg = xg >= threshold ? threshold + (xg - threshold) / ratio : xg;
+        float xl = xg - yg;
+
+        // Ballistics- smoothing of the gain reduction
+        float alpha = xl > yl_prev ? sc->alpha_attack : sc->alpha_release;
+        if (len != SIDE_CHAIN_CONTROL_FRAMES)
+            alpha = powf(alpha, len / (float)SIDE_CHAIN_CONTROL_FRAMES);
+        float yl = alpha * yl_prev + (1.0f - alpha) * xl;
+        float gain = db_to_gain(makeup_db - yl);
+
+        // ramp to the new gain over the period
+        apply_ramp(b, len, nb_channels, gain_prev, (gain - gain_prev) / len);
+        yl_prev = yl;
+        gain_prev = gain;
     }
-    *bgm_yl_prev = yl_prev;
-}
 
+    sc->yl_prev = yl_prev;
+    sc->gain_prev = gain_prev;
+}
@@ -6,8 +6,31 @@
 #define SIDE_CHAIN_ATTACK_MS 100
 #define SIDE_CHAIN_RELEASE_MS 300
 #define MAKEUP_GAIN_MAX_DB 5
+// frames between two gain computations
+#define SIDE_CHAIN_CONTROL_FRAMES 32
 
-void side_chain_compress(short *voice, short *bgm, float *bgm_yl_prev,
+typedef struct SideChain {
+    // smoothed gain reduction in dB
+    float yl_prev;
+    // gain reached at the end of the last control period
+    float gain_prev;
+    // ballistics of one control period, cached for these parameters
+    int sample_rate;
+    float attack_ms;
+    float release_ms;
+    float alpha_attack;
+    float alpha_release;
+} SideChain;
+
+/**
+ * @brief reset the state when a new source starts on the track
+ */
+void side_chain_reset(SideChain *sc, float makeup_gain);
+
+/**
+ * @brief duck bgm by the level of key, both interleaved with nb_channels
+ */
+void side_chain_compress(SideChain *sc, const short *key, short *bgm,
         int buffer_size, int sample_rate, int nb_channels, float threshold,
         float ratio, float attack_ms, float release_ms, float makeup_gain);
 #endif
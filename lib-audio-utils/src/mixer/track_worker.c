@@ -0,0 +1,239 @@
+#include "track_worker.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include "error_def.h"
+#include "log.h"
+#include "codec/idecoder.h"
+#include "tools/sdl_mutex.h"
+#include "tools/spsc_ring.h"
+
+#define WAIT_TIMEOUT_MS 20
+
+typedef struct TrackWorker {
+    pthread_t tid;
+    bool started;
+    int index;
+    struct TrackWorkerPool *pool;
+} TrackWorker;
+
+struct TrackWorkerPool {
+    volatile bool abort;
+    int nb_threads;
+    int nb_tracks;
+    TrackWorker *workers;
+    SpscRing **rings;
+    // producer side positions, touched only by the owning worker
+    int64_t *cur_size;
+    volatile bool *eof;
+    volatile int nb_waiting;
+    SdlMutex *mutex;
+    TrackProduceFunc produce;
+    void *opaque;
+};
+
+static inline bool pool_aborted(TrackWorkerPool *pool) {
+    return __atomic_load_n(&pool->abort, __ATOMIC_ACQUIRE);
+}
+
+static void pool_notify(TrackWorkerPool *pool) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&pool->nb_waiting, __ATOMIC_SEQ_CST) > 0) {
+        sdl_mutex_lock(pool->mutex);
+        sdl_mutex_broadcast(pool->mutex);
+        sdl_mutex_unlock(pool->mutex);
+    }
+}
+
+static bool worker_can_produce(TrackWorker *worker) {
+    TrackWorkerPool *pool = worker->pool;
+    for (int i = worker->index; i < pool->nb_tracks; i += pool->nb_threads) {
+        if (!__atomic_load_n(&pool->eof[i], __ATOMIC_ACQUIRE)
+                && spsc_ring_write_slot(pool->rings[i]))
+            return true;
+    }
+    return false;
+}
+
+static bool worker_finished(TrackWorker *worker) {
+    TrackWorkerPool *pool = worker->pool;
+    for (int i = worker->index; i < pool->nb_tracks; i += pool->nb_threads) {
+        if (!__atomic_load_n(&pool->eof[i], __ATOMIC_ACQUIRE))
+            return false;
+    }
+    return true;
+}
+
+static void *track_worker_thread(void *arg) {
+    TrackWorker *worker = (TrackWorker *)arg;
+    TrackWorkerPool *pool = worker->pool;
+
+    while (!pool_aborted(pool)) {
+        bool busy = false;
+        for (int i = worker->index; i < pool->nb_tracks && !pool_aborted(pool);
+                i += pool->nb_threads) {
+            if (pool->eof[i])
+                continue;
+            TrackBlock *block =
+                (TrackBlock *)spsc_ring_write_slot(pool->rings[i]);
+            if (!block)
+                continue;
+
+            int ret = pool->produce(pool->opaque, i, pool->cur_size[i], block);
+            if (ret < 0) {
+                __atomic_store_n(&pool->eof[i], true, __ATOMIC_RELEASE);
+            } else {
+                pool->cur_size[i] += ret * sizeof(short);
+                // an idle block is skipped without reaching the mixer
+                if (block->len > 0)
+                    spsc_ring_commit_write(pool->rings[i]);
+            }
+            busy = true;
+            pool_notify(pool);
+        }
+
+        if (busy)
+            continue;
+        if (worker_finished(worker))
+            break;
+
+        sdl_mutex_lock(pool->mutex);
+        __atomic_add_fetch(&pool->nb_waiting, 1, __ATOMIC_SEQ_CST);
+        if (!pool_aborted(pool) && !worker_can_produce(worker))
+            sdl_mutex_wait_timeout(pool->mutex, WAIT_TIMEOUT_MS);
+        __atomic_sub_fetch(&pool->nb_waiting, 1, __ATOMIC_SEQ_CST);
+        sdl_mutex_unlock(pool->mutex);
+    }
+
+    return NULL;
+}
+
+int track_worker_pool_acquire(TrackWorkerPool *pool,
+        int track_index, TrackBlock **block) {
+    if (!pool || !block || track_index < 0 || track_index >= pool->nb_tracks)
+        return -1;
+
+    while (1) {
+        if (pool_aborted(pool))
+            return AEERROR_INVALID_STATE;
+        *block = (TrackBlock *)spsc_ring_read_slot(pool->rings[track_index]);
+        if (*block)
+            return 0;
+        if (__atomic_load_n(&pool->eof[track_index], __ATOMIC_ACQUIRE)) {
+            // the worker may have committed a block right before eof
+            *block = (TrackBlock *)spsc_ring_read_slot(pool->rings[track_index]);
+            return *block ? 0 : PCM_FILE_EOF;
+        }
+
+        sdl_mutex_lock(pool->mutex);
+        __atomic_add_fetch(&pool->nb_waiting, 1, __ATOMIC_SEQ_CST);
+        if (!pool_aborted(pool)
+                && !__atomic_load_n(&pool->eof[track_index], __ATOMIC_ACQUIRE)
+                && !spsc_ring_read_slot(pool->rings[track_index]))
+            sdl_mutex_wait_timeout(pool->mutex, WAIT_TIMEOUT_MS);
+        __atomic_sub_fetch(&pool->nb_waiting, 1, __ATOMIC_SEQ_CST);
+        sdl_mutex_unlock(pool->mutex);
+    }
+}
+
+void track_worker_pool_release(TrackWorkerPool *pool, int track_index) {
+    if (!pool || track_index < 0 || track_index >= pool->nb_tracks)
+        return;
+
+    spsc_ring_commit_read(pool->rings[track_index]);
+    pool_notify(pool);
+}
+
+void track_worker_pool_abort(TrackWorkerPool *pool) {
+    if (!pool)
+        return;
+
+    sdl_mutex_lock(pool->mutex);
+    __atomic_store_n(&pool->abort, true, __ATOMIC_RELEASE);
+    sdl_mutex_broadcast(pool->mutex);
+    sdl_mutex_unlock(pool->mutex);
+}
+
+void track_worker_pool_freep(TrackWorkerPool **pool) {
+    if (!pool || !*pool)
+        return;
+    TrackWorkerPool *self = *pool;
+
+    if (self->mutex)
+        track_worker_pool_abort(self);
+    if (self->workers) {
+        for (int i = 0; i < self->nb_threads; i++) {
+            if (self->workers[i].started)
+                pthread_join(self->workers[i].tid, NULL);
+        }
+        free(self->workers);
+    }
+    if (self->rings) {
+        for (int i = 0; i < self->nb_tracks; i++) {
+            spsc_ring_freep(&self->rings[i]);
+        }
+        free(self->rings);
+    }
+    if (self->cur_size) free(self->cur_size);
+    if (self->eof) free((void *)self->eof);
+    sdl_mutex_free(&self->mutex);
+    free(self);
+    *pool = NULL;
+}
+
+TrackWorkerPool *track_worker_pool_create(int nb_threads, int nb_tracks,
+        int64_t cur_size, TrackProduceFunc produce, void *opaque) {
+    LogInfo("%s nb_threads %d, nb_tracks %d.\n", __func__,
+        nb_threads, nb_tracks);
+    if (nb_threads <= 0 || nb_tracks <= 0 || !produce)
+        return NULL;
+    if (nb_threads > nb_tracks)
+        nb_threads = nb_tracks;
+
+    TrackWorkerPool *pool =
+        (TrackWorkerPool *)calloc(1, sizeof(TrackWorkerPool));
+    if (!pool) {
+        LogError("%s calloc TrackWorkerPool failed.\n", __func__);
+        return NULL;
+    }
+
+    pool->nb_threads = nb_threads;
+    pool->nb_tracks = nb_tracks;
+    pool->produce = produce;
+    pool->opaque = opaque;
+    pool->mutex = sdl_mutex_create();
+    pool->workers = (TrackWorker *)calloc(nb_threads, sizeof(TrackWorker));
+    pool->rings = (SpscRing **)calloc(nb_tracks, sizeof(SpscRing *));
+    pool->cur_size = (int64_t *)calloc(nb_tracks, sizeof(int64_t));
+    pool->eof = (volatile bool *)calloc(nb_tracks, sizeof(bool));
+    if (!pool->mutex || !pool->workers || !pool->rings
+            || !pool->cur_size || !pool->eof) {
+        LogError("%s alloc pool members failed.\n", __func__);
+        goto fail;
+    }
+
+    for (int i = 0; i < nb_tracks; i++) {
+        pool->cur_size[i] = cur_size;
+        pool->rings[i] = spsc_ring_create(sizeof(TrackBlock),
+            TRACK_RING_NB_BLOCKS);
+        if (!pool->rings[i]) {
+            LogError("%s spsc_ring_create failed.\n", __func__);
+            goto fail;
+        }
+    }
+
+    for (int i = 0; i < nb_threads; i++) {
+        pool->workers[i].index = i;
+        pool->workers[i].pool = pool;
+        if (pthread_create(&pool->workers[i].tid, NULL,
+                track_worker_thread, &pool->workers[i]) != 0) {
+            LogError("%s pthread_create failed.\n", __func__);
+            goto fail;
+        }
+        pool->workers[i].started = true;
+    }
+
+    return pool;
+fail:
+    track_worker_pool_freep(&pool);
+    return NULL;
+}
@@ -0,0 +1,65 @@
+#ifndef _TRACK_WORKER_H_
+#define _TRACK_WORKER_H_
+#include <stdbool.h>
+#include <stdint.h>
+#include "codec/ffmpeg_utils.h"
+
+// number of blocks each track may decode ahead of the mixer
+#define TRACK_RING_NB_BLOCKS 16
+
+typedef struct TrackBlock {
+    // valid length of buffer in short
+    int len;
+    bool mute;
+    // first block after the track opened a new source
+    bool new_source;
+    bool side_chain_enable;
+    float makeup_gain;
+    short buffer[MAX_NB_SAMPLES];
+} TrackBlock;
+
+/**
+ * Fill one block of a track starting at cur_size (in bytes from the seek
+ * position). Return the number of shorts the block covers, or less than 0
+ * when the track has nothing more to produce. A block left with len 0 is
+ * not handed to the mixer.
+ */
+typedef int (*TrackProduceFunc)(void *opaque, int track_index,
+    int64_t cur_size, TrackBlock *block);
+
+typedef struct TrackWorkerPool TrackWorkerPool;
+
+/**
+ * @brief take the next block of a track, waiting for the worker if needed
+ *
+ * @return 0 on success, PCM_FILE_EOF at the end of track,
+ *         AEERROR_INVALID_STATE when the pool is aborted
+ */
+int track_worker_pool_acquire(TrackWorkerPool *pool,
+    int track_index, TrackBlock **block);
+
+/**
+ * @brief give the block taken by track_worker_pool_acquire back to the worker
+ */
+void track_worker_pool_release(TrackWorkerPool *pool, int track_index);
+
+/**
+ * @brief wake up and stop all workers, acquire fails from now on
+ */
+void track_worker_pool_abort(TrackWorkerPool *pool);
+
+/**
+ * @brief abort and join all workers, then free the pool
+ */
+void track_worker_pool_freep(TrackWorkerPool **pool);
+
+/**
+ * @brief start nb_threads workers that share nb_tracks tracks
+ *
+ * @param cur_size start position of every track in bytes
+ * @param produce called on the worker threads to fill a block
+ */
+TrackWorkerPool *track_worker_pool_create(int nb_threads, int nb_tracks,
+    int64_t cur_size, TrackProduceFunc produce, void *opaque);
+
+#endif
@@ -3,8 +3,13 @@
 #include "json/json_parse.h"
 #include "codec/audio_muxer.h"
 #include <pthread.h>
+#include <stdatomic.h>
 #include "mixer_effects.h"
 #include "side_chain_compress.h"
+#include "mix_bus.h"
+#include "track_worker.h"
+#include "mixer_schedule.h"
+#include "clip_preloader.h"
 #include "error_def.h"
 #include "log.h"
 #include "tools/util.h"
@@ -14,7 +19,12 @@
 
 #define DEFAULT_SAMPLE_RATE 44100
 #define DEFAULT_CHANNEL_NUMBER_2 2
-#define DEFAULT_CHANNEL_NUMBER_1 1
+#define MAX_NB_DECODE_THREADS 16
+#define DEFAULT_PRELOAD_TIME_MS 1000
+// longest run of silence written to the fifo at once
+#define MAX_NB_SILENT_SAMPLES (64 * MAX_NB_SAMPLES)
+// samples handed to the encoder per write
+#define MIX_CHUNK_NB_SAMPLES (8 * MAX_NB_SAMPLES)
 
 struct XmMixerContext_T {
     volatile bool abort;
@@ -33,6 +43,30 @@ struct XmMixerContext_T {
     char *in_config_path;
     EffectContext *reverb_ctx;
     short *zero_buffer;
+    // float accumulator of all tracks, converted to mix_buffer once per block
+    float *mix_bus;
+    short *mix_buffer;
+    float mix_factor;
+    // side chain state of each track, owned by the mixing thread
+    SideChain *side_chain;
+    // tracks sounding in the current block
+    MixerSchedule *schedule;
+    ScheduleCursor cursor;
+    // blocks used when the tracks are decoded on the mixing thread
+    TrackBlock *track_blocks;
+    // 0 means decoding all tracks on the mixing thread
+    int nb_decode_threads;
+    TrackWorkerPool *workers;
+    // open a clip this long before it starts, 0 opens it at the boundary
+    int preload_time_ms;
+    ClipPreloader *preloader;
+    // first clip of each track not started yet, owned by the mixing thread
+    int *preload_clips;
+    // effects of finished clips, reused by the next clips
+    EffectPool *effect_pool;
+    // run the effects of each clip on their own threads, set by the api
+    // thread and read by the thread that opens the clips
+    atomic_bool effect_pipeline;
     pthread_mutex_t mutex;
     MixerEffects mixer_effects;
 };
@@ -47,24 +81,6 @@ static void reverb_free(XmMixerContext *ctx) {
     }
 }
 
-static void mixer_effects_free(MixerEffects *mixer) {
-    LogInfo("%s\n", __func__);
-    if (NULL == mixer)
-        return;
-
-    for (int i = 0; i < MAX_NB_TRACKS; i++) {
-        if (mixer->source[i]) {
-            AudioSource_freep(&mixer->source[i]);
-        }
-        if (mixer->sourceQueue[i]) {
-            AudioSourceQueue_freep(&mixer->sourceQueue[i]);
-        }
-        if (mixer->sourceQueueBackup[i]) {
-            AudioSourceQueue_freep(&mixer->sourceQueueBackup[i]);
-        }
-    }
-}
-
 static int reverb_init(XmMixerContext *ctx) {
     int ret = -1;
     if (!ctx) return -1;
@@ -93,40 +109,33 @@ fail:
     return ret;
 }
 
-static int mixer_effects_init(MixerEffects *mixer) {
-    LogInfo("%s\n", __func__);
+static int timeline_init(XmMixerContext *ctx) {
     int ret = -1;
-    if (NULL == mixer)
-        return ret;
-
-    mixer_effects_free(mixer);
+    MixerEffects *mixer = &ctx->mixer_effects;
 
-    for (int i = 0; i < MAX_NB_TRACKS; i++) {
-        mixer->source[i] = (AudioSource *)calloc(1, sizeof(AudioSource));
-        if (NULL == mixer->source[i]) {
-            LogError("%s alloc AudioSource failed.\n", __func__);
-            ret = -1;
-            goto fail;
-        }
+    mixer_schedule_freep(&ctx->schedule);
+    ctx->schedule = mixer_schedule_create(mixer->nb_tracks);
+    if (!ctx->schedule) {
+        return AEERROR_NOMEM;
+    }
 
-        mixer->sourceQueue[i] = AudioSourceQueue_create();
-        if (NULL == mixer->sourceQueue[i]) {
-            LogError("%s alloc sourceQueue failed.\n", __func__);
-            ret = -1;
-            goto fail;
+    for (int i = 0; i < mixer->nb_tracks; i++) {
+        MixerTrack *track = &mixer->tracks[i];
+        for (int j = 0; j < track->nb_clips; j++) {
+            ret = mixer_schedule_add(ctx->schedule, i,
+                track->clips[j].start_time_ms, track->clips[j].end_time_ms);
+            if (ret < 0) return ret;
         }
+    }
 
-        mixer->sourceQueueBackup[i] = AudioSourceQueue_create();
-        if (NULL == mixer->sourceQueueBackup[i]) {
-            LogError("%s alloc sourceQueueBackup failed.\n", __func__);
-            ret = -1;
-            goto fail;
-        }
+    int block_duration_ms = calculation_duration_ms(
+        MAX_NB_SAMPLES * sizeof(short), ctx->bits_per_sample >> 3,
+        ctx->dst_channels, ctx->dst_sample_rate);
+    if ((ret = mixer_schedule_build(ctx->schedule, block_duration_ms)) < 0) {
+        return ret;
     }
 
-    ret = 0;
-fail:
-    return ret;
+    return mixer_schedule_cursor_init(ctx->schedule, &ctx->cursor);
 }
 
 static int get_pcm_from_decoder(AudioSource *source,
@@ -147,18 +156,16 @@ static int get_pcm_from_decoder(AudioSource *source,
     return ret;
 }
 
-static IAudioDecoder *open_source_decoder(AudioSource *source,
-        int dst_sample_rate, int dst_channels, int seek_time_ms) {
+static IAudioDecoder *open_source_decoder(XmMixerContext *ctx,
+        AudioSource *source, int seek_time_ms) {
     LogInfo("%s\n", __func__);
     if (!source || !source->file_path)
         return NULL;
     IAudioDecoder *decoder = NULL;
+    int dst_sample_rate = ctx->dst_sample_rate;
+    int dst_channels = ctx->dst_channels;
 
     IAudioDecoder_freep(&(source->decoder));
-    int decoder_out_channels = dst_channels;
-    if (source->has_effects) {
-        decoder_out_channels = DEFAULT_CHANNEL_NUMBER_1;
-    }
 
     enum DecoderType decoder_type = DECODER_NONE;
     if (source->is_pcm) {
@@ -166,10 +173,13 @@ static IAudioDecoder *open_source_decoder(AudioSource *source,
     } else {
         decoder_type = DECODER_FFMPEG;
     }
-    decoder = audio_decoder_create(source->file_path,
+    // the effect chain works on floats, so decode to them directly
+    enum DecoderSampleFormat sample_fmt = source->has_effects ?
+        DECODER_SAMPLE_FMT_FLT : DECODER_SAMPLE_FMT_S16;
+    decoder = audio_decoder_create_fmt(source->file_path,
         source->sample_rate, source->nb_channels,
-        dst_sample_rate, decoder_out_channels,
-        source->volume, decoder_type);
+        dst_sample_rate, dst_channels,
+        source->volume, decoder_type, sample_fmt);
     if (!decoder) {
         LogError("%s malloc source decoder failed.\n", __func__);
         return NULL;
@@ -184,13 +194,14 @@ static IAudioDecoder *open_source_decoder(AudioSource *source,
 
     source->fade_io.fade_in_nb_samples = source->fade_io.fade_in_time_ms * dst_sample_rate / 1000;
     source->fade_io.fade_out_nb_samples = source->fade_io.fade_out_time_ms * dst_sample_rate / 1000;
-    source->yl_prev = source->makeup_gain * MAKEUP_GAIN_MAX_DB;
 
     IAudioDecoder_seekTo(decoder, seek_time_ms);
 
     if (source->has_effects) {
         audio_effect_freep(&source->effects_ctx);
-        source->effects_ctx = audio_effect_create();
+        source->effects_ctx = audio_effect_create(ctx->effect_pool);
+        audio_effect_set_pipeline(source->effects_ctx,
+            atomic_load(&ctx->effect_pipeline));
         if (audio_effect_init(source->effects_ctx,
                 decoder, source->effects_info, dst_channels) < 0) {
             LogError("%s audio_effect_init failed.\n", __func__);
@@ -199,77 +210,63 @@ static IAudioDecoder *open_source_decoder(AudioSource *source,
         }
     }
 
-    if (source->buffer.buffer) free(source->buffer.buffer);
-    source->buffer.buffer =
-        (short *)calloc(sizeof(short), MAX_NB_SAMPLES);
-    if (!source->buffer.buffer) {
-        LogError("%s calloc Source Buffer failed.\n", __func__);
-        IAudioDecoder_freep(&decoder);
-        return NULL;
-    }
-
     source->decoder = decoder;
     return decoder;
 }
 
-static int update_audio_source(AudioSourceQueue *queue,
-        AudioSource *source, int dst_sample_rate, int dst_channels) {
+static int update_audio_source(XmMixerContext *ctx,
+        MixerTrack *track, int track_index) {
     int ret = -1;
-    if (!queue || !source || (AudioSourceQueue_size(queue) <= 0))
+    if (!track || !track->source || track->next_clip >= track->nb_clips)
         return ret;
 
-    while (AudioSourceQueue_size(queue) > 0) {
-        AudioSource_free(source);
-        if (AudioSourceQueue_get(queue, source) > 0) {
-            source->decoder = open_source_decoder(source,
-                dst_sample_rate, dst_channels, 0);
-            if (!source->decoder)
-            {
-                LogError("%s open decoder failed, file_path: %s.\n",
-                    __func__, source->file_path);
-                ret = AEERROR_NOMEM;
-            } else {
-                ret = 0;
-                break;
-            }
+    AudioSource *source = track->source;
+    AudioSource_release(source);
+    if (clip_preloader_take(ctx->preloader, track_index,
+            track->next_clip, source) == 0) {
+        track->next_clip++;
+        return 0;
+    }
+
+    while (track->next_clip < track->nb_clips) {
+        AudioSource_release(source);
+        // shallow copy, the strings stay owned by the clip
+        *source = track->clips[track->next_clip++];
+        source->decoder = open_source_decoder(ctx, source, 0);
+        if (!source->decoder)
+        {
+            LogError("%s open decoder failed, file_path: %s.\n",
+                __func__, source->file_path);
+            ret = AEERROR_NOMEM;
+        } else {
+            ret = 0;
+            break;
         }
     }
     return ret;
 }
 
-static void audio_source_seekTo(AudioSourceQueue *queue,
-        AudioSource *source, int dst_sample_rate,
-        int dst_channels, int seek_time_ms) {
+static void audio_source_seekTo(XmMixerContext *ctx,
+        MixerTrack *track, int seek_time_ms) {
     LogInfo("%s\n", __func__);
-    if (!queue || !source || (AudioSourceQueue_size(queue) <= 0))
+    if (!track || !track->source)
         return;
 
-    int source_seek_time = 0;
-    bool find_source = false;
-    while ((AudioSourceQueue_size(queue) > 0)) {
-        AudioSource_free(source);
-        if (AudioSourceQueue_get(queue, source) > 0) {
-            if (source->start_time_ms <= seek_time_ms) {
-                if (source->end_time_ms <= seek_time_ms) {
-                    source_seek_time = 0;
-                } else {
-                    source_seek_time = seek_time_ms - source->start_time_ms;
-                    find_source = true;
-                    break;
-                }
-            } else {
-                source_seek_time = 0;
-                find_source = true;
-                break;
-            }
-        }
-    }
+    AudioSource *source = track->source;
+    AudioSource_release(source);
+    int index = MixerTrack_find_clip(track, seek_time_ms);
+    track->next_clip = index;
+    if (index >= track->nb_clips)
+        return;
 
-    if (find_source)
-        open_source_decoder(source, dst_sample_rate,
-            dst_channels, source_seek_time);
-    else
-        AudioSource_free(source);
+    // only the clip covering the seek position is opened here,
+    // later clips are opened when the timeline reaches them
+    AudioSource *clip = &track->clips[index];
+    if (clip->start_time_ms <= seek_time_ms) {
+        *source = *clip;
+        track->next_clip = index + 1;
+        open_source_decoder(ctx, source, seek_time_ms - clip->start_time_ms);
+    }
 }
 
 static void fade_in_out(AudioSource *source, int sample_rate,
@@ -352,7 +349,21 @@ static void mixer_abort_l(XmMixerContext *ctx)
 
     pthread_mutex_lock(&ctx->mutex);
     ctx->abort = true;
+    track_worker_pool_abort(ctx->workers);
+    pthread_mutex_unlock(&ctx->mutex);
+}
+
+static void mixer_workers_stop(XmMixerContext *ctx)
+{
+    if(!ctx)
+        return;
+
+    pthread_mutex_lock(&ctx->mutex);
+    TrackWorkerPool *workers = ctx->workers;
+    ctx->workers = NULL;
     pthread_mutex_unlock(&ctx->mutex);
+
+    track_worker_pool_freep(&workers);
 }
 
 static void mixer_free_l(XmMixerContext *ctx)
@@ -361,8 +372,15 @@ static void mixer_free_l(XmMixerContext *ctx)
         return;
 
     xm_audio_mixer_stop(ctx);
+    mixer_workers_stop(ctx);
+    // the prepared clips borrow the strings of mixer_effects
+    clip_preloader_freep(&ctx->preloader);
 
-    mixer_effects_free(&(ctx->mixer_effects));
+    // the sources give their effects back to the pool
+    MixerEffects_free(&(ctx->mixer_effects));
+    effect_pool_freep(&ctx->effect_pool);
+    mixer_schedule_freep(&ctx->schedule);
+    mixer_schedule_cursor_free(&ctx->cursor);
 
     reverb_free(ctx);
 
@@ -381,6 +399,26 @@ static void mixer_free_l(XmMixerContext *ctx)
         free(ctx->zero_buffer);
         ctx->zero_buffer = NULL;
     }
+    if (ctx->mix_bus) {
+        free(ctx->mix_bus);
+        ctx->mix_bus = NULL;
+    }
+    if (ctx->mix_buffer) {
+        free(ctx->mix_buffer);
+        ctx->mix_buffer = NULL;
+    }
+    if (ctx->track_blocks) {
+        free(ctx->track_blocks);
+        ctx->track_blocks = NULL;
+    }
+    if (ctx->preload_clips) {
+        free(ctx->preload_clips);
+        ctx->preload_clips = NULL;
+    }
+    if (ctx->side_chain) {
+        free(ctx->side_chain);
+        ctx->side_chain = NULL;
+    }
 
     pthread_mutex_lock(&ctx->mutex);
     ctx->abort= false;
@@ -414,37 +452,37 @@ static void add_reverb_and_write_fifo(XmMixerContext *ctx,
     }
 }
 
-static short *mixer_combine(AudioSource *source,
-    int mix_len, short *prev_buffer,
-    short *dst_buffer, int channels) {
-    if (!source || !source->buffer.buffer
-        || !prev_buffer || !dst_buffer)
+static short *mixer_combine(XmMixerContext *ctx, int mix_len) {
+    if (!ctx || !ctx->mix_bus || !ctx->mix_buffer)
         return NULL;
     if (mix_len <= 0) {
         LogError("%s mix_len is %d.\n", __func__, mix_len);
         return NULL;
     }
 
-    MixBufferS16(prev_buffer, source->buffer.buffer,
-        mix_len / channels, channels, dst_buffer,
-        &(source->left_factor), &(source->right_factor));
+    float peak = mix_bus_peak(ctx->mix_bus, mix_len);
+    float factor = mix_bus_update_factor(ctx->mix_factor, peak);
+    // attenuate at once, recover with a ramp over the block
+    float gain_start = factor < ctx->mix_factor ? factor : ctx->mix_factor;
+    mix_bus_to_s16(ctx->mix_bus, ctx->mix_buffer, mix_len,
+        ctx->dst_channels, gain_start, factor);
+    ctx->mix_factor = factor;
 
-    return dst_buffer;
+    return ctx->mix_buffer;
 }
 
-static int fill_track_buffer(AudioSource *source,
+static int fill_track_buffer(AudioSource *source, short *buffer,
     int fill_len, int start_time, int duration,
     int sample_rate, int channels) {
     int ret = -1;
-    if (!source || !source->buffer.buffer)
+    if (!source || !buffer || fill_len <= 0)
         return ret;
 
-    short *buffer = source->buffer.buffer;
     int buffer_size_in_short = 0;
     int buffer_data_start_index = 0;
     if (start_time >= source->start_time_ms &&
         start_time + duration < source->end_time_ms) {
-        memset(buffer, 0, sizeof(short) * MAX_NB_SAMPLES);
+        memset(buffer, 0, sizeof(short) * fill_len);
         buffer_data_start_index = 0;
         buffer_size_in_short = fill_len > 0 ? fill_len : 0;
 
@@ -455,7 +493,7 @@ static int fill_track_buffer(AudioSource *source,
         }
     } else if (start_time < source->start_time_ms &&
             start_time + duration > source->start_time_ms) {
-        memset(buffer, 0, sizeof(short) * MAX_NB_SAMPLES);
+        memset(buffer, 0, sizeof(short) * fill_len);
         buffer_data_start_index = ((source->start_time_ms - start_time)
             * sample_rate * channels) / 1000;
         buffer_size_in_short =
@@ -469,7 +507,7 @@ static int fill_track_buffer(AudioSource *source,
         }
     } else if (start_time < source->end_time_ms &&
             start_time + duration > source->end_time_ms) {
-        memset(buffer, 0, sizeof(short) * MAX_NB_SAMPLES);
+        memset(buffer, 0, sizeof(short) * fill_len);
         buffer_data_start_index = 0;
         buffer_size_in_short = ((source->end_time_ms - start_time)
             * sample_rate * channels) / 1000;
@@ -483,7 +521,7 @@ static int fill_track_buffer(AudioSource *source,
         }
     } else if(start_time >= source->end_time_ms) {
         //update the decoder that point the next bgm
-        AudioSource_free(source);
+        AudioSource_release(source);
         goto end;
     } else {
         goto end;
@@ -497,81 +535,220 @@ end:
     return ret;
 }
 
-static int mixer_mix_and_write_fifo(XmMixerContext *ctx) {
-    if (!ctx) return -1;
-    int ret = -1, read_len = MAX_NB_SAMPLES;
-    int buffer_start_ms = ctx->seek_time_ms +
-        calculation_duration_ms(ctx->cur_size,
+static int mixer_plan_block(XmMixerContext *ctx, int64_t cur_size,
+    int *start_ms, int *duration, int *read_len) {
+    *read_len = MAX_NB_SAMPLES;
+    *start_ms = ctx->seek_time_ms +
+        calculation_duration_ms(cur_size,
         ctx->bits_per_sample >> 3, ctx->dst_channels,
         ctx->dst_sample_rate);
-    int duration = calculation_duration_ms(
-        read_len * sizeof(short), ctx->bits_per_sample >> 3,
+    *duration = calculation_duration_ms(
+        *read_len * sizeof(short), ctx->bits_per_sample >> 3,
         ctx->dst_channels, ctx->dst_sample_rate);
 
     int file_duration = ctx->mixer_effects.duration_ms;
-    if (buffer_start_ms >= file_duration) {
-        ret = PCM_FILE_EOF;
-        goto end;
-    } else if ((buffer_start_ms + duration >= file_duration)) {
-        duration = file_duration - buffer_start_ms;
-        read_len = (duration * ctx->dst_sample_rate
+    if (*start_ms >= file_duration) {
+        return PCM_FILE_EOF;
+    } else if ((*start_ms + *duration >= file_duration)) {
+        *duration = file_duration - *start_ms;
+        *read_len = (*duration * ctx->dst_sample_rate
             * ctx->dst_channels) / 1000;
     }
+    return 0;
+}
 
-    short *prev_buffer = NULL;
-    for (int i = 0; i < MAX_NB_TRACKS; i++) {
-        AudioSource *source = ctx->mixer_effects.source[i];
-        AudioSourceQueue *queue = ctx->mixer_effects.sourceQueue[i];
-        if (!source->decoder && AudioSourceQueue_size(queue) > 0) {
-            update_audio_source(queue, source,
-                ctx->dst_sample_rate, ctx->dst_channels);
-        }
+// Runs on the mixing thread, or on a worker thread that owns the track
+static int track_produce(void *opaque, int index,
+    int64_t cur_size, TrackBlock *block) {
+    XmMixerContext *ctx = (XmMixerContext *)opaque;
+    int ret = -1, read_len = 0, buffer_start_ms = 0, duration = 0;
+    if ((ret = mixer_plan_block(ctx, cur_size,
+            &buffer_start_ms, &duration, &read_len)) < 0)
+        return ret;
 
-        if (source->decoder) {
-            if (fill_track_buffer(source, read_len, buffer_start_ms,
-                duration, ctx->dst_sample_rate, ctx->dst_channels) < 0) {
-                    source->buffer.mute = true;
-                } else {
-                    source->buffer.mute = false;
-                }
+    MixerTrack *track = &ctx->mixer_effects.tracks[index];
+    enum TrackState state = mixer_schedule_track_state(ctx->schedule,
+        index, buffer_start_ms, duration);
+    if (state == TRACK_FINISHED) {
+        return PCM_FILE_EOF;
+    } else if (state == TRACK_IDLE) {
+        block->len = 0;
+        return read_len;
+    }
+
+    AudioSource *source = track->source;
+    block->new_source = false;
+    if (!source->decoder && track->next_clip < track->nb_clips) {
+        update_audio_source(ctx, track, index);
+        block->new_source = source->decoder != NULL;
+    }
+
+    block->len = read_len;
+    block->side_chain_enable = source->side_chain_enable;
+    block->makeup_gain = source->makeup_gain;
+    if (source->decoder) {
+        block->mute = fill_track_buffer(source, block->buffer,
+            read_len, buffer_start_ms, duration,
+            ctx->dst_sample_rate, ctx->dst_channels) < 0;
+    } else {
+        block->mute = true;
+    }
+    return read_len;
+}
+
+static int preload_open(void *opaque, AudioSource *source) {
+    XmMixerContext *ctx = (XmMixerContext *)opaque;
+    if (!open_source_decoder(ctx, source, 0)) {
+        LogError("%s open decoder failed, file_path: %s.\n",
+            __func__, source->file_path);
+        return AEERROR_NOMEM;
+    }
+    return 0;
+}
+
+static int mixer_workers_start(XmMixerContext *ctx) {
+    TrackWorkerPool *workers = track_worker_pool_create(
+        ctx->nb_decode_threads, ctx->mixer_effects.nb_tracks, ctx->cur_size,
+        track_produce, ctx);
+    if (!workers) {
+        LogError("%s track_worker_pool_create failed.\n", __func__);
+        return AEERROR_NOMEM;
+    }
+
+    pthread_mutex_lock(&ctx->mutex);
+    ctx->workers = workers;
+    pthread_mutex_unlock(&ctx->mutex);
+    return 0;
+}
+
+// Runs on the mixing thread for every block, so idle tracks and tracks
+// owned by a worker get their next clip opened in time as well
+static void mixer_request_preloads(XmMixerContext *ctx,
+    int start_ms, int end_ms) {
+    if (!ctx->preloader || !ctx->preload_clips)
+        return;
+
+    for (int i = 0; i < ctx->mixer_effects.nb_tracks; i++) {
+        MixerTrack *track = &ctx->mixer_effects.tracks[i];
+        int index = ctx->preload_clips[i];
+        while (index < track->nb_clips
+                && track->clips[index].start_time_ms < start_ms)
+            index++;
+        ctx->preload_clips[i] = index;
+
+        if (index < track->nb_clips && track->clips[index].start_time_ms
+                - ctx->preload_time_ms < end_ms)
+            clip_preloader_request(ctx->preloader,
+                i, index, &track->clips[index]);
+    }
+}
+
+// The block at cur_size has no active track, write it and the silent
+// blocks after it up to the next clip start in one go. The run stops
+// where the next clip is due for preloading, so the request goes out
+// with the next block.
+static int mixer_write_silence(XmMixerContext *ctx, int read_len) {
+    int next_start_ms =
+        mixer_schedule_next_start_ms(ctx->schedule, &ctx->cursor);
+    if (next_start_ms >= 0 && ctx->preloader)
+        next_start_ms -= ctx->preload_time_ms;
+    int64_t cur_size = ctx->cur_size + read_len * sizeof(short);
+    int nb_samples = read_len;
+    int start_ms = 0, duration = 0, len = 0;
+
+    while (nb_samples + MAX_NB_SAMPLES <= MAX_NB_SILENT_SAMPLES
+            && mixer_plan_block(ctx, cur_size,
+                &start_ms, &duration, &len) == 0
+            && (next_start_ms < 0 || next_start_ms >= start_ms + duration)) {
+        nb_samples += len;
+        cur_size += len * sizeof(short);
+    }
+
+    fifo_write_silence(ctx->audio_fifo, nb_samples);
+    ctx->cur_size = cur_size;
+    return nb_samples;
+}
+
+static int mixer_mix_and_write_fifo(XmMixerContext *ctx) {
+    if (!ctx) return -1;
+    int ret = -1, read_len = 0, buffer_start_ms = 0, duration = 0;
+    if ((ret = mixer_plan_block(ctx, ctx->cur_size,
+            &buffer_start_ms, &duration, &read_len)) < 0)
+        goto end;
+
+    if (ctx->preload_time_ms > 0 && !ctx->preloader) {
+        ctx->preloader = clip_preloader_create(
+            ctx->mixer_effects.nb_tracks, preload_open, ctx);
+        if (!ctx->preloader)
+            LogWarning("%s clip_preloader_create failed, "
+                "clips are opened at the boundary.\n", __func__);
+    }
+
+    if (ctx->nb_decode_threads > 0 && !ctx->workers) {
+        if ((ret = mixer_workers_start(ctx)) < 0)
+            goto end;
+    }
+
+    mixer_request_preloads(ctx, buffer_start_ms, buffer_start_ms + duration);
+
+    int nb_mixed = 0;
+    memset(ctx->mix_bus, 0, sizeof(float) * read_len);
+    int nb_active = mixer_schedule_advance(ctx->schedule,
+        &ctx->cursor, buffer_start_ms, duration);
+    if (nb_active == 0) {
+        return mixer_write_silence(ctx, read_len);
+    }
+    for (int n = 0; n < nb_active; n++) {
+        int i = mixer_schedule_active_track(ctx->schedule, &ctx->cursor, n);
+        TrackBlock *block = NULL;
+        if (ctx->workers) {
+            if ((ret = track_worker_pool_acquire(ctx->workers,
+                    i, &block)) < 0) {
+                LogError("%s track %d acquire block failed.\n", __func__, i);
+                goto end;
+            }
         } else {
-            source->buffer.mute = true;
+            block = &ctx->track_blocks[i];
+            track_produce(ctx, i, ctx->cur_size, block);
         }
 
-        if (!source->buffer.mute) {
-            if (prev_buffer != NULL) {
-                if (source->side_chain_enable) {
-                    side_chain_compress(prev_buffer,
-                        source->buffer.buffer, &(source->yl_prev),
-                        read_len, ctx->dst_sample_rate, ctx->dst_channels,
-                        SIDE_CHAIN_THRESHOLD, SIDE_CHAIN_RATIO,
-                        SIDE_CHAIN_ATTACK_MS, SIDE_CHAIN_RELEASE_MS,
-                        source->makeup_gain);
-                }
-                prev_buffer = mixer_combine(source, read_len,
-                    prev_buffer, source->buffer.buffer,
-                    ctx->dst_channels);
-            } else {
-                if (source->side_chain_enable) {
-                    side_chain_compress(ctx->zero_buffer,
-                        source->buffer.buffer, &(source->yl_prev),
-                        read_len, ctx->dst_sample_rate, ctx->dst_channels,
-                        SIDE_CHAIN_THRESHOLD, SIDE_CHAIN_RATIO,
-                        SIDE_CHAIN_ATTACK_MS, SIDE_CHAIN_RELEASE_MS,
-                        source->makeup_gain);
+        if (block->new_source) {
+            side_chain_reset(&ctx->side_chain[i], block->makeup_gain);
+        }
+
+        if (!block->mute) {
+            if (block->side_chain_enable) {
+                // the key signal is the sum of the tracks mixed so far
+                short *key = ctx->zero_buffer;
+                if (nb_mixed > 0) {
+                    mix_bus_to_s16(ctx->mix_bus, ctx->mix_buffer, read_len,
+                        ctx->dst_channels, 1.0f, 1.0f);
+                    key = ctx->mix_buffer;
                 }
-                prev_buffer = source->buffer.buffer;
+                side_chain_compress(&ctx->side_chain[i], key, block->buffer,
+                    read_len, ctx->dst_sample_rate, ctx->dst_channels,
+                    SIDE_CHAIN_THRESHOLD, SIDE_CHAIN_RATIO,
+                    SIDE_CHAIN_ATTACK_MS, SIDE_CHAIN_RELEASE_MS,
+                    block->makeup_gain);
             }
+            mix_bus_accumulate_s16(ctx->mix_bus,
+                block->buffer, read_len);
+            nb_mixed++;
+        }
+
+        if (ctx->workers) {
+            track_worker_pool_release(ctx->workers, i);
         }
     }
 
     ctx->cur_size += (read_len * sizeof(short));
-    if (!prev_buffer) {
-        fifo_write(ctx->audio_fifo, ctx->zero_buffer, read_len);
+    if (nb_mixed == 0) {
+        fifo_write_silence(ctx->audio_fifo, read_len);
         return read_len;
     }
 
-    add_reverb_and_write_fifo(ctx, prev_buffer, read_len);
+    add_reverb_and_write_fifo(ctx,
+        mixer_combine(ctx, read_len), read_len);
     ret = read_len;
 
 end:
@@ -610,6 +787,44 @@ int xm_audio_mixer_get_progress(XmMixerContext *ctx) {
     return ret;
 }
 
+void xm_audio_mixer_set_decode_threads(XmMixerContext *ctx,
+    int nb_threads) {
+    LogInfo("%s nb_threads %d\n", __func__, nb_threads);
+    if (NULL == ctx)
+        return;
+
+    if (nb_threads < 0) nb_threads = 0;
+    if (nb_threads > MAX_NB_DECODE_THREADS) nb_threads = MAX_NB_DECODE_THREADS;
+    if (nb_threads == ctx->nb_decode_threads)
+        return;
+
+    // restarted with the new count on the next block
+    mixer_workers_stop(ctx);
+    ctx->nb_decode_threads = nb_threads;
+}
+
+void xm_audio_mixer_set_preload_time(XmMixerContext *ctx,
+    int preload_time_ms) {
+    LogInfo("%s preload_time_ms %d\n", __func__, preload_time_ms);
+    if (NULL == ctx)
+        return;
+
+    ctx->preload_time_ms = preload_time_ms > 0 ? preload_time_ms : 0;
+    if (ctx->preload_time_ms == 0) {
+        mixer_workers_stop(ctx);
+        clip_preloader_freep(&ctx->preloader);
+    }
+}
+
+void xm_audio_mixer_set_effect_pipeline(XmMixerContext *ctx, bool enable) {
+    LogInfo("%s enable %d\n", __func__, enable);
+    if (NULL == ctx)
+        return;
+
+    // clips opened from now on, the preloaded ones keep their setting
+    atomic_store(&ctx->effect_pipeline, enable);
+}
+
 int xm_audio_mixer_get_frame(XmMixerContext *ctx,
     short *buffer, int buffer_size_in_short) {
     int ret = -1;
@@ -638,23 +853,27 @@ int xm_audio_mixer_seekTo(XmMixerContext *ctx,
     if (!ctx)
         return -1;
 
+    // the workers own the sources while running
+    mixer_workers_stop(ctx);
+    clip_preloader_flush(ctx->preloader);
     ctx->seek_time_ms = seek_time_ms > 0 ? seek_time_ms : 0;
     if (ctx->audio_fifo) fifo_clear(ctx->audio_fifo);
     ctx->cur_size = 0;
-
-    for (int i = 0; i < MAX_NB_TRACKS; i++) {
-        AudioSourceQueue_copy(
-            ctx->mixer_effects.sourceQueueBackup[i],
-            ctx->mixer_effects.sourceQueue[i]);
-        audio_source_seekTo(ctx->mixer_effects.sourceQueue[i],
-            ctx->mixer_effects.source[i], ctx->dst_sample_rate,
-            ctx->dst_channels, ctx->seek_time_ms);
+    ctx->mix_factor = 1.0f;
+    mixer_schedule_cursor_seek(ctx->schedule, &ctx->cursor,
+        ctx->seek_time_ms);
+
+    for (int i = 0; i < ctx->mixer_effects.nb_tracks; i++) {
+        MixerTrack *track = &ctx->mixer_effects.tracks[i];
+        audio_source_seekTo(ctx, track, ctx->seek_time_ms);
+        if (ctx->preload_clips) ctx->preload_clips[i] = track->next_clip;
+        side_chain_reset(&ctx->side_chain[i], track->source->makeup_gain);
     }
     return 0;
 }
 
 static int xm_audio_mixer_mix_l(XmMixerContext *ctx,
-    int encoder_type, const char *out_file_path) {
+    int encoder_type, const char *out_file_path, int start_ms, int end_ms) {
     LogInfo("%s.\n", __func__);
     int ret = -1;
     short *buffer = NULL;
@@ -671,32 +890,48 @@ static int xm_audio_mixer_mix_l(XmMixerContext *ctx,
         goto fail;
     }
 
-    buffer = (short *)calloc(sizeof(short), MAX_NB_SAMPLES);
+    buffer = (short *)calloc(sizeof(short), MIX_CHUNK_NB_SAMPLES);
     if (!buffer) {
         LogError("%s calloc buffer failed.\n", __func__);
         ret = AEERROR_NOMEM;
         goto fail;
     }
 
-    ctx->seek_time_ms = 0;
-    ctx->cur_size = 0;
+    if (start_ms > 0) {
+        xm_audio_mixer_seekTo(ctx, start_ms);
+    } else {
+        ctx->seek_time_ms = 0;
+        ctx->cur_size = 0;
+    }
     int file_duration = ctx->mixer_effects.duration_ms;
     //if (file_duration > MAX_DURATION_MIX_IN_MS) file_duration = MAX_DURATION_MIX_IN_MS;
-    while (!ctx->abort) {
+    if (end_ms > 0 && end_ms < file_duration) file_duration = end_ms;
+    // samples left in the range, less than 0 means up to the end
+    int64_t nb_remaining = -1;
+    if (end_ms > 0)
+        nb_remaining = (int64_t)(end_ms - ctx->seek_time_ms)
+            * ctx->dst_sample_rate / 1000 * ctx->dst_channels;
+    while (!ctx->abort && nb_remaining != 0) {
         int cur_position = ctx->seek_time_ms +
             calculation_duration_ms(ctx->cur_size, ctx->bits_per_sample >> 3,
             ctx->dst_channels, ctx->dst_sample_rate);
-        int progress = ((float)cur_position / file_duration) * 100;
+        int span = file_duration - ctx->seek_time_ms;
+        int progress = span > 0 ?
+            ((float)(cur_position - ctx->seek_time_ms) / span) * 100 : 100;
         pthread_mutex_lock(&ctx->mutex);
         ctx->progress = progress;
         pthread_mutex_unlock(&ctx->mutex);
 
-        ret = xm_audio_mixer_get_frame(ctx, buffer, MAX_NB_SAMPLES);
+        int nb_samples = MIX_CHUNK_NB_SAMPLES;
+        if (nb_remaining > 0 && nb_remaining < nb_samples)
+            nb_samples = nb_remaining;
+        ret = xm_audio_mixer_get_frame(ctx, buffer, nb_samples);
         if (ret <= 0) {
             LogInfo("xm_audio_mixer_get_frame len <= 0.\n");
             break;
         }
 
+        if (nb_remaining > 0) nb_remaining -= ret;
         ret = muxer_write_audio_frame(ctx->muxer, buffer, ret);
         if (ret < 0) {
             LogError("muxer_write_audio_frame failed\n");
@@ -704,7 +939,7 @@ static int xm_audio_mixer_mix_l(XmMixerContext *ctx,
         }
     }
 
-    if (PCM_FILE_EOF == ret) ret = 0;
+    if (PCM_FILE_EOF == ret || ctx->abort) ret = 0;
 fail:
     if (buffer != NULL) {
         free(buffer);
@@ -718,7 +953,14 @@ fail:
 int xm_audio_mixer_mix(XmMixerContext *ctx,
     const char *out_file_path, int encoder_type)
 {
-    LogInfo("%s out_file_path = %s, encoder_type = %d.\n", __func__, out_file_path, encoder_type);
+    return xm_audio_mixer_mix_range(ctx, out_file_path, encoder_type, 0, -1);
+}
+
+int xm_audio_mixer_mix_range(XmMixerContext *ctx,
+    const char *out_file_path, int encoder_type, int start_ms, int end_ms)
+{
+    LogInfo("%s out_file_path = %s, encoder_type = %d, range [%d, %d).\n",
+        __func__, out_file_path, encoder_type, start_ms, end_ms);
     int ret = -1;
     if (NULL == ctx || NULL == out_file_path) {
         return ret;
@@ -732,7 +974,8 @@ int xm_audio_mixer_mix(XmMixerContext *ctx,
     ctx->mix_status = MIX_STATE_STARTED;
     pthread_mutex_unlock(&ctx->mutex);
 
-    if ((ret = xm_audio_mixer_mix_l(ctx, encoder_type, out_file_path)) < 0) {
+    if ((ret = xm_audio_mixer_mix_l(ctx, encoder_type, out_file_path,
+            start_ms, end_ms)) < 0) {
         LogError("%s mixer_audio_mix_l failed\n", __func__);
         goto fail;
     }
@@ -749,6 +992,17 @@ fail:
     return ret;
 }
 
+void xm_audio_mixer_get_output_info(XmMixerContext *ctx,
+    int *duration_ms, int *sample_rate, int *channels)
+{
+    if (NULL == ctx)
+        return;
+
+    if (duration_ms) *duration_ms = ctx->mixer_effects.duration_ms;
+    if (sample_rate) *sample_rate = ctx->dst_sample_rate;
+    if (channels) *channels = ctx->dst_channels;
+}
+
 int xm_audio_mixer_init(XmMixerContext *ctx,
         const char *in_config_path)
 {
@@ -766,11 +1020,6 @@ int xm_audio_mixer_init(XmMixerContext *ctx,
     ctx->seek_time_ms = 0;
     ctx->in_config_path = av_strdup(in_config_path);
 
-    if ((ret = mixer_effects_init(&(ctx->mixer_effects))) < 0) {
-        LogError("%s mixer_effects_init failed\n", __func__);
-        goto fail;
-    }
-
     if ((ret = json_parse(&(ctx->mixer_effects), in_config_path)) < 0) {
         LogError("%s json_parse %s failed\n", __func__, in_config_path);
         goto fail;
@@ -791,11 +1040,45 @@ int xm_audio_mixer_init(XmMixerContext *ctx,
         goto fail;
     }
 
+    ctx->mix_bus = (float *)calloc(sizeof(float), MAX_NB_SAMPLES);
+    ctx->mix_buffer = (short *)calloc(sizeof(short), MAX_NB_SAMPLES);
+    if (!ctx->mix_bus || !ctx->mix_buffer) {
+        LogError("%s calloc mix bus failed.\n", __func__);
+        ret = AEERROR_NOMEM;
+        goto fail;
+    }
+    ctx->mix_factor = 1.0f;
+
+    int nb_tracks = ctx->mixer_effects.nb_tracks;
+    ctx->track_blocks = (TrackBlock *)calloc(nb_tracks, sizeof(TrackBlock));
+    ctx->side_chain = (SideChain *)calloc(nb_tracks, sizeof(SideChain));
+    ctx->preload_clips = (int *)calloc(nb_tracks, sizeof(int));
+    if (!ctx->track_blocks || !ctx->side_chain || !ctx->preload_clips) {
+        LogError("%s calloc track state failed.\n", __func__);
+        ret = AEERROR_NOMEM;
+        goto fail;
+    }
+    for (int i = 0; i < nb_tracks; i++) {
+        side_chain_reset(&ctx->side_chain[i], 0.0f);
+    }
+
+    if ((ret = timeline_init(ctx)) < 0) {
+        LogError("%s timeline_init failed\n", __func__);
+        goto fail;
+    }
+
     if ((ret = reverb_init(ctx)) < 0) {
         LogError("%s reverb_init failed\n", __func__);
         goto fail;
     }
 
+    // one set of effects per track, a clip of a track ends before the next
+    // one opens, without the pool every clip creates its effects
+    ctx->effect_pool = effect_pool_create(nb_tracks * MAX_NB_EFFECTS);
+    if (!ctx->effect_pool)
+        LogWarning("%s effect_pool_create failed, "
+            "creating the effects of every clip\n", __func__);
+
     pthread_mutex_lock(&ctx->mutex);
     ctx->mix_status = MIX_STATE_INITIALIZED;
     pthread_mutex_unlock(&ctx->mutex);
@@ -821,6 +1104,8 @@ XmMixerContext *xm_audio_mixer_create()
     self->dst_sample_rate = DEFAULT_SAMPLE_RATE;
     self->dst_channels = DEFAULT_CHANNEL_NUMBER_2;
     self->bits_per_sample = BITS_PER_SAMPLE_16;
+    self->preload_time_ms = DEFAULT_PRELOAD_TIME_MS;
+    atomic_init(&self->effect_pipeline, false);
     pthread_mutex_init(&self->mutex, NULL);
     self->mix_status = MIX_STATE_UNINIT;
 
@@ -1,5 +1,6 @@
 #ifndef XM_AUDIO_MIXER_H_
 #define XM_AUDIO_MIXER_H_
+#include <stdbool.h>
 
 typedef struct XmMixerContext_T XmMixerContext;
 
@@ -30,6 +31,35 @@ void xm_audio_mixer_stop(XmMixerContext *ctx);
  */
 int xm_audio_mixer_get_progress(XmMixerContext *ctx);
 
+/**
+ * @brief set the number of threads decoding tracks ahead of the mixer,
+ *        call it from the thread that gets frames
+ *
+ * @param ctx XmMixerContext
+ * @param nb_threads 0(default) decodes all tracks on the calling thread
+ */
+void xm_audio_mixer_set_decode_threads(XmMixerContext *ctx,
+    int nb_threads);
+
+/**
+ * @brief set how long before its start a clip is opened in the background,
+ *        call it from the thread that gets frames
+ *
+ * @param ctx XmMixerContext
+ * @param preload_time_ms 1000(default), 0 opens each clip at its start
+ */
+void xm_audio_mixer_set_preload_time(XmMixerContext *ctx,
+    int preload_time_ms);
+
+/**
+ * @brief run the effects of each clip on their own threads, one per
+ *        effect, call it from the thread that gets frames
+ *
+ * @param ctx XmMixerContext
+ * @param enable false(default) runs them on the thread decoding the track
+ */
+void xm_audio_mixer_set_effect_pipeline(XmMixerContext *ctx, bool enable);
+
 /**
  * @brief get mixed frame
  *
@@ -63,6 +93,30 @@ int xm_audio_mixer_seekTo(XmMixerContext *ctx,
 int xm_audio_mixer_mix(XmMixerContext *ctx,
     const char *out_file_path, int encoder_type);
 
+/**
+ * @brief mix the part [start_ms, end_ms) of the timeline and output m4a
+ *
+ * @param ctx XmMixerContext
+ * @param out_file_path output file path
+ * @param encoder_type Support ffmpeg and HW
+ * @param start_ms start of the part in ms
+ * @param end_ms end of the part in ms, less than 0 mixes to the end
+ * @return Less than 0 means failure
+ */
+int xm_audio_mixer_mix_range(XmMixerContext *ctx,
+    const char *out_file_path, int encoder_type, int start_ms, int end_ms);
+
+/**
+ * @brief get the duration and output format of the initialized mixer
+ *
+ * @param ctx XmMixerContext
+ * @param duration_ms mix duration in ms, can be NULL
+ * @param sample_rate output sample rate, can be NULL
+ * @param channels output channels, can be NULL
+ */
+void xm_audio_mixer_get_output_info(XmMixerContext *ctx,
+    int *duration_ms, int *sample_rate, int *channels);
+
 /**
  * @brief mixer init
  *
@@ -3,12 +3,22 @@
 #include <string.h>
 #include "effects/voice_effect.h"
 
-void AudioSource_free(AudioSource *source) {
+void AudioSource_release(AudioSource *source) {
     if (source) {
         if (source->effects_ctx) {
             audio_effect_freep(&source->effects_ctx);
         }
 
+        if (source->decoder) {
+            IAudioDecoder_freep(&(source->decoder));
+        }
+
+        memset(source, 0, sizeof(AudioSource));
+    }
+}
+
+void AudioSource_free(AudioSource *source) {
+    if (source) {
         for (short i = 0; i < MAX_NB_EFFECTS; ++i) {
             if (source->effects_info[i]) {
                 free(source->effects_info[i]);
@@ -21,16 +31,7 @@ void AudioSource_free(AudioSource *source) {
             source->file_path = NULL;
         }
 
-        if (source->decoder) {
-            IAudioDecoder_freep(&(source->decoder));
-        }
-
-        if (source->buffer.buffer) {
-            free(source->buffer.buffer);
-            source->buffer.buffer = NULL;
-        }
-
-        memset(source, 0, sizeof(AudioSource));
+        AudioSource_release(source);
     }
 }
 
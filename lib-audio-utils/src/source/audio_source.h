@@ -4,11 +4,6 @@
 #include "codec/idecoder.h"
 #include "effects/xm_audio_effects.h"
 
-struct TrackBuffer {
-    bool mute;
-    short *buffer;
-};
-
 typedef struct AudioSource {
     // source file type
     bool is_pcm;
@@ -29,7 +24,6 @@ typedef struct AudioSource {
     float left_factor;
     float right_factor;
     // side chain parameters
-    float yl_prev;
     float makeup_gain;
     bool side_chain_enable;
     // source address
@@ -40,11 +34,12 @@ typedef struct AudioSource {
     XmEffectContext *effects_ctx;
     bool has_effects;
     char *effects_info[MAX_NB_EFFECTS];
-    struct TrackBuffer buffer;
     // fade in and fade out parameters
     FadeInOut fade_io;
 } AudioSource;
 
+/* close the decoder and effects, the strings are owned by someone else */
+void AudioSource_release(AudioSource *source);
 void AudioSource_free(AudioSource *source);
 void AudioSource_freep(AudioSource **source);
 #endif
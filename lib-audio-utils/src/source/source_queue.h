@@ -51,7 +51,6 @@ void n##Queue_copy(n##Queue *src, n##Queue *dst)            \
             source.effects_info[i] =                        \
                 av_strdup(sourceList->source.effects_info[i]);\
         }                                                   \
-        source.buffer.buffer = NULL;                        \
         source.decoder = NULL;                              \
         source.effects_ctx = NULL;                          \
         pthread_mutex_unlock(&src->mLock);                  \
@@ -50,4 +50,14 @@ void FloatToS16(float *src, int16_t *dst, int nb_samples) {
         p++;
         n--;
     }
-}
\ No newline at end of file
+}
+int FoldToMonoFloat(float *samples, int nb_samples, int channels) {
+    const int nb_frames = nb_samples / channels;
+    const float scale = 1.0f / channels;
+    for (int i = 0; i < nb_frames; i++) {
+        float sum = samples[i * channels];
+        for (int c = 1; c < channels; c++) sum += samples[i * channels + c];
+        samples[i] = sum * scale;
+    }
+    return nb_frames;
+}
@@ -7,5 +7,7 @@
 
 void S16ToFloat(const short *src, float *dst, int nb_samples);
 void FloatToS16(float *src, short *dst, int nb_samples);
+// averages interleaved frames in place, returns the number of mono samples
+int FoldToMonoFloat(float *samples, int nb_samples, int channels);
 
 #endif  // AUDIO_EFFECT_CONVERSION_H
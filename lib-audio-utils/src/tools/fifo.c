@@ -63,6 +63,13 @@ int fifo_write(fifo *f, const void *data, const size_t n) {
     return n;
 }
 
+int fifo_write_silence(fifo *f, const size_t n) {
+    if (NULL == f) return -1;
+    void *s = fifo_reserve(f, n);
+    memset(s, 0, n * f->item_size);
+    return n;
+}
+
 void fifo_delete(fifo **f) {
     if (NULL == f || NULL == *f) return;
     if ((*f)->data) {
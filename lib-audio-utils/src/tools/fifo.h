@@ -13,6 +13,7 @@ void fifo_clear(fifo *f);
 size_t fifo_occupancy(fifo *f);
 int fifo_read(fifo *f, void *data, const size_t n);
 int fifo_write(fifo *f, const void *data, const size_t n);
+int fifo_write_silence(fifo *f, const size_t n);
 void fifo_delete(fifo **f);
 fifo *fifo_create(size_t item_size);
 
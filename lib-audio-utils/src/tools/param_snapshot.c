@@ -0,0 +1,130 @@
+#include "param_snapshot.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct Version {
+    struct Version *next;
+    double params[];
+} Version;
+
+struct ParamSnapshot {
+    size_t size;
+    ParamSnapshotRef retain;
+    ParamSnapshotRef release;
+    // the latest published version
+    Version *latest;
+    // the version the audio thread reads, never freed under it
+    Version *hazard;
+    // written by the audio thread only
+    Version *acquired;
+    // replaced versions not freed yet, guarded by mutex
+    Version *retired;
+    pthread_mutex_t mutex;
+};
+
+static Version *version_create(ParamSnapshot *snapshot, const void *params) {
+    Version *version = (Version *)malloc(sizeof(Version) + snapshot->size);
+    if (!version) return NULL;
+    version->next = NULL;
+    memcpy(version->params, params, snapshot->size);
+    if (snapshot->retain) snapshot->retain(version->params);
+    return version;
+}
+
+static void version_free(ParamSnapshot *snapshot, Version *version) {
+    if (snapshot->release) snapshot->release(version->params);
+    free(version);
+}
+
+static void free_list(ParamSnapshot *snapshot, Version *version) {
+    while (version) {
+        Version *next = version->next;
+        version_free(snapshot, version);
+        version = next;
+    }
+}
+
+static void reclaim_l(ParamSnapshot *snapshot) {
+    Version *hazard = __atomic_load_n(&snapshot->hazard, __ATOMIC_SEQ_CST);
+    Version **p = &snapshot->retired;
+    while (*p) {
+        Version *version = *p;
+        if (version == hazard) {
+            p = &version->next;
+        } else {
+            *p = version->next;
+            version_free(snapshot, version);
+        }
+    }
+}
+
+int param_snapshot_publish(ParamSnapshot *snapshot, const void *params) {
+    if (!snapshot || !params) return -1;
+
+    Version *version = version_create(snapshot, params);
+    if (!version) return -1;
+
+    pthread_mutex_lock(&snapshot->mutex);
+    Version *old = __atomic_exchange_n(&snapshot->latest, version,
+        __ATOMIC_SEQ_CST);
+    old->next = snapshot->retired;
+    snapshot->retired = old;
+    reclaim_l(snapshot);
+    pthread_mutex_unlock(&snapshot->mutex);
+    return 0;
+}
+
+const void *param_snapshot_acquire(ParamSnapshot *snapshot, bool *changed) {
+    Version *version = __atomic_load_n(&snapshot->latest, __ATOMIC_ACQUIRE);
+    if (version == snapshot->acquired) {
+        if (changed) *changed = false;
+        return version->params;
+    }
+
+    // the version may only be used once the hazard covering it is
+    // visible while it is still the latest one
+    for (;;) {
+        __atomic_store_n(&snapshot->hazard, version, __ATOMIC_SEQ_CST);
+        Version *latest = __atomic_load_n(&snapshot->latest, __ATOMIC_SEQ_CST);
+        if (latest == version) break;
+        version = latest;
+    }
+    snapshot->acquired = version;
+
+    if (changed) *changed = true;
+    return version->params;
+}
+
+void param_snapshot_freep(ParamSnapshot **snapshot) {
+    if (!snapshot || !*snapshot) return;
+
+    ParamSnapshot *self = *snapshot;
+    free_list(self, self->retired);
+    version_free(self, self->latest);
+    pthread_mutex_destroy(&self->mutex);
+    free(self);
+    *snapshot = NULL;
+}
+
+ParamSnapshot *param_snapshot_create(size_t size, const void *params) {
+    return param_snapshot_create_ref(size, params, NULL, NULL);
+}
+
+ParamSnapshot *param_snapshot_create_ref(size_t size, const void *params,
+        ParamSnapshotRef retain, ParamSnapshotRef release) {
+    if (size == 0 || !params) return NULL;
+
+    ParamSnapshot *self = (ParamSnapshot *)calloc(1, sizeof(ParamSnapshot));
+    if (!self) return NULL;
+    self->size = size;
+    self->retain = retain;
+    self->release = release;
+    self->latest = version_create(self, params);
+    if (!self->latest) {
+        free(self);
+        return NULL;
+    }
+    pthread_mutex_init(&self->mutex, NULL);
+    return self;
+}
@@ -0,0 +1,41 @@
+#ifndef PARAM_SNAPSHOT_H
+#define PARAM_SNAPSHOT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * Parameters of an effect shared between the threads that set them and the
+ * audio thread. A writer publishes a complete copy of the parameters with an
+ * atomic pointer swap; the audio thread picks up the latest copy once per
+ * block without taking a lock. A replaced copy is freed by a later writer
+ * once the audio thread has moved on from it.
+ */
+typedef struct ParamSnapshot ParamSnapshot;
+
+/**
+ * Lets the copies own what the params point to, retain is called on each
+ * copy made and release on each copy once the audio thread can no longer
+ * read it, always outside the audio thread.
+ */
+typedef void (*ParamSnapshotRef)(void *params);
+
+/**
+ * @brief publish a copy of params, writers are serialised by a mutex
+ * @return 0 on success, less than 0 if out of memory
+ */
+int param_snapshot_publish(ParamSnapshot *snapshot, const void *params);
+/**
+ * @brief get the latest params, only ever called from one audio thread
+ *
+ * @param changed set to whether they differ from the previous call
+ * @return params that stay valid until the next call
+ */
+const void *param_snapshot_acquire(ParamSnapshot *snapshot, bool *changed);
+/* Only safe while neither side is running */
+void param_snapshot_freep(ParamSnapshot **snapshot);
+ParamSnapshot *param_snapshot_create(size_t size, const void *params);
+ParamSnapshot *param_snapshot_create_ref(size_t size, const void *params,
+    ParamSnapshotRef retain, ParamSnapshotRef release);
+
+#endif // PARAM_SNAPSHOT_H
@@ -0,0 +1,86 @@
+#include "spsc_ring.h"
+#include <stdlib.h>
+#include <stdint.h>
+
+#define CACHE_LINE_SIZE 64
+
+struct SpscRing {
+    char *data;
+    size_t item_size;
+    unsigned int mask;
+    // written by the producer only
+    volatile unsigned int head __attribute__((aligned(CACHE_LINE_SIZE)));
+    // written by the consumer only
+    volatile unsigned int tail __attribute__((aligned(CACHE_LINE_SIZE)));
+};
+
+void *spsc_ring_write_slot(SpscRing *ring) {
+    if (!ring) return NULL;
+
+    unsigned int head = ring->head;
+    unsigned int tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    if (head - tail > ring->mask)
+        return NULL;
+    return ring->data + (head & ring->mask) * ring->item_size;
+}
+
+void spsc_ring_commit_write(SpscRing *ring) {
+    if (!ring) return;
+    __atomic_store_n(&ring->head, ring->head + 1, __ATOMIC_RELEASE);
+}
+
+void *spsc_ring_read_slot(SpscRing *ring) {
+    if (!ring) return NULL;
+
+    unsigned int tail = ring->tail;
+    unsigned int head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    if (head == tail)
+        return NULL;
+    return ring->data + (tail & ring->mask) * ring->item_size;
+}
+
+void spsc_ring_commit_read(SpscRing *ring) {
+    if (!ring) return;
+    __atomic_store_n(&ring->tail, ring->tail + 1, __ATOMIC_RELEASE);
+}
+
+int spsc_ring_occupancy(SpscRing *ring) {
+    if (!ring) return 0;
+    return __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE)
+        - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+}
+
+void spsc_ring_reset(SpscRing *ring) {
+    if (!ring) return;
+    __atomic_store_n(&ring->head, 0, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&ring->tail, 0, __ATOMIC_SEQ_CST);
+}
+
+void spsc_ring_freep(SpscRing **ring) {
+    if (!ring || !*ring) return;
+
+    if ((*ring)->data) free((*ring)->data);
+    free(*ring);
+    *ring = NULL;
+}
+
+SpscRing *spsc_ring_create(size_t item_size, int capacity) {
+    if (item_size == 0 || capacity <= 0) return NULL;
+
+    unsigned int size = 1;
+    while (size < (unsigned int)capacity) size <<= 1;
+
+    SpscRing *ring = NULL;
+    if (posix_memalign((void **)&ring, CACHE_LINE_SIZE, sizeof(SpscRing)))
+        return NULL;
+    ring->data = (char *)calloc(size, item_size);
+    if (!ring->data) {
+        free(ring);
+        return NULL;
+    }
+    ring->item_size = item_size;
+    ring->mask = size - 1;
+    ring->head = 0;
+    ring->tail = 0;
+    return ring;
+}
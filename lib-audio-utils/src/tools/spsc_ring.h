@@ -0,0 +1,26 @@
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <stddef.h>
+
+/**
+ * Bounded single-producer/single-consumer ring of fixed size items.
+ * The producer fills the slot returned by spsc_ring_write_slot() in place
+ * and publishes it with spsc_ring_commit_write(); the consumer does the
+ * same with spsc_ring_read_slot()/spsc_ring_commit_read(). No locks are
+ * taken, so each side must be driven by exactly one thread.
+ */
+typedef struct SpscRing SpscRing;
+
+void *spsc_ring_write_slot(SpscRing *ring);
+void spsc_ring_commit_write(SpscRing *ring);
+void *spsc_ring_read_slot(SpscRing *ring);
+void spsc_ring_commit_read(SpscRing *ring);
+int spsc_ring_occupancy(SpscRing *ring);
+/* Only safe while neither side is running */
+void spsc_ring_reset(SpscRing *ring);
+void spsc_ring_freep(SpscRing **ring);
+/* capacity is rounded up to a power of two */
+SpscRing *spsc_ring_create(size_t item_size, int capacity);
+
+#endif // SPSC_RING_H
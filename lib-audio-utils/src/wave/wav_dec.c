@@ -59,8 +59,11 @@ static int wav_parse_fmt_tag(FILE *reader,
     }
 
     header->audio_format = avio_rl16(reader);
-    // 1(0x0001) means PCM data
-    if (header->audio_format == 0x0001) {
+    // 1(0x0001) means PCM data, 3(0x0003) IEEE float data,
+    // 0xFFFE keeps the real format in the sub format of the extension
+    if (header->audio_format == WAV_FORMAT_PCM
+            || header->audio_format == WAV_FORMAT_IEEE_FLOAT
+            || header->audio_format == WAV_FORMAT_EXTENSIBLE) {
         header->nb_channels = avio_rl16(reader);
         header->sample_rate = avio_rl32(reader);
         header->byte_rate = avio_rl32(reader);
@@ -80,6 +83,26 @@ static int wav_parse_fmt_tag(FILE *reader,
             header->bits_per_sample);
     }
 
+    if (header->audio_format == WAV_FORMAT_EXTENSIBLE) {
+        // cbSize, valid bits per sample, channel mask, then the sub format
+        // GUID whose first two bytes are the format tag
+        if (size < 40) {
+            LogError("%s extensible fmt size %d too small.\n", __func__,
+                (int)size);
+            return -1;
+        }
+        avio_rl16(reader);
+        avio_rl16(reader);
+        avio_rl32(reader);
+        header->audio_format = avio_rl16(reader);
+        if (header->audio_format != WAV_FORMAT_PCM
+                && header->audio_format != WAV_FORMAT_IEEE_FLOAT) {
+            LogError("%s sub format 0x%x not pcm.\n", __func__,
+                header->audio_format);
+            return -1;
+        }
+    }
+
     return 0;
 }
 
@@ -9,6 +9,10 @@
 #define TAG_ID_FMT "fmt "
 #define TAG_ID_DATA "data"
 
+#define WAV_FORMAT_PCM 0x0001
+#define WAV_FORMAT_IEEE_FLOAT 0x0003
+#define WAV_FORMAT_EXTENSIBLE 0xFFFE
+
 typedef struct WavHeader {
     unsigned char riff_id[4];
     uint32_t riff_size;
@@ -1,5 +1,7 @@
 #include "xm_audio_generator.h"
 #include "mixer/xm_audio_mixer.h"
+#include "mixer/segment_render.h"
+#include "codec/muxer_config.h"
 #include <assert.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -12,7 +14,12 @@
 struct XmAudioGenerator {
     volatile int status;
     volatile int ref_count;
+    int decode_threads;
+    // more than 1 renders the timeline as segments in parallel
+    int render_segments;
+    int render_overlap_ms;
     XmMixerContext *mixer_ctx;
+    SegmentRender *segment_render;
     pthread_mutex_t mutex;
 };
 
@@ -48,6 +55,7 @@ static int mixer_mix(XmAudioGenerator *self, const char *in_config_path,
         ret = -1;
         goto end;
     }
+    xm_audio_mixer_set_decode_threads(self->mixer_ctx, self->decode_threads);
 
     ret = xm_audio_mixer_init(self->mixer_ctx, in_config_path);
     if (ret < 0) {
@@ -65,6 +73,35 @@ end:
     return ret;
 }
 
+static int segment_mix(XmAudioGenerator *self, const char *in_config_path,
+        const char *out_file_path, int encode_type) {
+    LogInfo("%s\n", __func__);
+    int ret = -1;
+    if(!self || !in_config_path || !out_file_path) {
+        return ret;
+    }
+
+    pthread_mutex_lock(&self->mutex);
+    segment_render_freep(&self->segment_render);
+    self->segment_render = segment_render_create(self->render_segments,
+        self->render_overlap_ms);
+    // stopped after start but before the render existed
+    if (self->status == GENERATOR_STATE_STOP)
+        segment_render_stop(self->segment_render);
+    pthread_mutex_unlock(&self->mutex);
+    if (!self->segment_render) {
+        LogError("%s segment_render_create failed\n", __func__);
+        return AEERROR_NOMEM;
+    }
+
+    ret = segment_render_run(self->segment_render,
+        in_config_path, out_file_path, encode_type);
+    if (ret < 0) {
+        LogError("%s segment_render_run failed\n", __func__);
+    }
+    return ret;
+}
+
 void xmag_inc_ref(XmAudioGenerator *self)
 {
     assert(self);
@@ -101,6 +138,7 @@ void xm_audio_generator_free(XmAudioGenerator *self) {
         xm_audio_mixer_stop(self->mixer_ctx);
         xm_audio_mixer_freep(&(self->mixer_ctx));
     }
+    segment_render_freep(&self->segment_render);
 }
 
 void xm_audio_generator_freep(XmAudioGenerator **ag) {
@@ -122,6 +160,7 @@ void xm_audio_generator_stop(XmAudioGenerator *self) {
 
     xm_audio_mixer_stop(self->mixer_ctx);
     pthread_mutex_lock(&self->mutex);
+    segment_render_stop(self->segment_render);
     self->status = GENERATOR_STATE_STOP;
     pthread_mutex_unlock(&self->mutex);
 }
@@ -130,7 +169,34 @@ int xm_audio_generator_get_progress(XmAudioGenerator *self) {
     if (NULL == self)
         return -1;
 
-    return xm_audio_mixer_get_progress(self->mixer_ctx);
+    int ret = 0;
+    pthread_mutex_lock(&self->mutex);
+    if (self->segment_render)
+        ret = segment_render_get_progress(self->segment_render);
+    else
+        ret = xm_audio_mixer_get_progress(self->mixer_ctx);
+    pthread_mutex_unlock(&self->mutex);
+    return ret;
+}
+
+void xm_audio_generator_set_decode_threads(XmAudioGenerator *self,
+    int nb_threads) {
+    LogInfo("%s nb_threads %d\n", __func__, nb_threads);
+    if (NULL == self)
+        return;
+
+    self->decode_threads = nb_threads > 0 ? nb_threads : 0;
+}
+
+void xm_audio_generator_set_render_segments(XmAudioGenerator *self,
+    int nb_segments, int overlap_ms) {
+    LogInfo("%s nb_segments %d, overlap_ms %d\n", __func__,
+        nb_segments, overlap_ms);
+    if (NULL == self)
+        return;
+
+    self->render_segments = nb_segments > 1 ? nb_segments : 0;
+    self->render_overlap_ms = overlap_ms > 0 ? overlap_ms : 0;
 }
 
 enum GeneratorStatus xm_audio_generator_start(
@@ -149,8 +215,18 @@ enum GeneratorStatus xm_audio_generator_start(
     self->status = GENERATOR_STATE_STARTED;
     pthread_mutex_unlock(&self->mutex);
 
-    if (mixer_mix(self, in_config_path, out_file_path,
-        encode_type) < 0) {
+    int mix_ret = -1;
+    if (self->render_segments > 1 && encode_type == ENCODER_FFMPEG) {
+        mix_ret = segment_mix(self, in_config_path,
+            out_file_path, encode_type);
+    } else {
+        pthread_mutex_lock(&self->mutex);
+        segment_render_freep(&self->segment_render);
+        pthread_mutex_unlock(&self->mutex);
+        mix_ret = mixer_mix(self, in_config_path,
+            out_file_path, encode_type);
+    }
+    if (mix_ret < 0) {
         LogError("%s mixer_mix failed\n", __func__);
         ret = GS_ERROR;
     } else {
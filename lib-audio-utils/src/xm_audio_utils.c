@@ -7,6 +7,8 @@
 #include "error_def.h"
 #include "tools/util.h"
 #include "codec/audio_decoder_factory.h"
+#include "codec/pcm_cache.h"
+#include "codec/seek_index.h"
 #include "mixer/fade_in_out.h"
 #include "mixer/xm_audio_mixer.h"
 
@@ -32,6 +34,10 @@ typedef struct Fade {
 
 struct XmAudioUtils {
     volatile int ref_count;
+    int mixer_decode_threads;
+    // less than 0 keeps the mixer default
+    int mixer_preload_time_ms;
+    bool mixer_effect_pipeline;
     IAudioDecoder *decoder;
     XmMixerContext *mixer_ctx;
     Fade *fade;
@@ -135,6 +141,51 @@ int xm_audio_utils_mixer_seekTo(XmAudioUtils *self,
     return xm_audio_mixer_seekTo(self->mixer_ctx, seek_time_ms);
 }
 
+void xm_audio_utils_mixer_set_decode_threads(XmAudioUtils *self,
+    int nb_threads) {
+    LogInfo("%s nb_threads %d\n", __func__, nb_threads);
+    if (!self) {
+        return;
+    }
+
+    self->mixer_decode_threads = nb_threads > 0 ? nb_threads : 0;
+    xm_audio_mixer_set_decode_threads(self->mixer_ctx,
+        self->mixer_decode_threads);
+}
+
+void xm_audio_utils_mixer_set_preload_time(XmAudioUtils *self,
+    int preload_time_ms) {
+    LogInfo("%s preload_time_ms %d\n", __func__, preload_time_ms);
+    if (!self) {
+        return;
+    }
+
+    self->mixer_preload_time_ms = preload_time_ms > 0 ? preload_time_ms : 0;
+    xm_audio_mixer_set_preload_time(self->mixer_ctx,
+        self->mixer_preload_time_ms);
+}
+
+void xm_audio_utils_mixer_set_effect_pipeline(XmAudioUtils *self,
+    bool enable) {
+    LogInfo("%s enable %d\n", __func__, enable);
+    if (!self) {
+        return;
+    }
+
+    self->mixer_effect_pipeline = enable;
+    xm_audio_mixer_set_effect_pipeline(self->mixer_ctx,
+        self->mixer_effect_pipeline);
+}
+
+int xm_audio_utils_set_decode_cache(size_t budget_bytes,
+        const char *spill_dir) {
+    return pcm_cache_set_budget(budget_bytes, spill_dir);
+}
+
+int xm_audio_utils_set_seek_index_dir(const char *index_dir) {
+    return seek_index_set_dir(index_dir);
+}
+
 int xm_audio_utils_mixer_init(XmAudioUtils *self,
         const char *in_config_path) {
     LogInfo("%s\n", __func__);
@@ -152,6 +203,13 @@ int xm_audio_utils_mixer_init(XmAudioUtils *self,
         ret = -1;
         goto end;
     }
+    xm_audio_mixer_set_decode_threads(self->mixer_ctx,
+        self->mixer_decode_threads);
+    if (self->mixer_preload_time_ms >= 0)
+        xm_audio_mixer_set_preload_time(self->mixer_ctx,
+            self->mixer_preload_time_ms);
+    xm_audio_mixer_set_effect_pipeline(self->mixer_ctx,
+        self->mixer_effect_pipeline);
 
     ret = xm_audio_mixer_init(self->mixer_ctx, in_config_path);
     if (ret < 0) {
@@ -367,6 +425,7 @@ XmAudioUtils *xm_audio_utils_create() {
         return NULL;
     }
 
+    self->mixer_preload_time_ms = -1;
     pthread_mutex_init(&self->mutex, NULL);
     xmau_inc_ref(self);
     return self;
@@ -1,5 +1,6 @@
 #include "xm_duration_parser.h"
 #include "codec/duration_parser.h"
+#include <string.h>
 
 int get_file_duration_ms(const char *file_addr, bool is_pcm,
     int bits_per_sample, int src_sample_rate_in_Hz, int src_nb_channels)
@@ -16,3 +17,22 @@ int get_file_duration_ms(const char *file_addr, bool is_pcm,
     }
 }
 
+int get_file_audio_info(const char *file_addr, XmAudioFileInfo *info)
+{
+    if (!file_addr || !info) return -1;
+
+    AudioProbeInfo probe;
+    int ret = probe_audio_file(file_addr, &probe);
+    if (ret < 0) return ret;
+
+    info->duration_ms = probe.duration_ms;
+    info->sample_rate = probe.sample_rate;
+    info->nb_channels = probe.nb_channels;
+    memcpy(info->codec_name, probe.codec_name, sizeof(info->codec_name));
+    return 0;
+}
+
+int set_file_probe_cache(const char *cache_file)
+{
+    return probe_cache_set_file(cache_file);
+}
@@ -1,4 +1,5 @@
 #include <sys/time.h>
+#include <stdlib.h>
 #include "effects/voice_effect.h"
 #include "file_helper.h"
 #include "log.h"
@@ -11,7 +12,8 @@ int main(int argc, char **argv) {
     AeSetLogMode(LOG_MODE_SCREEN);
 
     if (argc < 2) {
-        LogWarning("Usage %s input_pcm_file output_pcm_file\n", argv[0]);
+        LogWarning("Usage %s input_pcm_file output_pcm_file [channels]\n",
+                   argv[0]);
         return 0;
     }
 
@@ -33,7 +35,9 @@ int main(int argc, char **argv) {
     ret = OpenFile(&pcm_writer, argv[2], 1);
     if (ret < 0) goto end;
 
-    ctx = create_effect(find_effect("beautify"), DEFAULT_SAMPLE_RATE, DEFAULT_CHANNEL_NUMBER);
+    // interleaved input, 1024 samples hold whole frames of 1, 2 or 4 channels
+    int channels = argc > 3 ? atoi(argv[3]) : DEFAULT_CHANNEL_NUMBER;
+    ctx = create_effect(find_effect("beautify"), DEFAULT_SAMPLE_RATE, channels);
     ret = init_effect(ctx, 0, NULL);
     if (ret < 0) goto end;
 
@@ -0,0 +1,176 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "log.h"
+#include "effects/voice_effect.h"
+#include "effects/convolver/partitioned_convolver.h"
+#include "wave/wav_dec.h"
+
+#define SAMPLE_RATE 44100
+#define CHANNELS 2
+#define IR_SECONDS 3
+#define BENCH_SECONDS 30
+#define IR_FILE "test_convolver_ir.wav"
+
+static float frand() { return (float)rand() / RAND_MAX * 2.0f - 1.0f; }
+
+// decaying noise, like the tail of a room
+static float *make_ir(int nb_frames) {
+    float *ir = (float *)malloc(sizeof(float) * nb_frames * CHANNELS);
+    if (!ir) return NULL;
+    for (int i = 0; i < nb_frames * CHANNELS; i++)
+        ir[i] = 0.5f * frand() * expf(-6.9f * (i / CHANNELS) / nb_frames);
+    return ir;
+}
+
+static double seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// the convolver against the direct sum
+static int check_kernel(int block_size) {
+    const int ir_frames = 3 * block_size + 17;
+    const int nb_blocks = 8;
+    const int nb_frames = nb_blocks * block_size;
+    int ret = -1;
+    float *ir = make_ir(ir_frames);
+    float *in = (float *)malloc(sizeof(float) * nb_frames * CHANNELS);
+    float *out = (float *)malloc(sizeof(float) * nb_frames * CHANNELS);
+    IrSpectrum *spectrum = ir_spectrum_create(ir, ir_frames, CHANNELS,
+                                              block_size);
+    PartitionedConvolver *conv = partitioned_convolver_create(spectrum);
+    if (!ir || !in || !out || !conv) goto end;
+
+    for (int i = 0; i < nb_frames * CHANNELS; i++) in[i] = frand();
+    for (int b = 0; b < nb_blocks; b++) {
+        const size_t offset = (size_t)b * block_size * CHANNELS;
+        partitioned_convolver_process(conv, in + offset, out + offset);
+    }
+
+    double max_diff = 0;
+    for (int n = 0; n < nb_frames; n++) {
+        for (int c = 0; c < CHANNELS; c++) {
+            double sum = 0;
+            for (int k = 0; k < ir_frames && k <= n; k++)
+                sum += (double)ir[k * CHANNELS + c] *
+                       in[(n - k) * CHANNELS + c];
+            double diff = fabs(sum - out[n * CHANNELS + c]);
+            if (diff > max_diff) max_diff = diff;
+        }
+    }
+    LogInfo("block %d, max diff to the direct sum %g\n", block_size,
+            max_diff);
+    if (max_diff < 1e-4) ret = 0;
+end:
+    partitioned_convolver_freep(&conv);
+    ir_spectrum_release(&spectrum);
+    if (ir) free(ir);
+    if (in) free(in);
+    if (out) free(out);
+    return ret;
+}
+
+static int write_ir_file(const float *ir, int nb_frames) {
+    FILE *writer = fopen(IR_FILE, "wb");
+    if (!writer) return -1;
+
+    WavContext wav;
+    memset(&wav, 0, sizeof(wav));
+    wav.is_wav = true;
+    wav.header.audio_format = WAV_FORMAT_IEEE_FLOAT;
+    wav.header.nb_channels = CHANNELS;
+    wav.header.sample_rate = SAMPLE_RATE;
+    wav.header.bits_per_sample = 32;
+    wav.header.block_align = CHANNELS * sizeof(float);
+    wav.header.byte_rate = SAMPLE_RATE * wav.header.block_align;
+    wav.header.data_size = nb_frames * wav.header.block_align;
+    wav.header.riff_size = wav.header.data_size + sizeof(WavHeader) - 8;
+    int ret = wav_write_header(writer, &wav);
+    if (ret == 0 &&
+        fwrite(ir, sizeof(float) * CHANNELS, nb_frames, writer) != nb_frames)
+        ret = -1;
+    fclose(writer);
+    return ret;
+}
+
+// runs nb_frames of noise through the effect, gives the seconds it took
+static double run_effect(int block_size, const float *input, int nb_frames,
+                         float *output) {
+    double elapsed = -1;
+    char value[16];
+    snprintf(value, sizeof(value), "%d", block_size);
+    EffectContext *ctx = create_effect(find_effect("convolver"),
+                                       SAMPLE_RATE, CHANNELS);
+    if (!ctx || init_effect(ctx, 0, NULL) < 0 ||
+        set_effect(ctx, "block_size", value, 0) < 0 ||
+        set_effect(ctx, "ir", IR_FILE, 0) < 0 ||
+        set_effect(ctx, "Switch", "On", 0) < 0)
+        goto end;
+
+    // the first call may also load the response, leave it out
+    memcpy(output, input, sizeof(float) * 1024 * CHANNELS);
+    process_samples(ctx, output, 1024 * CHANNELS);
+
+    const double start = seconds();
+    const int chunk = 1024 * CHANNELS;
+    for (int i = 0; i < nb_frames * CHANNELS; i += chunk) {
+        memcpy(output + i, input + i, sizeof(float) * chunk);
+        if (process_samples(ctx, output + i, chunk) < 0) goto end;
+    }
+    elapsed = seconds() - start;
+end:
+    if (ctx) free_effect(ctx);
+    return elapsed;
+}
+
+int main() {
+    AeSetLogLevel(LOG_LEVEL_INFO);
+    AeSetLogMode(LOG_MODE_SCREEN);
+
+    int ret = -1;
+    const int ir_frames = IR_SECONDS * SAMPLE_RATE;
+    const int nb_frames = BENCH_SECONDS * SAMPLE_RATE / 1024 * 1024;
+    float *ir = make_ir(ir_frames);
+    float *input = (float *)malloc(sizeof(float) * nb_frames * CHANNELS);
+    float *output = (float *)malloc(sizeof(float) * nb_frames * CHANNELS);
+    if (!ir || !input || !output) goto end;
+
+    if (check_kernel(64) < 0 || check_kernel(256) < 0 ||
+        check_kernel(1024) < 0) {
+        LogError("convolver differs from the direct sum\n");
+        goto end;
+    }
+
+    if (write_ir_file(ir, ir_frames) < 0) {
+        LogError("write %s failed\n", IR_FILE);
+        goto end;
+    }
+    for (int i = 0; i < nb_frames * CHANNELS; i++) input[i] = 0.1f * frand();
+
+    const int block_sizes[] = {256, 512, 1024, 2048, 4096};
+    for (int i = 0; i < 5; i++) {
+        double elapsed = run_effect(block_sizes[i], input, nb_frames, output);
+        if (elapsed < 0) {
+            LogError("convolver failed at block %d\n", block_sizes[i]);
+            goto end;
+        }
+        LogInfo("%d s stereo ir, block %4d: %d s of stereo in %.3f s, "
+                "%.0fx real time\n", IR_SECONDS, block_sizes[i],
+                BENCH_SECONDS, elapsed, BENCH_SECONDS / elapsed);
+        if (elapsed > BENCH_SECONDS) {
+            LogError("slower than real time\n");
+            goto end;
+        }
+    }
+    ret = 0;
+end:
+    remove(IR_FILE);
+    if (ir) free(ir);
+    if (input) free(input);
+    if (output) free(output);
+    return ret;
+}
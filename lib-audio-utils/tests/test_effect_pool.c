@@ -0,0 +1,72 @@
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include "log.h"
+#include "effects/effect_pool.h"
+#include "effects/voice_effect.h"
+
+#define SAMPLE_RATE 44100
+#define CHANNELS 2
+#define NB_SAMPLES (SAMPLE_RATE * CHANNELS)
+
+static float input[NB_SAMPLES];
+
+// runs a second of a tone through the effect, returns the samples it gave
+static int run(EffectContext *effect, float *output) {
+    memcpy(output, input, sizeof(input));
+    return process_samples(effect, output, NB_SAMPLES);
+}
+
+int main() {
+    AeSetLogLevel(LOG_LEVEL_TRACE);
+    AeSetLogMode(LOG_MODE_SCREEN);
+
+    static float fresh[NB_SAMPLES], reused[NB_SAMPLES];
+    for (int i = 0; i < NB_SAMPLES / CHANNELS; i++) {
+        float s = 0.5f * sinf(2.0f * M_PI * 440.0f * i / SAMPLE_RATE);
+        input[i * CHANNELS] = s;
+        input[i * CHANNELS + 1] = -s;
+    }
+
+    int ret = -1;
+    EffectPool *pool = effect_pool_create(4);
+    if (!pool) return ret;
+
+    EffectContext *effect = effect_pool_acquire(pool, "beautify", "mode",
+        "CleanVoice", SAMPLE_RATE, CHANNELS);
+    if (!effect) goto end;
+    int nb_fresh = run(effect, fresh);
+    effect_pool_release(pool, effect);
+
+    // another mode must not get the released instance
+    EffectContext *other = effect_pool_acquire(pool, "beautify", "mode",
+        "Bass", SAMPLE_RATE, CHANNELS);
+    if (!other || other == effect) {
+        LogError("instance of another mode reused\n");
+        goto end;
+    }
+    effect_pool_release(pool, other);
+
+    EffectContext *again = effect_pool_acquire(pool, "beautify", "mode",
+        "CleanVoice", SAMPLE_RATE, CHANNELS);
+    if (again != effect) {
+        LogError("released instance not reused\n");
+        effect_pool_release(pool, again);
+        goto end;
+    }
+    int nb_reused = run(again, reused);
+    effect_pool_release(pool, again);
+
+    // a reset instance starts like a new one
+    if (nb_fresh <= 0 || nb_fresh != nb_reused ||
+        memcmp(fresh, reused, nb_fresh * sizeof(float)) != 0) {
+        LogError("reset instance differs, %d %d samples\n",
+            nb_fresh, nb_reused);
+        goto end;
+    }
+    LogInfo("%d samples, reset instance matches\n", nb_fresh);
+    ret = 0;
+end:
+    effect_pool_freep(&pool);
+    return ret;
+}
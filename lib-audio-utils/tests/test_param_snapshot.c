@@ -0,0 +1,72 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include "log.h"
+#include "tools/param_snapshot.h"
+
+#define NB_PUBLISH 100000
+
+typedef struct {
+    int serial;
+    float gain;
+    float check;
+} Params;
+
+static atomic_bool done;
+// copies retained and not released yet
+static atomic_int nb_live;
+
+static void retain(void *params) {
+    (void)params;
+    atomic_fetch_add(&nb_live, 1);
+}
+
+static void release(void *params) {
+    (void)params;
+    atomic_fetch_sub(&nb_live, 1);
+}
+
+static void *writer(void *arg) {
+    ParamSnapshot *snapshot = (ParamSnapshot *)arg;
+    for (int i = 1; i <= NB_PUBLISH; ++i) {
+        Params params = {i, i * 0.5f, -i * 0.5f};
+        if (param_snapshot_publish(snapshot, &params) < 0) break;
+    }
+    atomic_store(&done, true);
+    return NULL;
+}
+
+int main() {
+    AeSetLogLevel(LOG_LEVEL_TRACE);
+    AeSetLogMode(LOG_MODE_SCREEN);
+
+    int ret = -1;
+    Params params = {0, 0.0f, 0.0f};
+    ParamSnapshot *snapshot = param_snapshot_create_ref(sizeof(Params),
+        &params, retain, release);
+    if (!snapshot) return ret;
+
+    pthread_t tid;
+    pthread_create(&tid, NULL, writer, snapshot);
+
+    int nb_changes = 0, nb_torn = 0, serial = -1;
+    while (!atomic_load(&done)) {
+        bool changed = false;
+        const Params *p = param_snapshot_acquire(snapshot, &changed);
+        if (changed) nb_changes++;
+        // a torn read or a serial going back means a reclaimed snapshot
+        if (p->gain != -p->check || p->serial < serial) nb_torn++;
+        serial = p->serial;
+    }
+    pthread_join(tid, NULL);
+
+    const Params *p = param_snapshot_acquire(snapshot, NULL);
+    LogInfo("changes %d torn %d last serial %d\n", nb_changes, nb_torn,
+        p->serial);
+    if (nb_torn == 0 && p->serial == NB_PUBLISH) ret = 0;
+
+    param_snapshot_freep(&snapshot);
+    LogInfo("copies not released %d\n", atomic_load(&nb_live));
+    if (atomic_load(&nb_live) != 0) ret = -1;
+    return ret;
+}
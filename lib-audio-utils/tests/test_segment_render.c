@@ -0,0 +1,198 @@
+#include "xm_audio_generator.h"
+#include "mixer/xm_audio_mixer.h"
+#include "codec/audio_decoder_factory.h"
+#include "codec/ffmpeg_utils.h"
+#include "codec/muxer_config.h"
+#include <math.h>
+#include <sys/time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "error_def.h"
+#include "log.h"
+
+#define BUFFER_SIZE_IN_SHORT 4096
+#define WINDOW_NB_SAMPLES 2048
+// the stitched output may lose this much SNR against the sequential render
+#define MAX_SNR_LOSS_DB 1.0
+#define MAX_WINDOW_SNR_LOSS_DB 6.0
+
+typedef struct PcmData {
+    short *data;
+    int64_t size;
+    int64_t capacity;
+} PcmData;
+
+static int pcm_append(PcmData *pcm, const short *buffer, int len) {
+    if (pcm->size + len > pcm->capacity) {
+        int64_t capacity = pcm->capacity > 0 ? pcm->capacity * 2 : 1 << 20;
+        while (capacity < pcm->size + len) capacity *= 2;
+        short *data = (short *)realloc(pcm->data, capacity * sizeof(short));
+        if (!data) return -1;
+        pcm->data = data;
+        pcm->capacity = capacity;
+    }
+    memcpy(pcm->data + pcm->size, buffer, len * sizeof(short));
+    pcm->size += len;
+    return 0;
+}
+
+static int mix_reference(const char *config, PcmData *pcm,
+        int *sample_rate, int *channels) {
+    short buffer[BUFFER_SIZE_IN_SHORT];
+    XmMixerContext *mixer = xm_audio_mixer_create();
+    if (!mixer || xm_audio_mixer_init(mixer, config) < 0) {
+        xm_audio_mixer_freep(&mixer);
+        return -1;
+    }
+    xm_audio_mixer_get_output_info(mixer, NULL, sample_rate, channels);
+
+    int ret = 0;
+    while ((ret = xm_audio_mixer_get_frame(mixer,
+            buffer, BUFFER_SIZE_IN_SHORT)) > 0) {
+        if (pcm_append(pcm, buffer, ret) < 0) break;
+    }
+    xm_audio_mixer_freep(&mixer);
+    return pcm->size > 0 ? 0 : -1;
+}
+
+static int decode_file(const char *path, int sample_rate, int channels,
+        PcmData *pcm) {
+    short buffer[BUFFER_SIZE_IN_SHORT];
+    IAudioDecoder *decoder = audio_decoder_create(path, 0, 0,
+        sample_rate, channels, 1.0f, DECODER_FFMPEG);
+    if (!decoder) return -1;
+
+    int ret = 0;
+    while ((ret = IAudioDecoder_get_pcm_frame(decoder,
+            buffer, BUFFER_SIZE_IN_SHORT, false)) > 0) {
+        if (pcm_append(pcm, buffer, ret) < 0) break;
+    }
+    IAudioDecoder_freep(&decoder);
+    return pcm->size > 0 ? 0 : -1;
+}
+
+static int render(const char *config, const char *out,
+        int nb_segments, unsigned long *time_us) {
+    struct timeval start, end;
+    gettimeofday(&start, NULL);
+
+    XmAudioGenerator *generator = xm_audio_generator_create();
+    if (!generator) return -1;
+    xm_audio_generator_set_render_segments(generator, nb_segments, 0);
+    enum GeneratorStatus ret = xm_audio_generator_start(
+        generator, config, out, ENCODER_FFMPEG);
+    xm_audio_generator_freep(&generator);
+
+    gettimeofday(&end, NULL);
+    *time_us = 1000000 * (end.tv_sec - start.tv_sec)
+        + end.tv_usec - start.tv_usec;
+    return ret == GS_COMPLETED ? 0 : -1;
+}
+
+static double snr_db(const short *ref, const short *test, int64_t n) {
+    double signal = 0, noise = 0;
+    for (int64_t i = 0; i < n; i++) {
+        double d = (double)test[i] - ref[i];
+        signal += (double)ref[i] * ref[i];
+        noise += d * d;
+    }
+    if (noise <= 0) return 200.0;
+    if (signal <= 0) return -200.0;
+    return 10 * log10(signal / noise);
+}
+
+// The decoder may or may not drop the encoder priming
+static int64_t find_offset(const PcmData *ref, const PcmData *test,
+        int channels) {
+    int64_t best = 0;
+    double best_snr = -1e9;
+    for (int frames = 0; frames <= 2048; frames += 1024) {
+        int64_t offset = (int64_t)frames * channels;
+        int64_t n = ref->size < test->size - offset ?
+            ref->size : test->size - offset;
+        if (n <= 0) continue;
+        double snr = snr_db(ref->data, test->data + offset, n);
+        if (snr > best_snr) {
+            best_snr = snr;
+            best = offset;
+        }
+    }
+    return best;
+}
+
+int main(int argc, char **argv) {
+    AeSetLogLevel(LOG_LEVEL_INFO);
+    AeSetLogMode(LOG_MODE_SCREEN);
+
+    if (argc < 4) {
+        LogError("usage: %s config.json sequential.m4a segmented.m4a "
+            "[nb_segments]\n", argv[0]);
+        return 1;
+    }
+    int nb_segments = argc > 4 ? atoi(argv[4]) : 4;
+    int ret = 1;
+    int sample_rate = 0, channels = 0;
+    unsigned long seq_us = 0, seg_us = 0;
+    PcmData ref = {0}, seq = {0}, seg = {0};
+
+    RegisterFFmpeg();
+    if (mix_reference(argv[1], &ref, &sample_rate, &channels) < 0) {
+        LogError("mix_reference failed\n");
+        goto end;
+    }
+    if (render(argv[1], argv[2], 1, &seq_us) < 0
+            || render(argv[1], argv[3], nb_segments, &seg_us) < 0) {
+        LogError("render failed\n");
+        goto end;
+    }
+    if (decode_file(argv[2], sample_rate, channels, &seq) < 0
+            || decode_file(argv[3], sample_rate, channels, &seg) < 0) {
+        LogError("decode_file failed\n");
+        goto end;
+    }
+    LogInfo("sequential %lu us, %d segments %lu us\n",
+        seq_us, nb_segments, seg_us);
+
+    if (seq.size != seg.size) {
+        LogError("length differs: sequential %lld, segmented %lld\n",
+            (long long)seq.size, (long long)seg.size);
+        goto end;
+    }
+
+    int64_t offset = find_offset(&ref, &seq, channels);
+    int64_t n = ref.size < seq.size - offset ? ref.size : seq.size - offset;
+    double seq_snr = snr_db(ref.data, seq.data + offset, n);
+    double seg_snr = snr_db(ref.data, seg.data + offset, n);
+    LogInfo("SNR against the mixer output: sequential %.2f dB, "
+        "segmented %.2f dB\n", seq_snr, seg_snr);
+    if (seg_snr < seq_snr - MAX_SNR_LOSS_DB) {
+        LogError("segmented render is worse than the sequential one\n");
+        goto end;
+    }
+
+    // a seam shows up as a window much worse than the sequential render
+    int64_t window = (int64_t)WINDOW_NB_SAMPLES * channels;
+    int nb_bad = 0;
+    for (int64_t i = 0; i + window <= n; i += window) {
+        double ws = snr_db(ref.data + i, seq.data + offset + i, window);
+        double wg = snr_db(ref.data + i, seg.data + offset + i, window);
+        if (ws > 0 && wg < ws - MAX_WINDOW_SNR_LOSS_DB) {
+            LogError("window at sample %lld: sequential %.2f dB, "
+                "segmented %.2f dB\n", (long long)(i / channels), ws, wg);
+            nb_bad++;
+        }
+    }
+    if (nb_bad > 0) {
+        LogError("%d windows differ\n", nb_bad);
+        goto end;
+    }
+
+    LogInfo("segmented render matches the sequential render\n");
+    ret = 0;
+end:
+    free(ref.data);
+    free(seq.data);
+    free(seg.data);
+    return ret;
+}